@@ -0,0 +1,556 @@
+// Microbenchmarks for the vtfs core built as a userspace library.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "csum.h"
+#include "data.h"
+#include "delta.h"
+#include "heat.h"
+#include "index.h"
+#include "iosched.h"
+#include "mem.h"
+#include "proto.h"
+#include "rpc_proto.h"
+#include "xattr.h"
+}
+
+namespace {
+
+struct vtfs_file* add_file(struct vtfs_dir* dir, const char* name, ino_t ino) {
+  struct vtfs_file* file = vtfs_file_alloc(name, vtfs_node_alloc(NULL, ino, S_IFREG | 0777));
+  vtfs_dir_add(dir, file);
+  return file;
+}
+
+struct dir_fixture {
+  struct vtfs_node* self;
+  struct vtfs_dir* dir;
+  std::vector<std::string> names;
+
+  explicit dir_fixture(int64_t entries)
+      : self(vtfs_node_alloc(NULL, 100, S_IFDIR | 0777))
+      , dir(self->dir) {
+    for (int64_t i = 0; i < entries; i++) {
+      names.push_back("file-" + std::to_string(i));
+      add_file(dir, names.back().c_str(), 101 + i);
+    }
+  }
+
+  ~dir_fixture() {
+    struct vtfs_file* entry;
+    struct vtfs_file* tmp;
+    list_for_each_entry_safe(entry, tmp, &dir->children, list) {
+      struct vtfs_node* node = entry->node;
+      vtfs_dir_remove(entry);
+      if (vtfs_file_free(entry)) {
+        vtfs_node_free(node);
+      }
+    }
+    vtfs_node_free(self);
+  }
+};
+
+void bm_lookup(benchmark::State& state) {
+  dir_fixture fx(state.range(0));
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> pick(0, fx.names.size() - 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(vtfs_dir_find(fx.dir, fx.names[pick(rng)].c_str()));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_lookup)->RangeMultiplier(8)->Range(8, 4096);
+
+void bm_lookup_miss(benchmark::State& state) {
+  dir_fixture fx(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(vtfs_dir_find(fx.dir, "no-such-file"));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_lookup_miss)->RangeMultiplier(8)->Range(8, 4096);
+
+void bm_insert(benchmark::State& state) {
+  std::vector<std::string> names;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    names.push_back("file-" + std::to_string(i));
+  }
+  for (auto _ : state) {
+    dir_fixture fx(0);
+    for (size_t i = 0; i < names.size(); i++) {
+      // create() checks for duplicates before adding, so measure both
+      if (!vtfs_dir_find(fx.dir, names[i].c_str())) {
+        add_file(fx.dir, names[i].c_str(), 101 + i);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(bm_insert)->RangeMultiplier(8)->Range(8, 4096);
+
+void bm_iterate(benchmark::State& state) {
+  dir_fixture fx(state.range(0));
+  for (auto _ : state) {
+    size_t total = 0;
+    struct vtfs_file* entry;
+    list_for_each_entry(entry, &fx.dir->children, list) {
+      total += strlen(entry->name) + entry->node->ino;
+    }
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(bm_iterate)->RangeMultiplier(8)->Range(8, 4096);
+
+// Appends a file of 1 MiB in chunks of range(0) bytes
+void bm_write_append(benchmark::State& state) {
+  const size_t chunk = state.range(0);
+  const size_t total = 1 << 20;
+  std::vector<char> buf(chunk, 'x');
+  for (auto _ : state) {
+    struct vtfs_node* file = vtfs_node_alloc(NULL, 101, S_IFREG | 0777);
+    loff_t pos = 0;
+    while ((size_t)pos < total) {
+      vtfs_data_write(file, buf.data(), chunk, &pos);
+    }
+    vtfs_node_free(file);
+  }
+  state.SetBytesProcessed(state.iterations() * total);
+}
+BENCHMARK(bm_write_append)->RangeMultiplier(8)->Range(512, 256 << 10);
+
+void bm_write_overwrite(benchmark::State& state) {
+  const size_t chunk = state.range(0);
+  std::vector<char> buf(chunk, 'x');
+  struct vtfs_node* file = vtfs_node_alloc(NULL, 101, S_IFREG | 0777);
+  loff_t pos = 0;
+  vtfs_data_write(file, buf.data(), chunk, &pos);
+  for (auto _ : state) {
+    pos = 0;
+    vtfs_data_write(file, buf.data(), chunk, &pos);
+  }
+  vtfs_node_free(file);
+  state.SetBytesProcessed(state.iterations() * chunk);
+}
+BENCHMARK(bm_write_overwrite)->RangeMultiplier(8)->Range(512, 256 << 10);
+
+void bm_read(benchmark::State& state) {
+  const size_t chunk = state.range(0);
+  const size_t total = 1 << 20;
+  std::vector<char> buf(chunk, 'x');
+  struct vtfs_node* file = vtfs_node_alloc(NULL, 101, S_IFREG | 0777);
+  loff_t pos = 0;
+  while ((size_t)pos < total) {
+    vtfs_data_write(file, buf.data(), chunk, &pos);
+  }
+  for (auto _ : state) {
+    pos = 0;
+    while (vtfs_data_read(file, buf.data(), chunk, &pos) > 0) {
+    }
+  }
+  vtfs_node_free(file);
+  state.SetBytesProcessed(state.iterations() * total);
+}
+BENCHMARK(bm_read)->RangeMultiplier(8)->Range(512, 256 << 10);
+
+// CRC-32C over range(0) bytes, next to a plain copy of the same size for
+// scale: every byte sent or fetched with a checksum is also copied once
+void bm_crc32c(benchmark::State& state) {
+  std::vector<char> buf(state.range(0), 'x');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(vtfs_crc32c(buf.data(), buf.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(bm_crc32c)->RangeMultiplier(8)->Range(512, 256 << 10);
+
+void bm_memcpy(benchmark::State& state) {
+  std::vector<char> src(state.range(0), 'x');
+  std::vector<char> dst(src.size());
+  for (auto _ : state) {
+    memcpy(dst.data(), src.data(), src.size());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+}
+BENCHMARK(bm_memcpy)->RangeMultiplier(8)->Range(512, 256 << 10);
+
+// Checksums of a 1 MiB file with nothing written in between, as sent with a
+// hot file: served from the per-file cache after the first pass
+void bm_csum_cached(benchmark::State& state) {
+  const size_t total = 1 << 20;
+  std::vector<char> buf(total, 'x');
+  struct vtfs_node* file = vtfs_node_alloc(NULL, 101, S_IFREG | 0777);
+  loff_t pos = 0;
+  u32 crc;
+  vtfs_data_write(file, buf.data(), total, &pos);
+  for (auto _ : state) {
+    for (size_t i = 0; i < vtfs_csum_chunks(total); i++) {
+      vtfs_data_csum(file, i, &crc);
+      benchmark::DoNotOptimize(crc);
+    }
+  }
+  vtfs_node_free(file);
+  state.SetBytesProcessed(state.iterations() * total);
+}
+BENCHMARK(bm_csum_cached);
+
+// Delta of a range(0) byte file against its previous version with one byte
+// rewritten in the middle: the client side of a rewrite-in-place sync.
+// delta_bytes is what goes on the wire instead of the whole file.
+void bm_delta_encode(benchmark::State& state) {
+  const size_t size = state.range(0);
+  std::vector<char> old_data(size);
+  std::mt19937 rng(1);
+  for (auto& c : old_data) {
+    c = (char)rng();
+  }
+  std::vector<char> new_data = old_data;
+  new_data[size / 2] ^= 1;
+  std::vector<struct vtfs_delta_sig> sigs(vtfs_delta_blocks(size));
+  vtfs_delta_signature(old_data.data(), size, sigs.data());
+
+  ssize_t delta_len = 0;
+  for (auto _ : state) {
+    char* delta;
+    delta_len = vtfs_delta_encode(sigs.data(), sigs.size(), size, new_data.data(), size, &delta);
+    free(delta);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  state.counters["delta_bytes"] = delta_len;
+}
+BENCHMARK(bm_delta_encode)->RangeMultiplier(8)->Range(64 << 10, 16 << 20);
+
+// Fills a directory with range(0) files of range(1) bytes each and reports
+// what one file costs; bytes_per_file includes its data
+void bm_footprint(benchmark::State& state) {
+  const int64_t files = state.range(0);
+  const size_t size = state.range(1);
+  std::vector<char> buf(size, 'x');
+  struct vtfs_mem mem = {};
+  // Per-node tracking on, as on a mount
+  vtfs_mem_init(&mem);
+  for (auto _ : state) {
+    struct vtfs_node* root = vtfs_node_alloc(&mem, 100, S_IFDIR | 0777);
+    for (int64_t i = 0; i < files; i++) {
+      std::string name = "file-" + std::to_string(i);
+      struct vtfs_node* node = vtfs_node_alloc(&mem, 101 + i, S_IFREG | 0777);
+      loff_t pos = 0;
+      vtfs_dir_add(root->dir, vtfs_file_alloc(name.c_str(), node));
+      vtfs_data_write(node, buf.data(), size, &pos);
+    }
+
+    state.PauseTiming();
+    double total = vtfs_mem_total(&mem, 0);
+    state.counters["bytes_per_file"] = total / files;
+    state.counters["overhead_per_file"] = (total - (double)(files * size)) / files;
+    state.counters["slack_per_file"] =
+        (double)(vtfs_mem_read(&mem, VTFS_MEM_SLACK) + vtfs_mem_read(&mem, VTFS_MEM_DATA_SLACK)) /
+        files;
+    vtfs_tree_free(root);
+    if (vtfs_mem_total(&mem, 0) != 0) {
+      state.SkipWithError("accounting does not return to zero");
+    }
+    state.ResumeTiming();
+  }
+  vtfs_mem_destroy(&mem);
+}
+BENCHMARK(bm_footprint)->ArgsProduct({{1000}, {0, 100, 4096, 65536}});
+
+// getxattr of the last of four attributes, every file carrying the same
+// values: inline up to VTFS_XATTR_INLINE_MAX, one shared blob above it
+void bm_xattr_get(benchmark::State& state) {
+  const int files = 1000;
+  const size_t size = state.range(0);
+  std::vector<char> value(size, 'x');
+  std::vector<char> buf(size);
+  std::vector<struct vtfs_node*> nodes;
+  struct vtfs_mem mem = {};
+  struct vtfs_xattr_table table;
+  vtfs_xattr_table_init(&table, &mem);
+  for (int i = 0; i < files; i++) {
+    struct vtfs_node* node = vtfs_node_alloc(&mem, 101 + i, S_IFREG | 0777);
+    for (const char* name : {"user.a", "user.b", "user.c", "security.label"}) {
+      vtfs_xattr_set(&table, node, name, value.data(), size, 0);
+    }
+    nodes.push_back(node);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        vtfs_xattr_get(&table, nodes[i++ % files], "security.label", buf.data(), size)
+    );
+  }
+  state.counters["xattr_bytes_per_file"] =
+      (double)vtfs_mem_read(&mem, VTFS_MEM_XATTRS) / files;
+
+  for (struct vtfs_node* node : nodes) {
+    vtfs_node_free(node);
+  }
+  vtfs_xattr_table_destroy(&table);
+}
+BENCHMARK(bm_xattr_get)->Arg(16)->Arg(64)->Arg(256)->Arg(4096);
+
+int build_request(char* buf, size_t size, size_t arg_size, ...) {
+  va_list args;
+  va_start(args, arg_size);
+  int length = vtfs_http_build_request(buf, size, "0.0.0.0", "token", "lookup", arg_size, args);
+  va_end(args);
+  return length;
+}
+
+void bm_build_request(benchmark::State& state) {
+  char buf[VTFS_HTTP_REQUEST_SIZE];
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(build_request(buf, sizeof(buf), 2, "parent", "100", "name", "file-1"));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_build_request);
+
+// The same lookup as a binary RPC frame
+void bm_rpc_build_request(benchmark::State& state) {
+  const vtfs_arg args[] = {{"parent", "100", 3}, {"name", "file-1", 6}};
+  char buf[VTFS_HTTP_REQUEST_SIZE];
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(vtfs_rpc_build_request(buf, VTFS_RPC_LOOKUP, 1, "token", args, 2));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_rpc_build_request);
+
+// Framing a write of range(0) bytes: copied into one buffer, or gathered
+// with the data left in place
+void bm_rpc_build_write(benchmark::State& state) {
+  const bool gather = state.range(1);
+  std::string data(state.range(0), 'd');
+  const vtfs_arg args[] = {{"inode", "17", 2}, {"content", data.data(), data.size()}};
+  std::vector<char> buf(vtfs_rpc_request_size("token", args, 2));
+  vtfs_rpc_seg segs[VTFS_RPC_GATHER_SEGS(2)];
+  for (auto _ : state) {
+    if (gather) {
+      benchmark::DoNotOptimize(
+          vtfs_rpc_build_gather(buf.data(), VTFS_RPC_WRITE, 1, "token", args, 2, segs)
+      );
+    } else {
+      benchmark::DoNotOptimize(
+          vtfs_rpc_build_request(buf.data(), VTFS_RPC_WRITE, 1, "token", args, 2)
+      );
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(bm_rpc_build_write)->ArgsProduct({{4 << 10, 64 << 10, 1 << 20}, {0, 1}});
+
+void bm_encode(benchmark::State& state) {
+  std::string src(state.range(0), '\0');
+  for (size_t i = 0; i < src.size(); i++) {
+    src[i] = (char)(1 + i % 127);
+  }
+  std::vector<char> dst(src.size() * 3 + 1);
+  for (auto _ : state) {
+    encode(src.c_str(), dst.data());
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+}
+BENCHMARK(bm_encode)->Range(64, 2048);
+
+void bm_parse_response(benchmark::State& state) {
+  std::string payload(state.range(0), 'y');
+  int64_t result = 0;
+  std::string body(reinterpret_cast<const char*>(&result), sizeof(result));
+  body += payload;
+  std::string raw =
+      "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " +
+      std::to_string(body.size()) + "\r\n\r\n" + body;
+  std::vector<char> scratch(raw.size());
+  std::vector<char> out(payload.size());
+  for (auto _ : state) {
+    // parse_http_response splits the buffer in place
+    memcpy(scratch.data(), raw.data(), raw.size());
+    benchmark::DoNotOptimize(
+        parse_http_response(scratch.data(), raw.size(), out.data(), out.size())
+    );
+  }
+  state.SetBytesProcessed(state.iterations() * raw.size());
+}
+BENCHMARK(bm_parse_response)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// Framing a pipelined response off the stream before parsing it
+void bm_response_length(benchmark::State& state) {
+  std::string raw =
+      "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " +
+      std::to_string(state.range(0)) + "\r\nConnection: keep-alive\r\n\r\n" +
+      std::string(state.range(0), 'y');
+  for (auto _ : state) {
+    bool close;
+    benchmark::DoNotOptimize(vtfs_http_response_length(raw.data(), raw.size(), &close));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_response_length)->Arg(64)->Arg(64 << 10);
+
+// Cost of queueing, dispatching and completing one call with every class
+// backlogged
+void bm_iosched_dispatch(benchmark::State& state) {
+  struct vtfs_sched sched;
+  std::vector<vtfs_sched_request> requests(4 * VTFS_IO_CLASS_COUNT);
+  vtfs_sched_init(&sched, 32);
+  for (size_t i = 0; i < requests.size(); i++) {
+    vtfs_sched_enqueue(&sched, &requests[i], (vtfs_io_class)(i % VTFS_IO_CLASS_COUNT), 1 + i % 4);
+  }
+  for (auto _ : state) {
+    struct vtfs_sched_request* request = vtfs_sched_dispatch(&sched);
+    vtfs_sched_complete(&sched, request);
+    vtfs_sched_enqueue(&sched, request, request->io_class, 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_iosched_dispatch);
+
+// Simulated mount saturated by writeback: a backend that finishes the
+// oldest call in flight every tick, 64 writes always queued and a lookup
+// every 4 ticks. Reports the lookups' latency in ticks. range(0) = 0 puts
+// everything in one class, which is a plain FIFO over the same slots.
+void bm_iosched_foreground(benchmark::State& state) {
+  const bool classes = state.range(0);
+  const int ticks = 100000;
+  struct call {
+    vtfs_sched_request request;
+    int enqueued;
+    bool lookup;
+  };
+  std::vector<int> latencies;
+  for (auto _ : state) {
+    struct vtfs_sched sched;
+    std::deque<call> calls;
+    std::deque<call*> inflight;
+    int background = 0;
+    latencies.clear();
+    vtfs_sched_init(&sched, 32);
+    auto enqueue = [&](int now, bool lookup) {
+      calls.push_back({{}, now, lookup});
+      vtfs_io_class io_class = lookup || !classes ? VTFS_IO_SYNC_META : VTFS_IO_WRITEBACK;
+      vtfs_sched_enqueue(&sched, &calls.back().request, io_class, lookup ? 1 : 4);
+    };
+    for (int now = 0; now < ticks; now++) {
+      for (; background < 64; background++) {
+        enqueue(now, false);
+      }
+      if (now % 4 == 0) {
+        enqueue(now, true);
+      }
+      while (struct vtfs_sched_request* request = vtfs_sched_dispatch(&sched)) {
+        inflight.push_back(reinterpret_cast<call*>(request));
+      }
+      call* done = inflight.front();
+      inflight.pop_front();
+      vtfs_sched_complete(&sched, &done->request);
+      if (done->lookup) {
+        latencies.push_back(now + 1 - done->enqueued);
+      } else {
+        background--;
+      }
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  state.counters["lookup_p50"] = latencies[latencies.size() / 2];
+  state.counters["lookup_p99"] = latencies[latencies.size() * 99 / 100];
+}
+BENCHMARK(bm_iosched_foreground)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Cost of recording a one-chunk access to a 1 MiB file
+void bm_heat_access(benchmark::State& state) {
+  struct vtfs_heat_table table;
+  struct vtfs_node* node = vtfs_node_alloc(nullptr, 1, S_IFREG | 0644);
+  char* dst;
+  size_t i = 0;
+  vtfs_heat_init(&table, 0);
+  vtfs_data_reserve(node, 0, 256 * VTFS_CSUM_CHUNK, &dst);
+  vtfs_heat_resize(node, 0);
+  for (auto _ : state) {
+    vtfs_heat_access(&table, node, i % 256 * VTFS_CSUM_CHUNK, 1, i >> 10);
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+  vtfs_node_free(node);
+}
+BENCHMARK(bm_heat_access);
+
+// RAM hit ratio of 1M chunk reads over 1000 files of 16 chunks, with file
+// popularity Zipf-distributed, when RAM holds range(0) percent of the files
+// and the coldest are demoted to make room. Data is not allocated; only
+// the heat is exercised.
+void bm_heat_hit_ratio(benchmark::State& state) {
+  const size_t files = 1000;
+  const size_t chunks = 16;
+  const size_t budget = files * state.range(0) / 100;
+  std::vector<double> cdf(files);
+  double sum = 0;
+  for (size_t i = 0; i < files; i++) {
+    sum += 1.0 / (i + 1);
+    cdf[i] = sum;
+  }
+  double ratio = 0;
+  for (auto _ : state) {
+    struct vtfs_heat_table table;
+    std::vector<vtfs_node*> nodes(files);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> pick(0, sum);
+    size_t resident = files;
+    vtfs_heat_init(&table, 0);
+    for (size_t i = 0; i < files; i++) {
+      nodes[i] = vtfs_node_alloc(nullptr, i + 1, S_IFREG | 0644);
+      nodes[i]->nlink = 1;
+      nodes[i]->size = chunks * VTFS_CSUM_CHUNK;
+      vtfs_heat_resize(nodes[i], 0);
+      nodes[i]->heat->demoted = false;
+      vtfs_heat_link(&table, nodes[i]);
+    }
+    for (size_t i = 0; i < 1000000; i++) {
+      u64 now = i / 1000;
+      // Rounding can put the pick just past the last file
+      size_t file = std::lower_bound(cdf.begin(), cdf.end() - 1, pick(rng)) - cdf.begin();
+      struct vtfs_node* node = nodes[file];
+      size_t chunk = rng() % chunks;
+      size_t start;
+      size_t end;
+      vtfs_heat_access(&table, node, chunk * VTFS_CSUM_CHUNK, 1, now);
+      if (node->heat->demoted) {
+        vtfs_heat_restored(&table, node->heat);
+        resident++;
+      }
+      for (size_t from = 0;
+           vtfs_heat_next_fetch(node->heat, from, chunk, chunk + 1, now, &start, &end);
+           from = end) {
+        vtfs_heat_fetched(&table, node->heat, start, end);
+      }
+      while (resident > budget) {
+        vtfs_heat_demoted(&table, vtfs_heat_victim(&table, now)->heat);
+        resident--;
+      }
+    }
+    ratio = (double)table.hits / (table.hits + table.misses);
+    for (struct vtfs_node* node : nodes) {
+      vtfs_node_free(node);
+    }
+  }
+  state.counters["ram_hit_ratio"] = ratio;
+}
+BENCHMARK(bm_heat_hit_ratio)->Arg(10)->Arg(25)->Arg(50)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
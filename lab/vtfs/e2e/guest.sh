@@ -0,0 +1,90 @@
+#!/bin/sh
+# Runs inside the VM as root. For each transport, mounts vtfs against mockd
+# with a RAM budget a fraction of the data written, so the tier demotes most
+# of it to the backend. Then drops every cached inode, reads all of it
+# back and compares it with what was written. Also checks that an owner set
+# before the eviction survives it, and that unmount leaves nothing of the
+# mount on the backend.
+#
+# usage: guest.sh <vtfs-dir>
+set -eu
+
+VTFS=$1
+WORK=$(mktemp -d)
+HTTP_PORT=8080  # the kernel's HTTP client always dials 0.0.0.0:8080
+RPC_PORT=8081
+
+cleanup() {
+  umount "$WORK/mnt" 2>/dev/null || true
+  rmmod vtfs 2>/dev/null || true
+  [ -n "${MOCKD_PID:-}" ] && kill "$MOCKD_PID" 2>/dev/null || true
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+fail() {
+  echo "e2e: $*" >&2
+  exit 1
+}
+
+# usage: tier_stat <mountpoint> <field>
+tier_stat() {
+  awk -v key="$2" '$1 == key { print $2 }' "/sys/kernel/debug/vtfs/$(mountpoint -d "$1")/tier"
+}
+
+# Entries in the root directory of token's namespace on mockd. A list
+# response is an 8-byte result followed by one record per entry.
+backend_root_size() {
+  python3 -c '
+import sys, urllib.request
+url = "http://127.0.0.1:%s/api/list?token=%s&inode=100" % (sys.argv[1], sys.argv[2])
+print(len(urllib.request.urlopen(url).read()) - 8)
+' "$HTTP_PORT" "$1"
+}
+
+mountpoint -q /sys/kernel/debug || mount -t debugfs none /sys/kernel/debug
+"$VTFS/tools/mockd" -q -p "$HTTP_PORT" -R "$RPC_PORT" &
+MOCKD_PID=$!
+sleep 1
+if [ -f "$VTFS/vtfs.ko" ]; then
+  insmod "$VTFS/vtfs.ko"
+else
+  insmod "$VTFS/source/vtfs.ko"
+fi
+
+# 8 files of just over 1 MiB each, none a multiple of the 4 KiB chunk
+mkdir -p "$WORK/src" "$WORK/mnt"
+for i in 1 2 3 4 5 6 7 8; do
+  head -c $((1048576 + i * 1000)) /dev/urandom >"$WORK/src/f$i"
+done
+
+for transport in http rpc; do
+  token=e2e-$transport
+  opts=ram=2M
+  [ "$transport" = rpc ] && opts="$opts,rpc=tcp:127.0.0.1:$RPC_PORT"
+  mount -t vtfs -o "$opts" "$token" "$WORK/mnt"
+
+  cp "$WORK/src"/f* "$WORK/mnt/"
+  chown 1234:5678 "$WORK/mnt/f1"
+
+  # The tier demotes in the background once the mount is over budget
+  tries=0
+  while [ "$(tier_stat "$WORK/mnt" demotions)" -lt 6 ]; do
+    tries=$((tries + 1))
+    [ "$tries" -le 100 ] || fail "$transport: only $(tier_stat "$WORK/mnt" demotions) demotions"
+    sleep 0.1
+  done
+
+  # Evicts every inode not in use; the nodes and the backend copies stay
+  sync
+  echo 2 >/proc/sys/vm/drop_caches
+
+  for f in "$WORK/src"/f*; do
+    cmp "$f" "$WORK/mnt/$(basename "$f")" || fail "$transport: $(basename "$f") differs"
+  done
+  [ "$(stat -c %u:%g "$WORK/mnt/f1")" = 1234:5678 ] || fail "$transport: owner lost"
+
+  umount "$WORK/mnt"
+  [ "$(backend_root_size "$token")" -eq 0 ] || fail "$transport: backend not cleaned up"
+  echo "e2e: $transport ok"
+done
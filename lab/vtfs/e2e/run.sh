@@ -0,0 +1,26 @@
+#!/bin/sh
+# Builds vtfs.ko and mockd, boots the kernel tree in a throwaway VM and runs
+# guest.sh inside it: file data makes a real round trip through the
+# backend, over HTTP and over RPC. Exits non-zero if any check fails.
+#
+# usage: e2e/run.sh <kernel-tree>
+#
+# Needs virtme-ng (vng) on the host; python3 must be visible in the guest,
+# which by default shares the host root filesystem read-only.
+set -eu
+
+KERNEL=$(cd "$1" && pwd)
+HERE=$(cd "$(dirname "$0")" && pwd)
+VTFS=$(dirname "$HERE")
+
+make -C "$VTFS" KDIR="$KERNEL" >/dev/null
+make -C "$VTFS/tools" mockd >/dev/null
+
+VNG_ACCEL=
+if [ ! -w /dev/kvm ]; then
+  VNG_ACCEL=--disable-kvm
+fi
+
+# shellcheck disable=SC2086
+vng --run "$KERNEL" --user root $VNG_ACCEL --memory 1G --cpus 2 \
+  --exec "$HERE/guest.sh $VTFS"
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Runs the vtfs KUnit suite (including the timed benchmark cases) under UML,
+# so nothing is loaded into the host kernel.
+#
+# usage: kunit/run.sh /path/to/linux [kunit.py run arguments...]
+#
+# Links this directory into the kernel tree as fs/vtfs and hooks it into
+# fs/Kconfig and fs/Makefile once; later runs reuse that.
+set -eu
+
+KERNEL_SRC=${1:?usage: $0 /path/to/linux [kunit.py args...]}
+shift
+VTFS=$(cd "$(dirname "$0")/.." && pwd)
+
+ln -sfn "$VTFS" "$KERNEL_SRC/fs/vtfs"
+grep -q 'fs/vtfs/Kconfig' "$KERNEL_SRC/fs/Kconfig" ||
+  echo 'source "fs/vtfs/Kconfig"' >>"$KERNEL_SRC/fs/Kconfig"
+grep -q 'CONFIG_VTFS_FS' "$KERNEL_SRC/fs/Makefile" ||
+  echo 'obj-$(CONFIG_VTFS_FS) += vtfs/' >>"$KERNEL_SRC/fs/Makefile"
+
+cd "$KERNEL_SRC"
+exec ./tools/testing/kunit/kunit.py run --kunitconfig=fs/vtfs/.kunitconfig "$@"
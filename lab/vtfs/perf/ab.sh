@@ -0,0 +1,31 @@
+#!/bin/sh
+# Runs the perf matrix on two revisions and prints the comparison table.
+# Defaults to the merge base with main against the working tree, which is
+# what a change to vtfs.c or http.c should be reviewed with.
+#
+# usage: ab.sh <kernel-tree> [base-rev] [runs]
+set -eu
+
+KERNEL=$1
+BASE=${2:-$(git merge-base HEAD main)}
+RUNS=${3:-3}
+HERE=$(cd "$(dirname "$0")" && pwd)
+OUT=${VTFS_PERF_OUT:-$HERE/results}
+BASE_TREE=$(mktemp -d)
+
+cleanup() {
+  git worktree remove --force "$BASE_TREE" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+mkdir -p "$OUT"
+git worktree add --detach "$BASE_TREE" "$BASE" >/dev/null
+# Keep the harness itself fixed so both sides run the same matrix
+SUBDIR=$(git -C "$HERE" rev-parse --show-prefix)
+rm -rf "$BASE_TREE/$SUBDIR"
+cp -r "$HERE" "$BASE_TREE/$SUBDIR"
+
+VTFS_PERF_BASE=1 "$BASE_TREE/$SUBDIR/run.sh" "$KERNEL" "$OUT/before.json" "$RUNS"
+"$HERE/run.sh" "$KERNEL" "$OUT/after.json" "$RUNS"
+
+python3 "$HERE/compare.py" "$OUT/before.json" "$OUT/after.json" | tee "$OUT/compare.md"
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Prints a before/after table for two summaries and checks thresholds.
+
+usage: compare.py <before.json> <after.json> [thresholds.json]
+
+Exits with status 1 if any vtfs job (including the per-policy vtfs-<numa>
+mounts) regresses past its threshold. tmpfs rows are shown as a baseline
+for VM noise and never fail the check.
+"""
+
+import json
+import os
+import sys
+
+# Direction in which each metric improves
+HIGHER_IS_BETTER = {"bw_MBps": True, "iops": True, "lat_p99_us": False}
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def threshold(thresholds, job, metric):
+    return thresholds.get("jobs", {}).get(job, {}).get(
+        metric, thresholds.get("default", {}).get(metric, 10)
+    )
+
+
+def main(argv):
+    before = load(argv[1])
+    after = load(argv[2])
+    thresholds_path = argv[3] if len(argv) > 3 else os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), "thresholds.json"
+    )
+    thresholds = load(thresholds_path)
+
+    print(f"before: {before['meta']['rev']}  after: {after['meta']['rev']}\n")
+    print("| fs | job | metric | before | after | change | limit | |")
+    print("|---|---|---|---:|---:|---:|---:|---|")
+
+    failed = False
+    for fs in sorted(after["results"]):
+        for job in sorted(after["results"][fs]):
+            old = before["results"].get(fs, {}).get(job)
+            if old is None:
+                continue
+            for metric, higher_better in HIGHER_IS_BETTER.items():
+                a = old.get(metric, 0)
+                b = after["results"][fs][job].get(metric, 0)
+                if a == 0:
+                    continue
+                change = (b - a) / a * 100
+                regression = -change if higher_better else change
+                limit = threshold(thresholds, job, metric)
+                status = ""
+                if regression > limit:
+                    gated = fs.startswith("vtfs")
+                    status = "REGRESSION" if gated else "noise?"
+                    failed = failed or gated
+                print(
+                    f"| {fs} | {job} | {metric} | {a:.1f} | {b:.1f} | {change:+.1f}% | {limit}% | {status} |"
+                )
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,102 @@
+#!/bin/sh
+# Runs inside the benchmark VM as root: loads vtfs, mounts it next to a
+# tmpfs baseline, runs every job file on both, runs the metadata benchmark
+# on vtfs, tmpfs and ramfs, and writes one JSON summary. On a guest with
+# more than one NUMA node, jobs/numa/ also runs on one vtfs mount per
+# placement policy (results as vtfs-local, vtfs-interleave).
+#
+# usage: guest.sh <vtfs.ko> <out.json> <runs>
+set -eu
+
+MODULE=$1
+OUT=$2
+RUNS=${3:-1}
+HERE=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+NUMA_POLICIES=
+
+cleanup() {
+  [ -n "${BACKEND_PID:-}" ] && kill "$BACKEND_PID" 2>/dev/null || true
+  umount "$WORK/vtfs" 2>/dev/null || true
+  umount "$WORK/tmpfs" 2>/dev/null || true
+  umount "$WORK/ramfs" 2>/dev/null || true
+  for policy in $NUMA_POLICIES; do
+    umount "$WORK/vtfs-$policy" 2>/dev/null || true
+  done
+  rmmod vtfs 2>/dev/null || true
+}
+trap cleanup EXIT
+
+# usage: run_fio <bench-dir> <out.json> <job.fio>
+# On the base side of an A/B run a job the older module cannot do (a file
+# past what it can allocate, say) is left out, and compare.py skips it. The
+# revision under test must run every job.
+run_fio() {
+  if ! BENCH_DIR=$1 fio --output-format=json --output="$2" "$3" >/dev/null; then
+    [ "${VTFS_PERF_BASE:-0}" = 1 ] || return 1
+    echo "guest.sh: $(basename "$3") failed on the base revision, left out" >&2
+    rm -f "$2"
+  fi
+}
+
+# Optional backend stand-in, e.g. VTFS_BACKEND_CMD="tools/mockd -p 8080"
+if [ -n "${VTFS_BACKEND_CMD:-}" ]; then
+  sh -c "$VTFS_BACKEND_CMD" &
+  BACKEND_PID=$!
+  sleep 1
+fi
+
+insmod "$MODULE"
+mkdir -p "$WORK/vtfs" "$WORK/tmpfs" "$WORK/ramfs" "$WORK/raw"
+mount -t vtfs "${VTFS_TOKEN:-perf}" "$WORK/vtfs"
+mount -t tmpfs tmpfs "$WORK/tmpfs"
+mount -t ramfs ramfs "$WORK/ramfs"
+
+for fs in vtfs tmpfs; do
+  for job in "$HERE"/jobs/*.fio; do
+    name=$(basename "$job" .fio)
+    run=1
+    while [ "$run" -le "$RUNS" ]; do
+      mkdir -p "$WORK/$fs/$name"
+      run_fio "$WORK/$fs/$name" "$WORK/raw/$fs.$name.$run.json" "$job"
+      rm -rf "$WORK/$fs/$name"
+      run=$((run + 1))
+    done
+  done
+done
+
+# Absent when the revision predates it
+run=1
+while [ -x "$HERE/../tools/mdbench" ] && [ "$run" -le "$RUNS" ]; do
+  "$HERE/../tools/mdbench" -t 1,4 -n 2000 -j "$WORK/raw/mdbench.$run.jsonl" \
+    vtfs="$WORK/vtfs" tmpfs="$WORK/tmpfs" ramfs="$WORK/ramfs" >/dev/null
+  run=$((run + 1))
+done
+
+if [ -d /sys/devices/system/node/node1 ]; then
+  NUMA_POLICIES="local interleave"
+  WRITER_CPUS=$(cat /sys/devices/system/node/node0/cpulist)
+  READER_CPUS=$(cat /sys/devices/system/node/node1/cpulist)
+  export WRITER_CPUS READER_CPUS
+  for policy in $NUMA_POLICIES; do
+    mkdir -p "$WORK/vtfs-$policy"
+    # A base revision from before numa= refuses the option
+    if ! mount -t vtfs -o "numa=$policy" "${VTFS_TOKEN:-perf}" "$WORK/vtfs-$policy"; then
+      [ "${VTFS_PERF_BASE:-0}" = 1 ] || exit 1
+      echo "guest.sh: numa=$policy not supported by the base revision, left out" >&2
+      continue
+    fi
+    for job in "$HERE"/jobs/numa/*.fio; do
+      name=$(basename "$job" .fio)
+      run=1
+      while [ "$run" -le "$RUNS" ]; do
+        mkdir -p "$WORK/vtfs-$policy/$name"
+        run_fio "$WORK/vtfs-$policy/$name" "$WORK/raw/vtfs-$policy.$name.$run.json" "$job"
+        rm -rf "$WORK/vtfs-$policy/$name"
+        run=$((run + 1))
+      done
+    done
+  done
+fi
+
+python3 "$HERE/summarize.py" "$WORK/raw" >"$OUT"
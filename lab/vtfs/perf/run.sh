@@ -0,0 +1,52 @@
+#!/bin/sh
+# Builds vtfs.ko against a kernel tree, boots that kernel in a throwaway VM
+# and runs guest.sh inside it. Uses KVM when /dev/kvm is usable, TCG
+# otherwise (much slower, only compare TCG runs with TCG runs).
+#
+# usage: run.sh <kernel-tree> <out.json> [runs]
+#
+# Needs virtme-ng (vng) on the host; fio and python3 must be visible in the
+# guest, which by default shares the host root filesystem read-only.
+# VTFS_NUMA=1 gives the guest two NUMA nodes of two CPUs each, which adds
+# the cross-node jobs from jobs/numa/. VTFS_PERF_BASE=1, set by ab.sh for the
+# base revision, lets jobs that revision cannot run drop out.
+set -eu
+
+KERNEL=$(cd "$1" && pwd)
+OUT=$(realpath -m "$2")
+RUNS=${3:-3}
+HERE=$(cd "$(dirname "$0")" && pwd)
+VTFS=$(dirname "$HERE")
+
+make -C "$VTFS" KDIR="$KERNEL" >/dev/null
+# Revisions from before the top-level Kbuild build source/vtfs.ko, and those
+# from before mdbench lack it; guest.sh then leaves the metadata jobs out
+MODULE=$VTFS/vtfs.ko
+[ -f "$MODULE" ] || MODULE=$VTFS/source/vtfs.ko
+if [ -f "$VTFS/tools/mdbench.c" ]; then
+  make -C "$VTFS/tools" mdbench >/dev/null
+fi
+
+if [ -w /dev/kvm ]; then
+  ACCEL=kvm
+  VNG_ACCEL=
+else
+  ACCEL=tcg
+  VNG_ACCEL=--disable-kvm
+fi
+
+VNG_NUMA=
+if [ "${VTFS_NUMA:-0}" = 1 ]; then
+  VNG_NUMA="--numa 1G,cpus=0-1 --numa 1G,cpus=2-3"
+fi
+
+REV=$(git -C "$VTFS" describe --always --dirty 2>/dev/null || echo unknown)
+
+# shellcheck disable=SC2086
+vng --run "$KERNEL" --user root $VNG_ACCEL $VNG_NUMA --memory 2G --cpus 4 \
+  --rwdir "$(dirname "$OUT")" \
+  --exec "VTFS_REV=$REV VTFS_ACCEL=$ACCEL VTFS_TOKEN=${VTFS_TOKEN:-perf} \
+          VTFS_BACKEND_CMD='${VTFS_BACKEND_CMD:-}' VTFS_PERF_BASE=${VTFS_PERF_BASE:-0} \
+          $HERE/guest.sh $MODULE $OUT $RUNS"
+
+echo "results: $OUT"
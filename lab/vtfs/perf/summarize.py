@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Folds raw fio JSON outputs (<fs>.<jobfile>.<run>.json) and mdbench
+JSON lines (mdbench.<run>.jsonl) into one summary.
+
+Each job gets the median over runs of bandwidth, IOPS and p99 completion
+latency, read and write directions combined. mdbench phases become jobs
+named md-<phase>-<mode>-t<threads> with ops/s reported as IOPS.
+"""
+
+import json
+import os
+import platform
+import statistics
+import sys
+
+
+def job_metrics(job):
+    bw_kib = 0.0
+    iops = 0.0
+    p99_ns = 0.0
+    for direction in ("read", "write"):
+        stats = job.get(direction)
+        if not stats or stats.get("total_ios", 0) == 0:
+            continue
+        bw_kib += stats.get("bw", 0)
+        iops += stats.get("iops", 0)
+        percentiles = stats.get("clat_ns", {}).get("percentile", {})
+        p99_ns = max(p99_ns, percentiles.get("99.000000", 0))
+    return {"bw_MBps": bw_kib * 1024 / 1e6, "iops": iops, "lat_p99_us": p99_ns / 1000}
+
+
+def main(raw_dir):
+    runs = {}
+    for name in sorted(os.listdir(raw_dir)):
+        if name.endswith(".jsonl"):
+            with open(os.path.join(raw_dir, name)) as f:
+                for line in f:
+                    phase = json.loads(line)
+                    job = f"md-{phase['phase']}-{phase['mode']}-t{phase['threads']}"
+                    runs.setdefault((phase["fs"], job), []).append(
+                        {"bw_MBps": 0.0, "iops": phase["ops_per_sec"], "lat_p99_us": phase["p99_us"]}
+                    )
+            continue
+        fs, _, _ = name.split(".", 2)
+        with open(os.path.join(raw_dir, name)) as f:
+            # fio may print warnings before the JSON document
+            text = f.read()
+            report = json.loads(text[text.index("{"):])
+        for job in report["jobs"]:
+            key = (fs, job["jobname"])
+            runs.setdefault(key, []).append(job_metrics(job))
+
+    results = {}
+    for (fs, job), samples in runs.items():
+        results.setdefault(fs, {})[job] = {
+            metric: statistics.median(s[metric] for s in samples) for metric in samples[0]
+        }
+
+    summary = {
+        "meta": {
+            "rev": os.environ.get("VTFS_REV", "unknown"),
+            "kernel": platform.release(),
+            "accel": os.environ.get("VTFS_ACCEL", "unknown"),
+            "runs": max(len(s) for s in runs.values()) if runs else 0,
+        },
+        "results": results,
+    }
+    json.dump(summary, sys.stdout, indent=2, sort_keys=True)
+    print()
+
+
+if __name__ == "__main__":
+    main(sys.argv[1])
@@ -0,0 +1,196 @@
+#include "cache.h"
+
+#include <linux/err.h>
+#include <linux/namei.h>
+#include <linux/slab.h>
+
+#include "data.h"
+
+int vtfs_cache_init(struct vtfs_cache* cache, const char* dir) {
+  if (dir[0] != '/') {
+    return -EINVAL;
+  }
+  kfree(cache->dir);
+  cache->dir = kstrdup(dir, GFP_KERNEL);
+  if (!cache->dir) {
+    return -ENOMEM;
+  }
+  if (!cache->cred) {
+    cache->cred = get_current_cred();
+  }
+  return 0;
+}
+
+void vtfs_cache_destroy(struct vtfs_cache* cache) {
+  kfree(cache->dir);
+  if (cache->cred) {
+    put_cred(cache->cred);
+  }
+}
+
+// Empties the file and marks it as holding version
+static int vtfs_cache_reset(struct file* file, u64 version, u64 size) {
+  struct vtfs_cache_header header = {.version = version, .size = size};
+  char buf[VTFS_CACHE_HEADER_SIZE];
+  loff_t pos = 0;
+  int err;
+
+  err = vfs_truncate(&file->f_path, 0);
+  if (err) {
+    return err;
+  }
+  vtfs_cache_put_header(buf, &header);
+  return kernel_write(file, buf, sizeof(buf), &pos) == sizeof(buf) ? 0 : -EIO;
+}
+
+int vtfs_cache_open(
+    struct vtfs_cache* cache,
+    const char* token,
+    u64 ino,
+    u64 version,
+    u64 size,
+    struct vtfs_cache_file* cached
+) {
+  struct vtfs_cache_header header;
+  char buf[VTFS_CACHE_HEADER_SIZE];
+  const struct cred* old;
+  struct file* file;
+  loff_t pos = 0;
+  char* path;
+  int err = 0;
+
+  path = __getname();
+  if (!path) {
+    return -ENOMEM;
+  }
+  err = vtfs_cache_path(path, PATH_MAX, cache->dir, token, ino);
+  if (err) {
+    __putname(path);
+    return err;
+  }
+
+  old = override_creds(cache->cred);
+  file = filp_open(path, O_RDWR | O_CREAT | O_LARGEFILE, 0600);
+  __putname(path);
+  if (IS_ERR(file)) {
+    revert_creds(old);
+    return PTR_ERR(file);
+  }
+  if (kernel_read(file, buf, sizeof(buf), &pos) != sizeof(buf) ||
+      vtfs_cache_get_header(buf, &header) || header.version != version || header.size != size) {
+    err = vtfs_cache_reset(file, version, size);
+  }
+  revert_creds(old);
+  if (err) {
+    filp_close(file, NULL);
+    return err;
+  }
+
+  cached->cache = cache;
+  cached->file = file;
+  cached->size = size;
+  return 0;
+}
+
+void vtfs_cache_close(struct vtfs_cache_file* cached) {
+  if (cached->file) {
+    filp_close(cached->file, NULL);
+    cached->file = NULL;
+  }
+}
+
+size_t vtfs_cache_load(
+    struct vtfs_cache_file* cached, struct vtfs_node* node, size_t offset, size_t len
+) {
+  size_t end = min_t(u64, offset + len, cached->size);
+  size_t pos = offset;
+  const struct cred* old;
+  char* slot;
+
+  if (pos >= end) {
+    return 0;
+  }
+  slot = kmalloc(VTFS_CACHE_SLOT, GFP_KERNEL);
+  if (!slot) {
+    return 0;
+  }
+
+  old = override_creds(cached->cache->cred);
+  while (pos < end) {
+    size_t want = min_t(u64, VTFS_CSUM_CHUNK, cached->size - pos);
+    loff_t at = vtfs_cache_slot_offset(pos / VTFS_CSUM_CHUNK);
+    const char* data;
+    __le32 crc_le;
+    char* dst;
+    u32 crc;
+
+    if (kernel_read(cached->file, slot, VTFS_CACHE_SLOT_HEADER + want, &at) !=
+            VTFS_CACHE_SLOT_HEADER + want ||
+        vtfs_cache_get_slot(slot, &data, &crc) != want ||
+        vtfs_data_reserve(node, pos, want, &dst)) {
+      atomic_long_inc(&cached->cache->misses);
+      break;
+    }
+    memcpy(dst, data, want);
+    crc_le = cpu_to_le32(crc);
+    vtfs_data_filled(node, pos, want, (const char*)&crc_le);
+    atomic_long_inc(&cached->cache->hits);
+    pos += want;
+  }
+  revert_creds(old);
+
+  kfree(slot);
+  return pos - offset;
+}
+
+void vtfs_cache_store(
+    struct vtfs_cache_file* cached, struct vtfs_node* node, size_t offset, size_t len
+) {
+  size_t end = min_t(u64, offset + len, cached->size);
+  const struct cred* old;
+  char* slot;
+
+  slot = kmalloc(VTFS_CACHE_SLOT, GFP_KERNEL);
+  if (!slot) {
+    return;
+  }
+
+  old = override_creds(cached->cache->cred);
+  for (size_t pos = offset; pos < end; pos += VTFS_CSUM_CHUNK) {
+    size_t count = min(end - pos, (size_t)VTFS_CSUM_CHUNK);
+    loff_t at = vtfs_cache_slot_offset(pos / VTFS_CSUM_CHUNK);
+    u32 crc;
+
+    // Full chunks have the CRC the backend sent cached; a short one is
+    // only the file's last
+    if (count == VTFS_CSUM_CHUNK && node->size >= pos + count) {
+      vtfs_data_csum(node, pos / VTFS_CSUM_CHUNK, &crc);
+    } else {
+      crc = vtfs_crc32c(node->data + pos, count);
+    }
+    count = vtfs_cache_put_slot(slot, node->data + pos, count, crc);
+    if (kernel_write(cached->file, slot, count, &at) != count) {
+      break;
+    }
+    atomic_long_inc(&cached->cache->stores);
+  }
+  revert_creds(old);
+
+  kfree(slot);
+}
+
+int vtfs_cache_report(struct vtfs_cache* cache, char* buf, size_t size) {
+  return scnprintf(
+      buf,
+      size,
+      "%-8s %s\n%-8s %ld\n%-8s %ld\n%-8s %ld\n",
+      "dir",
+      cache->dir ? cache->dir : "-",
+      "hits",
+      atomic_long_read(&cache->hits),
+      "misses",
+      atomic_long_read(&cache->misses),
+      "stores",
+      atomic_long_read(&cache->stores)
+  );
+}
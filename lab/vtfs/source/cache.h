@@ -0,0 +1,64 @@
+#ifndef VTFS_CACHE_H
+#define VTFS_CACHE_H
+
+#include <linux/cred.h>
+#include <linux/fs.h>
+
+#include "cachefile.h"
+#include "index.h"
+
+// Local disk cache of backend file data, in the format of cachefile.h.
+// Chunks fetched from the backend are written through to it, and a read
+// of a version the cache holds is served from it, so demoted data comes
+// back from disk rather than over the network. Cache files are keyed on
+// the backend's inode number, never the local one, so they cannot be
+// confused with those of another file. A later mount has backend files of
+// its own and does not reuse them. Files in the directory are accessed
+// with the credentials of whoever mounted, whoever happens to read.
+struct vtfs_cache {
+  char* dir;  // NULL while the mount has no cache
+  const struct cred* cred;
+  atomic_long_t hits;    // chunks served from disk
+  atomic_long_t misses;  // loads that stopped at a chunk not on disk
+  atomic_long_t stores;  // chunks written
+};
+
+// The cache file of one version of a backend file, open for one read
+struct vtfs_cache_file {
+  struct vtfs_cache* cache;
+  struct file* file;
+  u64 size;  // of the backend file at that version
+};
+
+// Parses the cache=<dir> mount option; dir must be an absolute path
+int vtfs_cache_init(struct vtfs_cache* cache, const char* dir);
+void vtfs_cache_destroy(struct vtfs_cache* cache);
+
+// Opens the cache file of token's backend inode ino, emptying it unless it
+// holds version. The backend file has size bytes at that version.
+int vtfs_cache_open(
+    struct vtfs_cache* cache,
+    const char* token,
+    u64 ino,
+    u64 version,
+    u64 size,
+    struct vtfs_cache_file* cached
+);
+void vtfs_cache_close(struct vtfs_cache_file* cached);
+
+// Fills the node from offset, a chunk boundary, with up to len bytes from
+// disk, stopping at the first chunk that is missing or does not match its
+// CRC and at the end of the file. Returns the bytes filled.
+size_t vtfs_cache_load(
+    struct vtfs_cache_file* cached, struct vtfs_node* node, size_t offset, size_t len
+);
+// Writes [offset, offset + len) of the node, just filled from the backend,
+// to disk. Failures only cost a later fetch, so they are not reported.
+void vtfs_cache_store(
+    struct vtfs_cache_file* cached, struct vtfs_node* node, size_t offset, size_t len
+);
+
+// Formats the counters into buf, returns the length
+int vtfs_cache_report(struct vtfs_cache* cache, char* buf, size_t size);
+
+#endif  // VTFS_CACHE_H
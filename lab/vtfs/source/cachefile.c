@@ -0,0 +1,77 @@
+#include "cachefile.h"
+
+static void vtfs_cache_put32(char* p, u32 v) {
+  p[0] = (char)v;
+  p[1] = (char)(v >> 8);
+  p[2] = (char)(v >> 16);
+  p[3] = (char)(v >> 24);
+}
+
+static void vtfs_cache_put64(char* p, u64 v) {
+  vtfs_cache_put32(p, (u32)v);
+  vtfs_cache_put32(p + 4, (u32)(v >> 32));
+}
+
+static u64 vtfs_cache_get64(const char* p) {
+  return vtfs_csum_le32(p) | (u64)vtfs_csum_le32(p + 4) << 32;
+}
+
+int vtfs_cache_path(char* buf, size_t size, const char* dir, const char* token, u64 ino) {
+  int len = snprintf(buf, size, "%s/%s.%llu", dir, token, (unsigned long long)ino);
+
+  if (len < 0 || (size_t)len >= size) {
+    return -ENAMETOOLONG;
+  }
+  // Only the token can bring in a separator; the name stays one component
+  for (char* p = buf + strlen(dir) + 1; *p; p++) {
+    if (*p == '/') {
+      *p = '_';
+    }
+  }
+  return 0;
+}
+
+void vtfs_cache_put_header(char* buf, const struct vtfs_cache_header* header) {
+  memset(buf, 0, VTFS_CACHE_HEADER_SIZE);
+  vtfs_cache_put32(buf, VTFS_CACHE_MAGIC);
+  vtfs_cache_put32(buf + 4, VTFS_CACHE_FORMAT);
+  vtfs_cache_put64(buf + 8, header->version);
+  vtfs_cache_put64(buf + 16, header->size);
+}
+
+int vtfs_cache_get_header(const char* buf, struct vtfs_cache_header* header) {
+  if (vtfs_csum_le32(buf) != VTFS_CACHE_MAGIC || vtfs_csum_le32(buf + 4) != VTFS_CACHE_FORMAT) {
+    return -EINVAL;
+  }
+  header->version = vtfs_cache_get64(buf + 8);
+  header->size = vtfs_cache_get64(buf + 16);
+  return 0;
+}
+
+size_t vtfs_cache_put_slot(char* slot, const char* data, size_t len, u32 crc) {
+  vtfs_cache_put32(slot, VTFS_CACHE_MAGIC);
+  vtfs_cache_put32(slot + 4, len);
+  vtfs_cache_put32(slot + 8, crc);
+  vtfs_cache_put32(slot + 12, 0);
+  memcpy(slot + VTFS_CACHE_SLOT_HEADER, data, len);
+  return VTFS_CACHE_SLOT_HEADER + len;
+}
+
+ssize_t vtfs_cache_get_slot(const char* slot, const char** data, u32* crc) {
+  u32 magic = vtfs_csum_le32(slot);
+  u32 len = vtfs_csum_le32(slot + 4);
+
+  if (magic == 0) {
+    return -ENOENT;
+  }
+  if (magic != VTFS_CACHE_MAGIC || len > VTFS_CSUM_CHUNK) {
+    return -EBADMSG;
+  }
+  *data = slot + VTFS_CACHE_SLOT_HEADER;
+  *crc = vtfs_csum_le32(slot + 8);
+  // A write torn between the header and the data shows up here
+  if (vtfs_crc32c(*data, len) != *crc) {
+    return -EBADMSG;
+  }
+  return len;
+}
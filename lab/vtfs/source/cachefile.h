@@ -0,0 +1,52 @@
+#ifndef VTFS_CACHEFILE_H
+#define VTFS_CACHEFILE_H
+
+#include "csum.h"
+
+// On-disk format of the local cache of backend data (cache=<dir>). Each
+// backend file has one cache file in the directory, named after the mount's
+// token and the inode. It is keyed on the backend's data version: a header
+// records the version and size the contents belong to, and a file found
+// holding any other version is emptied before use. Every VTFS_CSUM_CHUNK of
+// data has a fixed slot with its length and CRC-32C in front, so a chunk
+// can be checked on its own and a slot never written reads back as a hole.
+//
+//   header { u32 magic, u32 format, u64 version, u64 size, u64 reserved }
+//   slot i at (i + 1) * VTFS_CACHE_SLOT:
+//          { u32 magic, u32 len, u32 crc32c, u32 reserved, data[len] }
+//
+// all little-endian.
+#define VTFS_CACHE_MAGIC 0x43465456  // "VTFC"
+#define VTFS_CACHE_FORMAT 1
+#define VTFS_CACHE_HEADER_SIZE 32
+#define VTFS_CACHE_SLOT_HEADER 16
+#define VTFS_CACHE_SLOT (VTFS_CACHE_SLOT_HEADER + VTFS_CSUM_CHUNK)
+
+struct vtfs_cache_header {
+  u64 version;
+  u64 size;
+};
+
+// Writes "<dir>/<token>.<ino>" into buf, with any '/' in token replaced.
+// ino is the file's inode number on the backend. Returns -ENAMETOOLONG if
+// it does not fit.
+int vtfs_cache_path(char* buf, size_t size, const char* dir, const char* token, u64 ino);
+
+void vtfs_cache_put_header(char* buf, const struct vtfs_cache_header* header);
+// -EINVAL if buf is not a header of this format
+int vtfs_cache_get_header(const char* buf, struct vtfs_cache_header* header);
+
+// File offset of the slot of the chunk'th VTFS_CSUM_CHUNK
+static inline u64 vtfs_cache_slot_offset(size_t chunk) {
+  return (u64)(chunk + 1) * VTFS_CACHE_SLOT;
+}
+
+// Fills slot with len (at most VTFS_CSUM_CHUNK) bytes of data and their
+// CRC. Returns the bytes of slot to write.
+size_t vtfs_cache_put_slot(char* slot, const char* data, size_t len, u32 crc);
+// Checks a slot read back. Returns the data length with *data pointing into
+// slot and *crc set, -ENOENT for an empty slot or -EBADMSG if it is torn
+// or corrupt.
+ssize_t vtfs_cache_get_slot(const char* slot, const char** data, u32* crc);
+
+#endif  // VTFS_CACHEFILE_H
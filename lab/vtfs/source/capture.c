@@ -0,0 +1,134 @@
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/kfifo.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include "shim.h"
+
+#define CREATE_TRACE_POINTS
+#include "vtfs_trace.h"
+
+// Records that do not fit are dropped and counted, never waited for
+#define VTFS_CAPTURE_SIZE (4 << 20)
+
+static DECLARE_KFIFO_PTR(capture_fifo, unsigned char);
+static DEFINE_SPINLOCK(capture_lock);
+static DECLARE_WAIT_QUEUE_HEAD(capture_wait);
+static atomic_t capture_open = ATOMIC_INIT(0);
+static u64 capture_dropped;
+
+static void vtfs_capture_probe(
+    void* data,
+    u16 op,
+    u64 ino,
+    u64 parent,
+    const char* name,
+    loff_t offset,
+    u64 len,
+    s64 ret,
+    u64 start_ns
+) {
+  static const unsigned char zeros[VTFS_TRACE_ALIGN];
+  u64 now = ktime_get_ns();
+  size_t name_len = name ? min_t(size_t, strlen(name), U16_MAX) : 0;
+  size_t padded = ALIGN(name_len, VTFS_TRACE_ALIGN);
+  struct vtfs_trace_record rec = {
+      // Ops already running when the capture started have no start time
+      .start_ns = start_ns ? start_ns : now,
+      .dur_ns = start_ns ? now - start_ns : 0,
+      .ino = ino,
+      .parent = parent,
+      .offset = offset,
+      .len = len,
+      .ret = ret,
+      .tid = task_pid_nr(current),
+      .op = op,
+      .name_len = name_len,
+  };
+  unsigned long flags;
+
+  spin_lock_irqsave(&capture_lock, flags);
+  if (kfifo_avail(&capture_fifo) < sizeof(rec) + padded) {
+    capture_dropped++;
+  } else {
+    kfifo_in(&capture_fifo, (unsigned char*)&rec, sizeof(rec));
+    kfifo_in(&capture_fifo, (const unsigned char*)name, name_len);
+    kfifo_in(&capture_fifo, zeros, padded - name_len);
+  }
+  spin_unlock_irqrestore(&capture_lock, flags);
+
+  wake_up_interruptible(&capture_wait);
+}
+
+// A single reader owns the capture: ops are only recorded while it is open
+static int vtfs_capture_open(struct inode* inode, struct file* file) {
+  int err;
+
+  if (atomic_cmpxchg(&capture_open, 0, 1) != 0) {
+    return -EBUSY;
+  }
+
+  err = kfifo_alloc(&capture_fifo, VTFS_CAPTURE_SIZE, GFP_KERNEL);
+  if (err) {
+    goto out;
+  }
+  capture_dropped = 0;
+
+  err = register_trace_vtfs_op(vtfs_capture_probe, NULL);
+  if (err) {
+    kfifo_free(&capture_fifo);
+    goto out;
+  }
+  return nonseekable_open(inode, file);
+
+out:
+  atomic_set(&capture_open, 0);
+  return err;
+}
+
+static int vtfs_capture_release(struct inode* inode, struct file* file) {
+  unregister_trace_vtfs_op(vtfs_capture_probe, NULL);
+  tracepoint_synchronize_unregister();
+  kfifo_free(&capture_fifo);
+
+  if (capture_dropped) {
+    LOG("Trace capture dropped %llu records\n", capture_dropped);
+  }
+  atomic_set(&capture_open, 0);
+  return 0;
+}
+
+// Records may be split across reads; the file is a plain byte stream
+static ssize_t vtfs_capture_read(struct file* file, char __user* buf, size_t len, loff_t* ppos) {
+  unsigned int copied;
+  int err;
+
+  if (kfifo_is_empty(&capture_fifo)) {
+    if (file->f_flags & O_NONBLOCK) {
+      return -EAGAIN;
+    }
+    err = wait_event_interruptible(capture_wait, !kfifo_is_empty(&capture_fifo));
+    if (err) {
+      return err;
+    }
+  }
+
+  err = kfifo_to_user(&capture_fifo, buf, len, &copied);
+  return err ? err : copied;
+}
+
+static const struct file_operations vtfs_capture_fops = {
+    .owner = THIS_MODULE,
+    .open = vtfs_capture_open,
+    .release = vtfs_capture_release,
+    .read = vtfs_capture_read,
+    .llseek = no_llseek,
+};
+
+void vtfs_capture_init(struct dentry* debugfs_root) {
+  debugfs_create_file("trace", 0400, debugfs_root, NULL, &vtfs_capture_fops);
+  debugfs_create_u64("trace_dropped", 0400, debugfs_root, &capture_dropped);
+}
@@ -0,0 +1,54 @@
+#ifndef VTFS_CAPTURE_H
+#define VTFS_CAPTURE_H
+
+// Binary VFS op trace, shared with tools/replay.c.
+//
+// Reading /sys/kernel/debug/vtfs/trace attaches a probe to the vtfs_op
+// tracepoint and streams one record per op until the file is closed. Each
+// record is followed by name_len bytes of name, zero-padded to 8 bytes.
+// Fields are in host byte order.
+
+#include <linux/types.h>
+
+enum vtfs_trace_op {
+  VTFS_OP_LOOKUP,
+  VTFS_OP_CREATE,
+  VTFS_OP_MKDIR,
+  VTFS_OP_UNLINK,
+  VTFS_OP_RMDIR,
+  VTFS_OP_LINK,
+  VTFS_OP_ITERATE,
+  VTFS_OP_READ,
+  VTFS_OP_WRITE,
+  VTFS_OP_SYMLINK,
+  VTFS_OP_COUNT,
+};
+
+// ino is the inode operated on (0 for a failed lookup or create); parent
+// and the name are set for namespace ops. For iterate, offset is the
+// starting position and len the number of entries emitted. For symlink, len
+// is the length of the target, which is not recorded.
+struct vtfs_trace_record {
+  __u64 start_ns;
+  __u64 dur_ns;
+  __u64 ino;
+  __u64 parent;
+  __s64 offset;
+  __u64 len;
+  __s64 ret;
+  __u32 tid;
+  __u16 op;
+  __u16 name_len;
+};
+
+#define VTFS_TRACE_ALIGN 8
+
+#ifdef __KERNEL__
+
+struct dentry;
+
+void vtfs_capture_init(struct dentry* debugfs_root);
+
+#endif
+
+#endif  // VTFS_CAPTURE_H
@@ -0,0 +1,113 @@
+#include "csum.h"
+
+#ifdef __KERNEL__
+
+#include <linux/crc32c.h>
+
+u32 vtfs_crc32c(const void* buf, size_t len) {
+  return ~crc32c(~0U, buf, len);
+}
+
+#else  // userspace
+
+// Same answers as the kernel: the SSE4.2 crc32 instruction when the CPU has
+// it, a table otherwise
+#define VTFS_CRC32C_POLY 0x82f63b78U
+
+static u32 crc32c_table[256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_table_init(void) {
+  for (u32 i = 0; i < 256; i++) {
+    u32 crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (crc & 1 ? VTFS_CRC32C_POLY : 0);
+    }
+    crc32c_table[i] = crc;
+  }
+}
+
+static u32 crc32c_sw(u32 crc, const unsigned char* p, size_t len) {
+  pthread_once(&crc32c_table_once, crc32c_table_init);
+  while (len--) {
+    crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static u32 crc32c_hw(u32 crc, const unsigned char* p, size_t len) {
+  uint64_t crc64 = crc;
+  uint64_t word;
+
+  for (; len >= 8; p += 8, len -= 8) {
+    memcpy(&word, p, 8);
+    crc64 = __builtin_ia32_crc32di(crc64, word);
+  }
+  crc = (u32)crc64;
+  while (len--) {
+    crc = __builtin_ia32_crc32qi(crc, *p++);
+  }
+  return crc;
+}
+#endif
+
+u32 vtfs_crc32c(const void* buf, size_t len) {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    return ~crc32c_hw(~0U, buf, len);
+  }
+#endif
+  return ~crc32c_sw(~0U, buf, len);
+}
+
+#endif  // __KERNEL__
+
+void vtfs_csum_hex(const u32* crcs, size_t count, char* hex) {
+  static const char digits[] = "0123456789abcdef";
+
+  for (size_t i = 0; i < count; i++) {
+    for (int shift = 28; shift >= 0; shift -= 4) {
+      *hex++ = digits[(crcs[i] >> shift) & 0xf];
+    }
+  }
+  *hex = '\0';
+}
+
+int vtfs_csum_verify(const char* data, size_t len, const char* crcs) {
+  for (size_t i = 0; i < vtfs_csum_chunks(len); i++) {
+    size_t offset = i * VTFS_CSUM_CHUNK;
+    size_t chunk = min((size_t)VTFS_CSUM_CHUNK, len - offset);
+
+    if (vtfs_crc32c(data + offset, chunk) != vtfs_csum_le32(crcs + i * sizeof(u32))) {
+      return -EBADMSG;
+    }
+  }
+  return 0;
+}
+
+ssize_t vtfs_csum_check_read(
+    const char* payload, size_t size, const char** data, const char** crcs
+) {
+  u32 len;
+  size_t chunks;
+  int err;
+
+  if (size < sizeof(len)) {
+    return -EPROTO;
+  }
+  len = vtfs_csum_le32(payload);
+  chunks = vtfs_csum_chunks(len);
+  if (size - sizeof(len) < len || (size - sizeof(len) - len) / sizeof(u32) < chunks) {
+    return -EPROTO;
+  }
+
+  *data = payload + sizeof(len);
+  *crcs = *data + len;
+  err = vtfs_csum_verify(*data, len, *crcs);
+  if (err) {
+    return err;
+  }
+  return len;
+}
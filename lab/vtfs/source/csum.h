@@ -0,0 +1,46 @@
+#ifndef VTFS_CSUM_H
+#define VTFS_CSUM_H
+
+#include "shim.h"
+
+// End-to-end checksums for file data moving to and from the backend: one
+// CRC-32C per VTFS_CSUM_CHUNK bytes, counted from the start of the transfer
+// (which the client always aligns to a chunk). The kernel uses the crc32c
+// library, which is backed by SSE4.2/PCLMUL where the CPU has them.
+//
+// On the wire (see tools/mockd.c):
+//   write ... &crc32c=<8 hex digits per chunk>  server answers EBADMSG on a
+//                                               mismatch and stores nothing
+//   read  ... &crc32c=1  -> { u32 len, data[len], u32 crc[chunks(len)] }
+#define VTFS_CSUM_CHUNK 4096
+
+// Standard CRC-32C (initial value and final xor ~0), as in iSCSI and ext4
+u32 vtfs_crc32c(const void* buf, size_t len);
+
+static inline size_t vtfs_csum_chunks(size_t len) {
+  return (len + VTFS_CSUM_CHUNK - 1) / VTFS_CSUM_CHUNK;
+}
+
+// The u32s on the wire are little-endian and unaligned
+static inline u32 vtfs_csum_le32(const char* p) {
+  const unsigned char* b = (const unsigned char*)p;
+  return b[0] | b[1] << 8 | b[2] << 16 | (u32)b[3] << 24;
+}
+
+// Formats count CRCs as lowercase hex, 8 digits each, for the write request.
+// hex must hold 8 * count + 1 bytes.
+void vtfs_csum_hex(const u32* crcs, size_t count, char* hex);
+
+// Checks len bytes of data against the wire-format CRCs of its chunks.
+// Returns 0 or -EBADMSG.
+int vtfs_csum_verify(const char* data, size_t len, const char* crcs);
+
+// Checks a read response payload in the format above. On success returns
+// the data length, points *data at it and *crcs at the verified CRCs (read
+// them with vtfs_csum_le32). -EBADMSG if a chunk does not match,
+// -EPROTO if the payload is malformed.
+ssize_t vtfs_csum_check_read(
+    const char* payload, size_t size, const char** data, const char** crcs
+);
+
+#endif  // VTFS_CSUM_H
@@ -0,0 +1,248 @@
+#include "data.h"
+
+ssize_t vtfs_data_read(struct vtfs_node* node, char __user* buf, size_t len, loff_t* ppos) {
+  size_t to_copy;
+
+  if (!node->data || *ppos < 0 || (size_t)*ppos >= node->size) {
+    return 0;
+  }
+
+  to_copy = min(len, node->size - (size_t)*ppos);
+  if (copy_to_user(buf, node->data + *ppos, to_copy)) {
+    return -EFAULT;
+  }
+
+  *ppos += to_copy;
+  return to_copy;
+}
+
+// A demoted file's bytes are only on the backend until it is restored and
+// fetched; there is nothing here to write over, extend or cut
+static bool vtfs_data_demoted(const struct vtfs_node* node) {
+  return !node->data && node->size;
+}
+
+// Zero-extends the file to new_size if it is shorter
+static int vtfs_data_grow(struct vtfs_node* node, size_t new_size) {
+  char* new_data;
+
+  if (vtfs_data_demoted(node)) {
+    return -EIO;
+  }
+  if (new_size <= node->size) {
+    return 0;
+  }
+
+  new_data = vtfs_mem_kvrealloc(node->mem, node->data, node->size, new_size, GFP_KERNEL);
+  if (!new_data) {
+    return -ENOMEM;
+  }
+
+  memset(new_data + node->size, 0, new_size - node->size);
+  if (node->size) {
+    vtfs_mem_charge(node->mem, VTFS_MEM_DATA, node->size, -1);
+  }
+  vtfs_mem_charge(node->mem, VTFS_MEM_DATA, new_size, 1);
+  node->data = new_data;
+  node->size = new_size;
+  return 0;
+}
+
+static size_t vtfs_csums_size(size_t count) {
+  return sizeof(struct vtfs_csums) + count * sizeof(u64);
+}
+
+// Drops the cached CRCs of every chunk that overlaps [start, end)
+static void vtfs_csums_invalidate(struct vtfs_node* node, size_t start, size_t end) {
+  struct vtfs_csums* csums = node->csums;
+  size_t last;
+
+  if (!csums || start >= end) {
+    return;
+  }
+  last = min(vtfs_csum_chunks(end), csums->count);
+  for (size_t i = start / VTFS_CSUM_CHUNK; i < last; i++) {
+    csums->chunk[i] = 0;
+  }
+}
+
+// Makes room for count entries; the new ones start out invalid
+static int vtfs_csums_reserve(struct vtfs_node* node, size_t count) {
+  struct vtfs_csums* csums = node->csums;
+  size_t old_count = csums ? csums->count : 0;
+  size_t old_size = csums ? vtfs_csums_size(old_count) : 0;
+
+  if (count <= old_count) {
+    return 0;
+  }
+
+  csums = vtfs_mem_krealloc(node->mem, csums, old_size, vtfs_csums_size(count), GFP_KERNEL);
+  if (!csums) {
+    return -ENOMEM;
+  }
+  memset(csums->chunk + old_count, 0, (count - old_count) * sizeof(u64));
+  if (old_size) {
+    vtfs_mem_charge(node->mem, VTFS_MEM_META, old_size, -1);
+  }
+  vtfs_mem_charge(node->mem, VTFS_MEM_META, vtfs_csums_size(count), 1);
+  csums->count = count;
+  node->csums = csums;
+  return 0;
+}
+
+static void vtfs_csums_free(struct vtfs_node* node) {
+  size_t size;
+
+  if (!node->csums) {
+    return;
+  }
+  size = vtfs_csums_size(node->csums->count);
+  vtfs_mem_charge(node->mem, VTFS_MEM_META, size, -1);
+  vtfs_mem_kfree(node->mem, node->csums, size);
+  node->csums = NULL;
+}
+
+ssize_t vtfs_data_write(struct vtfs_node* node, const char __user* buf, size_t len, loff_t* ppos) {
+  int err;
+
+  if (*ppos < 0) {
+    return -EINVAL;
+  }
+
+  err = vtfs_data_grow(node, (size_t)*ppos + len);
+  if (err) {
+    return err;
+  }
+
+  vtfs_csums_invalidate(node, *ppos, *ppos + len);
+  if (copy_from_user(node->data + *ppos, buf, len)) {
+    return -EFAULT;
+  }
+
+  *ppos += len;
+  return len;
+}
+
+int vtfs_data_truncate(struct vtfs_node* node, size_t size) {
+  char* new_data;
+
+  if (size == node->size) {
+    return 0;
+  }
+  if (size == 0) {
+    vtfs_data_free(node);
+    return 0;
+  }
+  if (vtfs_data_demoted(node)) {
+    return -EIO;
+  }
+  // The chunk holding the old or the new end changes either way
+  vtfs_csums_invalidate(node, min(size, node->size), max(size, node->size));
+
+  new_data = vtfs_mem_kvrealloc(node->mem, node->data, node->size, size, GFP_KERNEL);
+  if (!new_data) {
+    return -ENOMEM;
+  }
+  if (size > node->size) {
+    memset(new_data + node->size, 0, size - node->size);
+  }
+  if (node->size) {
+    vtfs_mem_charge(node->mem, VTFS_MEM_DATA, node->size, -1);
+  }
+  vtfs_mem_charge(node->mem, VTFS_MEM_DATA, size, 1);
+  node->data = new_data;
+  node->size = size;
+  return 0;
+}
+
+int vtfs_data_csum(struct vtfs_node* node, size_t chunk, u32* crc) {
+  size_t offset = chunk * VTFS_CSUM_CHUNK;
+  struct vtfs_csums* csums = node->csums;
+
+  if (offset >= node->size) {
+    return -EINVAL;
+  }
+  if (csums && chunk < csums->count && csums->chunk[chunk] & VTFS_CSUM_VALID) {
+    *crc = (u32)csums->chunk[chunk];
+    return 0;
+  }
+
+  *crc = vtfs_crc32c(node->data + offset, min((size_t)VTFS_CSUM_CHUNK, node->size - offset));
+  // Without room to cache it the CRC is simply computed again next time
+  if (!vtfs_csums_reserve(node, vtfs_csum_chunks(node->size))) {
+    node->csums->chunk[chunk] = *crc | VTFS_CSUM_VALID;
+  }
+  return 0;
+}
+
+int vtfs_data_reserve(struct vtfs_node* node, size_t offset, size_t len, char** dst) {
+  int err;
+
+  if (offset % VTFS_CSUM_CHUNK) {
+    return -EINVAL;
+  }
+  err = vtfs_data_grow(node, offset + len);
+  if (err) {
+    return err;
+  }
+  vtfs_csums_invalidate(node, offset, offset + len);
+  *dst = node->data + offset;
+  return 0;
+}
+
+void vtfs_data_filled(struct vtfs_node* node, size_t offset, size_t len, const char* crcs) {
+  size_t end = offset + len;
+
+  if (vtfs_csums_reserve(node, vtfs_csum_chunks(node->size))) {
+    return;
+  }
+  for (size_t i = 0; i < vtfs_csum_chunks(len); i++) {
+    // A short last chunk only matches the file's if the file ends there too
+    if (offset + (i + 1) * VTFS_CSUM_CHUNK <= end || end == node->size) {
+      node->csums->chunk[offset / VTFS_CSUM_CHUNK + i] =
+          vtfs_csum_le32(crcs + i * sizeof(u32)) | VTFS_CSUM_VALID;
+    }
+  }
+}
+
+int vtfs_data_fill(
+    struct vtfs_node* node, size_t offset, const char* buf, size_t len, const char* crcs
+) {
+  char* dst;
+  int err;
+
+  err = vtfs_data_reserve(node, offset, len, &dst);
+  if (err) {
+    return err;
+  }
+  memcpy(dst, buf, len);
+  vtfs_data_filled(node, offset, len, crcs);
+  return 0;
+}
+
+void vtfs_data_demote(struct vtfs_node* node) {
+  if (!node->data) {
+    return;
+  }
+  vtfs_mem_charge(node->mem, VTFS_MEM_DATA, node->size, -1);
+  vtfs_mem_kvfree(node->mem, node->data, node->size);
+  node->data = NULL;
+}
+
+int vtfs_data_restore(struct vtfs_node* node) {
+  if (node->data || !node->size) {
+    return 0;
+  }
+  node->data = vtfs_mem_kvzalloc(node->mem, node->size, GFP_KERNEL);
+  if (!node->data) {
+    return -ENOMEM;
+  }
+  vtfs_mem_charge(node->mem, VTFS_MEM_DATA, node->size, 1);
+  return 0;
+}
+
+void vtfs_data_free(struct vtfs_node* node) {
+  vtfs_csums_free(node);
+  vtfs_data_demote(node);
+  node->size = 0;
+}
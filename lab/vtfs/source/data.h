@@ -0,0 +1,57 @@
+#ifndef VTFS_DATA_H
+#define VTFS_DATA_H
+
+#include "csum.h"
+#include "index.h"
+
+// Per-file cache of the CRC-32C of each VTFS_CSUM_CHUNK of the contents, so
+// the checksums sent with a hot file are computed once. Writes and truncation
+// drop the entries they touch; data read back from the backend comes with
+// CRCs it was just verified against, which are kept as they are. Same
+// locking as the data itself.
+#define VTFS_CSUM_VALID (1ULL << 32)
+
+struct vtfs_csums {
+  size_t count;
+  u64 chunk[];  // crc | VTFS_CSUM_VALID, or 0
+};
+
+// Copies up to len bytes at *ppos to buf and advances *ppos.
+// Returns the number of bytes copied, 0 at or past EOF.
+ssize_t vtfs_data_read(struct vtfs_node* node, char __user* buf, size_t len, loff_t* ppos);
+
+// Copies len bytes from buf to *ppos, growing the file (zero-filled) as needed.
+ssize_t vtfs_data_write(struct vtfs_node* node, const char __user* buf, size_t len, loff_t* ppos);
+
+// Shrinks or zero-extends the file to size bytes
+int vtfs_data_truncate(struct vtfs_node* node, size_t size);
+
+// CRC of the chunk'th VTFS_CSUM_CHUNK of the file, cached after the first call.
+// -EINVAL if the chunk starts at or past EOF.
+int vtfs_data_csum(struct vtfs_node* node, size_t chunk, u32* crc);
+
+// Stores len bytes from a kernel buffer at offset, a chunk boundary, growing
+// the file as needed, and caches crcs (wire format, one per chunk of buf) as
+// the CRCs of the chunks it covers
+int vtfs_data_fill(
+    struct vtfs_node* node, size_t offset, const char* buf, size_t len, const char* crcs
+);
+
+// vtfs_data_fill() in two steps, for data received straight into the file:
+// reserve grows the file to cover [offset, offset + len), drops the cached
+// CRCs there and points *dst at where the bytes go; filled then caches crcs
+// once they are verified against what landed there.
+int vtfs_data_reserve(struct vtfs_node* node, size_t offset, size_t len, char** dst);
+void vtfs_data_filled(struct vtfs_node* node, size_t offset, size_t len, const char* crcs);
+
+// Demotion (see heat.h): frees the contents but keeps the size and the
+// CRCs, which still describe the backend's copy. Restoring allocates the
+// size zero-filled again, for the chunks to be fetched into. Until then,
+// writing, reserving or truncating to anything but 0 fails with -EIO.
+void vtfs_data_demote(struct vtfs_node* node);
+int vtfs_data_restore(struct vtfs_node* node);
+
+// Frees the contents and the checksum cache
+void vtfs_data_free(struct vtfs_node* node);
+
+#endif  // VTFS_DATA_H
@@ -0,0 +1,371 @@
+#include "delta.h"
+
+#ifdef __KERNEL__
+#include <linux/xxhash.h>
+#endif
+
+#define VTFS_DELTA_NONE ((u32)-1)
+
+u32 vtfs_delta_weak(const char* buf, size_t len) {
+  const unsigned char* p = (const unsigned char*)buf;
+  u32 a = 0;
+  u32 b = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    a += p[i];
+    b += a;
+  }
+  return (a & 0xffff) | b << 16;
+}
+
+#ifdef __KERNEL__
+
+u64 vtfs_delta_strong(const char* buf, size_t len) {
+  return xxh64(buf, len, 0);
+}
+
+#else  // userspace
+
+// Reference xxh64, so signatures match the kernel's lib/xxhash
+#define XXH_PRIME64_1 0x9e3779b185ebca87ULL
+#define XXH_PRIME64_2 0xc2b2ae3d27d4eb4fULL
+#define XXH_PRIME64_3 0x165667b19e3779f9ULL
+#define XXH_PRIME64_4 0x85ebca77c2b2ae63ULL
+#define XXH_PRIME64_5 0x27d4eb2f165667c5ULL
+
+static u64 xxh_rotl64(u64 x, int r) {
+  return x << r | x >> (64 - r);
+}
+
+static u64 xxh_read64(const unsigned char* p) {
+  u64 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static u32 xxh_read32(const unsigned char* p) {
+  u32 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static u64 xxh64_round(u64 acc, u64 input) {
+  acc += input * XXH_PRIME64_2;
+  return xxh_rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+static u64 xxh64_merge_round(u64 acc, u64 val) {
+  acc ^= xxh64_round(0, val);
+  return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+u64 vtfs_delta_strong(const char* buf, size_t len) {
+  const unsigned char* p = (const unsigned char*)buf;
+  const unsigned char* end = p + len;
+  u64 h;
+
+  if (len >= 32) {
+    u64 v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+    u64 v2 = XXH_PRIME64_2;
+    u64 v3 = 0;
+    u64 v4 = -XXH_PRIME64_1;
+
+    for (; p + 32 <= end; p += 32) {
+      v1 = xxh64_round(v1, xxh_read64(p));
+      v2 = xxh64_round(v2, xxh_read64(p + 8));
+      v3 = xxh64_round(v3, xxh_read64(p + 16));
+      v4 = xxh64_round(v4, xxh_read64(p + 24));
+    }
+    h = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+    h = xxh64_merge_round(h, v1);
+    h = xxh64_merge_round(h, v2);
+    h = xxh64_merge_round(h, v3);
+    h = xxh64_merge_round(h, v4);
+  } else {
+    h = XXH_PRIME64_5;
+  }
+  h += len;
+
+  for (; p + 8 <= end; p += 8) {
+    h ^= xxh64_round(0, xxh_read64(p));
+    h = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+  }
+  if (p + 4 <= end) {
+    h ^= (u64)xxh_read32(p) * XXH_PRIME64_1;
+    h = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= *p * XXH_PRIME64_5;
+    h = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+#endif  // __KERNEL__
+
+void vtfs_delta_signature(const char* buf, size_t len, struct vtfs_delta_sig* sigs) {
+  for (size_t i = 0; i < vtfs_delta_blocks(len); i++) {
+    size_t offset = i * VTFS_DELTA_BLOCK;
+    size_t block = min((size_t)VTFS_DELTA_BLOCK, len - offset);
+
+    sigs[i].weak = vtfs_delta_weak(buf + offset, block);
+    sigs[i].strong = vtfs_delta_strong(buf + offset, block);
+  }
+}
+
+static u32 vtfs_delta_le32(const char* p) {
+  const unsigned char* b = (const unsigned char*)p;
+  return b[0] | b[1] << 8 | b[2] << 16 | (u32)b[3] << 24;
+}
+
+static u64 vtfs_delta_le64(const char* p) {
+  return vtfs_delta_le32(p) | (u64)vtfs_delta_le32(p + 4) << 32;
+}
+
+int vtfs_delta_parse_signature(
+    const char* payload, size_t size, u64* old_size, struct vtfs_delta_sig** sigs, size_t* count
+) {
+  const char* p = payload + VTFS_DELTA_SIG_HEADER;
+
+  if (size < VTFS_DELTA_SIG_HEADER) {
+    return -EPROTO;
+  }
+  *old_size = vtfs_delta_le64(payload);
+  *count = vtfs_delta_le32(payload + 12);
+  if (vtfs_delta_le32(payload + 8) != VTFS_DELTA_BLOCK || *count != vtfs_delta_blocks(*old_size) ||
+      (size - VTFS_DELTA_SIG_HEADER) / VTFS_DELTA_SIG_SIZE < *count) {
+    return -EPROTO;
+  }
+
+  *sigs = kvmalloc_array(*count ? *count : 1, sizeof(**sigs), GFP_KERNEL);
+  if (!*sigs) {
+    return -ENOMEM;
+  }
+  for (size_t i = 0; i < *count; i++, p += VTFS_DELTA_SIG_SIZE) {
+    (*sigs)[i].weak = vtfs_delta_le32(p);
+    (*sigs)[i].strong = vtfs_delta_le64(p + 4);
+  }
+  return 0;
+}
+
+// Chained hash of the old file's full blocks by weak hash
+struct vtfs_delta_index {
+  u32* heads;
+  u32* next;
+  u32 mask;
+};
+
+static u32 vtfs_delta_bucket(const struct vtfs_delta_index* index, u32 weak) {
+  return (weak * 0x9e3779b1U) >> 8 & index->mask;
+}
+
+static int vtfs_delta_index_build(
+    struct vtfs_delta_index* index, const struct vtfs_delta_sig* sigs, size_t full
+) {
+  u32 buckets = 16;
+
+  while (buckets < full) {
+    buckets <<= 1;
+  }
+  index->mask = buckets - 1;
+  index->heads = kvmalloc_array(buckets, sizeof(u32), GFP_KERNEL);
+  index->next = kvmalloc_array(full ? full : 1, sizeof(u32), GFP_KERNEL);
+  if (!index->heads || !index->next) {
+    kvfree(index->heads);
+    kvfree(index->next);
+    return -ENOMEM;
+  }
+  memset(index->heads, 0xff, buckets * sizeof(u32));
+
+  // Inserted back to front so chains list the earliest block first
+  for (size_t i = full; i-- > 0;) {
+    u32 bucket = vtfs_delta_bucket(index, sigs[i].weak);
+    index->next[i] = index->heads[bucket];
+    index->heads[bucket] = i;
+  }
+  return 0;
+}
+
+static u32 vtfs_delta_index_find(
+    const struct vtfs_delta_index* index,
+    const struct vtfs_delta_sig* sigs,
+    u32 weak,
+    const char* block
+) {
+  u64 strong = 0;
+  bool hashed = false;
+
+  for (u32 i = index->heads[vtfs_delta_bucket(index, weak)]; i != VTFS_DELTA_NONE;
+       i = index->next[i]) {
+    if (sigs[i].weak != weak) {
+      continue;
+    }
+    if (!hashed) {
+      strong = vtfs_delta_strong(block, VTFS_DELTA_BLOCK);
+      hashed = true;
+    }
+    if (sigs[i].strong == strong) {
+      return i;
+    }
+  }
+  return VTFS_DELTA_NONE;
+}
+
+struct vtfs_delta_out {
+  char* buf;
+  size_t len;
+  u32 copy_first;  // pending copy op, merged with the blocks that follow it
+  u32 copy_count;
+};
+
+static void vtfs_delta_put32(struct vtfs_delta_out* out, u32 v) {
+  for (int i = 0; i < 4; i++) {
+    out->buf[out->len++] = (char)(v >> (8 * i));
+  }
+}
+
+static void vtfs_delta_flush_copy(struct vtfs_delta_out* out) {
+  if (out->copy_count) {
+    out->buf[out->len++] = 'C';
+    vtfs_delta_put32(out, out->copy_first);
+    vtfs_delta_put32(out, out->copy_count);
+    out->copy_count = 0;
+  }
+}
+
+static void vtfs_delta_copy(struct vtfs_delta_out* out, u32 block) {
+  if (out->copy_count && out->copy_first + out->copy_count == block) {
+    out->copy_count++;
+    return;
+  }
+  vtfs_delta_flush_copy(out);
+  out->copy_first = block;
+  out->copy_count = 1;
+}
+
+static void vtfs_delta_literal(struct vtfs_delta_out* out, const char* data, size_t len) {
+  if (!len) {
+    return;
+  }
+  vtfs_delta_flush_copy(out);
+  out->buf[out->len++] = 'L';
+  vtfs_delta_put32(out, len);
+  memcpy(out->buf + out->len, data, len);
+  out->len += len;
+}
+
+ssize_t vtfs_delta_encode(
+    const struct vtfs_delta_sig* sigs,
+    size_t count,
+    u64 old_size,
+    const char* data,
+    size_t len,
+    char** delta
+) {
+  size_t full = old_size / VTFS_DELTA_BLOCK;
+  size_t tail = old_size % VTFS_DELTA_BLOCK;
+  struct vtfs_delta_index index;
+  struct vtfs_delta_out out = {};
+  size_t literal = 0;
+  size_t pos = 0;
+  u32 weak = 0;
+
+  if (count != vtfs_delta_blocks(old_size) || len > U32_MAX) {
+    return -EINVAL;
+  }
+  // Every copy op covers at least one block and at most one literal op
+  // sits between two copies
+  out.buf = kvmalloc(len + 14 * (len / VTFS_DELTA_BLOCK + 2), GFP_KERNEL);
+  if (!out.buf) {
+    return -ENOMEM;
+  }
+  if (vtfs_delta_index_build(&index, sigs, full)) {
+    kvfree(out.buf);
+    return -ENOMEM;
+  }
+
+  if (full && len >= VTFS_DELTA_BLOCK) {
+    weak = vtfs_delta_weak(data, VTFS_DELTA_BLOCK);
+  }
+  while (full && pos + VTFS_DELTA_BLOCK <= len) {
+    u32 block = vtfs_delta_index_find(&index, sigs, weak, data + pos);
+
+    if (block != VTFS_DELTA_NONE) {
+      vtfs_delta_literal(&out, data + literal, pos - literal);
+      vtfs_delta_copy(&out, block);
+      pos += VTFS_DELTA_BLOCK;
+      literal = pos;
+      if (pos + VTFS_DELTA_BLOCK <= len) {
+        weak = vtfs_delta_weak(data + pos, VTFS_DELTA_BLOCK);
+      }
+      continue;
+    }
+    if (pos + VTFS_DELTA_BLOCK < len) {
+      weak = vtfs_delta_roll(weak, data[pos], data[pos + VTFS_DELTA_BLOCK], VTFS_DELTA_BLOCK);
+    }
+    pos++;
+  }
+
+  // The old file's short last block can only match the new file's end
+  if (tail && len - literal >= tail) {
+    const char* end = data + len - tail;
+    if (sigs[count - 1].weak == vtfs_delta_weak(end, tail) &&
+        sigs[count - 1].strong == vtfs_delta_strong(end, tail)) {
+      vtfs_delta_literal(&out, data + literal, end - (data + literal));
+      vtfs_delta_copy(&out, count - 1);
+      literal = len;
+    }
+  }
+  vtfs_delta_literal(&out, data + literal, len - literal);
+  vtfs_delta_flush_copy(&out);
+
+  kvfree(index.heads);
+  kvfree(index.next);
+  *delta = out.buf;
+  return out.len;
+}
+
+int vtfs_delta_apply(
+    const char* old, size_t old_len, const char* delta, size_t delta_len, char* out, size_t out_len
+) {
+  size_t pos = 0;
+  size_t written = 0;
+
+  while (pos < delta_len) {
+    char op = delta[pos];
+    u64 offset;
+    u64 len;
+
+    if (op == 'C' && delta_len - pos >= 9) {
+      offset = (u64)vtfs_delta_le32(delta + pos + 1) * VTFS_DELTA_BLOCK;
+      len = (u64)vtfs_delta_le32(delta + pos + 5) * VTFS_DELTA_BLOCK;
+      if (!len || offset >= old_len || offset + len - VTFS_DELTA_BLOCK >= old_len) {
+        return -EPROTO;
+      }
+      len = min(len, old_len - offset);
+      if (len > out_len - written) {
+        return -EPROTO;
+      }
+      memcpy(out + written, old + offset, len);
+      pos += 9;
+    } else if (op == 'L' && delta_len - pos >= 5) {
+      len = vtfs_delta_le32(delta + pos + 1);
+      if (len > delta_len - pos - 5 || len > out_len - written) {
+        return -EPROTO;
+      }
+      memcpy(out + written, delta + pos + 5, len);
+      pos += 5 + len;
+    } else {
+      return -EPROTO;
+    }
+    written += len;
+  }
+  return written == out_len ? 0 : -EPROTO;
+}
@@ -0,0 +1,75 @@
+#ifndef VTFS_DELTA_H
+#define VTFS_DELTA_H
+
+#include "shim.h"
+
+// Delta transfer of a rewritten file, rsync style with the roles swapped:
+// the backend holds the old contents and sends a signature of them, the
+// client slides a rolling weak hash over the new contents, confirms each
+// weak match with a strong hash and sends copy instructions for the blocks
+// the backend already has and literal bytes for everything else.
+//
+// On the wire (little-endian, see tools/mockd.c):
+//   signature inode -> { u64 size, u32 block, u32 count, { u32 weak, u64 strong }* }
+//   patch     inode, size, delta, crc32c
+// where delta is a sequence of ops:
+//   'C' u32 first, u32 count  copy count blocks of the old file from first
+//   'L' u32 len, bytes        literal bytes
+// and crc32c is the CRC-32C of the whole new file (8 hex digits). The
+// backend refuses a patch whose result does not match it with EBADMSG, which
+// also catches a file that changed after its signature was taken.
+#define VTFS_DELTA_BLOCK 4096
+#define VTFS_DELTA_SIG_HEADER 16
+#define VTFS_DELTA_SIG_SIZE 12
+
+struct vtfs_delta_sig {
+  u32 weak;
+  u64 strong;
+};
+
+// Adler-style checksum of len bytes: the sum of the bytes in the low 16 bits,
+// the sum of the running sums above. It can be rolled one byte at a time.
+u32 vtfs_delta_weak(const char* buf, size_t len);
+
+static inline u32 vtfs_delta_roll(u32 weak, unsigned char out, unsigned char in, size_t len) {
+  u32 a = (weak & 0xffff) - out + in;
+  u32 b = (weak >> 16) - (u32)(len * out) + a;
+  return (a & 0xffff) | b << 16;
+}
+
+// xxh64 with seed 0
+u64 vtfs_delta_strong(const char* buf, size_t len);
+
+static inline size_t vtfs_delta_blocks(size_t len) {
+  return (len + VTFS_DELTA_BLOCK - 1) / VTFS_DELTA_BLOCK;
+}
+
+// Signature of every VTFS_DELTA_BLOCK of buf, the last one possibly short.
+// sigs must hold vtfs_delta_blocks(len) entries.
+void vtfs_delta_signature(const char* buf, size_t len, struct vtfs_delta_sig* sigs);
+
+// Parses a signature response. On success *sigs points to a kvmalloc'd
+// array of *count entries, the caller frees it with kvfree().
+int vtfs_delta_parse_signature(
+    const char* payload, size_t size, u64* old_size, struct vtfs_delta_sig** sigs, size_t* count
+);
+
+// Delta turning the file described by sigs (old_size bytes) into data.
+// Returns its length and a kvmalloc'd buffer in *delta, or -ENOMEM.
+ssize_t vtfs_delta_encode(
+    const struct vtfs_delta_sig* sigs,
+    size_t count,
+    u64 old_size,
+    const char* data,
+    size_t len,
+    char** delta
+);
+
+// Rebuilds the new file into out, which must hold exactly out_len bytes.
+// -EPROTO if the delta is malformed, refers past old or does not produce
+// out_len bytes.
+int vtfs_delta_apply(
+    const char* old, size_t old_len, const char* delta, size_t delta_len, char* out, size_t out_len
+);
+
+#endif  // VTFS_DELTA_H
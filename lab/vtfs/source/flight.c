@@ -0,0 +1,163 @@
+#include "flight.h"
+
+#include <linux/completion.h>
+#include <linux/jhash.h>
+#include <linux/refcount.h>
+#include <linux/slab.h>
+
+struct vtfs_flight {
+  struct hlist_node node;  // in the table until its call returns
+  u32 hash;
+  char* key;
+  size_t key_len;
+  refcount_t refs;  // the caller making the call and every waiter
+  unsigned int waiters;
+  struct completion done;
+  int64_t result;
+  char* response;  // a copy for the waiters, if there are any
+};
+
+void vtfs_flight_init(struct vtfs_flight_table* table) {
+  spin_lock_init(&table->lock);
+  hash_init(table->flights);
+  table->calls = 0;
+  table->shared = 0;
+}
+
+// op, response_size and every (key, value) pair, length-prefixed so that
+// no two different calls serialise the same
+static char* vtfs_flight_key(
+    unsigned int op, const struct vtfs_arg* args, size_t nargs, size_t response_size, size_t* len
+) {
+  size_t size = sizeof(op) + sizeof(response_size);
+  char* key;
+  char* p;
+
+  for (size_t i = 0; i < nargs; i++) {
+    size += 2 * sizeof(size_t) + strlen(args[i].key) + args[i].len;
+  }
+  key = kvmalloc(size, GFP_KERNEL);
+  if (!key) {
+    return NULL;
+  }
+
+  p = key;
+  memcpy(p, &op, sizeof(op));
+  p += sizeof(op);
+  memcpy(p, &response_size, sizeof(response_size));
+  p += sizeof(response_size);
+  for (size_t i = 0; i < nargs; i++) {
+    size_t key_len = strlen(args[i].key);
+
+    memcpy(p, &key_len, sizeof(key_len));
+    memcpy(p + sizeof(key_len), &args[i].len, sizeof(args[i].len));
+    p += 2 * sizeof(size_t);
+    memcpy(p, args[i].key, key_len);
+    memcpy(p + key_len, args[i].value, args[i].len);
+    p += key_len + args[i].len;
+  }
+  *len = size;
+  return key;
+}
+
+static struct vtfs_flight* vtfs_flight_find(
+    struct vtfs_flight_table* table, u32 hash, const char* key, size_t key_len
+) {
+  struct vtfs_flight* flight;
+
+  hash_for_each_possible(table->flights, flight, node, hash) {
+    if (flight->hash == hash && flight->key_len == key_len &&
+        memcmp(flight->key, key, key_len) == 0) {
+      return flight;
+    }
+  }
+  return NULL;
+}
+
+static void vtfs_flight_put(struct vtfs_flight* flight) {
+  if (refcount_dec_and_test(&flight->refs)) {
+    kvfree(flight->response);
+    kvfree(flight->key);
+    kfree(flight);
+  }
+}
+
+int64_t vtfs_flight_do(
+    struct vtfs_flight_table* table,
+    unsigned int op,
+    const struct vtfs_arg* args,
+    size_t nargs,
+    char* response,
+    size_t response_size,
+    vtfs_flight_fn fn,
+    void* ctx
+) {
+  struct vtfs_flight* flight;
+  struct vtfs_flight* found;
+  unsigned int waiters;
+  int64_t result;
+  size_t key_len;
+  char* key;
+
+  key = vtfs_flight_key(op, args, nargs, response_size, &key_len);
+  flight = kzalloc(sizeof(*flight), GFP_KERNEL);
+  if (!key || !flight) {
+    // Coalescing is an optimisation; the call itself can still go ahead
+    kvfree(key);
+    kfree(flight);
+    return fn(ctx, response, response_size);
+  }
+  flight->hash = jhash(key, key_len, 0);
+  flight->key = key;
+  flight->key_len = key_len;
+  refcount_set(&flight->refs, 1);
+  init_completion(&flight->done);
+
+  spin_lock(&table->lock);
+  found = vtfs_flight_find(table, flight->hash, key, key_len);
+  if (found) {
+    refcount_inc(&found->refs);
+    found->waiters++;
+    table->shared++;
+  } else {
+    hash_add(table->flights, &flight->node, flight->hash);
+    table->calls++;
+  }
+  spin_unlock(&table->lock);
+
+  if (found) {
+    vtfs_flight_put(flight);
+    if (wait_for_completion_killable(&found->done)) {
+      vtfs_flight_put(found);
+      return -EINTR;
+    }
+    result = found->result;
+    if (found->response) {
+      memcpy(response, found->response, response_size);
+    } else if (result == 0) {
+      // Not enough memory to hand the response on: fetch it after all
+      result = fn(ctx, response, response_size);
+    }
+    vtfs_flight_put(found);
+    return result;
+  }
+
+  result = fn(ctx, response, response_size);
+
+  // Off the table first, so the waiter count below is final
+  spin_lock(&table->lock);
+  hash_del(&flight->node);
+  waiters = flight->waiters;
+  spin_unlock(&table->lock);
+
+  flight->result = result;
+  if (waiters) {
+    flight->response = kvmalloc(response_size, GFP_KERNEL);
+    if (flight->response) {
+      memcpy(flight->response, response, response_size);
+    }
+  }
+  complete_all(&flight->done);
+  vtfs_flight_put(flight);
+  return result;
+}
@@ -0,0 +1,42 @@
+#ifndef VTFS_FLIGHT_H
+#define VTFS_FLIGHT_H
+
+#include <linux/hashtable.h>
+#include <linux/spinlock.h>
+
+#include "proto.h"
+
+// Single-flight coalescing of identical backend calls. A call whose key
+// matches one already in flight does not go to the backend: it waits for
+// that call and gets a copy of its result and response. Only calls that
+// overlap in time are joined, so a caller never sees a result from before
+// it asked; callers that must not share (writes) simply do not use this.
+#define VTFS_FLIGHT_HASH_BITS 6
+
+struct vtfs_flight_table {
+  spinlock_t lock;
+  DECLARE_HASHTABLE(flights, VTFS_FLIGHT_HASH_BITS);
+  u64 calls;   // went to the backend
+  u64 shared;  // joined one that did
+};
+
+// Makes the backend call for vtfs_flight_do()
+typedef int64_t (*vtfs_flight_fn)(void* ctx, char* response, size_t response_size);
+
+void vtfs_flight_init(struct vtfs_flight_table* table);
+
+// Runs fn(ctx, response, response_size) unless an identical call (same op,
+// args and response_size) is in flight, in which case it waits for that one.
+// Returns fn's result either way, or -EINTR if killed while waiting.
+int64_t vtfs_flight_do(
+    struct vtfs_flight_table* table,
+    unsigned int op,
+    const struct vtfs_arg* args,
+    size_t nargs,
+    char* response,
+    size_t response_size,
+    vtfs_flight_fn fn,
+    void* ctx
+);
+
+#endif  // VTFS_FLIGHT_H
@@ -0,0 +1,316 @@
+#include "heat.h"
+
+#define VTFS_HEAT_TICK_BITS 24
+#define VTFS_HEAT_TICK_MASK ((1U << VTFS_HEAT_TICK_BITS) - 1)
+
+void vtfs_heat_init(struct vtfs_heat_table* table, size_t budget) {
+  memset(table, 0, sizeof(*table));
+  table->budget = budget;
+  table->seed = 0x9e3779b9;
+  INIT_LIST_HEAD(&table->nodes);
+}
+
+// xorshift32: the coin flips only need to be cheap, not unpredictable
+static u32 vtfs_heat_random(u32* seed) {
+  u32 x = *seed;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return x;
+}
+
+static u32 vtfs_heat_cell(u64 now, u32 flags, unsigned int level) {
+  return ((u32)now & VTFS_HEAT_TICK_MASK) << 8 | flags | level;
+}
+
+unsigned int vtfs_heat_level(u32 cell, u64 now) {
+  // Ticks wrap every 2^24; an idle time that wrapped only decays too little
+  u32 idle = ((u32)now - (cell >> 8)) & VTFS_HEAT_TICK_MASK;
+  unsigned int level = cell & VTFS_HEAT_COUNTER;
+  u32 steps = idle / VTFS_HEAT_DECAY;
+
+  return steps >= level ? 0 : level - steps;
+}
+
+u32 vtfs_heat_touch(u32 cell, u64 now, u32* seed) {
+  unsigned int level = vtfs_heat_level(cell, now);
+
+  // Bumps with probability 1 / ((level - INIT) * LOG_FACTOR + 1), so each
+  // step above VTFS_HEAT_INIT takes about LOG_FACTOR times the level more
+  // accesses than the last
+  if (level < VTFS_HEAT_COUNTER) {
+    u32 base = level > VTFS_HEAT_INIT ? level - VTFS_HEAT_INIT : 0;
+
+    if (vtfs_heat_random(seed) % (base * VTFS_HEAT_LOG_FACTOR + 1) == 0) {
+      level++;
+    }
+  }
+  return vtfs_heat_cell(now, cell & VTFS_HEAT_MISSING, level);
+}
+
+int vtfs_heat_resize(struct vtfs_node* node, u64 now) {
+  struct vtfs_heat* heat = node->heat;
+  size_t count = vtfs_csum_chunks(node->size);
+  size_t old_count = heat ? heat->count : 0;
+  size_t dropped = 0;
+  u32* chunk;
+
+  if (!heat) {
+    heat = vtfs_mem_kzalloc(node->mem, sizeof(*heat), GFP_KERNEL);
+    if (!heat) {
+      return -ENOMEM;
+    }
+    INIT_LIST_HEAD(&heat->list);
+    heat->node = node;
+    heat->file = vtfs_heat_cell(now, 0, VTFS_HEAT_INIT);
+    vtfs_mem_charge(node->mem, VTFS_MEM_META, sizeof(*heat), 1);
+    node->heat = heat;
+  }
+  heat->demoted = !node->data && node->size;
+  if (count == old_count) {
+    return 0;
+  }
+
+  // Chunks cut off by a truncation take their missing marks with them
+  for (size_t i = count; i < old_count; i++) {
+    if (heat->chunk[i] & VTFS_HEAT_MISSING) {
+      dropped++;
+    }
+  }
+  if (count) {
+    chunk = vtfs_mem_krealloc(
+        node->mem, heat->chunk, old_count * sizeof(u32), count * sizeof(u32), GFP_KERNEL
+    );
+    if (!chunk) {
+      return -ENOMEM;
+    }
+  } else {
+    vtfs_mem_kfree(node->mem, heat->chunk, old_count * sizeof(u32));
+    chunk = NULL;
+  }
+  for (size_t i = old_count; i < count; i++) {
+    chunk[i] = vtfs_heat_cell(now, 0, VTFS_HEAT_INIT);
+  }
+  if (old_count) {
+    vtfs_mem_charge(node->mem, VTFS_MEM_META, old_count * sizeof(u32), -1);
+  }
+  if (count) {
+    vtfs_mem_charge(node->mem, VTFS_MEM_META, count * sizeof(u32), 1);
+  }
+  heat->chunk = chunk;
+  heat->count = count;
+  heat->missing -= dropped;
+  return 0;
+}
+
+void vtfs_heat_link(struct vtfs_heat_table* table, struct vtfs_node* node) {
+  struct vtfs_heat* heat = node->heat;
+
+  if (heat && node->nlink && !heat->demoted && !heat->pinned && list_empty(&heat->list)) {
+    list_add_tail(&heat->list, &table->nodes);
+  }
+}
+
+void vtfs_heat_unlink(struct vtfs_node* node) {
+  if (node->heat) {
+    list_del_init(&node->heat->list);
+  }
+}
+
+void vtfs_heat_pin(struct vtfs_heat_table* table, struct vtfs_node* node, bool pinned) {
+  node->heat->pinned = pinned;
+  if (pinned) {
+    vtfs_heat_unlink(node);
+  } else {
+    vtfs_heat_link(table, node);
+  }
+}
+
+void vtfs_heat_cool(struct vtfs_heat* heat, size_t offset, size_t len) {
+  size_t last = min(vtfs_csum_chunks(offset + len), heat->count);
+
+  for (size_t i = offset / VTFS_CSUM_CHUNK; i < last; i++) {
+    heat->chunk[i] &= ~VTFS_HEAT_COUNTER;
+  }
+  if (offset == 0 && last == heat->count) {
+    heat->file &= ~VTFS_HEAT_COUNTER;
+  }
+}
+
+void vtfs_heat_free(struct vtfs_node* node) {
+  struct vtfs_heat* heat = node->heat;
+
+  if (!heat) {
+    return;
+  }
+  list_del(&heat->list);
+  vtfs_mem_charge(node->mem, VTFS_MEM_META, heat->count * sizeof(u32), -1);
+  vtfs_mem_kfree(node->mem, heat->chunk, heat->count * sizeof(u32));
+  vtfs_mem_charge(node->mem, VTFS_MEM_META, sizeof(*heat), -1);
+  vtfs_mem_kfree(node->mem, heat, sizeof(*heat));
+  node->heat = NULL;
+}
+
+size_t vtfs_heat_access(
+    struct vtfs_heat_table* table, struct vtfs_node* node, size_t offset, size_t len, u64 now
+) {
+  struct vtfs_heat* heat = node->heat;
+  size_t last;
+  size_t missing = 0;
+
+  if (!heat) {
+    return 0;
+  }
+  heat->file = vtfs_heat_touch(heat->file, now, &table->seed);
+  last = min(vtfs_csum_chunks(offset + len), heat->count);
+  for (size_t i = offset / VTFS_CSUM_CHUNK; i < last; i++) {
+    if (heat->chunk[i] & VTFS_HEAT_MISSING) {
+      missing++;
+    }
+    heat->chunk[i] = vtfs_heat_touch(heat->chunk[i], now, &table->seed);
+  }
+  table->misses += missing;
+  if (last > offset / VTFS_CSUM_CHUNK) {
+    table->hits += last - offset / VTFS_CSUM_CHUNK - missing;
+  }
+  return missing;
+}
+
+// Whether chunk i is to be fetched for an access to [first, last)
+static bool vtfs_heat_wanted(
+    const struct vtfs_heat* heat, size_t i, size_t first, size_t last, u64 now
+) {
+  if (!(heat->chunk[i] & VTFS_HEAT_MISSING)) {
+    return false;
+  }
+  return (i >= first && i < last) || vtfs_heat_level(heat->chunk[i], now) >= VTFS_HEAT_HOT;
+}
+
+bool vtfs_heat_next_fetch(
+    const struct vtfs_heat* heat,
+    size_t from,
+    size_t first,
+    size_t last,
+    u64 now,
+    size_t* start,
+    size_t* end
+) {
+  size_t i = from;
+  bool inside;
+
+  if (!heat->missing) {
+    return false;
+  }
+  while (i < heat->count && !vtfs_heat_wanted(heat, i, first, last, now)) {
+    i++;
+  }
+  if (i >= heat->count) {
+    return false;
+  }
+  *start = i;
+  inside = i >= first && i < last;
+  while (i < heat->count && vtfs_heat_wanted(heat, i, first, last, now) &&
+         (i >= first && i < last) == inside) {
+    i++;
+  }
+  *end = i;
+  return true;
+}
+
+void vtfs_heat_fetched(
+    struct vtfs_heat_table* table, struct vtfs_heat* heat, size_t start, size_t end
+) {
+  for (size_t i = start; i < end && i < heat->count; i++) {
+    if (heat->chunk[i] & VTFS_HEAT_MISSING) {
+      heat->chunk[i] &= ~VTFS_HEAT_MISSING;
+      heat->missing--;
+      table->promotions++;
+    }
+  }
+}
+
+void vtfs_heat_demoted(struct vtfs_heat_table* table, struct vtfs_heat* heat) {
+  for (size_t i = 0; i < heat->count; i++) {
+    heat->chunk[i] |= VTFS_HEAT_MISSING;
+  }
+  heat->missing = heat->count;
+  heat->dirty = false;
+  heat->demoted = true;
+  // Only files in RAM are candidates, so a sample never comes up empty
+  list_del_init(&heat->list);
+  table->demotions++;
+}
+
+void vtfs_heat_restored(struct vtfs_heat_table* table, struct vtfs_heat* heat) {
+  heat->demoted = false;
+  vtfs_heat_link(table, heat->node);
+}
+
+struct vtfs_node* vtfs_heat_victim(struct vtfs_heat_table* table, u64 now) {
+  struct vtfs_heat* coldest = NULL;
+  unsigned int coldest_level = 0;
+
+  for (int i = 0; i < VTFS_HEAT_SAMPLE && !list_empty(&table->nodes); i++) {
+    struct vtfs_heat* heat = list_first_entry(&table->nodes, struct vtfs_heat, list);
+    unsigned int level = vtfs_heat_level(heat->file, now);
+
+    // Rotating keeps the sample moving through every candidate
+    list_del(&heat->list);
+    list_add_tail(&heat->list, &table->nodes);
+    if (!heat->count) {
+      continue;
+    }
+    if (!coldest || level < coldest_level) {
+      coldest = heat;
+      coldest_level = level;
+    }
+  }
+  return coldest ? coldest->node : NULL;
+}
+
+// Hundredths of a percent
+static u64 vtfs_heat_ratio(u64 hits, u64 misses) {
+  return hits + misses ? hits * 10000 / (hits + misses) : 0;
+}
+
+int vtfs_heat_report(
+    const struct vtfs_heat_table* table,
+    long resident,
+    u64 disk,
+    u64 backend,
+    char* buf,
+    size_t size
+) {
+  u64 ram = vtfs_heat_ratio(table->hits, table->misses);
+  u64 cache = vtfs_heat_ratio(disk, backend);
+
+  return scnprintf(
+      buf,
+      size,
+      "%-10s %zu\n%-10s %ld\n%-10s %llu\n%-10s %llu\n"
+      "%-10s %12s %8s\n%-10s %12llu %5llu.%02llu%%\n%-10s %12llu %5llu.%02llu%%\n%-10s %12llu\n",
+      "budget",
+      table->budget,
+      "resident",
+      resident,
+      "demotions",
+      (unsigned long long)table->demotions,
+      "promotions",
+      (unsigned long long)table->promotions,
+      "tier",
+      "hits",
+      "ratio",
+      "ram",
+      (unsigned long long)table->hits,
+      (unsigned long long)(ram / 100),
+      (unsigned long long)(ram % 100),
+      "disk",
+      (unsigned long long)disk,
+      (unsigned long long)(cache / 100),
+      (unsigned long long)(cache % 100),
+      "backend",
+      (unsigned long long)backend
+  );
+}
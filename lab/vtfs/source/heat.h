@@ -0,0 +1,123 @@
+#ifndef VTFS_HEAT_H
+#define VTFS_HEAT_H
+
+#include "csum.h"
+#include "index.h"
+
+// Access heat of file data, for keeping the hottest files of a mount in RAM
+// under a budget (ram=<size>) and leaving the rest on the backend. A file
+// and each VTFS_CSUM_CHUNK of it have a cell: a logarithmic access counter
+// that an access only bumps with a probability falling as it grows, so 7
+// bits count well past a million accesses, and the tick of the last access,
+// from which the counter loses a step per VTFS_HEAT_DECAY ticks idle. The
+// level of a cell is frequency and recency in one number.
+//
+// RAM is given back a file at a time, since its contents are one
+// allocation: a demoted file keeps its size, frees its data and has every
+// chunk marked missing. An access to a missing chunk promotes the file: it
+// gets its allocation back and the chunks asked for are fetched, along with
+// any other missing chunk still at VTFS_HEAT_HOT, so a big file comes back
+// as the part of it that was in use rather than all or nothing.
+//
+// Not locked: callers serialise every call on one table and its nodes.
+#define VTFS_HEAT_COUNTER 0x7f
+#define VTFS_HEAT_MISSING 0x80
+#define VTFS_HEAT_INIT 5         // level of new data, so it is not the first to go
+#define VTFS_HEAT_LOG_FACTOR 10  // the lower, the faster the counter saturates
+#define VTFS_HEAT_DECAY 60       // ticks idle per level lost
+#define VTFS_HEAT_HOT 8          // missing chunks at this level come back with any
+#define VTFS_HEAT_SAMPLE 5       // candidates compared per demotion
+
+// Per-file heat, hung off the node
+struct vtfs_heat {
+  struct list_head list;  // in the table's candidates, empty when not one
+  struct vtfs_node* node;
+  u32 file;      // cell of the file as a whole
+  bool dirty;    // RAM holds changes the backend has not got
+  bool demoted;  // the data is not allocated
+  bool pinned;   // never demoted
+  size_t missing;  // chunks not in RAM
+  size_t count;
+  u32* chunk;  // cell per chunk: last tick (low 24 bits) << 8 | flags | counter
+};
+
+struct vtfs_heat_table {
+  size_t budget;  // bytes of file data to keep in RAM, 0 for no limit
+  u32 seed;       // of the counters' coin flips
+  struct list_head nodes;  // heat of every file in RAM that may be demoted
+  u64 hits;        // chunk accesses found in RAM
+  u64 misses;      // chunk accesses that had to promote
+  u64 demotions;   // files
+  u64 promotions;  // chunks fetched back
+};
+
+void vtfs_heat_init(struct vtfs_heat_table* table, size_t budget);
+
+// The cell after an access at now
+u32 vtfs_heat_touch(u32 cell, u64 now, u32* seed);
+// Counter of the cell decayed to now
+unsigned int vtfs_heat_level(u32 cell, u64 now);
+
+// Sizes the node's heat to its current size and state, allocating it on
+// first use. New chunks are in RAM at VTFS_HEAT_INIT.
+int vtfs_heat_resize(struct vtfs_node* node, u64 now);
+// Makes the node a demotion candidate, unless it has no heat, no links,
+// no data or a pin
+void vtfs_heat_link(struct vtfs_heat_table* table, struct vtfs_node* node);
+void vtfs_heat_unlink(struct vtfs_node* node);
+// Pins or unpins the node, which must have heat
+void vtfs_heat_pin(struct vtfs_heat_table* table, struct vtfs_node* node, bool pinned);
+void vtfs_heat_free(struct vtfs_node* node);
+
+// Records an access to [offset, offset + len) and returns how many of the
+// chunks in it are missing
+size_t vtfs_heat_access(
+    struct vtfs_heat_table* table, struct vtfs_node* node, size_t offset, size_t len, u64 now
+);
+
+// Drops the counters of the chunks in [offset, offset + len) to zero, and
+// the file's too if that is all of it, so they go first and do not come
+// back with a promotion as hot
+void vtfs_heat_cool(struct vtfs_heat* heat, size_t offset, size_t len);
+
+// Finds the next run of chunks from chunk from on to fetch for an access to
+// chunks [first, last): missing ones in that range, and missing hot ones
+// outside it. A run lies either all inside the range or all outside.
+// Returns false once there is none.
+bool vtfs_heat_next_fetch(
+    const struct vtfs_heat* heat,
+    size_t from,
+    size_t first,
+    size_t last,
+    u64 now,
+    size_t* start,
+    size_t* end
+);
+// Chunks [start, end) are back in RAM
+void vtfs_heat_fetched(
+    struct vtfs_heat_table* table, struct vtfs_heat* heat, size_t start, size_t end
+);
+// The node's data was freed, which also takes it off the candidates, or
+// allocated again
+void vtfs_heat_demoted(struct vtfs_heat_table* table, struct vtfs_heat* heat);
+void vtfs_heat_restored(struct vtfs_heat_table* table, struct vtfs_heat* heat);
+
+// Compares up to VTFS_HEAT_SAMPLE candidates from the head of the list,
+// moving them to the tail, and returns the node of the coldest one with
+// data, or NULL
+struct vtfs_node* vtfs_heat_victim(struct vtfs_heat_table* table, u64 now);
+
+// Formats the budget, the resident bytes and the chunks each tier served
+// into buf, returns the length. RAM's ratio is of every chunk accessed;
+// the disk cache's is of the chunks fetched into RAM, disk (from the
+// cache) and backend (from the backend) alike, readahead included.
+int vtfs_heat_report(
+    const struct vtfs_heat_table* table,
+    long resident,
+    u64 disk,
+    u64 backend,
+    char* buf,
+    size_t size
+);
+
+#endif  // VTFS_HEAT_H
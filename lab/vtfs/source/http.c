@@ -1,39 +1,83 @@
 #include "http.h"
+#include "http_pool.h"
 
 const char *SERVER_IP = "0.0.0.0";
 const int SERVER_PORT = 8080;
 
-// callee should call free_request on received buffer
-int fill_request(struct kvec *vec, const char *token, const char *method,
-                 size_t arg_size, va_list args) {
-  // 2048 bytes for URL and 64 bytes for anything else
-  char *request_buffer = kzalloc(2048 + 64, GFP_KERNEL);
-  if (request_buffer == 0) {
-    return -ENOMEM;
-  }
+// Builds a request into buffer; returns its length or a negative error
+typedef int (*build_request_fn)(char *buffer, size_t size, const void *ctx);
+
+// callee should kfree vec->iov_base
+static int fill_request_with(struct kvec *vec, build_request_fn build,
+                             const void *ctx) {
+  size_t size = VTFS_HTTP_REQUEST_SIZE;
+  int length;
 
-  strcpy(request_buffer, "GET /api/");
-  strcat(request_buffer, method);
+  while (true) {
+    char *request_buffer = kzalloc(size, GFP_KERNEL);
+    if (request_buffer == 0) {
+      return -ENOMEM;
+    }
 
-  strcat(request_buffer, "?token=");
-  strcat(request_buffer, token);
+    length = build(request_buffer, size, ctx);
+    if (length >= 0) {
+      memset(vec, 0, sizeof(struct kvec));
+      vec->iov_base = request_buffer;
+      vec->iov_len = length;
+      return 0;
+    }
 
-  for (int i = 0; i < arg_size; i++) {
-    strcat(request_buffer, "&");
-    strcat(request_buffer, va_arg(args, char *));
-    strcat(request_buffer, "=");
-    strcat(request_buffer, va_arg(args, char *));
+    kfree(request_buffer);
+    // writes carry their data in the URL, so those may need a bigger buffer
+    if (length != -ENOSPC || size >= VTFS_HTTP_REQUEST_MAX) {
+      return length;
+    }
+    size = min(size * 2, (size_t)VTFS_HTTP_REQUEST_MAX);
   }
+}
 
-  strcat(request_buffer, " HTTP/1.1\r\nHost:");
-  strcat(request_buffer, SERVER_IP);
-  strcat(request_buffer, "\r\nConnection: close\r\n\r\n");
+struct va_request {
+  const char *token;
+  const char *method;
+  size_t arg_size;
+  va_list *args;
+};
+
+static int build_va_request(char *buffer, size_t size, const void *ctx) {
+  const struct va_request *request = ctx;
+  va_list attempt;
+
+  va_copy(attempt, *request->args);
+  int length = vtfs_http_build_request(buffer, size, SERVER_IP, request->token,
+                                       request->method, request->arg_size,
+                                       attempt);
+  va_end(attempt);
+  return length;
+}
 
-  memset(vec, 0, sizeof(struct kvec));
-  vec->iov_base = request_buffer;
-  vec->iov_len = strlen(request_buffer);
+// callee should kfree vec->iov_base
+int fill_request(struct kvec *vec, const char *token, const char *method,
+                 size_t arg_size, va_list args) {
+  va_list copy;
+  va_copy(copy, args);
+  struct va_request request = {token, method, arg_size, &copy};
+  int error = fill_request_with(vec, build_va_request, &request);
+  va_end(copy);
+  return error;
+}
 
-  return 0;
+struct array_request {
+  const char *token;
+  const char *method;
+  const struct vtfs_arg *args;
+  size_t nargs;
+};
+
+static int build_array_request(char *buffer, size_t size, const void *ctx) {
+  const struct array_request *request = ctx;
+  return vtfs_http_build_request_args(buffer, size, SERVER_IP, request->token,
+                                      request->method, request->args,
+                                      request->nargs, true);
 }
 
 int receive_all(struct socket *sock, char *buffer, size_t buffer_size) {
@@ -59,82 +103,16 @@ int receive_all(struct socket *sock, char *buffer, size_t buffer_size) {
   return read;
 }
 
-int64_t parse_http_response(char *raw_response, size_t raw_response_size,
-                            char *response, size_t response_size) {
-  char *buffer = raw_response;
-
-  // Read Response Line
-  {
-    char *status_line = strsep(&buffer, "\r");
-    strsep(&status_line, " ");
-    if (status_line == 0) {
-      return -6;
-    }
-    char *status_code = strsep(&status_line, " ");
-    printk(KERN_INFO "Received response with status code %s\n", status_code);
-    if (strcmp(status_code, "200") != 0) {
-      return -5;
-    }
-  }
-
-  int length = -1;
-
-  while (true) {
-    if (buffer == 0) {
-      return -6;
-    }
-    char *header = strsep(&buffer, "\r");
-    ++header; // skip \n
-    if (strcmp(header, "") == 0) {
-      // end of headers
-      break;
-    }
-
-    if (strncmp(header, "Content-Length: ", 16) == 0) {
-      int error = kstrtoint(header + 16, 0, &length);
-      if (error != 0) {
-        return -6;
-      }
-      printk(KERN_INFO "Received response with content length %d\n", length);
-    }
-  }
-  ++buffer; // skip last '\n'
-
-  if (length == -1) {
-    return -6;
-  }
-
-  if (buffer + length > raw_response + raw_response_size) {
-    return -6;
-  }
-
-  if (length < sizeof(int64_t)) {
-    return -7;
-  }
-
-  length -= sizeof(int64_t);
-
-  if (length > response_size) {
-    return -ENOSPC;
-  }
-
-  int64_t return_value;
-  memcpy(&return_value, buffer, sizeof(int64_t));
-
-  buffer += sizeof(int64_t);
-  memcpy(response, buffer, length);
-
-  return return_value;
-}
-
-int64_t vtfs_http_call(const char *token, const char *method,
-                            char *response_buffer, size_t buffer_size,
-                            size_t arg_size, ...) {
+// Sends a filled request over a new connection and parses the response.
+// Frees the request.
+static int64_t vtfs_http_exchange(struct kvec *kvec, char *response_buffer,
+                                  size_t buffer_size) {
   struct socket *sock;
   int64_t error;
 
   error = sock_create_kern(&init_net, AF_INET, SOCK_STREAM, IPPROTO_TCP, &sock);
   if (error < 0) {
+    kfree(kvec->iov_base);
     return -1;
   }
 
@@ -145,28 +123,16 @@ int64_t vtfs_http_call(const char *token, const char *method,
   error = kernel_connect(sock, (struct sockaddr *)&s_addr,
                          sizeof(struct sockaddr_in), 0);
   if (error != 0) {
-
+    kfree(kvec->iov_base);
     sock_release(sock);
     return -2;
   }
 
-  struct kvec kvec;
-  va_list args;
-  va_start(args, arg_size);
-  error = fill_request(&kvec, token, method, arg_size, args);
-  va_end(args);
-
-  if (error != 0) {
-    kernel_sock_shutdown(sock, SHUT_RDWR);
-    sock_release(sock);
-    return error;
-  }
-
   struct msghdr msg;
   memset(&msg, 0, sizeof(struct msghdr));
 
-  error = kernel_sendmsg(sock, &msg, &kvec, 1, kvec.iov_len);
-  kfree(kvec.iov_base);
+  error = kernel_sendmsg(sock, &msg, kvec, 1, kvec->iov_len);
+  kfree(kvec->iov_base);
 
   if (error < 0) {
     kernel_sock_shutdown(sock, SHUT_RDWR);
@@ -198,17 +164,30 @@ int64_t vtfs_http_call(const char *token, const char *method,
   return error;
 }
 
-void encode(const char *src, char *dst) {
-  while (*src != '\0') {
-    if ((*src >= '0' && *src <= '9') || (*src >= 'a' && *src <= 'z') ||
-        (*src >= 'A' && *src <= 'Z')) {
-      *dst = *src;
-      dst++;
-    } else {
-      sprintf(dst, "%%%02X", (unsigned char)*src);
-      dst += 3;
-    }
-    src++;
+int64_t vtfs_http_call(const char *token, const char *method,
+                            char *response_buffer, size_t buffer_size,
+                            size_t arg_size, ...) {
+  struct kvec kvec;
+  va_list args;
+  va_start(args, arg_size);
+  int64_t error = fill_request(&kvec, token, method, arg_size, args);
+  va_end(args);
+
+  if (error != 0) {
+    return error;
+  }
+  return vtfs_http_exchange(&kvec, response_buffer, buffer_size);
+}
+
+int64_t vtfs_http_call_args(const char *token, const char *method,
+                            char *response_buffer, size_t buffer_size,
+                            const struct vtfs_arg *args, size_t nargs) {
+  struct array_request request = {token, method, args, nargs};
+  struct kvec kvec;
+  int64_t error = fill_request_with(&kvec, build_array_request, &request);
+
+  if (error != 0) {
+    return error;
   }
-  *dst = '\0';
+  return vtfs_http_pool_call(&kvec, response_buffer, buffer_size);
 }
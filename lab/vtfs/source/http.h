@@ -2,11 +2,24 @@
 #define VTFS_HTTP_H
 
 #include <linux/inet.h>
+#include <linux/net.h>
+#include <net/sock.h>
+
+#include "proto.h"
+
+// Backend address
+extern const char *SERVER_IP;
+extern const int SERVER_PORT;
 
 int64_t vtfs_http_call(const char *token, const char *method,
                             char *response_buffer, size_t buffer_size,
                             size_t arg_size, ...);
 
-void encode(const char *, char *);
+// vtfs_http_call() with raw parameter values, URL-encoded on the way out.
+// Goes over the pipelined connection pool of http_pool.h instead of a
+// connection of its own.
+int64_t vtfs_http_call_args(const char *token, const char *method,
+                            char *response_buffer, size_t buffer_size,
+                            const struct vtfs_arg *args, size_t nargs);
 
 #endif // VTFS_HTTP_H
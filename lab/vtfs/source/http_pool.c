@@ -0,0 +1,439 @@
+#include "http_pool.h"
+
+#include <linux/completion.h>
+#include <linux/err.h>
+#include <linux/inet.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/refcount.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/tcp.h>
+#include <linux/wait.h>
+#include <net/sock.h>
+
+#include "http.h"
+
+// Largest response a connection buffers, headers included
+#define VTFS_HTTP_RESPONSE_MAX (16 << 20)
+
+// A caller waiting for its response. Allocated, because a killed caller
+// leaves it queued: its response still arrives in order and has to be read.
+struct vtfs_http_waiter {
+  struct list_head list;  // on conn->pending, oldest first, until claimed
+  char* response;
+  size_t response_size;
+  int64_t result;
+  bool abandoned;  // its caller is gone; the receiver frees it
+  struct completion done;
+};
+
+struct vtfs_http_conn {
+  struct socket* sock;
+  struct task_struct* receiver;
+  refcount_t refs;
+  struct mutex send_lock;  // queue order is send order
+  spinlock_t lock;         // pending, inflight and error
+  struct list_head pending;
+  unsigned int inflight;  // slots taken, including requests not yet sent
+  int error;              // sticky; set once no more requests can be sent
+  char* buf;              // receiver only: bytes read but not yet parsed
+  size_t buf_size;
+  size_t buf_len;
+};
+
+static DEFINE_MUTEX(vtfs_http_pool_lock);
+static struct vtfs_http_conn* vtfs_http_pool[VTFS_HTTP_POOL_SIZE];
+static DECLARE_WAIT_QUEUE_HEAD(vtfs_http_pool_wait);
+// Bumped whenever a slot frees up, for callers waiting on a full pool
+static atomic_t vtfs_http_pool_released = ATOMIC_INIT(0);
+
+static void vtfs_http_conn_put(struct vtfs_http_conn* conn);
+
+// Frees a slot taken by vtfs_http_pool_get()
+static void vtfs_http_release_slot(struct vtfs_http_conn* conn) {
+  spin_lock(&conn->lock);
+  conn->inflight--;
+  spin_unlock(&conn->lock);
+  atomic_inc(&vtfs_http_pool_released);
+  wake_up(&vtfs_http_pool_wait);
+}
+
+// Hands a result to the waiter, or frees it if its caller is gone
+static void vtfs_http_finish(struct vtfs_http_waiter* waiter, bool abandoned, int64_t result) {
+  if (abandoned) {
+    kfree(waiter);
+    return;
+  }
+  waiter->result = result;
+  complete(&waiter->done);
+}
+
+static struct vtfs_http_waiter* vtfs_http_claim(struct vtfs_http_conn* conn, bool* abandoned) {
+  struct vtfs_http_waiter* waiter;
+
+  spin_lock(&conn->lock);
+  waiter = list_first_entry_or_null(&conn->pending, struct vtfs_http_waiter, list);
+  if (waiter) {
+    list_del_init(&waiter->list);
+    *abandoned = waiter->abandoned;
+  }
+  spin_unlock(&conn->lock);
+  return waiter;
+}
+
+// Marks the connection unusable and fails every request still queued with
+// error. The caller decides whether those requests may have been processed.
+static void vtfs_http_fail(struct vtfs_http_conn* conn, int error) {
+  struct vtfs_http_waiter* waiter;
+  struct vtfs_http_waiter* next;
+  LIST_HEAD(failed);
+
+  spin_lock(&conn->lock);
+  if (!conn->error) {
+    conn->error = error;
+  }
+  list_splice_init(&conn->pending, &failed);
+  spin_unlock(&conn->lock);
+
+  list_for_each_entry_safe(waiter, next, &failed, list) {
+    list_del_init(&waiter->list);
+    vtfs_http_finish(waiter, waiter->abandoned, error);
+    vtfs_http_release_slot(conn);
+  }
+}
+
+// Reads until buf holds one whole response; returns its length
+static ssize_t vtfs_http_read_response(struct vtfs_http_conn* conn, bool* close) {
+  while (true) {
+    ssize_t length = vtfs_http_response_length(conn->buf, conn->buf_len, close);
+    struct msghdr msg = {};
+    struct kvec vec;
+    int ret;
+
+    if (length != 0) {
+      return length < 0 ? -EPROTO : length;
+    }
+    if (conn->buf_len == conn->buf_size) {
+      size_t size = conn->buf_size * 2;
+      char* buf;
+
+      if (size > VTFS_HTTP_RESPONSE_MAX) {
+        return -EPROTO;
+      }
+      buf = kvmalloc(size, GFP_KERNEL);
+      if (!buf) {
+        return -ENOMEM;
+      }
+      memcpy(buf, conn->buf, conn->buf_len);
+      kvfree(conn->buf);
+      conn->buf = buf;
+      conn->buf_size = size;
+    }
+
+    vec.iov_base = conn->buf + conn->buf_len;
+    vec.iov_len = conn->buf_size - conn->buf_len;
+    ret = kernel_recvmsg(conn->sock, &msg, &vec, 1, vec.iov_len, 0);
+    if (ret < 0) {
+      return ret;
+    }
+    if (ret == 0) {
+      // A response without a length ends here; anything else was cut short
+      return *close && conn->buf_len ? conn->buf_len : -ECONNRESET;
+    }
+    conn->buf_len += ret;
+  }
+}
+
+static int vtfs_http_receiver(void* data) {
+  struct vtfs_http_conn* conn = data;
+  int err = 0;
+
+  while (!kthread_should_stop()) {
+    struct vtfs_http_waiter* waiter;
+    bool abandoned = false;
+    bool close = false;
+    ssize_t length;
+    int64_t result;
+
+    length = vtfs_http_read_response(conn, &close);
+    if (length < 0) {
+      err = length;
+      break;
+    }
+    waiter = vtfs_http_claim(conn, &abandoned);
+    if (!waiter) {
+      // Nothing was asked for
+      err = -EPROTO;
+      break;
+    }
+
+    // parse_http_response() splits the headers in place
+    if (abandoned) {
+      result = -EINTR;
+    } else {
+      result = parse_http_response(
+          conn->buf, length, waiter->response, waiter->response_size
+      );
+    }
+    conn->buf_len -= length;
+    memmove(conn->buf, conn->buf + length, conn->buf_len);
+    vtfs_http_finish(waiter, abandoned, result);
+    vtfs_http_release_slot(conn);
+
+    if (close) {
+      // Requests pipelined behind this one were never read by the server
+      err = -EAGAIN;
+      break;
+    }
+  }
+
+  // Whatever was sent and not answered may or may not have been processed
+  vtfs_http_fail(conn, err == -EAGAIN ? -EAGAIN : -EPIPE);
+  // Torn down by the last vtfs_http_conn_put(), which stops this thread
+  while (!kthread_should_stop()) {
+    set_current_state(TASK_INTERRUPTIBLE);
+    if (!kthread_should_stop()) {
+      schedule();
+    }
+    __set_current_state(TASK_RUNNING);
+  }
+  return 0;
+}
+
+static struct vtfs_http_conn* vtfs_http_connect(void) {
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_addr = {.s_addr = in_aton(SERVER_IP)},
+      .sin_port = htons(SERVER_PORT),
+  };
+  struct vtfs_http_conn* conn;
+  struct socket* sock;
+  int err;
+
+  err = sock_create_kern(&init_net, AF_INET, SOCK_STREAM, IPPROTO_TCP, &sock);
+  if (err) {
+    return ERR_PTR(err);
+  }
+  err = kernel_connect(sock, (struct sockaddr*)&addr, sizeof(addr), 0);
+  if (err) {
+    sock_release(sock);
+    return ERR_PTR(err);
+  }
+  // Pipelined requests go out as soon as they are written
+  tcp_sock_set_nodelay(sock->sk);
+
+  conn = kzalloc(sizeof(*conn), GFP_KERNEL);
+  if (conn) {
+    conn->buf_size = PAGE_SIZE;
+    conn->buf = kvmalloc(conn->buf_size, GFP_KERNEL);
+  }
+  if (!conn || !conn->buf) {
+    kfree(conn);
+    sock_release(sock);
+    return ERR_PTR(-ENOMEM);
+  }
+  conn->sock = sock;
+  refcount_set(&conn->refs, 1);
+  mutex_init(&conn->send_lock);
+  spin_lock_init(&conn->lock);
+  INIT_LIST_HEAD(&conn->pending);
+
+  conn->receiver = kthread_run(vtfs_http_receiver, conn, "vtfs-http");
+  if (IS_ERR(conn->receiver)) {
+    err = PTR_ERR(conn->receiver);
+    sock_release(sock);
+    kvfree(conn->buf);
+    kfree(conn);
+    return ERR_PTR(err);
+  }
+  return conn;
+}
+
+static void vtfs_http_conn_put(struct vtfs_http_conn* conn) {
+  if (!refcount_dec_and_test(&conn->refs)) {
+    return;
+  }
+  // Wakes the receiver out of its recv
+  kernel_sock_shutdown(conn->sock, SHUT_RDWR);
+  kthread_stop(conn->receiver);
+  sock_release(conn->sock);
+  mutex_destroy(&conn->send_lock);
+  kvfree(conn->buf);
+  kfree(conn);
+}
+
+// Tries to take a pipeline slot on the least loaded connection, opening a
+// new one while that is busy and the pool has room. Returns the connection
+// with a reference for the caller, NULL if every one is full, or an ERR_PTR.
+static struct vtfs_http_conn* vtfs_http_pool_try_get(void) {
+  struct vtfs_http_conn* best = NULL;
+  unsigned int best_inflight = UINT_MAX;
+  int empty = -1;
+
+  mutex_lock(&vtfs_http_pool_lock);
+  for (int i = 0; i < VTFS_HTTP_POOL_SIZE; i++) {
+    struct vtfs_http_conn* conn = vtfs_http_pool[i];
+
+    if (conn && READ_ONCE(conn->error)) {
+      vtfs_http_pool[i] = NULL;
+      vtfs_http_conn_put(conn);
+      conn = NULL;
+    }
+    if (!conn) {
+      if (empty < 0) {
+        empty = i;
+      }
+      continue;
+    }
+    if (READ_ONCE(conn->inflight) < best_inflight) {
+      best = conn;
+      best_inflight = READ_ONCE(conn->inflight);
+    }
+  }
+
+  if ((!best || best_inflight > 0) && empty >= 0) {
+    struct vtfs_http_conn* conn = vtfs_http_connect();
+
+    if (!IS_ERR(conn)) {
+      vtfs_http_pool[empty] = conn;
+      best = conn;
+    } else if (!best) {
+      mutex_unlock(&vtfs_http_pool_lock);
+      return conn;
+    }
+  }
+
+  if (best) {
+    struct vtfs_http_conn* conn = best;
+
+    spin_lock(&conn->lock);
+    if (conn->inflight < VTFS_HTTP_PIPELINE_DEPTH) {
+      conn->inflight++;
+      refcount_inc(&conn->refs);
+    } else {
+      best = NULL;
+    }
+    spin_unlock(&conn->lock);
+  }
+  mutex_unlock(&vtfs_http_pool_lock);
+  return best;
+}
+
+static struct vtfs_http_conn* vtfs_http_pool_get(void) {
+  while (true) {
+    int released = atomic_read(&vtfs_http_pool_released);
+    struct vtfs_http_conn* conn = vtfs_http_pool_try_get();
+
+    if (conn) {
+      return conn;
+    }
+    if (wait_event_killable(
+            vtfs_http_pool_wait, atomic_read(&vtfs_http_pool_released) != released
+        )) {
+      return ERR_PTR(-EINTR);
+    }
+  }
+}
+
+// Queues waiter and sends its request, both under send_lock so the queue
+// stays in the order the server sees the requests
+static int vtfs_http_send(
+    struct vtfs_http_conn* conn, struct kvec* request, struct vtfs_http_waiter* waiter
+) {
+  struct msghdr msg = {};
+  int err;
+
+  mutex_lock(&conn->send_lock);
+  spin_lock(&conn->lock);
+  err = conn->error;
+  if (!err) {
+    list_add_tail(&waiter->list, &conn->pending);
+  }
+  spin_unlock(&conn->lock);
+  if (!err && kernel_sendmsg(conn->sock, &msg, request, 1, request->iov_len) != request->iov_len) {
+    // Half a request leaves the stream unusable for everyone behind it; the
+    // receiver then fails them all, this one included
+    kernel_sock_shutdown(conn->sock, SHUT_RDWR);
+  }
+  mutex_unlock(&conn->send_lock);
+  return err;
+}
+
+static int64_t vtfs_http_pool_call_once(
+    struct kvec* request, char* response, size_t response_size
+) {
+  struct vtfs_http_waiter* waiter;
+  struct vtfs_http_conn* conn;
+  int64_t result;
+  bool queued;
+  int err;
+
+  waiter = kzalloc(sizeof(*waiter), GFP_KERNEL);
+  if (!waiter) {
+    return -ENOMEM;
+  }
+  waiter->response = response;
+  waiter->response_size = response_size;
+  INIT_LIST_HEAD(&waiter->list);
+  init_completion(&waiter->done);
+
+  conn = vtfs_http_pool_get();
+  if (IS_ERR(conn)) {
+    kfree(waiter);
+    return PTR_ERR(conn);
+  }
+  err = vtfs_http_send(conn, request, waiter);
+  if (err) {
+    // Never queued: the slot is still the caller's to give back
+    vtfs_http_release_slot(conn);
+    vtfs_http_conn_put(conn);
+    kfree(waiter);
+    // Broken before anything was sent, so the request is safe to resend
+    return -EAGAIN;
+  }
+
+  if (wait_for_completion_killable(&waiter->done)) {
+    spin_lock(&conn->lock);
+    queued = !list_empty(&waiter->list);
+    if (queued) {
+      // Its response is still read in turn, then dropped with the waiter
+      waiter->abandoned = true;
+    }
+    spin_unlock(&conn->lock);
+    if (queued) {
+      vtfs_http_conn_put(conn);
+      return -EINTR;
+    }
+    // The receiver already claimed it and is writing into response
+    wait_for_completion(&waiter->done);
+  }
+  result = waiter->result;
+  kfree(waiter);
+  vtfs_http_conn_put(conn);
+  return result;
+}
+
+int64_t vtfs_http_pool_call(struct kvec* request, char* response, size_t response_size) {
+  int64_t result;
+
+  // -EAGAIN only comes back for requests the server never read, so one
+  // resend on a fresh connection cannot apply anything twice
+  result = vtfs_http_pool_call_once(request, response, response_size);
+  if (result == -EAGAIN) {
+    result = vtfs_http_pool_call_once(request, response, response_size);
+  }
+  kfree(request->iov_base);
+  return result;
+}
+
+void vtfs_http_pool_destroy(void) {
+  mutex_lock(&vtfs_http_pool_lock);
+  for (int i = 0; i < VTFS_HTTP_POOL_SIZE; i++) {
+    if (vtfs_http_pool[i]) {
+      vtfs_http_conn_put(vtfs_http_pool[i]);
+      vtfs_http_pool[i] = NULL;
+    }
+  }
+  mutex_unlock(&vtfs_http_pool_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef VTFS_HTTP_POOL_H
+#define VTFS_HTTP_POOL_H
+
+#include <linux/net.h>
+#include <linux/uio.h>
+
+// A small pool of keep-alive connections to the backend, shared by every
+// mount. Each connection carries up to VTFS_HTTP_PIPELINE_DEPTH pipelined
+// requests at once. HTTP/1.1 answers them in the order they were sent, so
+// one receiver thread per connection hands each response to the oldest
+// waiter. Callers block while every connection is full.
+#define VTFS_HTTP_POOL_SIZE 4
+#define VTFS_HTTP_PIPELINE_DEPTH 8
+
+// Sends request (built with keep_alive) on a pooled connection and parses
+// the response into response, with the contract of vtfs_http_call().
+// Always frees request->iov_base.
+int64_t vtfs_http_pool_call(struct kvec* request, char* response, size_t response_size);
+
+// Closes every pooled connection; on module exit
+void vtfs_http_pool_destroy(void);
+
+#endif  // VTFS_HTTP_POOL_H
@@ -0,0 +1,162 @@
+#include "index.h"
+
+#include "data.h"
+#include "heat.h"
+#include "xattr.h"
+
+struct vtfs_node* vtfs_node_alloc(struct vtfs_mem* mem, ino_t ino, umode_t mode) {
+  struct vtfs_node* node = vtfs_mem_kzalloc(mem, sizeof(struct vtfs_node), GFP_KERNEL);
+  if (!node) {
+    return NULL;
+  }
+
+  if (S_ISDIR(mode)) {
+    node->dir = vtfs_mem_kzalloc(mem, sizeof(struct vtfs_dir), GFP_KERNEL);
+    if (!node->dir) {
+      vtfs_mem_kfree(mem, node, sizeof(struct vtfs_node));
+      return NULL;
+    }
+    INIT_LIST_HEAD(&node->dir->children);
+    vtfs_mem_charge(mem, VTFS_MEM_META, sizeof(struct vtfs_dir), 1);
+  }
+
+  node->ino = ino;
+  node->mode = mode;
+  node->mem = mem;
+  vtfs_mem_charge(mem, VTFS_MEM_META, sizeof(struct vtfs_node), 1);
+  vtfs_mem_add(mem, S_ISDIR(mode) ? VTFS_MEM_DIRS : VTFS_MEM_FILES, 1);
+  return node;
+}
+
+struct vtfs_node* vtfs_symlink_alloc(struct vtfs_mem* mem, ino_t ino, const char* target) {
+  size_t len = strlen(target);
+  bool inline_target = len + 1 <= VTFS_SYMLINK_INLINE_MAX;
+  size_t node_size = sizeof(struct vtfs_node) + (inline_target ? len + 1 : 0);
+  struct vtfs_node* node = vtfs_mem_kzalloc(mem, node_size, GFP_KERNEL);
+
+  if (!node) {
+    return NULL;
+  }
+
+  if (inline_target) {
+    node->data = (char*)(node + 1);
+  } else {
+    node->data = vtfs_mem_kmalloc(mem, len + 1, GFP_KERNEL);
+    if (!node->data) {
+      vtfs_mem_kfree(mem, node, node_size);
+      return NULL;
+    }
+    vtfs_mem_charge(mem, VTFS_MEM_DATA, len + 1, 1);
+  }
+  memcpy(node->data, target, len + 1);
+
+  node->ino = ino;
+  node->mode = S_IFLNK | 0777;
+  node->mem = mem;
+  node->size = len;
+  vtfs_mem_charge(mem, VTFS_MEM_META, node_size, 1);
+  vtfs_mem_add(mem, VTFS_MEM_FILES, 1);
+  return node;
+}
+
+void vtfs_node_free(struct vtfs_node* node) {
+  struct vtfs_mem* mem = node->mem;
+  size_t node_size = sizeof(struct vtfs_node);
+
+  if (vtfs_node_inline_target(node)) {
+    node_size += node->size + 1;
+    node->data = NULL;
+    node->size = 0;
+  } else if (S_ISLNK(node->mode)) {
+    // Charged as its allocation, not as file contents that grew to size
+    vtfs_mem_charge(mem, VTFS_MEM_DATA, node->size + 1, -1);
+    vtfs_mem_kfree(mem, node->data, node->size + 1);
+    node->data = NULL;
+    node->size = 0;
+  }
+  if (node->dir) {
+    vtfs_mem_charge(mem, VTFS_MEM_META, sizeof(struct vtfs_dir), -1);
+  }
+  vtfs_mem_charge(mem, VTFS_MEM_META, node_size, -1);
+  vtfs_mem_add(mem, node->dir ? VTFS_MEM_DIRS : VTFS_MEM_FILES, -1);
+
+  vtfs_data_free(node);
+  vtfs_heat_free(node);
+  vtfs_xattrs_free(node);
+  vtfs_mem_kfree(mem, node->dir, sizeof(struct vtfs_dir));
+  vtfs_mem_kfree(mem, node, node_size);
+}
+
+void vtfs_tree_free(struct vtfs_node* root) {
+  LIST_HEAD(pending);
+
+  if (!root) {
+    return;
+  }
+
+  // Entries of every directory reached are queued before the directory goes
+  list_splice_tail_init(&root->dir->children, &pending);
+  while (!list_empty(&pending)) {
+    struct vtfs_file* entry = list_first_entry(&pending, struct vtfs_file, list);
+    struct vtfs_node* node = entry->node;
+
+    list_del(&entry->list);
+    if (node->dir) {
+      list_splice_tail_init(&node->dir->children, &pending);
+    }
+    if (vtfs_file_free(entry)) {
+      vtfs_node_free(node);
+    }
+  }
+  vtfs_node_free(root);
+}
+
+struct vtfs_file* vtfs_file_alloc(const char* name, struct vtfs_node* node) {
+  struct vtfs_file* file = vtfs_mem_kzalloc(node->mem, sizeof(struct vtfs_file), GFP_KERNEL);
+  if (!file) {
+    return NULL;
+  }
+
+  file->name = vtfs_mem_kstrdup(node->mem, name, GFP_KERNEL);
+  if (!file->name) {
+    vtfs_mem_kfree(node->mem, file, sizeof(struct vtfs_file));
+    return NULL;
+  }
+
+  INIT_LIST_HEAD(&file->list);
+  file->node = node;
+  node->nlink++;
+  vtfs_mem_charge(node->mem, VTFS_MEM_META, sizeof(struct vtfs_file), 1);
+  vtfs_mem_charge(node->mem, VTFS_MEM_NAMES, strlen(name) + 1, 1);
+  vtfs_mem_add(node->mem, VTFS_MEM_ENTRIES, 1);
+  return file;
+}
+
+bool vtfs_file_free(struct vtfs_file* file) {
+  struct vtfs_node* node = file->node;
+
+  vtfs_mem_charge(node->mem, VTFS_MEM_META, sizeof(struct vtfs_file), -1);
+  vtfs_mem_charge(node->mem, VTFS_MEM_NAMES, strlen(file->name) + 1, -1);
+  vtfs_mem_add(node->mem, VTFS_MEM_ENTRIES, -1);
+  vtfs_mem_kfree(node->mem, file->name, strlen(file->name) + 1);
+  vtfs_mem_kfree(node->mem, file, sizeof(struct vtfs_file));
+  return --node->nlink == 0;
+}
+
+struct vtfs_file* vtfs_dir_find(struct vtfs_dir* dir, const char* name) {
+  struct vtfs_file* entry;
+  list_for_each_entry(entry, &dir->children, list) {
+    if (strcmp(entry->name, name) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+void vtfs_dir_add(struct vtfs_dir* dir, struct vtfs_file* file) {
+  list_add_tail(&file->list, &dir->children);
+}
+
+void vtfs_dir_remove(struct vtfs_file* file) {
+  list_del_init(&file->list);
+}
@@ -0,0 +1,86 @@
+#ifndef VTFS_INDEX_H
+#define VTFS_INDEX_H
+
+#include "mem.h"
+#include "shim.h"
+
+struct vtfs_csums;
+struct vtfs_dir;
+struct vtfs_heat;
+struct vtfs_xattrs;
+
+// Per-inode state, shared by every hard link to it
+struct vtfs_node {
+  ino_t ino;
+  umode_t mode;
+  unsigned int nlink;
+  struct vtfs_mem* mem;  // accounting of the owning mount, may be NULL
+  struct vtfs_dir* dir;  // directories only
+  size_t size;
+  // File contents, kvmalloc'd through vtfs_mem, or the NUL-terminated
+  // target of a symlink. NULL with a nonzero size while the contents are
+  // demoted to the backend (heat.h).
+  char* data;
+  struct vtfs_xattrs* xattrs;  // NULL until the first setxattr
+  struct vtfs_csums* csums;    // NULL until a checksum is asked for
+  struct vtfs_heat* heat;      // NULL until the data is first accessed
+  u64 remote_ino;              // the file on the backend, 0 until created (remote.h)
+  // Nanoseconds since the epoch. The cached inode's times and owner are
+  // authoritative and are copied back here on a metadata flush and on evict;
+  // ctime is 0 until the node first gets an inode.
+  s64 atime;
+  s64 mtime;
+  s64 ctime;
+  kuid_t uid;
+  kgid_t gid;
+};
+
+// Directory entry: a name linking a node into its parent
+struct vtfs_file {
+  struct list_head list;
+  char* name;
+  struct vtfs_node* node;
+};
+
+struct vtfs_dir {
+  struct list_head children;
+};
+
+// Allocates a node with no links, charged to mem; directories also get an
+// empty vtfs_dir
+struct vtfs_node* vtfs_node_alloc(struct vtfs_mem* mem, ino_t ino, umode_t mode);
+void vtfs_node_free(struct vtfs_node* node);
+
+// Symlink targets up to this size (terminator included) are stored in the
+// same allocation as the node, right after it
+#define VTFS_SYMLINK_INLINE_MAX (256 - sizeof(struct vtfs_node))
+
+// Allocates a symlink node holding a copy of target. The target never
+// changes afterwards, so node->data can be handed to the VFS as i_link.
+struct vtfs_node* vtfs_symlink_alloc(struct vtfs_mem* mem, ino_t ino, const char* target);
+
+// Only a symlink's target is ever inline: the data of a regular file may
+// be the slab object right after its node
+static inline bool vtfs_node_inline_target(const struct vtfs_node* node) {
+  return S_ISLNK(node->mode) && node->data == (const char*)(node + 1);
+}
+
+// Frees root and everything below it, at unmount. Nodes reachable through
+// several links are freed once. Iterative, so tree depth is not bounded by
+// the kernel stack.
+void vtfs_tree_free(struct vtfs_node* root);
+
+// Allocates a detached entry with a private copy of name, taking a link on node
+struct vtfs_file* vtfs_file_alloc(const char* name, struct vtfs_node* node);
+// Frees the entry and drops its link. Returns true if it was the node's last link
+bool vtfs_file_free(struct vtfs_file* file);
+
+struct vtfs_file* vtfs_dir_find(struct vtfs_dir* dir, const char* name);
+void vtfs_dir_add(struct vtfs_dir* dir, struct vtfs_file* file);
+void vtfs_dir_remove(struct vtfs_file* file);
+
+static inline bool vtfs_dir_empty(const struct vtfs_dir* dir) {
+  return list_empty(&dir->children);
+}
+
+#endif  // VTFS_INDEX_H
@@ -0,0 +1,150 @@
+#include "iosched.h"
+
+// Virtual time one unit of cost takes at weight 1
+#define VTFS_SCHED_SCALE 1024
+#define VTFS_SCHED_COST_MAX (16 << 20)
+
+static const char* const vtfs_sched_names[VTFS_IO_CLASS_COUNT] = {
+    [VTFS_IO_SYNC_META] = "sync_meta",
+    [VTFS_IO_SYNC_DATA] = "sync_data",
+    [VTFS_IO_READAHEAD] = "readahead",
+    [VTFS_IO_WRITEBACK] = "writeback",
+};
+
+void vtfs_sched_init(struct vtfs_sched* sched, unsigned int limit) {
+  unsigned int background = max(limit / 4, 1U);
+
+  memset(sched, 0, sizeof(*sched));
+  sched->limit = limit;
+  for (int i = 0; i < VTFS_IO_CLASS_COUNT; i++) {
+    INIT_LIST_HEAD(&sched->classes[i].queue);
+  }
+  // A lookup is worth twice a read to whoever waits on it: it is usually
+  // one step of a longer path walk
+  vtfs_sched_set_class(sched, VTFS_IO_SYNC_META, 8, limit);
+  vtfs_sched_set_class(sched, VTFS_IO_SYNC_DATA, 4, limit);
+  vtfs_sched_set_class(sched, VTFS_IO_READAHEAD, 1, background);
+  vtfs_sched_set_class(sched, VTFS_IO_WRITEBACK, 2, background);
+}
+
+int vtfs_sched_set_class(
+    struct vtfs_sched* sched, enum vtfs_io_class io_class, unsigned int weight, unsigned int limit
+) {
+  if ((unsigned int)io_class >= VTFS_IO_CLASS_COUNT || !weight || !limit) {
+    return -EINVAL;
+  }
+  sched->classes[io_class].weight = weight;
+  sched->classes[io_class].limit = limit;
+  return 0;
+}
+
+void vtfs_sched_enqueue(
+    struct vtfs_sched* sched,
+    struct vtfs_sched_request* request,
+    enum vtfs_io_class io_class,
+    unsigned int cost
+) {
+  struct vtfs_sched_class* class = &sched->classes[io_class];
+  // A class that went idle starts again from now, not from where it left
+  // off, so it cannot bank its share while it has nothing to send
+  u64 start = max(sched->vtime, class->last_finish);
+
+  request->io_class = io_class;
+  request->finish = start + (u64)max(cost, 1U) * VTFS_SCHED_SCALE / class->weight;
+  request->dispatched = false;
+  class->last_finish = request->finish;
+  class->queued++;
+  list_add_tail(&request->list, &class->queue);
+}
+
+struct vtfs_sched_request* vtfs_sched_dispatch(struct vtfs_sched* sched) {
+  struct vtfs_sched_request* best = NULL;
+
+  if (sched->inflight >= sched->limit) {
+    return NULL;
+  }
+  // Within a class tags only grow, so its head is its earliest
+  for (int i = 0; i < VTFS_IO_CLASS_COUNT; i++) {
+    struct vtfs_sched_class* class = &sched->classes[i];
+    struct vtfs_sched_request* head;
+
+    if (list_empty(&class->queue) || class->inflight >= class->limit) {
+      continue;
+    }
+    head = list_first_entry(&class->queue, struct vtfs_sched_request, list);
+    if (!best || head->finish < best->finish) {
+      best = head;
+    }
+  }
+  if (!best) {
+    return NULL;
+  }
+
+  list_del_init(&best->list);
+  best->dispatched = true;
+  sched->classes[best->io_class].queued--;
+  sched->classes[best->io_class].inflight++;
+  sched->classes[best->io_class].dispatched++;
+  sched->inflight++;
+  sched->vtime = max(sched->vtime, best->finish);
+  return best;
+}
+
+void vtfs_sched_complete(struct vtfs_sched* sched, struct vtfs_sched_request* request) {
+  sched->classes[request->io_class].inflight--;
+  sched->inflight--;
+}
+
+void vtfs_sched_cancel(struct vtfs_sched* sched, struct vtfs_sched_request* request) {
+  list_del_init(&request->list);
+  sched->classes[request->io_class].queued--;
+}
+
+unsigned int vtfs_sched_cost(size_t bytes) {
+  // Capped at a frame, past which a call is not much slower per byte
+  return 1 + min(bytes, (size_t)VTFS_SCHED_COST_MAX) / 4096;
+}
+
+int vtfs_sched_report(const struct vtfs_sched* sched, char* buf, size_t size) {
+  int len = 0;
+  unsigned int queued = 0;
+
+  len += scnprintf(
+      buf + len,
+      size - len,
+      "%-12s %6s %6s %8s %6s %12s\n",
+      "class",
+      "weight",
+      "limit",
+      "inflight",
+      "queued",
+      "dispatched"
+  );
+  for (int i = 0; i < VTFS_IO_CLASS_COUNT; i++) {
+    const struct vtfs_sched_class* class = &sched->classes[i];
+
+    queued += class->queued;
+    len += scnprintf(
+        buf + len,
+        size - len,
+        "%-12s %6u %6u %8u %6u %12llu\n",
+        vtfs_sched_names[i],
+        class->weight,
+        class->limit,
+        class->inflight,
+        class->queued,
+        (unsigned long long)class->dispatched
+    );
+  }
+  len += scnprintf(
+      buf + len,
+      size - len,
+      "%-12s %6s %6u %8u %6u\n",
+      "total",
+      "-",
+      sched->limit,
+      sched->inflight,
+      queued
+  );
+  return len;
+}
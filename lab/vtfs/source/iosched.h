@@ -0,0 +1,84 @@
+#ifndef VTFS_IOSCHED_H
+#define VTFS_IOSCHED_H
+
+#include "shim.h"
+
+// Per-mount scheduler for backend calls. Every call is queued in a priority
+// class and only goes out once the scheduler hands it a slot: at most
+// limit calls are in flight for the mount (what the connections can carry
+// at once) and at most each class's own limit for any one class, so
+// background work never holds every slot. Among the classes with room,
+// calls are picked by weighted fair queuing (self-clocked, on a virtual
+// clock): a backlogged class gets a share of the dispatches in proportion
+// to its weight, scaled by what each of its calls costs.
+//
+// Not locked: callers serialise every call on one scheduler.
+enum vtfs_io_class {
+  VTFS_IO_SYNC_META,  // lookups and other metadata a caller waits on
+  VTFS_IO_SYNC_DATA,  // reads a caller waits on
+  VTFS_IO_READAHEAD,  // reads nobody waits on yet
+  VTFS_IO_WRITEBACK,  // writes and syncs of dirty data
+  VTFS_IO_CLASS_COUNT,
+};
+
+// One call waiting for or holding a slot. Owned by the caller.
+struct vtfs_sched_request {
+  struct list_head list;  // on its class's queue until dispatched
+  enum vtfs_io_class io_class;
+  u64 finish;  // virtual finish tag
+  bool dispatched;
+};
+
+struct vtfs_sched_class {
+  unsigned int weight;
+  unsigned int limit;  // in flight at once
+  unsigned int inflight;
+  unsigned int queued;
+  u64 last_finish;  // finish tag of the last call queued
+  u64 dispatched;   // calls sent
+  struct list_head queue;
+};
+
+struct vtfs_sched {
+  struct vtfs_sched_class classes[VTFS_IO_CLASS_COUNT];
+  unsigned int limit;
+  unsigned int inflight;
+  u64 vtime;  // finish tag of the last call dispatched
+};
+
+// Default weights and limits for a mount whose connections carry limit
+// calls at once. The synchronous classes may use every slot; readahead and
+// writeback are held to a quarter each.
+void vtfs_sched_init(struct vtfs_sched* sched, unsigned int limit);
+// Returns -EINVAL for an unknown class or a zero weight or limit
+int vtfs_sched_set_class(
+    struct vtfs_sched* sched, enum vtfs_io_class io_class, unsigned int weight, unsigned int limit
+);
+
+// Queues request in io_class. cost is in units of a small call (see
+// vtfs_sched_cost()).
+void vtfs_sched_enqueue(
+    struct vtfs_sched* sched,
+    struct vtfs_sched_request* request,
+    enum vtfs_io_class io_class,
+    unsigned int cost
+);
+// Takes the next request allowed to go out off its queue and marks it
+// dispatched, or returns NULL if none is. Call until it returns NULL after
+// every enqueue and completion.
+struct vtfs_sched_request* vtfs_sched_dispatch(struct vtfs_sched* sched);
+// Gives back the slot of a dispatched request
+void vtfs_sched_complete(struct vtfs_sched* sched, struct vtfs_sched_request* request);
+// Drops a request that was not dispatched, e.g. because its caller was
+// killed while waiting
+void vtfs_sched_cancel(struct vtfs_sched* sched, struct vtfs_sched_request* request);
+
+// Cost of a call moving bytes of parameters and response: one unit plus
+// one for every 4 KiB
+unsigned int vtfs_sched_cost(size_t bytes);
+
+// Formats one line per class (weight, limit, in flight, queued, dispatched)
+// and the mount's totals into buf. Returns the length.
+int vtfs_sched_report(const struct vtfs_sched* sched, char* buf, size_t size);
+
+#endif  // VTFS_IOSCHED_H
@@ -0,0 +1,217 @@
+#include "mem.h"
+
+#include "index.h"
+
+static const char* const vtfs_mem_names[VTFS_MEM_COUNT] = {
+    [VTFS_MEM_FILES] = "files",
+    [VTFS_MEM_DIRS] = "dirs",
+    [VTFS_MEM_ENTRIES] = "entries",
+    [VTFS_MEM_INODES] = "inodes",
+    [VTFS_MEM_META] = "metadata",
+    [VTFS_MEM_NAMES] = "names",
+    [VTFS_MEM_DATA] = "data",
+    [VTFS_MEM_XATTRS] = "xattrs",
+    [VTFS_MEM_SLACK] = "slack",
+    [VTFS_MEM_DATA_SLACK] = "data_slack",
+};
+
+int vtfs_mem_init(struct vtfs_mem* mem) {
+  mem->node_bytes = kcalloc(nr_node_ids, sizeof(*mem->node_bytes), GFP_KERNEL);
+  return mem->node_bytes ? 0 : -ENOMEM;
+}
+
+void vtfs_mem_destroy(struct vtfs_mem* mem) {
+  kfree(mem->node_bytes);
+  mem->node_bytes = NULL;
+}
+
+int vtfs_mem_set_policy(struct vtfs_mem* mem, const char* spec) {
+  if (strcmp(spec, "local") == 0) {
+    mem->policy = VTFS_NUMA_LOCAL;
+    return 0;
+  }
+#ifdef __KERNEL__
+  if (strcmp(spec, "interleave") == 0) {
+    mem->policy = VTFS_NUMA_INTERLEAVE;
+    mem->nodes = node_states[N_MEMORY];
+    return 0;
+  }
+  if (strncmp(spec, "bind:", 5) == 0) {
+    nodemask_t nodes;
+
+    if (nodelist_parse(spec + 5, nodes) || nodes_empty(nodes) ||
+        !nodes_subset(nodes, node_states[N_MEMORY])) {
+      return -EINVAL;
+    }
+    mem->policy = VTFS_NUMA_BIND;
+    mem->nodes = nodes;
+    return 0;
+  }
+#endif
+  return -EINVAL;
+}
+
+// Node to allocate the next object on, NUMA_NO_NODE for the local one
+static int vtfs_mem_pick_node(struct vtfs_mem* mem) {
+#ifdef __KERNEL__
+  unsigned int n;
+  int nid;
+
+  if (!mem || mem->policy == VTFS_NUMA_LOCAL) {
+    return NUMA_NO_NODE;
+  }
+  if (mem->policy == VTFS_NUMA_BIND && node_isset(numa_node_id(), mem->nodes)) {
+    return numa_node_id();
+  }
+
+  n = (unsigned int)atomic_inc_return(&mem->rotor) % nodes_weight(mem->nodes);
+  for_each_node_mask(nid, mem->nodes) {
+    if (n-- == 0) {
+      return nid;
+    }
+  }
+#endif
+  return NUMA_NO_NODE;
+}
+
+static void vtfs_mem_track(struct vtfs_mem* mem, const void* ptr, size_t size, int sign) {
+  if (mem && mem->node_bytes && ptr) {
+    atomic_long_add(
+        sign * (long)vtfs_mem_alloc_size(size), &mem->node_bytes[vtfs_ptr_nid(ptr)]
+    );
+  }
+}
+
+void* vtfs_mem_kmalloc(struct vtfs_mem* mem, size_t size, gfp_t gfp) {
+  void* ptr = kmalloc_node(size, gfp, vtfs_mem_pick_node(mem));
+  vtfs_mem_track(mem, ptr, size, 1);
+  return ptr;
+}
+
+void* vtfs_mem_kzalloc(struct vtfs_mem* mem, size_t size, gfp_t gfp) {
+  void* ptr = kzalloc_node(size, gfp, vtfs_mem_pick_node(mem));
+  vtfs_mem_track(mem, ptr, size, 1);
+  return ptr;
+}
+
+void* vtfs_mem_krealloc(struct vtfs_mem* mem, void* ptr, size_t old_size, size_t size, gfp_t gfp) {
+  void* new_ptr;
+
+  // krealloc grows in place within the size class, and otherwise moves to
+  // the local node, which is what the default policy wants anyway
+  if (!mem || mem->policy == VTFS_NUMA_LOCAL ||
+      (ptr && kmalloc_size_roundup(size) == kmalloc_size_roundup(old_size))) {
+    vtfs_mem_track(mem, ptr, old_size, -1);
+    new_ptr = krealloc(ptr, size, gfp);
+    if (new_ptr) {
+      vtfs_mem_track(mem, new_ptr, size, 1);
+    } else {
+      vtfs_mem_track(mem, ptr, old_size, 1);
+    }
+    return new_ptr;
+  }
+
+  new_ptr = vtfs_mem_kmalloc(mem, size, gfp);
+  if (new_ptr && ptr) {
+    memcpy(new_ptr, ptr, min(old_size, size));
+    vtfs_mem_kfree(mem, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+char* vtfs_mem_kstrdup(struct vtfs_mem* mem, const char* s, gfp_t gfp) {
+  size_t size = strlen(s) + 1;
+  char* copy = vtfs_mem_kmalloc(mem, size, gfp);
+
+  if (copy) {
+    memcpy(copy, s, size);
+  }
+  return copy;
+}
+
+void vtfs_mem_kfree(struct vtfs_mem* mem, const void* ptr, size_t size) {
+  vtfs_mem_track(mem, ptr, size, -1);
+  kfree(ptr);
+}
+
+void* vtfs_mem_kvzalloc(struct vtfs_mem* mem, size_t size, gfp_t gfp) {
+  void* ptr = kvzalloc_node(size, gfp, vtfs_mem_pick_node(mem));
+  vtfs_mem_track(mem, ptr, size, 1);
+  return ptr;
+}
+
+void* vtfs_mem_kvrealloc(struct vtfs_mem* mem, void* ptr, size_t old_size, size_t size, gfp_t gfp) {
+  void* new_ptr;
+
+  if (size <= KMALLOC_MAX_SIZE && !is_vmalloc_addr(ptr)) {
+    return vtfs_mem_krealloc(mem, ptr, old_size, size, gfp);
+  }
+
+  new_ptr = kvmalloc_node(size, gfp, vtfs_mem_pick_node(mem));
+  if (!new_ptr) {
+    return NULL;
+  }
+  vtfs_mem_track(mem, new_ptr, size, 1);
+  if (ptr) {
+    memcpy(new_ptr, ptr, min(old_size, size));
+    vtfs_mem_kvfree(mem, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+void vtfs_mem_kvfree(struct vtfs_mem* mem, const void* ptr, size_t size) {
+  vtfs_mem_track(mem, ptr, size, -1);
+  kvfree(ptr);
+}
+
+long vtfs_mem_total(const struct vtfs_mem* mem, size_t inode_size) {
+  return vtfs_mem_read(mem, VTFS_MEM_META) + vtfs_mem_read(mem, VTFS_MEM_NAMES) +
+         vtfs_mem_read(mem, VTFS_MEM_DATA) + vtfs_mem_read(mem, VTFS_MEM_XATTRS) +
+         vtfs_mem_read(mem, VTFS_MEM_SLACK) +
+         vtfs_mem_read(mem, VTFS_MEM_DATA_SLACK) +
+         vtfs_mem_read(mem, VTFS_MEM_INODES) * (long)inode_size;
+}
+
+int vtfs_mem_report(const struct vtfs_mem* mem, size_t inode_size, char* buf, size_t size) {
+  long files = vtfs_mem_read(mem, VTFS_MEM_FILES);
+  long nodes = files + vtfs_mem_read(mem, VTFS_MEM_DIRS);
+  long data = vtfs_mem_read(mem, VTFS_MEM_DATA) + vtfs_mem_read(mem, VTFS_MEM_DATA_SLACK);
+  long total = vtfs_mem_total(mem, inode_size);
+  int len = 0;
+  int i;
+
+  for (i = 0; i < VTFS_MEM_COUNT; i++) {
+    len += scnprintf(
+        buf + len, size - len, "%-16s %ld\n", vtfs_mem_names[i], vtfs_mem_read(mem, i)
+    );
+  }
+  len += scnprintf(
+      buf + len,
+      size - len,
+      "%-16s %ld\n"
+      "%-16s %zu\n%-16s %zu\n%-16s %zu\n%-16s %zu\n"
+      "%-16s %ld\n%-16s %ld\n",
+      "total",
+      total,
+      // What one more file, directory or name costs before its name and data
+      "sizeof_node",
+      kmalloc_size_roundup(sizeof(struct vtfs_node)),
+      "sizeof_dir",
+      kmalloc_size_roundup(sizeof(struct vtfs_dir)),
+      "sizeof_entry",
+      kmalloc_size_roundup(sizeof(struct vtfs_file)),
+      "sizeof_inode",
+      inode_size,
+      "per_node",
+      nodes ? (total - data) / nodes : 0,
+      "data_per_file",
+      files ? data / files : 0
+  );
+  for (i = 0; mem && mem->node_bytes && i < nr_node_ids; i++) {
+    long bytes = atomic_long_read(&mem->node_bytes[i]);
+    if (bytes) {
+      len += scnprintf(buf + len, size - len, "node%-12d %ld\n", i, bytes);
+    }
+  }
+  return len;
+}
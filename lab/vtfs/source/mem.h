@@ -0,0 +1,112 @@
+#ifndef VTFS_MEM_H
+#define VTFS_MEM_H
+
+#include "shim.h"
+
+// Per-mount memory accounting. Every allocation made for a node, entry, name
+// or file data is charged here with the bytes requested, and the kmalloc size
+// class rounding on top of them is charged to a slack counter. Counters are
+// plain atomics, so reading them never allocates or takes a lock.
+enum vtfs_mem_counter {
+  VTFS_MEM_FILES,    // regular file nodes
+  VTFS_MEM_DIRS,     // directory nodes
+  VTFS_MEM_ENTRIES,  // names linking nodes into directories
+  VTFS_MEM_INODES,   // VFS inodes currently cached for this mount
+  VTFS_MEM_META,     // bytes in vtfs_node, vtfs_file and vtfs_dir
+  VTFS_MEM_NAMES,    // bytes in entry names, including the terminator
+  VTFS_MEM_DATA,     // bytes of file contents
+  VTFS_MEM_XATTRS,   // packed xattr areas and shared xattr value blobs
+  VTFS_MEM_SLACK,    // kmalloc rounding of metadata and names
+  VTFS_MEM_DATA_SLACK,
+  VTFS_MEM_COUNT,
+};
+
+// Where the mount's allocations are placed. local leaves it to the CPU that
+// allocates, which for file data means whoever first wrote it; interleave
+// rotates over the online nodes; bind rotates over a node set, preferring
+// the local node when it is in the set.
+enum vtfs_numa_policy {
+  VTFS_NUMA_LOCAL,
+  VTFS_NUMA_INTERLEAVE,
+  VTFS_NUMA_BIND,
+};
+
+struct vtfs_mem {
+  atomic_long_t counters[VTFS_MEM_COUNT];
+  enum vtfs_numa_policy policy;
+#ifdef __KERNEL__
+  nodemask_t nodes;  // candidates for interleave and bind
+  atomic_t rotor;
+#endif
+  // Bytes held on each of the nr_node_ids NUMA nodes, at allocation size
+  // granularity (vtfs_mem_alloc_size()). Sized at mount rather than for MAX_NUMNODES; NULL (nothing
+  // tracked per node) until vtfs_mem_init().
+  atomic_long_t* node_bytes;
+};
+
+// Allocates the per-node counters. The rest of the struct starts zeroed.
+int vtfs_mem_init(struct vtfs_mem* mem);
+void vtfs_mem_destroy(struct vtfs_mem* mem);
+
+// All helpers accept a NULL mem for nodes that belong to no mount
+static inline void vtfs_mem_add(struct vtfs_mem* mem, enum vtfs_mem_counter counter, long delta) {
+  if (mem) {
+    atomic_long_add(delta, &mem->counters[counter]);
+  }
+}
+
+static inline long vtfs_mem_read(const struct vtfs_mem* mem, enum vtfs_mem_counter counter) {
+  return mem ? atomic_long_read(&mem->counters[counter]) : 0;
+}
+
+// Bytes an allocation of size really takes: its kmalloc size class, or
+// whole pages past KMALLOC_MAX_SIZE, where only kvmalloc can serve it
+static inline size_t vtfs_mem_alloc_size(size_t size) {
+#ifdef __KERNEL__
+  if (size > KMALLOC_MAX_SIZE) {
+    return PAGE_ALIGN(size);
+  }
+#endif
+  return kmalloc_size_roundup(size);
+}
+
+// Charges (sign 1) or uncharges (sign -1) an allocation of size bytes
+static inline void vtfs_mem_charge(
+    struct vtfs_mem* mem, enum vtfs_mem_counter counter, size_t size, int sign
+) {
+  enum vtfs_mem_counter slack = counter == VTFS_MEM_DATA ? VTFS_MEM_DATA_SLACK : VTFS_MEM_SLACK;
+
+  vtfs_mem_add(mem, counter, sign * (long)size);
+  vtfs_mem_add(mem, slack, sign * (long)(vtfs_mem_alloc_size(size) - size));
+}
+
+// Parses the numa= mount option: "local", "interleave" or "bind:<nodelist>"
+int vtfs_mem_set_policy(struct vtfs_mem* mem, const char* spec);
+
+// Placement-aware allocation. These only place and track per-node bytes;
+// counters are still charged by the caller. size must be what was asked
+// for when the object was allocated. A NULL mem allocates locally.
+void* vtfs_mem_kmalloc(struct vtfs_mem* mem, size_t size, gfp_t gfp);
+void* vtfs_mem_kzalloc(struct vtfs_mem* mem, size_t size, gfp_t gfp);
+// Stays in place while the size class does not change, moves to a node
+// picked by the policy otherwise
+void* vtfs_mem_krealloc(struct vtfs_mem* mem, void* ptr, size_t old_size, size_t size, gfp_t gfp);
+char* vtfs_mem_kstrdup(struct vtfs_mem* mem, const char* s, gfp_t gfp);
+void vtfs_mem_kfree(struct vtfs_mem* mem, const void* ptr, size_t size);
+// The same for file data, which may outgrow kmalloc: kvmalloc falls back to
+// vmalloc for it. kvrealloc keeps using krealloc while both sizes fit kmalloc.
+void* vtfs_mem_kvzalloc(struct vtfs_mem* mem, size_t size, gfp_t gfp);
+void* vtfs_mem_kvrealloc(struct vtfs_mem* mem, void* ptr, size_t old_size, size_t size, gfp_t gfp);
+void vtfs_mem_kvfree(struct vtfs_mem* mem, const void* ptr, size_t size);
+
+// Bytes allocated for the mount, slack included. inode_size is the size of
+// one cached VFS inode; pass 0 to count only what vtfs allocates itself.
+long vtfs_mem_total(const struct vtfs_mem* mem, size_t inode_size);
+
+// Formats one "name value" line per counter, the total, the allocation size
+// of each structure, per-node and per-file averages and the bytes held on
+// each NUMA node into buf. Does not
+// allocate, so it is safe to call under memory pressure. Returns the length.
+int vtfs_mem_report(const struct vtfs_mem* mem, size_t inode_size, char* buf, size_t size);
+
+#endif  // VTFS_MEM_H
@@ -0,0 +1,351 @@
+#include "proto.h"
+
+static int append(char *buffer, size_t buffer_size, size_t *length,
+                  const char *str) {
+  size_t str_length = strlen(str);
+  if (*length + str_length >= buffer_size) {
+    return -ENOSPC;
+  }
+  memcpy(buffer + *length, str, str_length + 1);
+  *length += str_length;
+  return 0;
+}
+
+int vtfs_http_build_request(char *buffer, size_t buffer_size, const char *host,
+                            const char *token, const char *method,
+                            size_t arg_size, va_list args) {
+  size_t length = 0;
+  int error = 0;
+
+  error |= append(buffer, buffer_size, &length, "GET /api/");
+  error |= append(buffer, buffer_size, &length, method);
+
+  error |= append(buffer, buffer_size, &length, "?token=");
+  error |= append(buffer, buffer_size, &length, token);
+
+  for (int i = 0; i < arg_size; i++) {
+    error |= append(buffer, buffer_size, &length, "&");
+    error |= append(buffer, buffer_size, &length, va_arg(args, char *));
+    error |= append(buffer, buffer_size, &length, "=");
+    error |= append(buffer, buffer_size, &length, va_arg(args, char *));
+  }
+
+  error |= append(buffer, buffer_size, &length, " HTTP/1.1\r\nHost:");
+  error |= append(buffer, buffer_size, &length, host);
+  error |= append(buffer, buffer_size, &length,
+                  "\r\nConnection: close\r\n\r\n");
+
+  if (error != 0) {
+    return -ENOSPC;
+  }
+  return length;
+}
+
+// Appends len bytes of src URL-encoded. Reserves the worst case of 3 bytes
+// per input byte.
+static int append_encoded(char *buffer, size_t buffer_size, size_t *length,
+                          const char *src, size_t len) {
+  if (*length + 3 * len >= buffer_size) {
+    return -ENOSPC;
+  }
+  encode_n(src, len, buffer + *length);
+  *length += strlen(buffer + *length);
+  return 0;
+}
+
+int vtfs_http_build_request_args(char *buffer, size_t buffer_size,
+                                 const char *host, const char *token,
+                                 const char *method,
+                                 const struct vtfs_arg *args, size_t nargs,
+                                 bool keep_alive) {
+  size_t length = 0;
+  int error = 0;
+
+  error |= append(buffer, buffer_size, &length, "GET /api/");
+  error |= append(buffer, buffer_size, &length, method);
+
+  error |= append(buffer, buffer_size, &length, "?token=");
+  error |= append(buffer, buffer_size, &length, token);
+
+  for (size_t i = 0; i < nargs && error == 0; i++) {
+    error |= append(buffer, buffer_size, &length, "&");
+    error |= append(buffer, buffer_size, &length, args[i].key);
+    error |= append(buffer, buffer_size, &length, "=");
+    error |= append_encoded(buffer, buffer_size, &length, args[i].value,
+                            args[i].len);
+  }
+
+  error |= append(buffer, buffer_size, &length, " HTTP/1.1\r\nHost:");
+  error |= append(buffer, buffer_size, &length, host);
+  error |= append(buffer, buffer_size, &length,
+                  keep_alive ? "\r\nConnection: keep-alive\r\n\r\n"
+                             : "\r\nConnection: close\r\n\r\n");
+
+  if (error != 0) {
+    return -ENOSPC;
+  }
+  return length;
+}
+
+// Finds "\r\n" in [from, end), or returns 0
+static const char *find_crlf(const char *from, const char *end) {
+  for (const char *p = from; p + 1 < end; p++) {
+    if (p[0] == '\r' && p[1] == '\n') {
+      return p;
+    }
+  }
+  return 0;
+}
+
+static bool header_is(const char *line, const char *line_end,
+                      const char *name) {
+  size_t len = strlen(name);
+  return (size_t)(line_end - line) >= len && strncasecmp(line, name, len) == 0;
+}
+
+// Length of a chunked body starting at body, 0 if it is incomplete
+static ssize_t chunked_length(const char *body, const char *end) {
+  const char *pos = body;
+
+  while (true) {
+    const char *line_end = find_crlf(pos, end);
+    size_t size = 0;
+    int digits = 0;
+
+    if (line_end == 0) {
+      return 0;
+    }
+    for (; pos < line_end && digits < 16; pos++, digits++) {
+      char c = *pos;
+      if (c >= '0' && c <= '9') {
+        size = size * 16 + (c - '0');
+      } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+        size = size * 16 + ((c | 0x20) - 'a' + 10);
+      } else {
+        break; // chunk extensions
+      }
+    }
+    if (digits == 0 || (pos < line_end && *pos != ';' && *pos != ' ')) {
+      return -6;
+    }
+    pos = line_end + 2;
+
+    if (size == 0) {
+      // trailers up to the final empty line
+      while ((line_end = find_crlf(pos, end)) != 0 && line_end != pos) {
+        pos = line_end + 2;
+      }
+      return line_end == 0 ? 0 : line_end + 2 - body;
+    }
+    if (size + 2 > (size_t)(end - pos)) {
+      return 0;
+    }
+    pos += size + 2;
+  }
+}
+
+ssize_t vtfs_http_response_length(const char *raw, size_t raw_size,
+                                  bool *close) {
+  const char *end = raw + raw_size;
+  const char *line = raw;
+  const char *line_end = find_crlf(line, end);
+  unsigned long content_length = 0;
+  bool has_length = false;
+  bool chunked = false;
+
+  if (line_end == 0) {
+    return 0;
+  }
+  if (!header_is(line, line_end, "HTTP/1.")) {
+    return -6;
+  }
+  // HTTP/1.0 closes unless asked not to
+  *close = line[7] == '0';
+
+  while (true) {
+    line = line_end + 2;
+    line_end = find_crlf(line, end);
+    if (line_end == 0) {
+      return 0;
+    }
+    if (line_end == line) {
+      break;
+    }
+
+    if (header_is(line, line_end, "Content-Length: ")) {
+      char digits[24];
+      size_t len = line_end - line - 16;
+      if (len == 0 || len >= sizeof(digits)) {
+        return -6;
+      }
+      memcpy(digits, line + 16, len);
+      digits[len] = '\0';
+      if (kstrtoul(digits, 10, &content_length) != 0) {
+        return -6;
+      }
+      has_length = true;
+    } else if (header_is(line, line_end, "Transfer-Encoding: ")) {
+      chunked = header_is(line + 19, line_end, "chunked");
+    } else if (header_is(line, line_end, "Connection: ")) {
+      *close = header_is(line + 12, line_end, "close");
+    }
+  }
+
+  const char *body = line_end + 2;
+  size_t head = body - raw;
+  if (chunked) {
+    ssize_t length = chunked_length(body, end);
+    return length <= 0 ? length : head + length;
+  }
+  if (!has_length) {
+    *close = true;
+    return 0;
+  }
+  if (content_length > raw_size - head) {
+    return 0;
+  }
+  return head + content_length;
+}
+
+// Returns the next CRLF-terminated line starting at *pos and moves *pos past
+// it, or 0 if the buffer ends first. The CRLF is overwritten with NULs.
+static char *next_line(char **pos, char *end) {
+  char *line = *pos;
+  char *cr = memchr(line, '\r', end - line);
+  if (cr == 0 || cr + 1 >= end || cr[1] != '\n') {
+    return 0;
+  }
+  cr[0] = '\0';
+  cr[1] = '\0';
+  *pos = cr + 2;
+  return line;
+}
+
+// Decodes a chunked body in place. Returns the decoded length or -6.
+static int dechunk(char *body, char *end) {
+  char *read = body;
+  char *write = body;
+
+  while (true) {
+    char *line = next_line(&read, end);
+    if (line == 0) {
+      return -6;
+    }
+    char *size_field = strsep(&line, ";"); // drop chunk extensions
+
+    unsigned long size;
+    if (kstrtoul(size_field, 16, &size) != 0) {
+      return -6;
+    }
+    if (size == 0) {
+      // skip trailers up to the final empty line
+      while ((line = next_line(&read, end)) != 0 && *line != '\0') {
+      }
+      return line == 0 ? -6 : write - body;
+    }
+    if (size + 2 > (size_t)(end - read) || read[size] != '\r' || read[size + 1] != '\n') {
+      return -6;
+    }
+    memmove(write, read, size);
+    write += size;
+    read += size + 2;
+  }
+}
+
+int64_t parse_http_response(char *raw_response, size_t raw_response_size,
+                            char *response, size_t response_size) {
+  char *buffer = raw_response;
+  char *end = raw_response + raw_response_size;
+
+  // Read Response Line
+  {
+    char *status_line = next_line(&buffer, end);
+    if (status_line == 0) {
+      return -6;
+    }
+    strsep(&status_line, " ");
+    if (status_line == 0) {
+      return -6;
+    }
+    char *status_code = strsep(&status_line, " ");
+    printk(KERN_INFO "Received response with status code %s\n", status_code);
+    if (strcmp(status_code, "200") != 0) {
+      return -5;
+    }
+  }
+
+  int length = -1;
+  bool chunked = false;
+
+  while (true) {
+    char *header = next_line(&buffer, end);
+    if (header == 0) {
+      return -6;
+    }
+    if (strcmp(header, "") == 0) {
+      // end of headers
+      break;
+    }
+
+    if (strncasecmp(header, "Content-Length: ", 16) == 0) {
+      int error = kstrtoint(header + 16, 0, &length);
+      if (error != 0 || length < 0) {
+        return -6;
+      }
+      printk(KERN_INFO "Received response with content length %d\n", length);
+    } else if (strncasecmp(header, "Transfer-Encoding: ", 19) == 0) {
+      chunked = strstr(header + 19, "chunked") != 0;
+    }
+  }
+
+  if (chunked) {
+    length = dechunk(buffer, end);
+    if (length < 0) {
+      return length;
+    }
+  }
+
+  if (length == -1) {
+    return -6;
+  }
+
+  if (length > end - buffer) {
+    return -6;
+  }
+
+  if (length < sizeof(int64_t)) {
+    return -7;
+  }
+
+  length -= sizeof(int64_t);
+
+  if (length > response_size) {
+    return -ENOSPC;
+  }
+
+  int64_t return_value;
+  memcpy(&return_value, buffer, sizeof(int64_t));
+
+  buffer += sizeof(int64_t);
+  memcpy(response, buffer, length);
+
+  return return_value;
+}
+
+void encode(const char *src, char *dst) { encode_n(src, strlen(src), dst); }
+
+void encode_n(const char *src, size_t len, char *dst) {
+  const char *end = src + len;
+  while (src != end) {
+    if ((*src >= '0' && *src <= '9') || (*src >= 'a' && *src <= 'z') ||
+        (*src >= 'A' && *src <= 'Z')) {
+      *dst = *src;
+      dst++;
+    } else {
+      sprintf(dst, "%%%02X", (unsigned char)*src);
+      dst += 3;
+    }
+    src++;
+  }
+  *dst = '\0';
+}
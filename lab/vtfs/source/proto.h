@@ -0,0 +1,52 @@
+#ifndef VTFS_PROTO_H
+#define VTFS_PROTO_H
+
+#include "shim.h"
+
+// 2048 bytes for URL and 64 bytes for anything else
+#define VTFS_HTTP_REQUEST_SIZE (2048 + 64)
+// Requests carrying file data grow their buffer up to this size
+#define VTFS_HTTP_REQUEST_MAX (64 * 1024)
+
+// Writes "GET /api/<method>?token=<token>&k1=v1... HTTP/1.1" with headers into
+// buffer. args holds 2 * arg_size const char* values (param, value pairs).
+// Returns the request length or -ENOSPC if it does not fit.
+int vtfs_http_build_request(char *buffer, size_t buffer_size, const char *host,
+                            const char *token, const char *method,
+                            size_t arg_size, va_list args);
+
+// One request parameter; value is len bytes and may contain NULs
+struct vtfs_arg {
+  const char *key;
+  const char *value;
+  size_t len;
+};
+
+// vtfs_http_build_request() for raw parameter values, which are URL-encoded
+// on the way in. keep_alive asks the server to keep the connection open for
+// further (pipelined) requests instead of closing it after the response.
+int vtfs_http_build_request_args(char *buffer, size_t buffer_size,
+                                 const char *host, const char *token,
+                                 const char *method,
+                                 const struct vtfs_arg *args, size_t nargs,
+                                 bool keep_alive);
+
+// Length of the first complete response at the start of raw: status line,
+// headers and a body delimited by Content-Length or chunked encoding.
+// Returns 0 if more bytes are needed and -6 if the headers are malformed.
+// *close is set if the server closes the connection after this response;
+// a response with neither delimiter then runs until that close and 0 is
+// returned until it happens.
+ssize_t vtfs_http_response_length(const char *raw, size_t raw_size,
+                                  bool *close);
+
+// Parses a raw HTTP response, copies the payload after the int64_t result
+// into response and returns that result (or a negative error code).
+int64_t parse_http_response(char *raw_response, size_t raw_response_size,
+                            char *response, size_t response_size);
+
+void encode(const char *, char *);
+// encode() for len bytes that may contain NULs; dst needs 3 * len + 1 bytes
+void encode_n(const char *src, size_t len, char *dst);
+
+#endif // VTFS_PROTO_H
@@ -0,0 +1,804 @@
+#include "remote.h"
+
+#include <kunit/static_stub.h>
+#include <linux/completion.h>
+#include <linux/err.h>
+#include <linux/random.h>
+#include <asm/unaligned.h>
+
+#include "csum.h"
+#include "data.h"
+#include "delta.h"
+#include "http.h"
+#include "http_pool.h"
+#include "rpc.h"
+
+// Chunks per request. Over HTTP a write carries its data URL-encoded (up to
+// 3 bytes per byte), which has to fit in VTFS_HTTP_REQUEST_MAX.
+#define VTFS_REMOTE_WRITE_CHUNKS 4
+#define VTFS_REMOTE_READ_CHUNKS 16
+// Largest file synced by delta: 48 KiB of signatures
+#define VTFS_REMOTE_DELTA_BLOCKS 4096
+// Delta bytes per patch, after URL encoding and with room for the rest
+#define VTFS_REMOTE_DELTA_MAX ((VTFS_HTTP_REQUEST_MAX - 512) / 3)
+// The backend's root directory
+#define VTFS_REMOTE_ROOT 100
+// { u64 ino, u32 mode, u32 nlink, u64 size, u64 version }
+#define VTFS_REMOTE_ENTRY_SIZE 32
+// Listing of the mount's directory read per pass at unmount
+#define VTFS_REMOTE_LIST_MAX (64 * 1024)
+
+void vtfs_remote_init(struct vtfs_remote* remote) {
+  mutex_init(&remote->lock);
+  mutex_init(&remote->dir_lock);
+  vtfs_flight_init(&remote->flights);
+  spin_lock_init(&remote->sched_lock);
+  // As many calls as the HTTP pool can carry at once. The RPC connection
+  // multiplexes any number, but the backend still serves them in turn.
+  vtfs_sched_init(&remote->sched, VTFS_HTTP_POOL_SIZE * VTFS_HTTP_PIPELINE_DEPTH);
+}
+
+int vtfs_remote_set_rpc(struct vtfs_remote* remote, const char* addr) {
+  if (strncmp(addr, "tcp:", 4) != 0 && strncmp(addr, "unix:", 5) != 0) {
+    return -EINVAL;
+  }
+  kfree(remote->rpc_addr);
+  remote->rpc_addr = kstrdup(addr, GFP_KERNEL);
+  if (!remote->rpc_addr) {
+    return -ENOMEM;
+  }
+  remote->transport = VTFS_TRANSPORT_RPC;
+  return 0;
+}
+
+void vtfs_remote_destroy(struct vtfs_remote* remote) {
+  if (remote->rpc) {
+    vtfs_rpc_put(remote->rpc);
+  }
+  vtfs_cache_destroy(&remote->cache);
+  kfree(remote->rpc_addr);
+  kfree(remote->token);
+  mutex_destroy(&remote->dir_lock);
+  mutex_destroy(&remote->lock);
+}
+
+// The mount's connection with a reference for the caller, (re)connecting
+// if there is none or the last one broke
+static struct vtfs_rpc_conn* vtfs_remote_rpc(struct vtfs_remote* remote) {
+  struct vtfs_rpc_conn* conn;
+
+  mutex_lock(&remote->lock);
+  if (remote->rpc && vtfs_rpc_broken(remote->rpc)) {
+    vtfs_rpc_put(remote->rpc);
+    remote->rpc = NULL;
+  }
+  if (!remote->rpc) {
+    conn = vtfs_rpc_connect(remote->rpc_addr);
+    if (IS_ERR(conn)) {
+      mutex_unlock(&remote->lock);
+      return conn;
+    }
+    remote->rpc = conn;
+  }
+  conn = remote->rpc;
+  vtfs_rpc_get(conn);
+  mutex_unlock(&remote->lock);
+  return conn;
+}
+
+struct vtfs_remote_request {
+  struct vtfs_remote* remote;
+  enum vtfs_io_class io_class;
+  enum vtfs_rpc_op op;
+  const struct vtfs_arg* args;
+  size_t nargs;
+  vtfs_rpc_sink sink;  // RPC only: takes the payload instead of response
+  void* sink_ctx;
+};
+
+// A call waiting in the scheduler. Lives on the caller's stack.
+struct vtfs_remote_slot {
+  struct vtfs_sched_request request;
+  struct completion ready;
+};
+
+// Wakes every call the scheduler lets out. Called with sched_lock held.
+static void vtfs_remote_kick(struct vtfs_remote* remote) {
+  struct vtfs_sched_request* request;
+
+  while ((request = vtfs_sched_dispatch(&remote->sched))) {
+    complete(&container_of(request, struct vtfs_remote_slot, request)->ready);
+  }
+}
+
+static void vtfs_remote_release(struct vtfs_remote* remote, struct vtfs_remote_slot* slot) {
+  spin_lock(&remote->sched_lock);
+  vtfs_sched_complete(&remote->sched, &slot->request);
+  vtfs_remote_kick(remote);
+  spin_unlock(&remote->sched_lock);
+}
+
+// Waits for the scheduler to hand the call a slot
+static int vtfs_remote_admit(
+    struct vtfs_remote* remote,
+    struct vtfs_remote_slot* slot,
+    enum vtfs_io_class io_class,
+    size_t bytes
+) {
+  bool dispatched;
+
+  init_completion(&slot->ready);
+  spin_lock(&remote->sched_lock);
+  vtfs_sched_enqueue(&remote->sched, &slot->request, io_class, vtfs_sched_cost(bytes));
+  vtfs_remote_kick(remote);
+  spin_unlock(&remote->sched_lock);
+
+  if (!wait_for_completion_killable(&slot->ready)) {
+    return 0;
+  }
+  // Dispatch and its wakeup both happen under the lock, so once it is
+  // taken the slot is either still queued or already ours
+  spin_lock(&remote->sched_lock);
+  dispatched = slot->request.dispatched;
+  if (!dispatched) {
+    vtfs_sched_cancel(&remote->sched, &slot->request);
+  }
+  spin_unlock(&remote->sched_lock);
+  if (dispatched) {
+    vtfs_remote_release(remote, slot);
+  }
+  return -EINTR;
+}
+
+static int64_t vtfs_remote_send(void* ctx, char* response, size_t response_size) {
+  const struct vtfs_remote_request* request = ctx;
+  struct vtfs_remote* remote = request->remote;
+  struct vtfs_remote_slot slot;
+  struct vtfs_rpc_conn* conn;
+  size_t bytes = response_size;
+  int64_t result;
+  int err;
+
+  for (size_t i = 0; i < request->nargs; i++) {
+    bytes += request->args[i].len;
+  }
+  err = vtfs_remote_admit(remote, &slot, request->io_class, bytes);
+  if (err) {
+    return err;
+  }
+
+  if (remote->transport == VTFS_TRANSPORT_HTTP) {
+    result = vtfs_http_call_args(
+        remote->token,
+        vtfs_rpc_method(request->op),
+        response,
+        response_size,
+        request->args,
+        request->nargs
+    );
+  } else {
+    conn = vtfs_remote_rpc(remote);
+    if (IS_ERR(conn)) {
+      result = PTR_ERR(conn);
+    } else if (request->sink) {
+      result = vtfs_rpc_call_sink(
+          conn,
+          remote->token,
+          request->op,
+          request->sink,
+          request->sink_ctx,
+          request->args,
+          request->nargs
+      );
+      vtfs_rpc_put(conn);
+    } else {
+      result = vtfs_rpc_call(
+          conn, remote->token, request->op, response, response_size, request->args, request->nargs
+      );
+      vtfs_rpc_put(conn);
+    }
+  }
+
+  vtfs_remote_release(remote, &slot);
+  return result;
+}
+
+static enum vtfs_io_class vtfs_remote_class(enum vtfs_rpc_op op) {
+  switch (op) {
+    case VTFS_RPC_READ:
+      return VTFS_IO_SYNC_DATA;
+    case VTFS_RPC_WRITE:
+    case VTFS_RPC_SIGNATURE:
+    case VTFS_RPC_PATCH:
+      return VTFS_IO_WRITEBACK;
+    default:
+      return VTFS_IO_SYNC_META;
+  }
+}
+
+int64_t vtfs_remote_call(
+    struct vtfs_remote* remote,
+    enum vtfs_rpc_op op,
+    char* response,
+    size_t response_size,
+    const struct vtfs_arg* args,
+    size_t nargs
+) {
+  // Lets the tests stand in for the backend
+  KUNIT_STATIC_STUB_REDIRECT(vtfs_remote_call, remote, op, response, response_size, args, nargs);
+  return vtfs_remote_call_class(
+      remote, vtfs_remote_class(op), op, response, response_size, args, nargs
+  );
+}
+
+int64_t vtfs_remote_call_class(
+    struct vtfs_remote* remote,
+    enum vtfs_io_class io_class,
+    enum vtfs_rpc_op op,
+    char* response,
+    size_t response_size,
+    const struct vtfs_arg* args,
+    size_t nargs
+) {
+  struct vtfs_remote_request request = {
+      .remote = remote,
+      .io_class = io_class,
+      .op = op,
+      .args = args,
+      .nargs = nargs,
+  };
+
+  switch (op) {
+    case VTFS_RPC_LOOKUP:
+    case VTFS_RPC_GETATTR:
+    case VTFS_RPC_LIST:
+    case VTFS_RPC_READ:
+    case VTFS_RPC_SIGNATURE:
+      // Keyed on the class too: a foreground read must not end up waiting
+      // behind a queued readahead of the same range
+      return vtfs_flight_do(
+          &remote->flights,
+          op * VTFS_IO_CLASS_COUNT + io_class,
+          args,
+          nargs,
+          response,
+          response_size,
+          vtfs_remote_send,
+          &request
+      );
+    default:
+      return vtfs_remote_send(&request, response, response_size);
+  }
+}
+
+// Transport failures come back as negative codes, backend errors as a
+// positive errno
+static int vtfs_remote_error(int64_t result) {
+  if (result == -ENOMEM || result == -EINTR) {
+    return result;
+  }
+  return result < 0 ? -EIO : -(int)result;
+}
+
+// Parameter with a string value
+#define VTFS_ARG(k, v) ((struct vtfs_arg){.key = (k), .value = (v), .len = strlen(v)})
+
+// vtfs_remote_write(), with the first request also setting the backend's
+// file to the node's size when resize is set, so a write of the whole file
+// drops whatever the backend still has past its end
+static int vtfs_remote_put(
+    struct vtfs_remote* remote, struct vtfs_node* node, size_t offset, size_t len, bool resize
+) {
+  size_t start = round_down(offset, VTFS_CSUM_CHUNK);
+  size_t end = min(round_up(offset + len, VTFS_CSUM_CHUNK), node->size);
+  u32 crcs[VTFS_REMOTE_WRITE_CHUNKS];
+  char hex[8 * VTFS_REMOTE_WRITE_CHUNKS + 1];
+  char ino[24];
+  char off[24];
+  char size[24];
+  char response[8];
+  int err;
+
+  err = vtfs_remote_create(remote, node);
+  if (err) {
+    return err;
+  }
+  snprintf(ino, sizeof(ino), "%llu", node->remote_ino);
+  snprintf(size, sizeof(size), "%zu", node->size);
+
+  while (start < end && !err) {
+    size_t count = min(end - start, (size_t)VTFS_REMOTE_WRITE_CHUNKS * VTFS_CSUM_CHUNK);
+    size_t chunks = vtfs_csum_chunks(count);
+
+    // Clean chunks come from the cache; only rewritten ones are recomputed
+    for (size_t i = 0; i < chunks && !err; i++) {
+      err = vtfs_data_csum(node, start / VTFS_CSUM_CHUNK + i, &crcs[i]);
+    }
+    if (err) {
+      break;
+    }
+    vtfs_csum_hex(crcs, chunks, hex);
+    snprintf(off, sizeof(off), "%zu", start);
+
+    struct vtfs_arg args[] = {
+        VTFS_ARG("inode", ino),
+        VTFS_ARG("offset", off),
+        {.key = "content", .value = node->data + start, .len = count},
+        VTFS_ARG("crc32c", hex),
+        VTFS_ARG("size", size),
+    };
+    err = vtfs_remote_error(vtfs_remote_call(
+        remote, VTFS_RPC_WRITE, response, sizeof(response), args, ARRAY_SIZE(args) - !resize
+    ));
+    start += count;
+    resize = false;
+  }
+  return err;
+}
+
+int vtfs_remote_write(
+    struct vtfs_remote* remote, struct vtfs_node* node, size_t offset, size_t len
+) {
+  return vtfs_remote_put(remote, node, offset, len, false);
+}
+
+// Size and data version of the node's file on the backend, from its
+// entry { u64 ino, u32 mode, u32 nlink, u64 size, u64 version }. A backend
+// that does not version data leaves *version 0.
+static int vtfs_remote_stat(
+    struct vtfs_remote* remote, struct vtfs_node* node, u64* size, u64* version
+) {
+  char response[VTFS_REMOTE_ENTRY_SIZE] = {};
+  char ino[24];
+
+  snprintf(ino, sizeof(ino), "%llu", node->remote_ino);
+  struct vtfs_arg args[] = {VTFS_ARG("inode", ino)};
+  int err = vtfs_remote_error(
+      vtfs_remote_call(remote, VTFS_RPC_GETATTR, response, sizeof(response), args, 1)
+  );
+  if (err) {
+    return err;
+  }
+  *size = get_unaligned_le64(response + 16);
+  *version = get_unaligned_le64(response + 24);
+  return 0;
+}
+
+// Where a read over RPC puts its payload: the data straight into the
+// node, the CRCs aside until the data is checked against them
+struct vtfs_remote_fill {
+  struct vtfs_node* node;
+  size_t offset;
+  size_t len;  // bytes received into the node
+  char crcs[VTFS_REMOTE_READ_CHUNKS * sizeof(u32)];
+};
+
+static int vtfs_remote_fill_sink(void* ctx, struct vtfs_rpc_payload* payload) {
+  struct vtfs_remote_fill* fill = ctx;
+  __le32 len;
+  size_t crcs;
+  char* dst;
+  int err;
+
+  err = vtfs_rpc_payload_read(payload, &len, sizeof(len));
+  if (err) {
+    return err;
+  }
+  fill->len = le32_to_cpu(len);
+  crcs = vtfs_csum_chunks(fill->len) * sizeof(u32);
+  if (fill->len > VTFS_REMOTE_READ_CHUNKS * VTFS_CSUM_CHUNK ||
+      vtfs_rpc_payload_left(payload) < fill->len + crcs) {
+    fill->len = 0;
+    return -EPROTO;
+  }
+  err = vtfs_data_reserve(fill->node, fill->offset, fill->len, &dst);
+  if (err) {
+    fill->len = 0;
+    return err;
+  }
+  err = vtfs_rpc_payload_read(payload, dst, fill->len);
+  if (!err) {
+    err = vtfs_rpc_payload_read(payload, fill->crcs, crcs);
+  }
+  return err;
+}
+
+// One batch over RPC, received in place: a single copy from the socket
+// into the file. Data that fails its CRCs has already overwritten the
+// range by then, so the file is cut back to its old size and the range's
+// cached CRCs stay dropped; the caller gets -EBADMSG as with a copy.
+static ssize_t vtfs_remote_read_direct(
+    struct vtfs_remote_request* request, struct vtfs_node* node, size_t start, size_t size
+) {
+  struct vtfs_remote_fill fill = {.node = node, .offset = start};
+  size_t old_size = node->size;
+  int64_t result;
+  int err;
+
+  request->sink = vtfs_remote_fill_sink;
+  request->sink_ctx = &fill;
+  // Not coalesced: an identical read would be of the same node, whose
+  // lock this caller holds. size only weighs the call for the scheduler.
+  result = vtfs_remote_send(request, NULL, size);
+  err = vtfs_remote_error(result);
+  if (!err && fill.len) {
+    err = vtfs_csum_verify(node->data + start, fill.len, fill.crcs);
+  }
+  if (err) {
+    if (node->size > old_size) {
+      vtfs_data_truncate(node, old_size);
+    }
+    return err;
+  }
+  vtfs_data_filled(node, start, fill.len, fill.crcs);
+  return fill.len;
+}
+
+// One batch through a response buffer, checked before it is copied in
+static ssize_t vtfs_remote_read_copy(
+    struct vtfs_remote_request* request,
+    struct vtfs_node* node,
+    size_t start,
+    char* response,
+    size_t response_size
+) {
+  const char* data;
+  const char* crcs;
+  int64_t result;
+  ssize_t got;
+  int err;
+
+  result = vtfs_remote_call_class(
+      request->remote,
+      request->io_class,
+      VTFS_RPC_READ,
+      response,
+      response_size,
+      request->args,
+      request->nargs
+  );
+  if (result != 0) {
+    return vtfs_remote_error(result);
+  }
+  // Checked against the buffer: the payload cannot be larger than it
+  got = vtfs_csum_check_read(response, response_size, &data, &crcs);
+  if (got < 0 || (size_t)got > VTFS_REMOTE_READ_CHUNKS * VTFS_CSUM_CHUNK) {
+    return got < 0 ? got : -EPROTO;
+  }
+  err = vtfs_data_fill(node, start, data, got, crcs);
+  return err ? err : got;
+}
+
+// Bytes of [offset, offset + len) among got bytes read at start
+static size_t vtfs_remote_asked(size_t start, size_t got, size_t offset, size_t len) {
+  if (start + got <= offset) {
+    return 0;
+  }
+  return min(start + got, offset + len) - max(start, offset);
+}
+
+static ssize_t vtfs_remote_read_class(
+    struct vtfs_remote* remote,
+    enum vtfs_io_class io_class,
+    struct vtfs_node* node,
+    size_t offset,
+    size_t len
+) {
+  size_t start = round_down(offset, VTFS_CSUM_CHUNK);
+  size_t end = round_up(offset + len, VTFS_CSUM_CHUNK);
+  size_t batch = VTFS_REMOTE_READ_CHUNKS * VTFS_CSUM_CHUNK;
+  size_t response_size = sizeof(u32) + batch + VTFS_REMOTE_READ_CHUNKS * sizeof(u32);
+  struct vtfs_cache_file cached = {};
+  char ino[24];
+  char off[24];
+  char length[24];
+  char* response = NULL;
+  ssize_t done = 0;
+  u64 version = 0;
+  u64 size;
+  int err = 0;
+
+  // Nothing of it was ever sent to the backend
+  if (!node->remote_ino) {
+    return -ESTALE;
+  }
+  // Without a version to key it on, the cache is simply not used
+  if (remote->cache.dir && !vtfs_remote_stat(remote, node, &size, &version) && version) {
+    vtfs_cache_open(&remote->cache, remote->token, node->remote_ino, version, size, &cached);
+  }
+  // The RPC transport receives straight into the node and needs no buffer
+  if (remote->transport == VTFS_TRANSPORT_HTTP) {
+    response = kmalloc(response_size, GFP_KERNEL);
+    if (!response) {
+      vtfs_cache_close(&cached);
+      return -ENOMEM;
+    }
+  }
+  snprintf(ino, sizeof(ino), "%llu", node->remote_ino);
+  snprintf(length, sizeof(length), "%zu", batch);
+
+  while (start < end) {
+    // off is only formatted once the cache had nothing for start
+    struct vtfs_arg args[] = {
+        VTFS_ARG("inode", ino),
+        {.key = "offset", .value = off},
+        VTFS_ARG("length", length),
+        VTFS_ARG("crc32c", "1"),
+    };
+    struct vtfs_remote_request request = {
+        .remote = remote,
+        .io_class = io_class,
+        .op = VTFS_RPC_READ,
+        .args = args,
+        .nargs = ARRAY_SIZE(args),
+    };
+    ssize_t got;
+
+    if (cached.file) {
+      got = vtfs_cache_load(&cached, node, start, end - start);
+      done += vtfs_remote_asked(start, got, offset, len);
+      start += got;
+      if (start >= cached.size) {
+        break;
+      }
+      if (got) {
+        // Take what follows from disk too, if it is there
+        continue;
+      }
+    }
+
+    snprintf(off, sizeof(off), "%zu", start);
+    args[1].len = strlen(off);
+    if (response) {
+      got = vtfs_remote_read_copy(&request, node, start, response, response_size);
+    } else {
+      got = vtfs_remote_read_direct(&request, node, start, response_size);
+    }
+    if (got < 0) {
+      err = got;
+      break;
+    }
+    atomic_long_add(vtfs_csum_chunks(got), &remote->fetched);
+    if (cached.file) {
+      vtfs_cache_store(&cached, node, start, got);
+    }
+
+    // Only the bytes the caller asked for count, not the chunk padding
+    done += vtfs_remote_asked(start, got, offset, len);
+    if ((size_t)got < batch) {
+      break;
+    }
+    start += batch;
+  }
+
+  vtfs_cache_close(&cached);
+  kfree(response);
+  return err ? err : done;
+}
+
+ssize_t vtfs_remote_read(
+    struct vtfs_remote* remote, struct vtfs_node* node, size_t offset, size_t len
+) {
+  return vtfs_remote_read_class(remote, VTFS_IO_SYNC_DATA, node, offset, len);
+}
+
+ssize_t vtfs_remote_readahead(
+    struct vtfs_remote* remote, struct vtfs_node* node, size_t offset, size_t len
+) {
+  return vtfs_remote_read_class(remote, VTFS_IO_READAHEAD, node, offset, len);
+}
+
+// Sends delta as a single patch, so the backend applies it all or nothing
+static int vtfs_remote_patch(
+    struct vtfs_remote* remote, struct vtfs_node* node, const char* delta, size_t delta_len
+) {
+  u32 crc = vtfs_crc32c(node->data, node->size);
+  char hex[9];
+  char ino[24];
+  char size[24];
+  char response[8];
+
+  vtfs_csum_hex(&crc, 1, hex);
+  snprintf(ino, sizeof(ino), "%llu", node->remote_ino);
+  snprintf(size, sizeof(size), "%zu", node->size);
+
+  struct vtfs_arg args[] = {
+      VTFS_ARG("inode", ino),
+      VTFS_ARG("size", size),
+      {.key = "delta", .value = delta, .len = delta_len},
+      VTFS_ARG("crc32c", hex),
+  };
+  return vtfs_remote_error(vtfs_remote_call(
+      remote, VTFS_RPC_PATCH, response, sizeof(response), args, ARRAY_SIZE(args)
+  ));
+}
+
+int vtfs_remote_sync(struct vtfs_remote* remote, struct vtfs_node* node) {
+  size_t response_size =
+      VTFS_DELTA_SIG_HEADER + VTFS_REMOTE_DELTA_BLOCKS * VTFS_DELTA_SIG_SIZE;
+  struct vtfs_delta_sig* sigs;
+  char ino[24];
+  char* response;
+  char* delta;
+  ssize_t delta_len;
+  size_t count;
+  u64 old_size;
+  int err;
+
+  err = vtfs_remote_create(remote, node);
+  if (err) {
+    return err;
+  }
+  if (vtfs_delta_blocks(node->size) > VTFS_REMOTE_DELTA_BLOCKS) {
+    return vtfs_remote_put(remote, node, 0, node->size, true);
+  }
+
+  response = kvmalloc(response_size, GFP_KERNEL);
+  if (!response) {
+    return -ENOMEM;
+  }
+  snprintf(ino, sizeof(ino), "%llu", node->remote_ino);
+  struct vtfs_arg args[] = {VTFS_ARG("inode", ino)};
+  err = vtfs_remote_error(
+      vtfs_remote_call(remote, VTFS_RPC_SIGNATURE, response, response_size, args, 1)
+  );
+  if (!err) {
+    err = vtfs_delta_parse_signature(response, response_size, &old_size, &sigs, &count);
+  }
+  kvfree(response);
+  if (err) {
+    return err;
+  }
+
+  delta_len = vtfs_delta_encode(sigs, count, old_size, node->data, node->size, &delta);
+  kvfree(sigs);
+  if (delta_len < 0) {
+    return delta_len;
+  }
+
+  // The RPC transport carries any size in one frame
+  if (delta_len <= VTFS_REMOTE_DELTA_MAX || remote->transport == VTFS_TRANSPORT_RPC) {
+    err = vtfs_remote_patch(remote, node, delta, delta_len);
+  } else {
+    // Mostly new data: a plain write moves about as many bytes
+    err = vtfs_remote_put(remote, node, 0, node->size, true);
+  }
+  kvfree(delta);
+  return err;
+}
+
+// Name of the node's file in the mount's directory
+static void vtfs_remote_name(const struct vtfs_node* node, char* name, size_t size) {
+  snprintf(name, size, "%lu", node->ino);
+}
+
+// Creates name under parent as a "file" or "dir", or takes over what is
+// already there, and returns the backend's inode number for it in *ino
+static int vtfs_remote_create_in(
+    struct vtfs_remote* remote, u64 parent, const char* name, const char* type, u64* ino
+) {
+  char response[VTFS_REMOTE_ENTRY_SIZE] = {};
+  char dir[24];
+  int err;
+
+  snprintf(dir, sizeof(dir), "%llu", parent);
+  struct vtfs_arg args[] = {
+      VTFS_ARG("parent", dir),
+      VTFS_ARG("name", name),
+      VTFS_ARG("type", type),
+  };
+  err = vtfs_remote_error(vtfs_remote_call(
+      remote, VTFS_RPC_CREATE, response, sizeof(response), args, ARRAY_SIZE(args)
+  ));
+  // Left by an earlier node with the same number whose unlink failed. Its
+  // data is overwritten by the first sync, like any stale copy.
+  if (err == -EEXIST) {
+    err = vtfs_remote_error(
+        vtfs_remote_call(remote, VTFS_RPC_LOOKUP, response, sizeof(response), args, 2)
+    );
+  }
+  if (err) {
+    return err;
+  }
+  *ino = get_unaligned_le64(response);
+  return *ino ? 0 : -EPROTO;
+}
+
+int vtfs_remote_create(struct vtfs_remote* remote, struct vtfs_node* node) {
+  char name[24];
+  u64 dir;
+  int err = 0;
+
+  if (node->remote_ino) {
+    return 0;
+  }
+  // Random, so that no two mounts of the same token share files
+  mutex_lock(&remote->dir_lock);
+  if (!remote->dir_ino) {
+    snprintf(remote->dir_name, sizeof(remote->dir_name), "vtfs-%016llx", get_random_u64());
+    err = vtfs_remote_create_in(
+        remote, VTFS_REMOTE_ROOT, remote->dir_name, "dir", &remote->dir_ino
+    );
+  }
+  dir = remote->dir_ino;
+  mutex_unlock(&remote->dir_lock);
+  if (err) {
+    return err;
+  }
+  vtfs_remote_name(node, name, sizeof(name));
+  return vtfs_remote_create_in(remote, dir, name, "file", &node->remote_ino);
+}
+
+static int vtfs_remote_remove(
+    struct vtfs_remote* remote, enum vtfs_rpc_op op, u64 parent, const char* name
+) {
+  char response[8];
+  char dir[24];
+
+  snprintf(dir, sizeof(dir), "%llu", parent);
+  struct vtfs_arg args[] = {VTFS_ARG("parent", dir), VTFS_ARG("name", name)};
+  return vtfs_remote_error(
+      vtfs_remote_call(remote, op, response, sizeof(response), args, ARRAY_SIZE(args))
+  );
+}
+
+void vtfs_remote_forget(struct vtfs_remote* remote, struct vtfs_node* node) {
+  char name[24];
+
+  if (!node->remote_ino) {
+    return;
+  }
+  vtfs_remote_name(node, name, sizeof(name));
+  vtfs_remote_remove(remote, VTFS_RPC_UNLINK, remote->dir_ino, name);
+  node->remote_ino = 0;
+}
+
+// Unlinks every file of one listing of the mount's directory, a sequence
+// of { u64 ino, u32 mode, u32 name_len, name }. Returns how many it removed.
+static size_t vtfs_remote_clear(struct vtfs_remote* remote, const char* list, size_t size) {
+  char name[NAME_MAX + 1];
+  size_t removed = 0;
+  size_t pos = 0;
+
+  // The buffer starts zeroed and no backend inode is 0
+  while (size - pos >= 16 && get_unaligned_le64(list + pos)) {
+    u32 len = get_unaligned_le32(list + pos + 12);
+
+    if (len > NAME_MAX || size - pos - 16 < len) {
+      break;
+    }
+    memcpy(name, list + pos + 16, len);
+    name[len] = '\0';
+    removed += !vtfs_remote_remove(remote, VTFS_RPC_UNLINK, remote->dir_ino, name);
+    pos += 16 + len;
+  }
+  return removed;
+}
+
+void vtfs_remote_cleanup(struct vtfs_remote* remote) {
+  char* response;
+  char dir[24];
+  size_t removed;
+
+  if (!remote->dir_ino) {
+    return;
+  }
+  response = kvmalloc(VTFS_REMOTE_LIST_MAX, GFP_KERNEL);
+  if (!response) {
+    return;
+  }
+  snprintf(dir, sizeof(dir), "%llu", remote->dir_ino);
+  struct vtfs_arg args[] = {VTFS_ARG("inode", dir)};
+  // Until a pass removes nothing. A listing too large for the buffer fails,
+  // and the directory stays.
+  do {
+    memset(response, 0, VTFS_REMOTE_LIST_MAX);
+    if (vtfs_remote_call(remote, VTFS_RPC_LIST, response, VTFS_REMOTE_LIST_MAX, args, 1)) {
+      break;
+    }
+    removed = vtfs_remote_clear(remote, response, VTFS_REMOTE_LIST_MAX);
+  } while (removed);
+  kvfree(response);
+  vtfs_remote_remove(remote, VTFS_RPC_RMDIR, VTFS_REMOTE_ROOT, remote->dir_name);
+  remote->dir_ino = 0;
+}
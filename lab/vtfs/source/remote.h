@@ -0,0 +1,120 @@
+#ifndef VTFS_REMOTE_H
+#define VTFS_REMOTE_H
+
+#include "cache.h"
+#include "flight.h"
+#include "index.h"
+#include "iosched.h"
+#include "proto.h"
+#include "rpc_proto.h"
+
+// How a mount talks to its backend: HTTP by default, or the binary RPC of
+// rpc_proto.h when mounted with rpc=<addr>
+enum vtfs_transport {
+  VTFS_TRANSPORT_HTTP,
+  VTFS_TRANSPORT_RPC,
+};
+
+struct vtfs_rpc_conn;
+
+// Per-mount backend endpoint
+struct vtfs_remote {
+  char* token;  // the mount's device name
+  enum vtfs_transport transport;
+  char* rpc_addr;
+  struct mutex lock;  // protects rpc
+  struct vtfs_rpc_conn* rpc;  // connected on first use, replaced once broken
+  struct vtfs_flight_table flights;  // read-only calls in flight, see flight.h
+  spinlock_t sched_lock;
+  struct vtfs_sched sched;  // admits calls to the transport, see iosched.h
+  struct vtfs_cache cache;  // local copy of fetched data, see cache.h
+  atomic_long_t fetched;    // chunks of file data received from the backend
+  // The mount's own directory on the backend, created on first use; it
+  // holds one file per node, named after the local inode number
+  struct mutex dir_lock;
+  u64 dir_ino;
+  char dir_name[24];
+};
+
+void vtfs_remote_init(struct vtfs_remote* remote);
+// Parses the rpc= mount option, switching the mount to the RPC transport
+int vtfs_remote_set_rpc(struct vtfs_remote* remote, const char* addr);
+void vtfs_remote_destroy(struct vtfs_remote* remote);
+
+// One backend call over the mount's transport. Same contract as
+// vtfs_http_call(), with raw parameter values. Calls that only read
+// (lookup, getattr, list, read, signature) are coalesced: identical ones
+// made while the first is in flight share its response. The call waits in
+// the scheduler for a slot in the class of its op: metadata is
+// VTFS_IO_SYNC_META, reads VTFS_IO_SYNC_DATA and anything that sends file
+// data VTFS_IO_WRITEBACK. Returns -EINTR if killed while waiting.
+int64_t vtfs_remote_call(
+    struct vtfs_remote* remote,
+    enum vtfs_rpc_op op,
+    char* response,
+    size_t response_size,
+    const struct vtfs_arg* args,
+    size_t nargs
+);
+// vtfs_remote_call() in an explicit class
+int64_t vtfs_remote_call_class(
+    struct vtfs_remote* remote,
+    enum vtfs_io_class io_class,
+    enum vtfs_rpc_op op,
+    char* response,
+    size_t response_size,
+    const struct vtfs_arg* args,
+    size_t nargs
+);
+
+// File data transfers to and from the backend, checked end to end with the
+// per-chunk CRC-32Cs of csum.h. Ranges are widened to whole chunks so the
+// node's cached checksums can be sent and refilled as they are. Callers hold
+// the inode lock, as for any other access to the node's data. The node's
+// file is addressed by the inode number the backend gave it: writes and
+// syncs create the file first while node->remote_ino is 0, and reads of
+// such a node fail with -ESTALE.
+
+// Gives the node a file of its own on the backend, in the mount's directory,
+// unless it already has one. Returns 0 or a negative errno.
+int vtfs_remote_create(struct vtfs_remote* remote, struct vtfs_node* node);
+
+// Sends [offset, offset + len) of the node's contents. Returns 0, -EBADMSG
+// if the backend found a chunk that does not match its CRC, or another
+// negative errno.
+int vtfs_remote_write(
+    struct vtfs_remote* remote, struct vtfs_node* node, size_t offset, size_t len
+);
+
+// Fetches [offset, offset + len) into the node, growing it as needed, and
+// keeps the CRCs it verified. With a local cache, asks the backend for the
+// file's data version first and takes whatever chunks the cache holds for
+// it from disk, writing the ones it fetches through. Returns the bytes
+// stored (short at the backend's EOF), -EBADMSG if the data did not match
+// its CRCs, or another negative errno.
+ssize_t vtfs_remote_read(
+    struct vtfs_remote* remote, struct vtfs_node* node, size_t offset, size_t len
+);
+// vtfs_remote_read() for data nobody waits on yet, which yields to
+// synchronous calls
+ssize_t vtfs_remote_readahead(
+    struct vtfs_remote* remote, struct vtfs_node* node, size_t offset, size_t len
+);
+
+// Brings the backend's copy of the file up to date with the node, sending
+// only the blocks it does not already have (see delta.h). Files too large
+// for one signature response, or whose delta does not fit in one request,
+// go up whole, setting the backend's size as a patch does. Returns 0,
+// -EBADMSG if the backend's copy changed in the meantime, or another
+// negative errno.
+int vtfs_remote_sync(struct vtfs_remote* remote, struct vtfs_node* node);
+
+// Removes the backend file of a node that is being freed. Best effort: a
+// file left behind is taken over by the next node with the same number,
+// or goes with the mount's directory.
+void vtfs_remote_forget(struct vtfs_remote* remote, struct vtfs_node* node);
+// Removes the mount's directory and the files still in it, at unmount.
+// Best effort too.
+void vtfs_remote_cleanup(struct vtfs_remote* remote);
+
+#endif  // VTFS_REMOTE_H
@@ -0,0 +1,423 @@
+#include "rpc.h"
+
+#include <linux/completion.h>
+#include <linux/err.h>
+#include <linux/inet.h>
+#include <linux/kthread.h>
+#include <linux/net.h>
+#include <linux/refcount.h>
+#include <linux/spinlock.h>
+#include <linux/tcp.h>
+#include <linux/un.h>
+#include <net/sock.h>
+
+// A caller waiting for its response. Lives on the caller's stack.
+struct vtfs_rpc_call {
+  struct list_head list;  // on conn->pending until the receiver claims it
+  u32 id;
+  char* response;
+  size_t response_size;
+  vtfs_rpc_sink sink;  // takes the payload instead of response, if set
+  void* sink_ctx;
+  int64_t result;
+  struct completion done;
+};
+
+struct vtfs_rpc_payload {
+  struct socket* sock;
+  size_t left;
+  int err;  // the connection failed under the sink
+};
+
+struct vtfs_rpc_conn {
+  struct socket* sock;
+  struct task_struct* receiver;
+  refcount_t refs;
+  struct mutex send_lock;  // keeps frames from interleaving
+  spinlock_t lock;         // pending, next_id and error
+  struct list_head pending;
+  u32 next_id;
+  int error;  // sticky; set once the connection can no longer be used
+};
+
+static int vtfs_rpc_recv(struct socket* sock, void* buf, size_t len) {
+  struct msghdr msg = {};
+  struct kvec vec = {.iov_base = buf, .iov_len = len};
+  int ret;
+
+  if (!len) {
+    return 0;
+  }
+  ret = kernel_recvmsg(sock, &msg, &vec, 1, len, MSG_WAITALL);
+  if (ret < 0) {
+    return ret;
+  }
+  return ret == len ? 0 : -ECONNRESET;
+}
+
+// Reads and drops n bytes nobody has room for
+static int vtfs_rpc_skip(struct socket* sock, size_t n) {
+  char scratch[256];
+  int err = 0;
+
+  while (n && !err) {
+    size_t chunk = min(n, sizeof(scratch));
+    err = vtfs_rpc_recv(sock, scratch, chunk);
+    n -= chunk;
+  }
+  return err;
+}
+
+int vtfs_rpc_payload_read(struct vtfs_rpc_payload* payload, void* buf, size_t len) {
+  if (payload->err) {
+    return payload->err;
+  }
+  if (len > payload->left) {
+    return -EPROTO;
+  }
+  payload->err = vtfs_rpc_recv(payload->sock, buf, len);
+  if (!payload->err) {
+    payload->left -= len;
+  }
+  return payload->err;
+}
+
+size_t vtfs_rpc_payload_left(const struct vtfs_rpc_payload* payload) {
+  return payload->left;
+}
+
+// Receives the payload of a response into its caller. Returns an error
+// only if the connection is unusable; the caller's own is in its result.
+static int vtfs_rpc_deliver(
+    struct vtfs_rpc_conn* conn, struct vtfs_rpc_call* call, size_t len, int64_t result
+) {
+  struct vtfs_rpc_payload payload = {.sock = conn->sock, .left = len};
+  size_t copy;
+  int err;
+
+  if (call->sink && result == 0) {
+    result = call->sink(call->sink_ctx, &payload);
+    err = payload.err;
+  } else if (call->sink) {
+    err = 0;
+  } else {
+    copy = min(len, call->response_size);
+    err = vtfs_rpc_payload_read(&payload, call->response, copy);
+    if (len > call->response_size) {
+      result = -ENOSPC;
+    }
+  }
+  if (!err) {
+    err = vtfs_rpc_skip(conn->sock, payload.left);
+  }
+  call->result = err ? err : result;
+  return err;
+}
+
+static struct vtfs_rpc_call* vtfs_rpc_claim(struct vtfs_rpc_conn* conn, u32 id) {
+  struct vtfs_rpc_call* call;
+
+  spin_lock(&conn->lock);
+  list_for_each_entry(call, &conn->pending, list) {
+    if (call->id == id) {
+      list_del_init(&call->list);
+      spin_unlock(&conn->lock);
+      return call;
+    }
+  }
+  spin_unlock(&conn->lock);
+  return NULL;
+}
+
+// Marks the connection unusable and fails every call still waiting
+static void vtfs_rpc_fail(struct vtfs_rpc_conn* conn, int error) {
+  struct vtfs_rpc_call* call;
+  struct vtfs_rpc_call* next;
+  LIST_HEAD(failed);
+
+  spin_lock(&conn->lock);
+  if (!conn->error) {
+    conn->error = error;
+  }
+  error = conn->error;
+  list_splice_init(&conn->pending, &failed);
+  spin_unlock(&conn->lock);
+
+  list_for_each_entry_safe(call, next, &failed, list) {
+    // The call may go away as soon as it is completed
+    list_del_init(&call->list);
+    call->result = error;
+    complete(&call->done);
+  }
+}
+
+static int vtfs_rpc_receiver(void* data) {
+  struct vtfs_rpc_conn* conn = data;
+  char head[VTFS_RPC_HEADER_SIZE];
+  int err = 0;
+
+  while (!kthread_should_stop()) {
+    struct vtfs_rpc_header header;
+    struct vtfs_rpc_call* call;
+    size_t payload;
+    __le64 result;
+
+    err = vtfs_rpc_recv(conn->sock, head, sizeof(head));
+    if (!err) {
+      err = vtfs_rpc_get_header(head, &header);
+    }
+    if (!err && header.len < sizeof(result)) {
+      err = -EPROTO;
+    }
+    if (!err) {
+      err = vtfs_rpc_recv(conn->sock, &result, sizeof(result));
+    }
+    if (err) {
+      break;
+    }
+
+    payload = header.len - sizeof(result);
+    call = vtfs_rpc_claim(conn, header.id);
+    if (!call) {
+      // Its caller was killed while waiting
+      err = vtfs_rpc_skip(conn->sock, payload);
+      if (err) {
+        break;
+      }
+      continue;
+    }
+
+    err = vtfs_rpc_deliver(conn, call, payload, le64_to_cpu(result));
+    complete(&call->done);
+    if (err) {
+      break;
+    }
+  }
+
+  vtfs_rpc_fail(conn, -EPIPE);
+  // The connection is torn down by whoever drops the last reference, which
+  // stops this thread; wait for that
+  while (!kthread_should_stop()) {
+    set_current_state(TASK_INTERRUPTIBLE);
+    if (!kthread_should_stop()) {
+      schedule();
+    }
+    __set_current_state(TASK_RUNNING);
+  }
+  return 0;
+}
+
+static int vtfs_rpc_parse_addr(const char* addr, struct sockaddr_storage* sa, int* len) {
+  if (strncmp(addr, "tcp:", 4) == 0) {
+    struct sockaddr_in* in = (struct sockaddr_in*)sa;
+    const char* port = strrchr(addr + 4, ':');
+    u16 port_nr;
+
+    if (!port || !in4_pton(addr + 4, port - addr - 4, (u8*)&in->sin_addr, -1, NULL) ||
+        kstrtou16(port + 1, 10, &port_nr)) {
+      return -EINVAL;
+    }
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port_nr);
+    *len = sizeof(*in);
+    return 0;
+  }
+  if (strncmp(addr, "unix:", 5) == 0) {
+    struct sockaddr_un* un = (struct sockaddr_un*)sa;
+
+    un->sun_family = AF_UNIX;
+    if (strscpy(un->sun_path, addr + 5, sizeof(un->sun_path)) <= 0) {
+      return -EINVAL;
+    }
+    *len = sizeof(*un);
+    return 0;
+  }
+  return -EINVAL;
+}
+
+struct vtfs_rpc_conn* vtfs_rpc_connect(const char* addr) {
+  struct sockaddr_storage sa = {};
+  struct vtfs_rpc_conn* conn;
+  struct socket* sock;
+  int len;
+  int err;
+
+  err = vtfs_rpc_parse_addr(addr, &sa, &len);
+  if (err) {
+    return ERR_PTR(err);
+  }
+  err = sock_create_kern(
+      &init_net, sa.ss_family, SOCK_STREAM, sa.ss_family == AF_INET ? IPPROTO_TCP : 0, &sock
+  );
+  if (err) {
+    return ERR_PTR(err);
+  }
+  err = kernel_connect(sock, (struct sockaddr*)&sa, len, 0);
+  if (err) {
+    sock_release(sock);
+    return ERR_PTR(err);
+  }
+  if (sa.ss_family == AF_INET) {
+    // Small requests go out as soon as they are written
+    tcp_sock_set_nodelay(sock->sk);
+  }
+
+  conn = kzalloc(sizeof(*conn), GFP_KERNEL);
+  if (!conn) {
+    sock_release(sock);
+    return ERR_PTR(-ENOMEM);
+  }
+  conn->sock = sock;
+  refcount_set(&conn->refs, 1);
+  mutex_init(&conn->send_lock);
+  spin_lock_init(&conn->lock);
+  INIT_LIST_HEAD(&conn->pending);
+
+  conn->receiver = kthread_run(vtfs_rpc_receiver, conn, "vtfs-rpc");
+  if (IS_ERR(conn->receiver)) {
+    err = PTR_ERR(conn->receiver);
+    sock_release(sock);
+    kfree(conn);
+    return ERR_PTR(err);
+  }
+  return conn;
+}
+
+void vtfs_rpc_get(struct vtfs_rpc_conn* conn) {
+  refcount_inc(&conn->refs);
+}
+
+void vtfs_rpc_put(struct vtfs_rpc_conn* conn) {
+  if (!refcount_dec_and_test(&conn->refs)) {
+    return;
+  }
+  spin_lock(&conn->lock);
+  if (!conn->error) {
+    conn->error = -ESHUTDOWN;
+  }
+  spin_unlock(&conn->lock);
+
+  // Wakes the receiver out of its recv
+  kernel_sock_shutdown(conn->sock, SHUT_RDWR);
+  kthread_stop(conn->receiver);
+  sock_release(conn->sock);
+  mutex_destroy(&conn->send_lock);
+  kfree(conn);
+}
+
+bool vtfs_rpc_broken(const struct vtfs_rpc_conn* conn) {
+  return READ_ONCE(conn->error) != 0;
+}
+
+// Parameters per call; bounds the gather list kept on the stack
+#define VTFS_RPC_SEND_ARGS 8
+
+// Sends the request for call and sleeps until its response is in. Large
+// values, file data above all, go to the socket from where they are: only
+// the rest of the frame is written into a buffer. They are kvecs, not
+// spliced pages, as file data may be kmalloc'd or vmalloc'd (index.h) and
+// the caller may rewrite it as soon as this returns.
+static int64_t vtfs_rpc_do(
+    struct vtfs_rpc_conn* conn,
+    struct vtfs_rpc_call* call,
+    const char* token,
+    u16 opcode,
+    const struct vtfs_arg* args,
+    size_t nargs
+) {
+  size_t len = vtfs_rpc_request_size(token, args, nargs);
+  struct vtfs_rpc_seg segs[VTFS_RPC_GATHER_SEGS(VTFS_RPC_SEND_ARGS)];
+  struct kvec vec[VTFS_RPC_GATHER_SEGS(VTFS_RPC_SEND_ARGS)];
+  struct msghdr msg = {};
+  size_t count;
+  char* head;
+  bool queued;
+  int err;
+
+  if (nargs > VTFS_RPC_SEND_ARGS || len - VTFS_RPC_HEADER_SIZE > VTFS_RPC_FRAME_MAX) {
+    return -E2BIG;
+  }
+  head = kvmalloc(vtfs_rpc_gather_size(token, args, nargs), GFP_KERNEL);
+  if (!head) {
+    return -ENOMEM;
+  }
+  INIT_LIST_HEAD(&call->list);
+  init_completion(&call->done);
+
+  // Queued before it is sent, so the response always finds its caller
+  spin_lock(&conn->lock);
+  err = conn->error;
+  if (!err) {
+    call->id = conn->next_id++;
+    list_add_tail(&call->list, &conn->pending);
+  }
+  spin_unlock(&conn->lock);
+  if (err) {
+    kvfree(head);
+    return err;
+  }
+
+  count = vtfs_rpc_build_gather(head, opcode, call->id, token, args, nargs, segs);
+  for (size_t i = 0; i < count; i++) {
+    vec[i].iov_base = (void*)segs[i].base;
+    vec[i].iov_len = segs[i].len;
+  }
+  mutex_lock(&conn->send_lock);
+  err = kernel_sendmsg(conn->sock, &msg, vec, count, len);
+  mutex_unlock(&conn->send_lock);
+  kvfree(head);
+  if (err != len) {
+    // Half a frame leaves the stream unusable for every caller; the
+    // receiver then fails them all, this one included
+    kernel_sock_shutdown(conn->sock, SHUT_RDWR);
+  }
+
+  if (wait_for_completion_killable(&call->done)) {
+    spin_lock(&conn->lock);
+    queued = !list_empty(&call->list);
+    if (queued) {
+      list_del_init(&call->list);
+    }
+    spin_unlock(&conn->lock);
+    if (queued) {
+      return -EINTR;
+    }
+    // The receiver already claimed it and is writing into response
+    wait_for_completion(&call->done);
+  }
+  return call->result;
+}
+
+int64_t vtfs_rpc_call(
+    struct vtfs_rpc_conn* conn,
+    const char* token,
+    u16 opcode,
+    char* response,
+    size_t response_size,
+    const struct vtfs_arg* args,
+    size_t nargs
+) {
+  struct vtfs_rpc_call call = {
+      .response = response,
+      .response_size = response_size,
+  };
+
+  return vtfs_rpc_do(conn, &call, token, opcode, args, nargs);
+}
+
+int64_t vtfs_rpc_call_sink(
+    struct vtfs_rpc_conn* conn,
+    const char* token,
+    u16 opcode,
+    vtfs_rpc_sink sink,
+    void* ctx,
+    const struct vtfs_arg* args,
+    size_t nargs
+) {
+  struct vtfs_rpc_call call = {
+      .sink = sink,
+      .sink_ctx = ctx,
+  };
+
+  return vtfs_rpc_do(conn, &call, token, opcode, args, nargs);
+}
@@ -0,0 +1,62 @@
+#ifndef VTFS_RPC_H
+#define VTFS_RPC_H
+
+#include "rpc_proto.h"
+
+// One multiplexed binary RPC connection to the backend. Any number of
+// callers may have requests in flight on it at once: sends are serialised,
+// and a receiver thread hands each response to whichever caller waits for
+// its id, in whatever order the backend answers.
+struct vtfs_rpc_conn;
+
+// addr is "tcp:<ipv4>:<port>" or "unix:<path>". Returns the connection
+// holding one reference, or an ERR_PTR.
+struct vtfs_rpc_conn* vtfs_rpc_connect(const char* addr);
+// Callers hold a reference across vtfs_rpc_call(); dropping the last one
+// shuts the connection down
+void vtfs_rpc_get(struct vtfs_rpc_conn* conn);
+void vtfs_rpc_put(struct vtfs_rpc_conn* conn);
+// True once the connection broke; calls fail with -EPIPE from then on
+bool vtfs_rpc_broken(const struct vtfs_rpc_conn* conn);
+
+// Same contract as vtfs_http_call(): the backend's result (0 or a positive
+// errno) with the payload copied into response, or a negative error if the
+// call did not complete. Sleeps until the response arrives.
+int64_t vtfs_rpc_call(
+    struct vtfs_rpc_conn* conn,
+    const char* token,
+    u16 opcode,
+    char* response,
+    size_t response_size,
+    const struct vtfs_arg* args,
+    size_t nargs
+);
+
+// The payload of a response as it comes off the connection, for callers
+// that place it themselves instead of having it copied into a buffer
+struct vtfs_rpc_payload;
+
+// Receives the next len bytes of the payload into buf. -EPROTO if fewer
+// are left.
+int vtfs_rpc_payload_read(struct vtfs_rpc_payload* payload, void* buf, size_t len);
+size_t vtfs_rpc_payload_left(const struct vtfs_rpc_payload* payload);
+
+// Consumes the payload of a successful response. Runs on the receiver
+// thread while the caller sleeps in vtfs_rpc_call_sink(), so it may write
+// into whatever the caller holds locked; bytes it leaves unread are
+// dropped. Returns 0 or a negative error for the call.
+typedef int (*vtfs_rpc_sink)(void* ctx, struct vtfs_rpc_payload* payload);
+
+// vtfs_rpc_call() that hands the payload to sink instead of a response
+// buffer. sink is not called if the backend returns an error.
+int64_t vtfs_rpc_call_sink(
+    struct vtfs_rpc_conn* conn,
+    const char* token,
+    u16 opcode,
+    vtfs_rpc_sink sink,
+    void* ctx,
+    const struct vtfs_arg* args,
+    size_t nargs
+);
+
+#endif  // VTFS_RPC_H
@@ -0,0 +1,188 @@
+#include "rpc_proto.h"
+
+static const char* const vtfs_rpc_methods[VTFS_RPC_OP_COUNT] = {
+    [VTFS_RPC_LOOKUP] = "lookup",
+    [VTFS_RPC_GETATTR] = "getattr",
+    [VTFS_RPC_CREATE] = "create",
+    [VTFS_RPC_LINK] = "link",
+    [VTFS_RPC_UNLINK] = "unlink",
+    [VTFS_RPC_RMDIR] = "rmdir",
+    [VTFS_RPC_LIST] = "list",
+    [VTFS_RPC_READ] = "read",
+    [VTFS_RPC_WRITE] = "write",
+    [VTFS_RPC_SETXATTR] = "setxattr",
+    [VTFS_RPC_REMOVEXATTR] = "removexattr",
+    [VTFS_RPC_SIGNATURE] = "signature",
+    [VTFS_RPC_PATCH] = "patch",
+};
+
+const char* vtfs_rpc_method(unsigned int opcode) {
+  return opcode < VTFS_RPC_OP_COUNT ? vtfs_rpc_methods[opcode] : NULL;
+}
+
+int vtfs_rpc_opcode(const char* method) {
+  for (int op = VTFS_RPC_LOOKUP; op < VTFS_RPC_OP_COUNT; op++) {
+    if (strcmp(vtfs_rpc_methods[op], method) == 0) {
+      return op;
+    }
+  }
+  return -EINVAL;
+}
+
+static void vtfs_rpc_put16(char* p, u16 v) {
+  p[0] = (char)v;
+  p[1] = (char)(v >> 8);
+}
+
+static void vtfs_rpc_put32(char* p, u32 v) {
+  vtfs_rpc_put16(p, (u16)v);
+  vtfs_rpc_put16(p + 2, (u16)(v >> 16));
+}
+
+static u16 vtfs_rpc_get16(const char* p) {
+  const unsigned char* b = (const unsigned char*)p;
+  return b[0] | b[1] << 8;
+}
+
+static u32 vtfs_rpc_get32(const char* p) {
+  return vtfs_rpc_get16(p) | (u32)vtfs_rpc_get16(p + 2) << 16;
+}
+
+void vtfs_rpc_put_header(char* buf, const struct vtfs_rpc_header* header) {
+  vtfs_rpc_put32(buf, header->magic);
+  vtfs_rpc_put16(buf + 4, header->opcode);
+  vtfs_rpc_put16(buf + 6, header->nargs);
+  vtfs_rpc_put32(buf + 8, header->id);
+  vtfs_rpc_put32(buf + 12, header->len);
+}
+
+int vtfs_rpc_get_header(const char* buf, struct vtfs_rpc_header* header) {
+  header->magic = vtfs_rpc_get32(buf);
+  header->opcode = vtfs_rpc_get16(buf + 4);
+  header->nargs = vtfs_rpc_get16(buf + 6);
+  header->id = vtfs_rpc_get32(buf + 8);
+  header->len = vtfs_rpc_get32(buf + 12);
+  if (header->magic != VTFS_RPC_MAGIC || header->len > VTFS_RPC_FRAME_MAX) {
+    return -EPROTO;
+  }
+  return 0;
+}
+
+// Key length byte and value length word in front of every parameter
+#define VTFS_RPC_ARG_HEADER 5
+
+size_t vtfs_rpc_request_size(const char* token, const struct vtfs_arg* args, size_t nargs) {
+  size_t size = VTFS_RPC_HEADER_SIZE + VTFS_RPC_ARG_HEADER + strlen("token") + strlen(token);
+
+  for (size_t i = 0; i < nargs; i++) {
+    size += VTFS_RPC_ARG_HEADER + strlen(args[i].key) + args[i].len;
+  }
+  return size;
+}
+
+// Everything of a parameter but its value
+static char* vtfs_rpc_put_arg_head(char* p, const char* key, size_t len) {
+  size_t key_len = strlen(key);
+
+  *p = (char)key_len;
+  vtfs_rpc_put32(p + 1, len);
+  memcpy(p + VTFS_RPC_ARG_HEADER, key, key_len);
+  return p + VTFS_RPC_ARG_HEADER + key_len;
+}
+
+static char* vtfs_rpc_put_arg(char* p, const char* key, const char* value, size_t len) {
+  p = vtfs_rpc_put_arg_head(p, key, len);
+  memcpy(p, value, len);
+  return p + len;
+}
+
+size_t vtfs_rpc_build_request(
+    char* buf, u16 opcode, u32 id, const char* token, const struct vtfs_arg* args, size_t nargs
+) {
+  struct vtfs_rpc_header header = {
+      .magic = VTFS_RPC_MAGIC,
+      .opcode = opcode,
+      .nargs = nargs + 1,
+      .id = id,
+  };
+  char* p = buf + VTFS_RPC_HEADER_SIZE;
+
+  p = vtfs_rpc_put_arg(p, "token", token, strlen(token));
+  for (size_t i = 0; i < nargs; i++) {
+    p = vtfs_rpc_put_arg(p, args[i].key, args[i].value, args[i].len);
+  }
+  header.len = p - buf - VTFS_RPC_HEADER_SIZE;
+  vtfs_rpc_put_header(buf, &header);
+  return p - buf;
+}
+
+size_t vtfs_rpc_gather_size(const char* token, const struct vtfs_arg* args, size_t nargs) {
+  size_t size = vtfs_rpc_request_size(token, args, nargs);
+
+  for (size_t i = 0; i < nargs; i++) {
+    if (args[i].len >= VTFS_RPC_GATHER_MIN) {
+      size -= args[i].len;
+    }
+  }
+  return size;
+}
+
+size_t vtfs_rpc_build_gather(
+    char* buf,
+    u16 opcode,
+    u32 id,
+    const char* token,
+    const struct vtfs_arg* args,
+    size_t nargs,
+    struct vtfs_rpc_seg* segs
+) {
+  struct vtfs_rpc_header header = {
+      .magic = VTFS_RPC_MAGIC,
+      .opcode = opcode,
+      .nargs = nargs + 1,
+      .id = id,
+  };
+  char* p = buf + VTFS_RPC_HEADER_SIZE;
+  char* run = buf;  // start of what is written but in no segment yet
+  size_t values = 0;
+  size_t count = 0;
+
+  p = vtfs_rpc_put_arg(p, "token", token, strlen(token));
+  for (size_t i = 0; i < nargs; i++) {
+    if (args[i].len < VTFS_RPC_GATHER_MIN) {
+      p = vtfs_rpc_put_arg(p, args[i].key, args[i].value, args[i].len);
+      continue;
+    }
+    p = vtfs_rpc_put_arg_head(p, args[i].key, args[i].len);
+    segs[count++] = (struct vtfs_rpc_seg){.base = run, .len = p - run};
+    segs[count++] = (struct vtfs_rpc_seg){.base = args[i].value, .len = args[i].len};
+    values += args[i].len;
+    run = p;
+  }
+  if (p > run) {
+    segs[count++] = (struct vtfs_rpc_seg){.base = run, .len = p - run};
+  }
+  header.len = p - buf - VTFS_RPC_HEADER_SIZE + values;
+  vtfs_rpc_put_header(buf, &header);
+  return count;
+}
+
+int vtfs_rpc_next_arg(
+    const char* body, size_t len, size_t* pos, struct vtfs_arg* arg, size_t* key_len
+) {
+  if (*pos == len) {
+    return 0;
+  }
+  if (len - *pos < VTFS_RPC_ARG_HEADER) {
+    return -EPROTO;
+  }
+  *key_len = (unsigned char)body[*pos];
+  arg->len = vtfs_rpc_get32(body + *pos + 1);
+  if (len - *pos - VTFS_RPC_ARG_HEADER < *key_len + arg->len) {
+    return -EPROTO;
+  }
+  arg->key = body + *pos + VTFS_RPC_ARG_HEADER;
+  arg->value = arg->key + *key_len;
+  *pos += VTFS_RPC_ARG_HEADER + *key_len + arg->len;
+  return 1;
+}
@@ -0,0 +1,101 @@
+#ifndef VTFS_RPC_PROTO_H
+#define VTFS_RPC_PROTO_H
+
+#include "proto.h"
+#include "shim.h"
+
+// Binary RPC framing, the alternative to the HTTP transport. Same methods,
+// parameters and results, without text: every frame is a fixed header
+// followed by len bytes of body, all little-endian.
+//
+//   header   { u32 magic, u16 opcode, u16 nargs, u32 id, u32 len }
+//   request  nargs times { u8 key_len, u32 value_len, key, value }; the
+//            first is always "token"
+//   response { s64 result, payload }, with the opcode and id of the request
+//
+// Requests on one connection are tagged with ids chosen by the client and
+// may be answered in any order, so a slow read does not hold up the lookups
+// sent after it.
+#define VTFS_RPC_MAGIC 0x50525456  // "VTRP"
+#define VTFS_RPC_HEADER_SIZE 16
+#define VTFS_RPC_FRAME_MAX (16 << 20)
+
+enum vtfs_rpc_op {
+  VTFS_RPC_LOOKUP = 1,
+  VTFS_RPC_GETATTR,
+  VTFS_RPC_CREATE,
+  VTFS_RPC_LINK,
+  VTFS_RPC_UNLINK,
+  VTFS_RPC_RMDIR,
+  VTFS_RPC_LIST,
+  VTFS_RPC_READ,
+  VTFS_RPC_WRITE,
+  VTFS_RPC_SETXATTR,
+  VTFS_RPC_REMOVEXATTR,
+  VTFS_RPC_SIGNATURE,
+  VTFS_RPC_PATCH,
+  VTFS_RPC_OP_COUNT,
+};
+
+struct vtfs_rpc_header {
+  u32 magic;
+  u16 opcode;
+  u16 nargs;
+  u32 id;
+  u32 len;
+};
+
+// HTTP method name of an opcode and back; NULL and -EINVAL if unknown
+const char* vtfs_rpc_method(unsigned int opcode);
+int vtfs_rpc_opcode(const char* method);
+
+void vtfs_rpc_put_header(char* buf, const struct vtfs_rpc_header* header);
+// -EPROTO on a bad magic or a body over VTFS_RPC_FRAME_MAX
+int vtfs_rpc_get_header(const char* buf, struct vtfs_rpc_header* header);
+
+// Size of the whole request frame, header included
+size_t vtfs_rpc_request_size(const char* token, const struct vtfs_arg* args, size_t nargs);
+// Writes the request frame into buf, which holds vtfs_rpc_request_size()
+// bytes, and returns its length
+size_t vtfs_rpc_build_request(
+    char* buf, u16 opcode, u32 id, const char* token, const struct vtfs_arg* args, size_t nargs
+);
+
+// Gather form of a request, for sending file data from where it is instead
+// of copying it into the frame: parameters with values of at least
+// VTFS_RPC_GATHER_MIN bytes are split into their header, written into buf,
+// and the value itself.
+#define VTFS_RPC_GATHER_MIN 256
+#define VTFS_RPC_GATHER_SEGS(nargs) (2 * (nargs) + 1)
+
+// One piece of a request frame
+struct vtfs_rpc_seg {
+  const char* base;
+  size_t len;
+};
+
+// Bytes vtfs_rpc_build_gather() writes into buf
+size_t vtfs_rpc_gather_size(const char* token, const struct vtfs_arg* args, size_t nargs);
+// Writes the frame into buf except for its large values and fills segs,
+// which holds VTFS_RPC_GATHER_SEGS(nargs) entries, with the pieces of buf
+// and the values in order. Sent back to back they are the frame of
+// vtfs_rpc_build_request(), vtfs_rpc_request_size() bytes. Returns the
+// number of segs used.
+size_t vtfs_rpc_build_gather(
+    char* buf,
+    u16 opcode,
+    u32 id,
+    const char* token,
+    const struct vtfs_arg* args,
+    size_t nargs,
+    struct vtfs_rpc_seg* segs
+);
+
+// Reads the parameter at *pos of a request body and advances *pos. Returns
+// 1, 0 at the end of the body or -EPROTO if it is truncated. Neither key
+// (key_len bytes) nor value (arg->len bytes) is NUL-terminated.
+int vtfs_rpc_next_arg(
+    const char* body, size_t len, size_t* pos, struct vtfs_arg* arg, size_t* key_len
+);
+
+#endif  // VTFS_RPC_PROTO_H
@@ -0,0 +1,259 @@
+#ifndef VTFS_SHIM_H
+#define VTFS_SHIM_H
+
+// Thin portability layer for the parts of vtfs that are plain data structures
+// and protocol code (index.c, data.c, csum.c, xattr.c, proto.c). In the kernel it only pulls in
+// the usual headers; in userspace it maps the handful of kernel primitives
+// they use onto libc so the same sources build into a benchmark library.
+
+#ifdef __KERNEL__
+
+#include <linux/atomic.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/minmax.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/nodemask.h>
+#include <linux/printk.h>
+#include <linux/slab.h>
+#include <linux/stat.h>
+#include <linux/stdarg.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/xattr.h>
+
+// NUMA node backing a kmalloc'd object, or the first page of a vmalloc'd one
+#define vtfs_ptr_nid(ptr) \
+  page_to_nid(is_vmalloc_addr(ptr) ? vmalloc_to_page(ptr) : virt_to_page(ptr))
+
+#else  // userspace
+
+#include <errno.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+
+typedef unsigned short umode_t;
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef unsigned int gfp_t;
+typedef struct {
+  uid_t val;
+} kuid_t;
+typedef struct {
+  gid_t val;
+} kgid_t;
+
+#define U32_MAX UINT32_MAX
+
+#define __user
+
+#define GFP_KERNEL 0
+#define kmalloc(size, gfp) malloc(size)
+#define kzalloc(size, gfp) calloc(1, size)
+#define kcalloc(n, size, gfp) calloc(n, size)
+#define krealloc(ptr, size, gfp) realloc(ptr, size)
+#define kstrdup(s, gfp) strdup(s)
+#define kfree(ptr) free((void*)(ptr))
+#define kvmalloc(size, gfp) malloc(size)
+#define kvmalloc_array(n, size, gfp) calloc(n, size)
+#define kvfree(ptr) free((void*)(ptr))
+#define is_vmalloc_addr(ptr) ((void)(ptr), false)
+#define KMALLOC_MAX_SIZE ((size_t)4 << 20)
+
+// A single memory node: placement policies have nothing to choose from
+#define NUMA_NO_NODE (-1)
+#define kmalloc_node(size, gfp, node) ((void)(node), malloc(size))
+#define kzalloc_node(size, gfp, node) ((void)(node), calloc(1, size))
+#define kvmalloc_node(size, gfp, node) ((void)(node), malloc(size))
+#define kvzalloc_node(size, gfp, node) ((void)(node), calloc(1, size))
+#define numa_node_id() 0
+#define nr_node_ids 1
+#define vtfs_ptr_nid(ptr) 0
+
+// Size class kmalloc would serve a request from: the kmalloc-8 .. kmalloc-8k
+// slab caches (including the 96 and 192 byte ones), whole pages above that
+static inline size_t kmalloc_size_roundup(size_t size) {
+  size_t pow2 = 8;
+  if (size == 0) {
+    return 0;
+  }
+  if (size > 64 && size <= 96) {
+    return 96;
+  }
+  if (size > 128 && size <= 192) {
+    return 192;
+  }
+  while (pow2 < size) {
+    pow2 <<= 1;
+  }
+  return size > 8192 ? (size + 4095) & ~(size_t)4095 : pow2;
+}
+
+typedef struct {
+  long counter;
+} atomic_long_t;
+
+static inline long atomic_long_read(const atomic_long_t* v) {
+  return __atomic_load_n(&v->counter, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_long_add(long i, atomic_long_t* v) {
+  __atomic_fetch_add(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_long_sub(long i, atomic_long_t* v) {
+  __atomic_fetch_sub(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+#define scnprintf(buf, size, ...)            \
+  ({                                         \
+    int __n = snprintf(buf, size, __VA_ARGS__); \
+    __n < (int)(size) ? __n : (int)(size) - 1; \
+  })
+
+struct mutex {
+  pthread_mutex_t m;
+};
+
+#define mutex_init(lock) pthread_mutex_init(&(lock)->m, NULL)
+#define mutex_destroy(lock) pthread_mutex_destroy(&(lock)->m)
+#define mutex_lock(lock) pthread_mutex_lock(&(lock)->m)
+#define mutex_unlock(lock) pthread_mutex_unlock(&(lock)->m)
+
+#define WARN_ON(cond) ((void)(cond))
+
+#define KERN_INFO ""
+#define KERN_ERR ""
+#define printk(...) ((void)0)
+#define pr_info(...) ((void)0)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+static inline unsigned long copy_to_user(void* to, const void* from, unsigned long n) {
+  memcpy(to, from, n);
+  return 0;
+}
+
+static inline unsigned long copy_from_user(void* to, const void* from, unsigned long n) {
+  memcpy(to, from, n);
+  return 0;
+}
+
+static inline int kstrtoint(const char* s, unsigned int base, int* res) {
+  char* end;
+  long v = strtol(s, &end, (int)base);
+  if (end == s || (*end != '\0' && *end != '\n')) {
+    return -EINVAL;
+  }
+  *res = (int)v;
+  return 0;
+}
+
+static inline int kstrtoul(const char* s, unsigned int base, unsigned long* res) {
+  char* end;
+  unsigned long v = strtoul(s, &end, (int)base);
+  if (end == s || (*end != '\0' && *end != '\n')) {
+    return -EINVAL;
+  }
+  *res = v;
+  return 0;
+}
+
+#define container_of(ptr, type, member) ((type*)((char*)(ptr)-offsetof(type, member)))
+
+struct list_head {
+  struct list_head *next, *prev;
+};
+
+#define LIST_HEAD(name) struct list_head name = {&(name), &(name)}
+
+static inline void INIT_LIST_HEAD(struct list_head* list) {
+  list->next = list;
+  list->prev = list;
+}
+
+static inline void __list_add(struct list_head* entry, struct list_head* prev, struct list_head* next) {
+  next->prev = entry;
+  entry->next = next;
+  entry->prev = prev;
+  prev->next = entry;
+}
+
+static inline void list_add(struct list_head* entry, struct list_head* head) {
+  __list_add(entry, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head* entry, struct list_head* head) {
+  __list_add(entry, head->prev, head);
+}
+
+static inline void list_del(struct list_head* entry) {
+  entry->next->prev = entry->prev;
+  entry->prev->next = entry->next;
+  entry->next = NULL;
+  entry->prev = NULL;
+}
+
+static inline void list_del_init(struct list_head* entry) {
+  entry->next->prev = entry->prev;
+  entry->prev->next = entry->next;
+  INIT_LIST_HEAD(entry);
+}
+
+static inline int list_empty(const struct list_head* head) {
+  return head->next == head;
+}
+
+static inline void list_splice_tail_init(struct list_head* list, struct list_head* head) {
+  if (!list_empty(list)) {
+    list->next->prev = head->prev;
+    head->prev->next = list->next;
+    list->prev->next = head;
+    head->prev = list->prev;
+    INIT_LIST_HEAD(list);
+  }
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_first_entry(ptr, type, member) list_entry((ptr)->next, type, member)
+
+#define list_for_each(pos, head) for (pos = (head)->next; pos != (head); pos = pos->next)
+
+#define list_for_each_entry(pos, head, member)                           \
+  for (pos = list_entry((head)->next, __typeof__(*pos), member);         \
+       &pos->member != (head);                                           \
+       pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+#define list_for_each_entry_safe(pos, n, head, member)                   \
+  for (pos = list_entry((head)->next, __typeof__(*pos), member),         \
+      n = list_entry(pos->member.next, __typeof__(*pos), member);        \
+       &pos->member != (head);                                           \
+       pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+#endif  // __KERNEL__
+
+#define MODULE_NAME "vtfs"
+
+#define LOG(fmt, ...) pr_info("[" MODULE_NAME "]: " fmt, ##__VA_ARGS__)
+
+#endif  // VTFS_SHIM_H
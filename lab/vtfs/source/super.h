@@ -0,0 +1,31 @@
+#ifndef VTFS_SUPER_H
+#define VTFS_SUPER_H
+
+#include <linux/fs.h>
+
+#include "index.h"
+#include "mem.h"
+#include "remote.h"
+#include "tier.h"
+#include "xattr.h"
+
+// Per-mount state, hung off sb->s_fs_info
+struct vtfs_sb_info {
+  struct vtfs_node* root;
+  struct vtfs_mem mem;
+  struct vtfs_xattr_table xattrs;  // shared xattr values, serialises all xattr ops
+  struct dentry* debugfs;  // /sys/kernel/debug/vtfs/<dev>/
+  struct vtfs_remote remote;
+  struct vtfs_tier tier;
+};
+
+static inline struct vtfs_sb_info* vtfs_sb(const struct super_block* sb) {
+  return sb->s_fs_info;
+}
+
+// Returns a referenced inode for node, reusing the cached one if any
+struct inode* vtfs_get_inode(
+    struct super_block* sb, const struct inode* dir, struct vtfs_node* node
+);
+
+#endif  // VTFS_SUPER_H
@@ -0,0 +1,365 @@
+#include "tier.h"
+
+#include <linux/fadvise.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+#include <linux/wait_bit.h>
+
+#include "data.h"
+#include "super.h"
+
+// Demotions tried per run of the worker, so a mount whose files are all
+// busy or dirty with the backend down does not keep it spinning
+#define VTFS_TIER_PASSES 64
+
+static bool vtfs_tier_over(struct vtfs_tier* tier, struct vtfs_mem* mem) {
+  return tier->heat.budget && vtfs_mem_read(mem, VTFS_MEM_DATA) > (long)tier->heat.budget;
+}
+
+static void vtfs_tier_kick(struct vtfs_tier* tier, struct vtfs_mem* mem) {
+  if (vtfs_tier_over(tier, mem)) {
+    queue_work(system_unbound_wq, &tier->work);
+  }
+}
+
+// Called with the inode locked
+static int vtfs_tier_demote(
+    struct vtfs_tier* tier, struct vtfs_remote* remote, struct vtfs_node* node
+) {
+  struct vtfs_heat* heat = node->heat;
+  int err;
+
+  if (!heat || !node->data) {
+    return 0;
+  }
+  // Only a fully faulted-in file can be dirty, so the sync sends all of it.
+  // Data the backend has no file for yet goes up whatever its state.
+  if (heat->dirty || !node->remote_ino) {
+    err = vtfs_remote_sync(remote, node);
+    if (err) {
+      return err;
+    }
+  }
+  mutex_lock(&tier->lock);
+  vtfs_heat_demoted(&tier->heat, heat);
+  mutex_unlock(&tier->lock);
+  vtfs_data_demote(node);
+  return 0;
+}
+
+static void vtfs_tier_balance(struct work_struct* work) {
+  struct vtfs_tier* tier = container_of(work, struct vtfs_tier, work);
+  struct vtfs_sb_info* sbi = vtfs_sb(tier->sb);
+
+  for (int pass = 0; pass < VTFS_TIER_PASSES && vtfs_tier_over(tier, &sbi->mem); pass++) {
+    struct vtfs_node* node;
+    struct inode* inode = NULL;
+    int err = 0;
+
+    mutex_lock(&tier->lock);
+    node = vtfs_heat_victim(&tier->heat, ktime_get_seconds());
+    if (node) {
+      inode = vtfs_get_inode(tier->sb, NULL, node);
+    }
+    mutex_unlock(&tier->lock);
+    if (!inode) {
+      break;
+    }
+    // A file in use is hot anyway; the next sample has other candidates
+    if (inode_trylock(inode)) {
+      err = vtfs_tier_demote(tier, &sbi->remote, node);
+      inode_unlock(inode);
+    }
+    iput(inode);
+    // The backend is likely down for the next file too; the next write
+    // over budget tries again
+    if (err) {
+      break;
+    }
+  }
+}
+
+void vtfs_tier_init(struct vtfs_tier* tier, struct super_block* sb) {
+  mutex_init(&tier->lock);
+  vtfs_heat_init(&tier->heat, 0);
+  tier->sb = sb;
+  INIT_WORK(&tier->work, vtfs_tier_balance);
+  atomic_set(&tier->prefetches, 0);
+}
+
+int vtfs_tier_set_budget(struct vtfs_tier* tier, const char* size) {
+  char* end;
+  unsigned long long budget = memparse(size, &end);
+
+  if (end == size || *end) {
+    return -EINVAL;
+  }
+  tier->heat.budget = budget;
+  return 0;
+}
+
+void vtfs_tier_destroy(struct vtfs_tier* tier) {
+  // Prefetches hold inode references, which have to be gone by eviction
+  wait_var_event(&tier->prefetches, !atomic_read(&tier->prefetches));
+  cancel_work_sync(&tier->work);
+  mutex_destroy(&tier->lock);
+}
+
+bool vtfs_tier_access(struct vtfs_tier* tier, struct vtfs_node* node, size_t offset, size_t len) {
+  size_t missing;
+
+  if (!node->heat) {
+    return false;
+  }
+  mutex_lock(&tier->lock);
+  missing = vtfs_heat_access(&tier->heat, node, offset, len, ktime_get_seconds());
+  mutex_unlock(&tier->lock);
+  return missing || (!node->data && node->size);
+}
+
+// Fetches chunks [start, end) of the node, which a caller waits on when
+// sync is set
+static ssize_t vtfs_tier_fetch(
+    struct vtfs_remote* remote, struct vtfs_node* node, size_t start, size_t end, bool sync
+) {
+  size_t offset = start * VTFS_CSUM_CHUNK;
+  size_t bytes = min_t(size_t, end * VTFS_CSUM_CHUNK, node->size) - offset;
+
+  if (sync) {
+    return vtfs_remote_read(remote, node, offset, bytes);
+  }
+  return vtfs_remote_readahead(remote, node, offset, bytes);
+}
+
+int vtfs_tier_fault(
+    struct vtfs_tier* tier,
+    struct vtfs_remote* remote,
+    struct vtfs_node* node,
+    size_t offset,
+    size_t len,
+    size_t ahead
+) {
+  struct vtfs_heat* heat = node->heat;
+  size_t first = offset / VTFS_CSUM_CHUNK;
+  size_t last = len ? vtfs_csum_chunks(offset + len) : first;
+  size_t window = vtfs_csum_chunks(min_t(size_t, offset + len + ahead, node->size));
+  u64 now = ktime_get_seconds();
+  size_t from = 0;
+  size_t start;
+  size_t end;
+  int err;
+
+  if (!heat) {
+    return 0;
+  }
+  if (!node->data && node->size) {
+    err = vtfs_data_restore(node);
+    if (err) {
+      return err;
+    }
+    mutex_lock(&tier->lock);
+    vtfs_heat_restored(&tier->heat, heat);
+    mutex_unlock(&tier->lock);
+  }
+
+  for (;;) {
+    bool found;
+    size_t split;
+
+    mutex_lock(&tier->lock);
+    found = vtfs_heat_next_fetch(heat, from, first, max(last, window), now, &start, &end);
+    mutex_unlock(&tier->lock);
+    if (!found) {
+      break;
+    }
+    from = end;
+
+    // The chunks asked for are waited on; the window past them and hot
+    // chunks elsewhere are readahead, and a failure there only costs a
+    // fault of their own later
+    split = clamp(last, start, end);
+    if (split > start) {
+      ssize_t got = vtfs_tier_fetch(remote, node, start, split, true);
+
+      if (got < 0) {
+        return got;
+      }
+    }
+    if (split < end && vtfs_tier_fetch(remote, node, split, end, false) < 0) {
+      end = split;
+    }
+    // Past the backend's EOF the file is zeros, as restored
+    mutex_lock(&tier->lock);
+    vtfs_heat_fetched(&tier->heat, heat, start, end);
+    mutex_unlock(&tier->lock);
+  }
+
+  vtfs_tier_kick(tier, node->mem);
+  return 0;
+}
+
+struct vtfs_tier_prefetch {
+  struct work_struct work;
+  struct vtfs_tier* tier;
+  struct inode* inode;
+  size_t offset;
+  size_t len;
+};
+
+static void vtfs_tier_prefetch_work(struct work_struct* work) {
+  struct vtfs_tier_prefetch* prefetch = container_of(work, struct vtfs_tier_prefetch, work);
+  struct vtfs_tier* tier = prefetch->tier;
+  struct inode* inode = prefetch->inode;
+
+  inode_lock(inode);
+  vtfs_tier_fault(
+      tier, &vtfs_sb(inode->i_sb)->remote, inode->i_private, prefetch->offset, 0, prefetch->len
+  );
+  inode_unlock(inode);
+  iput(inode);
+  kfree(prefetch);
+
+  if (atomic_dec_and_test(&tier->prefetches)) {
+    wake_up_var(&tier->prefetches);
+  }
+}
+
+int vtfs_tier_prefetch(struct vtfs_tier* tier, struct inode* inode, size_t offset, size_t len) {
+  struct vtfs_node* node = inode->i_private;
+  struct vtfs_tier_prefetch* prefetch;
+  bool missing;
+
+  mutex_lock(&tier->lock);
+  missing = node->heat && node->heat->missing;
+  mutex_unlock(&tier->lock);
+  if (!missing) {
+    return 0;
+  }
+
+  prefetch = kmalloc(sizeof(*prefetch), GFP_KERNEL);
+  if (!prefetch) {
+    return -ENOMEM;
+  }
+  INIT_WORK(&prefetch->work, vtfs_tier_prefetch_work);
+  prefetch->tier = tier;
+  prefetch->inode = inode;
+  prefetch->offset = offset;
+  prefetch->len = len;
+  ihold(inode);
+  atomic_inc(&tier->prefetches);
+  queue_work(system_unbound_wq, &prefetch->work);
+  return 0;
+}
+
+void vtfs_tier_open(struct file* file) {
+  file->f_ra.ra_pages = VTFS_TIER_READAHEAD_PAGES;
+}
+
+void vtfs_tier_advise(struct file* file, int advice) {
+  switch (advice) {
+    case POSIX_FADV_NORMAL:
+    case POSIX_FADV_SEQUENTIAL:
+      file->f_ra.ra_pages = VTFS_TIER_READAHEAD_PAGES;
+      if (advice == POSIX_FADV_SEQUENTIAL) {
+        file->f_ra.ra_pages *= 2;
+      }
+      spin_lock(&file->f_lock);
+      file->f_mode &= ~FMODE_RANDOM;
+      spin_unlock(&file->f_lock);
+      break;
+    case POSIX_FADV_RANDOM:
+      spin_lock(&file->f_lock);
+      file->f_mode |= FMODE_RANDOM;
+      spin_unlock(&file->f_lock);
+      break;
+  }
+}
+
+size_t vtfs_tier_readahead(struct file* file) {
+  if (file->f_mode & FMODE_RANDOM) {
+    return 0;
+  }
+  return (size_t)file->f_ra.ra_pages << PAGE_SHIFT;
+}
+
+int vtfs_tier_drop(struct vtfs_tier* tier, struct vtfs_node* node, size_t offset, size_t len) {
+  struct vtfs_heat* heat = node->heat;
+  bool whole;
+
+  if (!heat || heat->pinned) {
+    return 0;
+  }
+  whole = offset == 0 && len >= node->size;
+  mutex_lock(&tier->lock);
+  if (whole && node->data && !heat->dirty) {
+    vtfs_heat_demoted(&tier->heat, heat);
+  } else {
+    vtfs_heat_cool(heat, offset, len);
+    whole = false;
+  }
+  mutex_unlock(&tier->lock);
+
+  if (whole) {
+    vtfs_data_demote(node);
+  }
+  return 0;
+}
+
+int vtfs_tier_pin(struct vtfs_tier* tier, struct vtfs_node* node, bool pinned) {
+  int err = 0;
+
+  if (!S_ISREG(node->mode)) {
+    return 0;
+  }
+  mutex_lock(&tier->lock);
+  if (!node->heat) {
+    err = vtfs_heat_resize(node, ktime_get_seconds());
+  }
+  if (!err) {
+    vtfs_heat_pin(&tier->heat, node, pinned);
+  }
+  mutex_unlock(&tier->lock);
+  return err;
+}
+
+void vtfs_tier_changed(struct vtfs_tier* tier, struct vtfs_node* node) {
+  int err;
+
+  mutex_lock(&tier->lock);
+  err = vtfs_heat_resize(node, ktime_get_seconds());
+  if (node->heat) {
+    node->heat->dirty = true;
+    // Heat that no longer covers the file must not mark it demoted
+    if (err) {
+      vtfs_heat_unlink(node);
+    } else {
+      vtfs_heat_link(&tier->heat, node);
+    }
+  }
+  mutex_unlock(&tier->lock);
+
+  vtfs_tier_kick(tier, node->mem);
+}
+
+void vtfs_tier_forget(struct vtfs_tier* tier, struct vtfs_node* node) {
+  mutex_lock(&tier->lock);
+  vtfs_heat_unlink(node);
+  mutex_unlock(&tier->lock);
+}
+
+int vtfs_tier_report(struct vtfs_tier* tier, struct vtfs_remote* remote, char* buf, size_t size) {
+  long resident = vtfs_mem_read(&vtfs_sb(tier->sb)->mem, VTFS_MEM_DATA);
+  int len;
+
+  mutex_lock(&tier->lock);
+  len = vtfs_heat_report(
+      &tier->heat,
+      resident,
+      atomic_long_read(&remote->cache.hits),
+      atomic_long_read(&remote->fetched),
+      buf,
+      size
+  );
+  mutex_unlock(&tier->lock);
+  return len;
+}
@@ -0,0 +1,98 @@
+#ifndef VTFS_TIER_H
+#define VTFS_TIER_H
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/xattr.h>
+
+#include "heat.h"
+
+struct vtfs_remote;
+
+// RAM tier of a mount's file data. With a ram=<size> budget, a worker
+// demotes the coldest files (see heat.h) whenever the file data charged to
+// the mount goes over it, syncing those with changes to the backend first,
+// and an access to a demoted file promotes it again. Callers hold the
+// node's inode lock: shared to record an access, exclusive for anything
+// that changes its data or drops it. The worker only ever trylocks an
+// inode.
+struct vtfs_tier {
+  // Protects heat and every node's heat. The worker holds it while it takes
+  // an inode for a candidate, so the node cannot lose its last link and be
+  // freed in between.
+  struct mutex lock;
+  struct vtfs_heat_table heat;
+  struct super_block* sb;
+  struct work_struct work;
+  atomic_t prefetches;  // queued by vtfs_tier_prefetch() and not done yet
+};
+
+// Setting this xattr (any value) pins a file: it is never demoted. Being a
+// trusted.* name, only CAP_SYS_ADMIN can set it.
+#define VTFS_TIER_PIN_XATTR XATTR_TRUSTED_PREFIX "vtfs.pin"
+
+void vtfs_tier_init(struct vtfs_tier* tier, struct super_block* sb);
+// Parses the ram=<size> mount option, in bytes with an optional K, M or G
+int vtfs_tier_set_budget(struct vtfs_tier* tier, const char* size);
+// Stops the worker; before the mount's inodes are evicted
+void vtfs_tier_destroy(struct vtfs_tier* tier);
+
+// Records an access to [offset, offset + len) of the node. Returns true if
+// part of it is on the backend only and has to be faulted in first.
+bool vtfs_tier_access(struct vtfs_tier* tier, struct vtfs_node* node, size_t offset, size_t len);
+
+// Promotes the node for an access to [offset, offset + len): gives it its
+// allocation back and fetches the missing chunks in the range from the
+// backend. The missing chunks in the ahead bytes past it, and hot ones
+// anywhere, are fetched as readahead. Returns 0 or a negative errno, which
+// only the chunks in the range can cause.
+int vtfs_tier_fault(
+    struct vtfs_tier* tier,
+    struct vtfs_remote* remote,
+    struct vtfs_node* node,
+    size_t offset,
+    size_t len,
+    size_t ahead
+);
+
+// Application hints (fadvise and the pin xattr)
+
+// Pages of a file a read faults in past itself by default. The mount has
+// no backing device, whose readahead the VFS would otherwise copy into
+// every file at open.
+#define VTFS_TIER_READAHEAD_PAGES VM_READAHEAD_PAGES
+
+// Gives a newly opened file the default readahead window
+void vtfs_tier_open(struct file* file);
+// Applies POSIX_FADV_NORMAL, SEQUENTIAL (twice the default) or RANDOM
+// (none) to the file's window; other advice is left to the caller
+void vtfs_tier_advise(struct file* file, int advice);
+// Bytes past a read of the file to fault in with it
+size_t vtfs_tier_readahead(struct file* file);
+
+// Faults [offset, offset + len) of the inode in as readahead, from a
+// worker holding a reference to it. Does nothing if none of the file is
+// missing.
+int vtfs_tier_prefetch(struct vtfs_tier* tier, struct inode* inode, size_t offset, size_t len);
+// Drops [offset, offset + len) of the node from RAM if the backend has it.
+// Only a range covering the whole file frees anything, the file's data
+// being one allocation; a part, or a file with changes, is cooled instead
+// so that it goes first. Pinned files are left alone.
+int vtfs_tier_drop(struct vtfs_tier* tier, struct vtfs_node* node, size_t offset, size_t len);
+// Pins or unpins a regular file; others are ignored
+int vtfs_tier_pin(struct vtfs_tier* tier, struct vtfs_node* node, bool pinned);
+
+// The node's data was changed in RAM, which needs it fully faulted in: it
+// has to be synced before it is demoted again. A node whose heat cannot be
+// sized to it stays in RAM.
+void vtfs_tier_changed(struct vtfs_tier* tier, struct vtfs_node* node);
+// The node lost its last link and stays in RAM until it is freed
+void vtfs_tier_forget(struct vtfs_tier* tier, struct vtfs_node* node);
+
+// Formats the RAM counters and the chunks the disk cache and the backend
+// supplied into buf, returns the length
+int vtfs_tier_report(struct vtfs_tier* tier, struct vtfs_remote* remote, char* buf, size_t size);
+
+#endif  // VTFS_TIER_H
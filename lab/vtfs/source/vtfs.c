@@ -1,132 +1,392 @@
+#include <linux/ctype.h>
+#include <linux/debugfs.h>
+#include <linux/fadvise.h>
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/printk.h>
 #include <linux/processor.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/xattr.h>
 
-#define MODULE_NAME "vtfs"
+#include "capture.h"
+#include "data.h"
+#include "http_pool.h"
+#include "index.h"
+#include "mem.h"
+#include "super.h"
+#include "vtfs_trace.h"
+#include "xattr.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("secs-dev");
 MODULE_DESCRIPTION("A simple FS kernel module");
 
-#define LOG(fmt, ...) pr_info("[" MODULE_NAME "]: " fmt, ##__VA_ARGS__)
-
-struct vtfs_file {
-  struct list_head list;
-  char* name;
-  ino_t ino;
-  umode_t mode;
-  struct inode* inode;
-  size_t size;
-  char* data;
-};
-
-struct vtfs_dir {
-  struct list_head children;
-  struct vtfs_file* self;
-};
-
 void vtfs_kill_sb(struct super_block*);
 struct dentry* vtfs_mount(struct file_system_type*, int, const char*, void*);
 int vtfs_fill_super(struct super_block*, void*, int);
-struct inode* vtfs_get_inode(struct super_block*, const struct inode*, umode_t, int);
+struct inode* vtfs_get_inode(struct super_block*, const struct inode*, struct vtfs_node*);
+void vtfs_evict_inode(struct inode*);
 struct dentry* vtfs_lookup(struct inode*, struct dentry*, unsigned int);
 int vtfs_iterate(struct file*, struct dir_context*);
 int vtfs_create(struct mnt_idmap*, struct inode*, struct dentry*, umode_t, bool);
 int vtfs_unlink(struct inode*, struct dentry*);
 int vtfs_mkdir(struct mnt_idmap*, struct inode*, struct dentry*, umode_t);
 int vtfs_rmdir(struct inode*, struct dentry*);
+int vtfs_open(struct inode*, struct file*);
 ssize_t vtfs_read(struct file*, char __user*, size_t, loff_t*);
 ssize_t vtfs_write(struct file*, const char __user*, size_t, loff_t*);
+int vtfs_fadvise(struct file*, loff_t, loff_t, int);
 int vtfs_link(struct dentry*, struct inode*, struct dentry*);
+int vtfs_symlink(struct mnt_idmap*, struct inode*, struct dentry*, const char*);
+ssize_t vtfs_listxattr(struct dentry*, char*, size_t);
+int vtfs_getattr(struct mnt_idmap*, const struct path*, struct kstat*, u32, unsigned int);
+int vtfs_setattr(struct mnt_idmap*, struct dentry*, struct iattr*);
+void vtfs_dirty_inode(struct inode*, int);
+int vtfs_show_options(struct seq_file*, struct dentry*);
+
+static struct dentry* vtfs_debugfs_root;
+
+// Traced entry points: each reports one vtfs_op event when the op returns
+
+static inline u64 vtfs_trace_start(void) {
+  return trace_vtfs_op_enabled() ? ktime_get_ns() : 0;
+}
+
+static inline u64 vtfs_dentry_ino(const struct dentry* dentry) {
+  return d_really_is_positive(dentry) ? d_inode(dentry)->i_ino : 0;
+}
+
+static struct dentry* vtfs_traced_lookup(
+    struct inode* dir, struct dentry* dentry, unsigned int flags
+) {
+  u64 start = vtfs_trace_start();
+  struct dentry* ret = vtfs_lookup(dir, dentry, flags);
+
+  trace_vtfs_op(
+      VTFS_OP_LOOKUP,
+      vtfs_dentry_ino(dentry),
+      dir->i_ino,
+      dentry->d_name.name,
+      0,
+      0,
+      PTR_ERR_OR_ZERO(ret),
+      start
+  );
+  return ret;
+}
+
+static int vtfs_traced_create(
+    struct mnt_idmap* idmap, struct inode* dir, struct dentry* dentry, umode_t mode, bool excl
+) {
+  u64 start = vtfs_trace_start();
+  int ret = vtfs_create(idmap, dir, dentry, mode, excl);
+
+  trace_vtfs_op(
+      VTFS_OP_CREATE, vtfs_dentry_ino(dentry), dir->i_ino, dentry->d_name.name, 0, 0, ret, start
+  );
+  return ret;
+}
+
+static int vtfs_traced_mkdir(
+    struct mnt_idmap* idmap, struct inode* dir, struct dentry* dentry, umode_t mode
+) {
+  u64 start = vtfs_trace_start();
+  int ret = vtfs_mkdir(idmap, dir, dentry, mode);
+
+  trace_vtfs_op(
+      VTFS_OP_MKDIR, vtfs_dentry_ino(dentry), dir->i_ino, dentry->d_name.name, 0, 0, ret, start
+  );
+  return ret;
+}
+
+static int vtfs_traced_unlink(struct inode* dir, struct dentry* dentry) {
+  u64 start = vtfs_trace_start();
+  u64 ino = vtfs_dentry_ino(dentry);
+  int ret = vtfs_unlink(dir, dentry);
+
+  trace_vtfs_op(VTFS_OP_UNLINK, ino, dir->i_ino, dentry->d_name.name, 0, 0, ret, start);
+  return ret;
+}
+
+static int vtfs_traced_rmdir(struct inode* dir, struct dentry* dentry) {
+  u64 start = vtfs_trace_start();
+  u64 ino = vtfs_dentry_ino(dentry);
+  int ret = vtfs_rmdir(dir, dentry);
+
+  trace_vtfs_op(VTFS_OP_RMDIR, ino, dir->i_ino, dentry->d_name.name, 0, 0, ret, start);
+  return ret;
+}
+
+static int vtfs_traced_link(struct dentry* old_dentry, struct inode* dir, struct dentry* dentry) {
+  u64 start = vtfs_trace_start();
+  int ret = vtfs_link(old_dentry, dir, dentry);
+
+  trace_vtfs_op(
+      VTFS_OP_LINK, vtfs_dentry_ino(old_dentry), dir->i_ino, dentry->d_name.name, 0, 0, ret, start
+  );
+  return ret;
+}
+
+static int vtfs_traced_symlink(
+    struct mnt_idmap* idmap, struct inode* dir, struct dentry* dentry, const char* target
+) {
+  u64 start = vtfs_trace_start();
+  int ret = vtfs_symlink(idmap, dir, dentry, target);
+
+  trace_vtfs_op(
+      VTFS_OP_SYMLINK,
+      vtfs_dentry_ino(dentry),
+      dir->i_ino,
+      dentry->d_name.name,
+      0,
+      strlen(target),
+      ret,
+      start
+  );
+  return ret;
+}
+
+static int vtfs_traced_iterate(struct file* file, struct dir_context* ctx) {
+  u64 start = vtfs_trace_start();
+  loff_t pos = ctx->pos;
+  int ret = vtfs_iterate(file, ctx);
+
+  trace_vtfs_op(
+      VTFS_OP_ITERATE, file_inode(file)->i_ino, 0, NULL, pos, ctx->pos - pos, ret, start
+  );
+  return ret;
+}
+
+static ssize_t vtfs_traced_read(struct file* file, char __user* buf, size_t len, loff_t* ppos) {
+  u64 start = vtfs_trace_start();
+  loff_t pos = *ppos;
+  ssize_t ret = vtfs_read(file, buf, len, ppos);
+
+  trace_vtfs_op(VTFS_OP_READ, file_inode(file)->i_ino, 0, NULL, pos, len, ret, start);
+  return ret;
+}
+
+static ssize_t vtfs_traced_write(
+    struct file* file, const char __user* buf, size_t len, loff_t* ppos
+) {
+  u64 start = vtfs_trace_start();
+  loff_t pos = *ppos;
+  ssize_t ret = vtfs_write(file, buf, len, ppos);
+
+  trace_vtfs_op(VTFS_OP_WRITE, file_inode(file)->i_ino, 0, NULL, pos, len, ret, start);
+  return ret;
+}
 
 struct file_operations vtfs_dir_ops = {
-    .iterate_shared = vtfs_iterate,
+    .iterate_shared = vtfs_traced_iterate,
 };
 
 struct file_operations vtfs_file_ops = {
-    .read = vtfs_read,
-    .write = vtfs_write,
+    .read = vtfs_traced_read,
+    .write = vtfs_traced_write,
+    .open = vtfs_open,
     .llseek = generic_file_llseek,
+    .fadvise = vtfs_fadvise,
 };
 
 struct inode_operations vtfs_inode_ops = {
-    .lookup = vtfs_lookup,
-    .create = vtfs_create,
-    .unlink = vtfs_unlink,
-    .mkdir = vtfs_mkdir,
-    .rmdir = vtfs_rmdir,
-    .link = vtfs_link,
+    .lookup = vtfs_traced_lookup,
+    .create = vtfs_traced_create,
+    .unlink = vtfs_traced_unlink,
+    .mkdir = vtfs_traced_mkdir,
+    .rmdir = vtfs_traced_rmdir,
+    .link = vtfs_traced_link,
+    .symlink = vtfs_traced_symlink,
+    .getattr = vtfs_getattr,
+    .setattr = vtfs_setattr,
+    .listxattr = vtfs_listxattr,
 };
 
-ssize_t vtfs_read(struct file* file, char __user* buf, size_t len, loff_t* ppos) {
-  struct inode* inode = file_inode(file);
-  struct vtfs_file* file_data = inode->i_private;
-  size_t available, to_copy;
+// i_link points at the node's target, so path walks (RCU ones included)
+// follow it without calling into vtfs or copying it
+struct inode_operations vtfs_symlink_ops = {
+    .get_link = simple_get_link,
+    .getattr = vtfs_getattr,
+    .setattr = vtfs_setattr,
+    .listxattr = vtfs_listxattr,
+};
 
-  if (!file_data || !file_data->data) {
-    LOG("No data in file %s\n", file_data ? file_data->name : "NULL");
-    return 0;
+struct super_operations vtfs_super_ops = {
+    .statfs = simple_statfs,
+    .dirty_inode = vtfs_dirty_inode,
+    .evict_inode = vtfs_evict_inode,
+    .show_options = vtfs_show_options,
+};
+
+static inline struct vtfs_dir* vtfs_inode_dir(const struct inode* inode) {
+  struct vtfs_node* node = inode->i_private;
+  return node ? node->dir : NULL;
+}
+
+static inline s64 vtfs_ts_ns(struct timespec64 ts) {
+  return timespec64_to_ns(&ts);
+}
+
+// Metadata flush: copies what the VFS keeps in the inode back into the node
+static void vtfs_sync_node(struct inode* inode) {
+  struct vtfs_node* node = inode->i_private;
+
+  if (!node) {
+    return;
   }
-  available = file_data->size - *ppos;
-  if (available <= 0) {
-    return 0;
+  node->mode = inode->i_mode;
+  node->uid = inode->i_uid;
+  node->gid = inode->i_gid;
+  node->atime = vtfs_ts_ns(inode_get_atime(inode));
+  node->mtime = vtfs_ts_ns(inode_get_mtime(inode));
+  node->ctime = vtfs_ts_ns(inode_get_ctime(inode));
+}
+
+// A name was added to or removed from dir. inode is the node it links to,
+// when that node already existed and so gains or loses a link.
+static void vtfs_dir_changed(struct inode* dir, struct inode* inode) {
+  struct timespec64 now = inode_set_ctime_current(dir);
+
+  inode_set_mtime_to_ts(dir, now);
+  mark_inode_dirty(dir);
+  if (inode) {
+    inode_set_ctime_to_ts(inode, now);
+    mark_inode_dirty(inode);
   }
+}
 
-  to_copy = min(len, available);
+// There is no page cache, so the file's readahead window, as fadvise sets
+// it, sizes the tier's faults instead
+int vtfs_open(struct inode* inode, struct file* file) {
+  vtfs_tier_open(file);
+  return generic_file_open(inode, file);
+}
 
-  if (copy_to_user(buf, file_data->data + *ppos, to_copy)) {
-    LOG("Failed to copy data to US\n");
-    return -EFAULT;
+ssize_t vtfs_read(struct file* file, char __user* buf, size_t len, loff_t* ppos) {
+  struct inode* inode = file_inode(file);
+  struct vtfs_node* node = inode->i_private;
+  struct vtfs_sb_info* sbi = vtfs_sb(inode->i_sb);
+  ssize_t read;
+
+  // noatime, relatime and lazytime are all applied here by the VFS
+  file_accessed(file);
+  if (!node) {
+    LOG("No data in file %lu\n", inode->i_ino);
+    return 0;
+  }
+
+  // The tier demotes data under the inode lock. Reads share it, unless
+  // chunks on the backend have to be faulted in first.
+  inode_lock_shared(inode);
+  if (*ppos >= 0 && vtfs_tier_access(&sbi->tier, node, *ppos, len)) {
+    inode_unlock_shared(inode);
+    inode_lock(inode);
+    read = vtfs_tier_fault(
+        &sbi->tier, &sbi->remote, node, *ppos, len, vtfs_tier_readahead(file)
+    );
+    if (!read) {
+      read = vtfs_data_read(node, buf, len, ppos);
+    }
+    inode_unlock(inode);
+  } else {
+    read = vtfs_data_read(node, buf, len, ppos);
+    inode_unlock_shared(inode);
+  }
+  if (read < 0) {
+    LOG("Failed to read file %lu: %zd\n", inode->i_ino, read);
+    return read;
   }
 
-  *ppos += to_copy;
-  LOG("Read %zu bytes from file %s at offset %lld\n", to_copy, file_data->name, *ppos);
-  return to_copy;
+  LOG("Read %zd bytes from file %lu at offset %lld\n", read, inode->i_ino, *ppos);
+  return read;
 }
 
 ssize_t vtfs_write(struct file* file, const char __user* buf, size_t len, loff_t* ppos) {
   struct inode* inode = file->f_inode;
-  struct vtfs_file* file_data = inode->i_private;
-  char* new_data;
-  size_t new_size;
+  struct vtfs_node* node = inode->i_private;
+  struct vtfs_sb_info* sbi = vtfs_sb(inode->i_sb);
+  ssize_t written;
 
-  if (!file_data) {
+  if (!node) {
     LOG("Invalid file data\n");
     return -EINVAL;
   }
 
-  new_size = max((size_t)(*ppos + len), file_data->size);
-
-  if (new_size > file_data->size) {
-    new_data = krealloc(file_data->data, new_size, GFP_KERNEL);
-    if (!new_data) {
-      LOG("Realloc failed\n");
-      return -ENOMEM;
-    }
+  inode_lock(inode);
+  // Only marks the inode dirty when the coarse clock moved, and with
+  // lazytime only as I_DIRTY_TIME, which vtfs_dirty_inode() leaves for later
+  written = file_update_time(file);
+  if (written) {
+    goto out;
+  }
 
-    if (new_size > file_data->size) {
-      memset(new_data + file_data->size, 0, new_size - file_data->size);
-    }
+  // A changed file goes back to the backend whole, so all of it is faulted in
+  if (*ppos >= 0) {
+    vtfs_tier_access(&sbi->tier, node, *ppos, len);
+  }
+  written = vtfs_tier_fault(&sbi->tier, &sbi->remote, node, 0, node->size, 0);
+  if (written) {
+    goto out;
+  }
 
-    memset(new_data + file_data->size, 0, new_size - file_data->size);
-    file_data->data = new_data;
-    file_data->size = new_size;
+  written = vtfs_data_write(node, buf, len, ppos);
+  if (written < 0) {
+    LOG("Write to file %lu failed: %zd\n", inode->i_ino, written);
+    goto out;
   }
+  i_size_write(inode, node->size);
+  vtfs_tier_changed(&sbi->tier, node);
 
-  if (copy_from_user(file_data->data + *ppos, buf, len)) {
-    LOG("Failed to copy data from US\n");
-    return -EFAULT;
+  LOG("Wrote %zd bytes to file %lu at offset %lld\n", written, inode->i_ino, *ppos);
+
+out:
+  inode_unlock(inode);
+  return written;
+}
+
+int vtfs_fadvise(struct file* file, loff_t offset, loff_t len, int advice) {
+  struct inode* inode = file_inode(file);
+  struct vtfs_sb_info* sbi = vtfs_sb(inode->i_sb);
+  loff_t size = i_size_read(inode);
+  int err;
+
+  // Checks the arguments, but leaves the readahead state alone on a
+  // superblock without a backing device
+  err = generic_fadvise(file, offset, len, advice);
+  if (err || !inode->i_private) {
+    return err;
   }
 
-  *ppos += len;
-  LOG("Wrote %zu bytes to file %s at offset %lld\n", len, file_data->name, *ppos);
+  vtfs_tier_advise(file, advice);
+  if (advice != POSIX_FADV_WILLNEED && advice != POSIX_FADV_DONTNEED) {
+    return 0;
+  }
 
-  return len;
+  // A length of 0 means to the end of the file
+  if (offset >= size) {
+    return 0;
+  }
+  if (!len || len > size - offset) {
+    len = size - offset;
+  }
+  switch (advice) {
+    case POSIX_FADV_WILLNEED:
+      err = vtfs_tier_prefetch(&sbi->tier, inode, offset, len);
+      break;
+    case POSIX_FADV_DONTNEED:
+      inode_lock(inode);
+      err = vtfs_tier_drop(&sbi->tier, inode->i_private, offset, len);
+      inode_unlock(inode);
+      break;
+  }
+  if (err) {
+    LOG("fadvise %d on file %lu failed: %d\n", advice, inode->i_ino, err);
+  }
+  return err;
 }
 
 int vtfs_create(
@@ -141,40 +401,42 @@ int vtfs_create(
     return -EPERM;
   }
 
-  struct vtfs_dir* parent_dir = parent_inode->i_private;
+  struct vtfs_dir* parent_dir = vtfs_inode_dir(parent_inode);
+  struct vtfs_node* node;
   struct vtfs_file* new_file;
+  struct inode* inode;
 
-  struct list_head* pos;
-  list_for_each(pos, &parent_dir->children) {
-    struct vtfs_file* entry = list_entry(pos, struct vtfs_file, list);
-    if (strcmp(entry->name, child_dentry->d_name.name) == 0) {
-      return -EEXIST;
-    }
+  if (vtfs_dir_find(parent_dir, child_dentry->d_name.name)) {
+    return -EEXIST;
   }
 
-  new_file = kmalloc(sizeof(struct vtfs_file), GFP_KERNEL);
-  if (!new_file)
+  node = vtfs_node_alloc(&vtfs_sb(parent_inode->i_sb)->mem, get_next_ino(), mode);
+  if (!node)
     return -ENOMEM;
 
-  new_file->name = kstrdup(child_dentry->d_name.name, GFP_KERNEL);
-  new_file->ino = get_next_ino();
-  new_file->mode = mode;
-  new_file->size = 0;
-  new_file->data = NULL;
+  new_file = vtfs_file_alloc(child_dentry->d_name.name, node);
+  if (!new_file) {
+    vtfs_node_free(node);
+    return -ENOMEM;
+  }
 
-  new_file->inode = vtfs_get_inode(parent_inode->i_sb, parent_inode, mode, new_file->ino);
-  new_file->inode->i_private = new_file;  // happy debugging
-  new_file->inode->i_op = &vtfs_inode_ops;
-  new_file->inode->i_fop = &vtfs_file_ops;
+  inode = vtfs_get_inode(parent_inode->i_sb, parent_inode, node);
+  if (!inode) {
+    vtfs_file_free(new_file);
+    vtfs_node_free(node);
+    return -ENOMEM;
+  }
 
-  list_add(&new_file->list, &parent_dir->children);
-  d_add(child_dentry, new_file->inode);
+  vtfs_dir_add(parent_dir, new_file);
+  vtfs_dir_changed(parent_inode, NULL);
+  d_add(child_dentry, inode);
   return 0;
 }
 
 int vtfs_unlink(struct inode* parent_inode, struct dentry* child_dentry) {
   struct vtfs_dir* parent_dir;
   struct vtfs_file* file_entry;
+  struct vtfs_node* node;
   const char* name;
 
   LOG("Entering vtfs_unlink\n");
@@ -184,7 +446,7 @@ int vtfs_unlink(struct inode* parent_inode, struct dentry* child_dentry) {
     return -EINVAL;
   }
 
-  parent_dir = parent_inode->i_private;
+  parent_dir = vtfs_inode_dir(parent_inode);
   if (!parent_dir) {
     LOG("Parent inode private data is NULL\n");
     return -EFAULT;
@@ -193,71 +455,105 @@ int vtfs_unlink(struct inode* parent_inode, struct dentry* child_dentry) {
   name = child_dentry->d_name.name;
   LOG("Attempting to unlink file: %s\n", name);
 
-  list_for_each_entry(file_entry, &parent_dir->children, list) {
-    if (strcmp(file_entry->name, name) == 0) {
-      list_del(&file_entry->list);
-      LOG("File %s removed from list\n", name);
-      kfree(file_entry->name);
-      kfree(file_entry->data);
-      kfree(file_entry);
-
-      inode_dec_link_count(child_dentry->d_inode);
-      d_drop(child_dentry);
+  file_entry = vtfs_dir_find(parent_dir, name);
+  if (!file_entry) {
+    LOG("File %s not found\n", name);
+    return -ENOENT;
+  }
 
-      LOG("File %s unlinked\n", name);
-      return 0;
-    }
+  vtfs_dir_remove(file_entry);
+  LOG("File %s removed from list\n", name);
+  node = file_entry->node;
+  // The node outlives its last link until the inode is evicted
+  if (vtfs_file_free(file_entry)) {
+    vtfs_tier_forget(&vtfs_sb(parent_inode->i_sb)->tier, node);
   }
 
-  LOG("File %s not found\n", name);
-  return -ENOENT;
+  vtfs_dir_changed(parent_inode, child_dentry->d_inode);
+  inode_dec_link_count(child_dentry->d_inode);
+  d_drop(child_dentry);
+
+  LOG("File %s unlinked\n", name);
+  return 0;
 }
 
 int vtfs_link(struct dentry* old_dentry, struct inode* parent_inode, struct dentry* new_dentry) {
-  struct vtfs_file* old_file;
+  struct inode* old_inode = d_inode(old_dentry);
+  struct vtfs_node* node;
   struct vtfs_dir* parent_dir;
   struct vtfs_file* new_file;
 
-  old_file = old_dentry->d_inode->i_private;
-  parent_dir = parent_inode->i_private;
+  node = old_inode->i_private;
+  parent_dir = vtfs_inode_dir(parent_inode);
 
-  if (S_ISDIR(old_file->mode)) {
+  if (S_ISDIR(node->mode)) {
     LOG("Hard links to directories are not allowed\n");
     return -EPERM;
   }
 
-  struct list_head* pos;
-  list_for_each(pos, &parent_dir->children) {
-    struct vtfs_file* entry = list_entry(pos, struct vtfs_file, list);
-    if (strcmp(entry->name, new_dentry->d_name.name) == 0) {
-      LOG("File with the same name already exists: %s\n", new_dentry->d_name.name);
-      return -EEXIST;
-    }
+  if (vtfs_dir_find(parent_dir, new_dentry->d_name.name)) {
+    LOG("File with the same name already exists: %s\n", new_dentry->d_name.name);
+    return -EEXIST;
   }
 
-  new_file = kzalloc(sizeof(struct vtfs_file), GFP_KERNEL);
+  new_file = vtfs_file_alloc(new_dentry->d_name.name, node);
   if (!new_file) {
     LOG("kzalloc failed\n");
     return -ENOMEM;
   }
 
-  new_file->name = kstrdup(new_dentry->d_name.name, GFP_KERNEL);
-  new_file->size = old_file->size;
-  new_file->data = old_file->data;
-  new_file->inode = old_dentry->d_inode;
+  vtfs_dir_add(parent_dir, new_file);
+  vtfs_dir_changed(parent_inode, old_inode);
+
+  ihold(old_inode);
+  inode_inc_link_count(old_inode);
+  d_add(new_dentry, old_inode);
+
+  LOG("Hard link created\n");
+  return 0;
+}
+
+int vtfs_symlink(
+    struct mnt_idmap* idmap,
+    struct inode* parent_inode,
+    struct dentry* child_dentry,
+    const char* target
+) {
+  struct vtfs_dir* parent_dir = vtfs_inode_dir(parent_inode);
+  struct vtfs_node* node;
+  struct vtfs_file* new_file;
+  struct inode* inode;
 
-  list_add_tail(&new_file->list, &parent_dir->children);
+  if (strlen(target) >= PAGE_SIZE) {
+    return -ENAMETOOLONG;
+  }
 
-  d_add(new_dentry, old_dentry->d_inode);
+  node = vtfs_symlink_alloc(&vtfs_sb(parent_inode->i_sb)->mem, get_next_ino(), target);
+  if (!node) {
+    return -ENOMEM;
+  }
 
-  inode_inc_link_count(old_dentry->d_inode);
+  new_file = vtfs_file_alloc(child_dentry->d_name.name, node);
+  if (!new_file) {
+    vtfs_node_free(node);
+    return -ENOMEM;
+  }
 
-  LOG("Hard link created\n");
+  inode = vtfs_get_inode(parent_inode->i_sb, parent_inode, node);
+  if (!inode) {
+    vtfs_file_free(new_file);
+    vtfs_node_free(node);
+    return -ENOMEM;
+  }
+
+  vtfs_dir_add(parent_dir, new_file);
+  vtfs_dir_changed(parent_inode, NULL);
+  d_add(child_dentry, inode);
   return 0;
 }
 
 int vtfs_iterate(struct file* flip, struct dir_context* ctx) {
-  struct vtfs_dir* dir = flip->f_inode->i_private;
+  struct vtfs_dir* dir = vtfs_inode_dir(flip->f_inode);
   struct list_head* pos;
   unsigned long offset = ctx->pos;
   unsigned long index = 0;
@@ -271,8 +567,8 @@ int vtfs_iterate(struct file* flip, struct dir_context* ctx) {
             ctx,
             entry->name,
             strlen(entry->name),
-            entry->ino,
-            S_ISDIR(entry->mode) ? DT_DIR : DT_REG
+            entry->node->ino,
+            S_DT(entry->node->mode)
         )) {
       return -ENOMEM;
     }
@@ -285,15 +581,16 @@ int vtfs_iterate(struct file* flip, struct dir_context* ctx) {
 struct dentry* vtfs_lookup(
     struct inode* parent_inode, struct dentry* child_dentry, unsigned int flag
 ) {
-  struct vtfs_dir* parent_dir = parent_inode->i_private;
+  struct vtfs_dir* parent_dir = vtfs_inode_dir(parent_inode);
+  struct vtfs_file* entry = vtfs_dir_find(parent_dir, child_dentry->d_name.name);
+  struct inode* inode;
 
-  struct list_head* pos;
-  list_for_each(pos, &parent_dir->children) {
-    struct vtfs_file* entry = list_entry(pos, struct vtfs_file, list);
-    if (strcmp(entry->name, child_dentry->d_name.name) == 0) {
-      d_add(child_dentry, entry->inode);
-      return NULL;
+  if (entry) {
+    inode = vtfs_get_inode(parent_inode->i_sb, parent_inode, entry->node);
+    if (!inode) {
+      return ERR_PTR(-ENOMEM);
     }
+    d_add(child_dentry, inode);
   }
 
   return NULL;
@@ -303,54 +600,44 @@ int vtfs_mkdir(
     struct mnt_idmap* idmap, struct inode* parent_inode, struct dentry* child_dentry, umode_t mode
 ) {
   struct vtfs_dir* parent_dir;
-  struct vtfs_dir* new_dir;
+  struct vtfs_node* node;
   struct vtfs_file* new_file;
+  struct inode* inode;
 
   if (!parent_inode || !child_dentry) {
     LOG("Invalid args\n");
     return -EINVAL;
   }
 
-  parent_dir = parent_inode->i_private;
+  parent_dir = vtfs_inode_dir(parent_inode);
   if (!parent_dir) {
     LOG("Parent dir is NULL\n");
     return -EFAULT;
   }
 
-  new_file = kzalloc(sizeof(*new_file), GFP_KERNEL);
-  if (!new_file) {
-    LOG("kzalloc failed file\n");
+  node = vtfs_node_alloc(&vtfs_sb(parent_inode->i_sb)->mem, get_next_ino(), S_IFDIR | mode);
+  if (!node) {
+    LOG("kzalloc failed dir\n");
     return -ENOMEM;
   }
 
-  new_file->name = kstrdup(child_dentry->d_name.name, GFP_KERNEL);
-  if (!new_file->name) {
-    kfree(new_file);
+  new_file = vtfs_file_alloc(child_dentry->d_name.name, node);
+  if (!new_file) {
+    LOG("kzalloc failed file\n");
+    vtfs_node_free(node);
     return -ENOMEM;
   }
 
-  new_dir = kzalloc(sizeof(*new_dir), GFP_KERNEL);
-  if (!new_dir) {
-    LOG("kzalloc failed dir\n");
-    kfree(new_file->name);
-    kfree(new_file);
+  inode = vtfs_get_inode(parent_inode->i_sb, parent_inode, node);
+  if (!inode) {
+    vtfs_file_free(new_file);
+    vtfs_node_free(node);
     return -ENOMEM;
   }
 
-  INIT_LIST_HEAD(&new_dir->children);
-  new_dir->self = new_file;
-
-  new_file->ino = get_next_ino();
-  new_file->mode = S_IFDIR | mode;
-  new_file->size = 0;
-  new_file->data = NULL;
-  new_file->inode = vtfs_get_inode(parent_inode->i_sb, parent_inode, new_file->mode, new_file->ino);
-  new_file->inode->i_private = new_dir;
-  new_file->inode->i_op = &vtfs_inode_ops;
-  new_file->inode->i_fop = &vtfs_dir_ops;
-  list_add_tail(&new_file->list, &parent_dir->children);
-
-  d_add(child_dentry, new_file->inode);
+  vtfs_dir_add(parent_dir, new_file);
+  vtfs_dir_changed(parent_inode, NULL);
+  d_add(child_dentry, inode);
 
   LOG("Dir %s created\n", child_dentry->d_name.name);
   return 0;
@@ -367,7 +654,7 @@ int vtfs_rmdir(struct inode* parent_inode, struct dentry* child_dentry) {
     return -EINVAL;
   }
 
-  parent_dir = parent_inode->i_private;
+  parent_dir = vtfs_inode_dir(parent_inode);
   target_inode = child_dentry->d_inode;
 
   if (!parent_dir || !target_inode) {
@@ -375,88 +662,463 @@ int vtfs_rmdir(struct inode* parent_inode, struct dentry* child_dentry) {
     return -EFAULT;
   }
 
-  target_dir = target_inode->i_private;
+  target_dir = vtfs_inode_dir(target_inode);
+  target_file = vtfs_dir_find(parent_dir, child_dentry->d_name.name);
 
-  if (!target_dir || !target_dir->self) {
+  if (!target_dir || !target_file) {
     LOG("Dir corrupted\n");
     return -EFAULT;
   }
 
-  target_file = target_dir->self;
-
-  if (!list_empty(&target_dir->children)) {
+  if (!vtfs_dir_empty(target_dir)) {
     LOG("Directory %s is not empty\n", child_dentry->d_name.name);
     return -ENOTEMPTY;
   }
 
-  list_del_init(&target_file->list);
+  vtfs_dir_remove(target_file);
+  vtfs_file_free(target_file);
 
+  vtfs_dir_changed(parent_inode, target_inode);
   inode_dec_link_count(target_inode);
   d_drop(child_dentry);
 
-  kfree(target_file->name);
-  kfree(target_file);
-  kfree(target_dir);
   LOG("Dir %s removed\n", child_dentry->d_name.name);
   return 0;
 }
 
+static int vtfs_xattr_handler_get(
+    const struct xattr_handler* handler,
+    struct dentry* unused,
+    struct inode* inode,
+    const char* name,
+    void* buffer,
+    size_t size
+) {
+  return vtfs_xattr_get(
+      &vtfs_sb(inode->i_sb)->xattrs,
+      inode->i_private,
+      xattr_full_name(handler, name),
+      buffer,
+      size
+  );
+}
+
+static int vtfs_xattr_handler_set(
+    const struct xattr_handler* handler,
+    struct mnt_idmap* idmap,
+    struct dentry* unused,
+    struct inode* inode,
+    const char* name,
+    const void* value,
+    size_t size,
+    int flags
+) {
+  struct vtfs_tier* tier = &vtfs_sb(inode->i_sb)->tier;
+  struct vtfs_node* node = inode->i_private;
+  const char* full = xattr_full_name(handler, name);
+  bool pin = !strcmp(full, VTFS_TIER_PIN_XATTR);
+  bool was = false;
+  int err;
+
+  // Pinning only keeps the file from being demoted; what is on the backend
+  // stays there until it is read
+  if (pin) {
+    mutex_lock(&tier->lock);
+    was = node->heat && node->heat->pinned;
+    mutex_unlock(&tier->lock);
+    err = vtfs_tier_pin(tier, node, value != NULL);
+    if (err) {
+      return err;
+    }
+  }
+  err = vtfs_xattr_set(&vtfs_sb(inode->i_sb)->xattrs, node, full, value, size, flags);
+  if (err && pin) {
+    vtfs_tier_pin(tier, node, was);
+  }
+  if (!err) {
+    inode_set_ctime_current(inode);
+    mark_inode_dirty(inode);
+  }
+  return err;
+}
+
+static const struct xattr_handler vtfs_xattr_user_handler = {
+    .prefix = XATTR_USER_PREFIX,
+    .get = vtfs_xattr_handler_get,
+    .set = vtfs_xattr_handler_set,
+};
+
+static const struct xattr_handler vtfs_xattr_trusted_handler = {
+    .prefix = XATTR_TRUSTED_PREFIX,
+    .get = vtfs_xattr_handler_get,
+    .set = vtfs_xattr_handler_set,
+};
+
+static const struct xattr_handler vtfs_xattr_security_handler = {
+    .prefix = XATTR_SECURITY_PREFIX,
+    .get = vtfs_xattr_handler_get,
+    .set = vtfs_xattr_handler_set,
+};
+
+static const struct xattr_handler* const vtfs_xattr_handlers[] = {
+    &vtfs_xattr_user_handler,
+    &vtfs_xattr_trusted_handler,
+    &vtfs_xattr_security_handler,
+    NULL,
+};
+
+// trusted.* names are only listed to CAP_SYS_ADMIN, as getxattr checks on read
+static bool vtfs_xattr_visible(const char* name) {
+  return strncmp(name, XATTR_TRUSTED_PREFIX, XATTR_TRUSTED_PREFIX_LEN) != 0 ||
+         capable(CAP_SYS_ADMIN);
+}
+
+ssize_t vtfs_listxattr(struct dentry* dentry, char* buffer, size_t size) {
+  struct inode* inode = d_inode(dentry);
+
+  return vtfs_xattr_list(
+      &vtfs_sb(inode->i_sb)->xattrs, inode->i_private, vtfs_xattr_visible, buffer, size
+  );
+}
+
+static int vtfs_inode_test(struct inode* inode, void* node) {
+  return inode->i_private == node;
+}
+
+static int vtfs_inode_set(struct inode* inode, void* node) {
+  inode->i_private = node;
+  return 0;
+}
+
+// Returns a referenced inode for node, reusing the cached one if any
 struct inode* vtfs_get_inode(
-    struct super_block* sb, const struct inode* dir, umode_t mode, int i_ino
+    struct super_block* sb, const struct inode* dir, struct vtfs_node* node
 ) {
-  struct inode* inode = new_inode(sb);
+  struct inode* inode =
+      iget5_locked(sb, node->ino, vtfs_inode_test, vtfs_inode_set, node);
   struct mnt_idmap* idmap = &nop_mnt_idmap;
-  if (inode != NULL) {
-    inode_init_owner(idmap, inode, dir, mode);
-    inode->i_mode = mode;
+
+  if (!inode || !(inode->i_state & I_NEW)) {
+    return inode;
   }
-  inode->i_ino = i_ino;
+
+  // A node that has had an inode before keeps its owner; only a new one
+  // takes it from the creating task and dir
+  if (node->ctime) {
+    inode->i_uid = node->uid;
+    inode->i_gid = node->gid;
+  } else {
+    inode_init_owner(idmap, inode, dir, node->mode);
+  }
+  inode->i_mode = node->mode;
+  inode->i_ino = node->ino;
+  if (S_ISLNK(node->mode)) {
+    inode->i_op = &vtfs_symlink_ops;
+    inode->i_link = node->data;
+  } else {
+    inode->i_op = &vtfs_inode_ops;
+    inode->i_fop = S_ISDIR(node->mode) ? &vtfs_dir_ops : &vtfs_file_ops;
+  }
+  inode->i_size = node->size;
+  set_nlink(inode, node->nlink);
+  if (node->ctime) {
+    inode_set_atime_to_ts(inode, ns_to_timespec64(node->atime));
+    inode_set_mtime_to_ts(inode, ns_to_timespec64(node->mtime));
+    inode_set_ctime_to_ts(inode, ns_to_timespec64(node->ctime));
+  } else {
+    simple_inode_init_ts(inode);
+    vtfs_sync_node(inode);
+  }
+  vtfs_mem_add(&vtfs_sb(sb)->mem, VTFS_MEM_INODES, 1);
+  unlock_new_inode(inode);
   return inode;
 }
 
-int vtfs_fill_super(struct super_block* sb, void* data, int silent) {
-  struct vtfs_dir* root_dir;
-  struct vtfs_file* root_file;
+int vtfs_getattr(
+    struct mnt_idmap* idmap,
+    const struct path* path,
+    struct kstat* stat,
+    u32 request_mask,
+    unsigned int query_flags
+) {
+  struct inode* inode = d_inode(path->dentry);
+
+  generic_fillattr(idmap, request_mask, inode, stat);
+  // File data lives in one kvmalloc'd buffer of exactly i_size bytes
+  stat->blocks = DIV_ROUND_UP(i_size_read(inode), 512);
+  return 0;
+}
+
+int vtfs_setattr(struct mnt_idmap* idmap, struct dentry* dentry, struct iattr* attr) {
+  struct inode* inode = d_inode(dentry);
+  struct vtfs_node* node = inode->i_private;
+  int err = setattr_prepare(idmap, dentry, attr);
+
+  if (err) {
+    return err;
+  }
+
+  if ((attr->ia_valid & ATTR_SIZE) && attr->ia_size != i_size_read(inode)) {
+    struct vtfs_sb_info* sbi = vtfs_sb(inode->i_sb);
+
+    // What is kept is faulted in, as for a write; truncating to nothing
+    // needs none of it
+    if (attr->ia_size) {
+      err = vtfs_tier_fault(
+          &sbi->tier, &sbi->remote, node, 0, min_t(loff_t, attr->ia_size, node->size), 0
+      );
+      if (err) {
+        return err;
+      }
+    }
+    err = vtfs_data_truncate(node, attr->ia_size);
+    if (err) {
+      return err;
+    }
+    i_size_write(inode, node->size);
+    vtfs_tier_changed(&sbi->tier, node);
+  }
+
+  setattr_copy(idmap, inode, attr);
+  mark_inode_dirty(inode);
+  return 0;
+}
+
+// Timestamp-only updates under lazytime arrive as I_DIRTY_TIME and are not
+// flushed here; the VFS upgrades them to I_DIRTY_SYNC on the last iput, sync
+// or after dirtytime_expire_seconds, and evict flushes whatever is left.
+void vtfs_dirty_inode(struct inode* inode, int flags) {
+  if (flags & I_DIRTY_INODE) {
+    vtfs_sync_node(inode);
+  }
+}
+
+void vtfs_evict_inode(struct inode* inode) {
+  struct vtfs_node* node = inode->i_private;
+
+  vtfs_sync_node(inode);
+  truncate_inode_pages_final(&inode->i_data);
+  clear_inode(inode);
+  vtfs_mem_add(&vtfs_sb(inode->i_sb)->mem, VTFS_MEM_INODES, -1);
+
+  if (node && node->nlink == 0) {
+    vtfs_remote_forget(&vtfs_sb(inode->i_sb)->remote, node);
+    vtfs_node_free(node);
+  }
+}
+
+static ssize_t vtfs_memory_read(struct file* file, char __user* buf, size_t len, loff_t* ppos) {
+  struct vtfs_sb_info* sbi = file->private_data;
+  char report[1024];
+  int size = vtfs_mem_report(&sbi->mem, sizeof(struct inode), report, sizeof(report));
+
+  return simple_read_from_buffer(buf, len, ppos, report, size);
+}
 
-  root_dir = kmalloc(sizeof(struct vtfs_dir), GFP_KERNEL);
-  if (!root_dir) {
+static const struct file_operations vtfs_memory_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .read = vtfs_memory_read,
+    .llseek = default_llseek,
+};
+
+static ssize_t vtfs_sched_read(struct file* file, char __user* buf, size_t len, loff_t* ppos) {
+  struct vtfs_sb_info* sbi = file->private_data;
+  char report[512];
+  int size;
+
+  spin_lock(&sbi->remote.sched_lock);
+  size = vtfs_sched_report(&sbi->remote.sched, report, sizeof(report));
+  spin_unlock(&sbi->remote.sched_lock);
+  return simple_read_from_buffer(buf, len, ppos, report, size);
+}
+
+static const struct file_operations vtfs_sched_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .read = vtfs_sched_read,
+    .llseek = default_llseek,
+};
+
+static ssize_t vtfs_cache_read(struct file* file, char __user* buf, size_t len, loff_t* ppos) {
+  struct vtfs_sb_info* sbi = file->private_data;
+  size_t report_size = PATH_MAX + 128;  // the directory may be a long path
+  char* report = kmalloc(report_size, GFP_KERNEL);
+  ssize_t ret;
+
+  if (!report) {
     return -ENOMEM;
   }
+  ret = simple_read_from_buffer(
+      buf, len, ppos, report, vtfs_cache_report(&sbi->remote.cache, report, report_size)
+  );
+  kfree(report);
+  return ret;
+}
+
+static const struct file_operations vtfs_cache_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .read = vtfs_cache_read,
+    .llseek = default_llseek,
+};
 
-  INIT_LIST_HEAD(&root_dir->children);
+static ssize_t vtfs_tier_read(struct file* file, char __user* buf, size_t len, loff_t* ppos) {
+  struct vtfs_sb_info* sbi = file->private_data;
+  char report[512];
+  int size = vtfs_tier_report(&sbi->tier, &sbi->remote, report, sizeof(report));
+
+  return simple_read_from_buffer(buf, len, ppos, report, size);
+}
+
+static const struct file_operations vtfs_tier_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .read = vtfs_tier_read,
+    .llseek = default_llseek,
+};
+
+// Named after the anonymous device, as in the third field of /proc/self/mountinfo
+static void vtfs_debugfs_mount(struct super_block* sb) {
+  struct vtfs_sb_info* sbi = vtfs_sb(sb);
+  char name[32];
+
+  snprintf(name, sizeof(name), "%u:%u", MAJOR(sb->s_dev), MINOR(sb->s_dev));
+  sbi->debugfs = debugfs_create_dir(name, vtfs_debugfs_root);
+  debugfs_create_file("memory", 0444, sbi->debugfs, sbi, &vtfs_memory_fops);
+  debugfs_create_file("sched", 0444, sbi->debugfs, sbi, &vtfs_sched_fops);
+  debugfs_create_file("cache", 0444, sbi->debugfs, sbi, &vtfs_cache_fops);
+  debugfs_create_file("tier", 0444, sbi->debugfs, sbi, &vtfs_tier_fops);
+}
 
-  root_file = kmalloc(sizeof(struct vtfs_file), GFP_KERNEL);
-  if (!root_file) {
-    kfree(root_dir);
+// Mount options: numa=local|interleave|bind:<nodelist>, rpc=tcp:<ip>:<port>|unix:<path>,
+// cache=<dir>, ram=<size>
+static int vtfs_parse_options(struct vtfs_sb_info* sbi, char* options) {
+  while (options && *options) {
+    char* opt = options;
+    char* end = opt;
+
+    // A nodelist may itself contain commas: "numa=bind:0,2,size=..." splits
+    // only before a token that does not start with a digit
+    while ((end = strchr(end, ',')) && isdigit(end[1])) {
+      end++;
+    }
+    if (end) {
+      *end++ = '\0';
+    }
+    options = end;
+
+    if (!*opt) {
+      continue;
+    }
+    if (strncmp(opt, "numa=", 5) == 0 && !vtfs_mem_set_policy(&sbi->mem, opt + 5)) {
+      continue;
+    }
+    if (strncmp(opt, "rpc=", 4) == 0 && !vtfs_remote_set_rpc(&sbi->remote, opt + 4)) {
+      continue;
+    }
+    if (strncmp(opt, "cache=", 6) == 0 && !vtfs_cache_init(&sbi->remote.cache, opt + 6)) {
+      continue;
+    }
+    if (strncmp(opt, "ram=", 4) == 0 && !vtfs_tier_set_budget(&sbi->tier, opt + 4)) {
+      continue;
+    }
+    printk(KERN_ERR "vtfs: bad mount option \"%s\"\n", opt);
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int vtfs_show_options(struct seq_file* m, struct dentry* root) {
+  struct vtfs_sb_info* sbi = vtfs_sb(root->d_sb);
+  struct vtfs_mem* mem = &sbi->mem;
+
+  if (mem->policy == VTFS_NUMA_INTERLEAVE) {
+    seq_puts(m, ",numa=interleave");
+  } else if (mem->policy == VTFS_NUMA_BIND) {
+    seq_printf(m, ",numa=bind:%*pbl", nodemask_pr_args(&mem->nodes));
+  }
+  if (sbi->remote.transport == VTFS_TRANSPORT_RPC) {
+    seq_show_option(m, "rpc", sbi->remote.rpc_addr);
+  }
+  if (sbi->remote.cache.dir) {
+    seq_show_option(m, "cache", sbi->remote.cache.dir);
+  }
+  if (sbi->tier.heat.budget) {
+    seq_printf(m, ",ram=%zu", sbi->tier.heat.budget);
+  }
+  return 0;
+}
+
+int vtfs_fill_super(struct super_block* sb, void* data, int silent) {
+  struct vtfs_sb_info* sbi;
+  struct vtfs_node* root;
+  struct inode* inode;
+  int err;
+
+  sbi = kzalloc(sizeof(struct vtfs_sb_info), GFP_KERNEL);
+  if (!sbi) {
     return -ENOMEM;
   }
+  sb->s_fs_info = sbi;
+  err = vtfs_mem_init(&sbi->mem);
+  if (err) {
+    return err;
+  }
+  vtfs_xattr_table_init(&sbi->xattrs, &sbi->mem);
+  vtfs_remote_init(&sbi->remote);
+  vtfs_tier_init(&sbi->tier, sb);
+  err = vtfs_parse_options(sbi, data);
+  if (err) {
+    return err;
+  }
 
-  root_file->name = kstrdup("/", GFP_KERNEL);
-  root_file->ino = 100;
-  root_file->mode = S_IFDIR | 0777;
-  root_file->inode = vtfs_get_inode(sb, NULL, root_file->mode, root_file->ino);
-  root_file->data = NULL;
-  root_file->size = 0;
+  root = vtfs_node_alloc(&sbi->mem, 100, S_IFDIR | 0777);
+  if (!root) {
+    return -ENOMEM;
+  }
+  // The root has no entry in a parent directory but must never be freed on evict
+  root->nlink = 1;
 
-  root_dir->self = root_file;
+  sb->s_op = &vtfs_super_ops;
+  sb->s_xattr = vtfs_xattr_handlers;
 
-  root_file->inode->i_private = root_dir;
-  root_file->inode->i_op = &vtfs_inode_ops;
-  root_file->inode->i_fop = &vtfs_dir_ops;
+  inode = vtfs_get_inode(sb, NULL, root);
+  if (!inode) {
+    vtfs_node_free(root);
+    return -ENOMEM;
+  }
 
-  sb->s_root = d_make_root(root_file->inode);
+  sb->s_root = d_make_root(inode);
   if (!sb->s_root) {
-    kfree(root_file->name);
-    kfree(root_file);
-    kfree(root_dir);
+    vtfs_node_free(root);
     return -ENOMEM;
   }
+  sbi->root = root;
+  vtfs_debugfs_mount(sb);
 
   LOG("Superblock initialized");
   return 0;
 }
 
 void vtfs_kill_sb(struct super_block* sb) {
+  struct vtfs_sb_info* sbi = vtfs_sb(sb);
+
+  // The tier's worker takes inodes of its own
+  if (sbi) {
+    vtfs_tier_destroy(&sbi->tier);
+  }
+  // Evicts every cached inode; nodes still linked are freed with the tree
+  kill_anon_super(sb);
+  if (sbi) {
+    debugfs_remove_recursive(sbi->debugfs);
+    vtfs_tree_free(sbi->root);
+    vtfs_xattr_table_destroy(&sbi->xattrs);
+    vtfs_remote_cleanup(&sbi->remote);
+    vtfs_remote_destroy(&sbi->remote);
+    vtfs_mem_destroy(&sbi->mem);
+    kfree(sbi);
+  }
   printk(KERN_INFO "vtfs super block is destroyed. Unmount successfully.\n");
 }
 
@@ -470,15 +1132,30 @@ struct dentry* vtfs_mount(
     struct file_system_type* fs_type, int flags, const char* token, void* data
 ) {
   struct dentry* ret = mount_nodev(fs_type, flags, data, vtfs_fill_super);
-  if (ret == NULL) {
+  if (IS_ERR_OR_NULL(ret)) {
     printk(KERN_ERR "Can't mount file system");
   } else {
+    // The device name is the backend token; fill_super never sees it
+    struct vtfs_sb_info* sbi = vtfs_sb(ret->d_sb);
+
+    sbi->remote.token = kstrdup(token, GFP_KERNEL);
+    if (!sbi->remote.token) {
+      struct super_block* sb = ret->d_sb;
+
+      // Still locked by mount_nodev(), as on its own failure paths
+      dput(ret);
+      deactivate_locked_super(sb);
+      return ERR_PTR(-ENOMEM);
+    }
     printk(KERN_INFO "Mounted successfully");
   }
   return ret;
 }
 
 static int __init vtfs_init(void) {
+  vtfs_debugfs_root = debugfs_create_dir(MODULE_NAME, NULL);
+  vtfs_capture_init(vtfs_debugfs_root);
+
   register_filesystem(&vtfs_fs_type);
   LOG("VTFS joined the kernel\n");
   return 0;
@@ -486,6 +1163,8 @@ static int __init vtfs_init(void) {
 
 static void __exit vtfs_exit(void) {
   unregister_filesystem(&vtfs_fs_type);
+  vtfs_http_pool_destroy();
+  debugfs_remove_recursive(vtfs_debugfs_root);
   LOG("VTFS left the kernel\n");
 }
 
@@ -0,0 +1,1839 @@
+// KUnit suite for the vtfs core: directory index, data path, link
+// refcounting, memory accounting, xattrs and the HTTP response parser, plus timed
+// benchmark cases for the hot paths (marked slow, so "--filter speed>slow"
+// skips them).
+//
+// Run under UML with kunit/run.sh, or build into the module with
+// CONFIG_VTFS_KUNIT_TEST=y on a kernel with CONFIG_KUNIT.
+
+#include <kunit/static_stub.h>
+#include <kunit/test.h>
+#include <linux/delay.h>
+#include <linux/fadvise.h>
+#include <linux/fs.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/mman.h>
+#include <linux/random.h>
+#include <asm/unaligned.h>
+
+#include "cachefile.h"
+#include "data.h"
+#include "delta.h"
+#include "flight.h"
+#include "heat.h"
+#include "index.h"
+#include "iosched.h"
+#include "mem.h"
+#include "proto.h"
+#include "remote.h"
+#include "rpc_proto.h"
+#include "tier.h"
+#include "xattr.h"
+
+static struct vtfs_node* new_dir(struct kunit* test) {
+  struct vtfs_node* node = vtfs_node_alloc(NULL, 100, S_IFDIR | 0777);
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  node->nlink = 1;
+  return node;
+}
+
+static struct vtfs_file* add_file(struct kunit* test, struct vtfs_node* dir, const char* name) {
+  struct vtfs_node* node = vtfs_node_alloc(NULL, get_next_ino(), S_IFREG | 0777);
+  struct vtfs_file* file;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  file = vtfs_file_alloc(name, node);
+  KUNIT_ASSERT_NOT_NULL(test, file);
+  vtfs_dir_add(dir->dir, file);
+  return file;
+}
+
+static void free_dir(struct vtfs_node* dir) {
+  struct vtfs_file* entry;
+  struct vtfs_file* tmp;
+
+  list_for_each_entry_safe(entry, tmp, &dir->dir->children, list) {
+    struct vtfs_node* node = entry->node;
+
+    vtfs_dir_remove(entry);
+    if (vtfs_file_free(entry)) {
+      vtfs_node_free(node);
+    }
+  }
+  vtfs_node_free(dir);
+}
+
+static char __user* user_buffer(struct kunit* test, size_t size) {
+  unsigned long addr = kunit_vm_mmap(
+      test, NULL, 0, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0
+  );
+  KUNIT_ASSERT_NE_MSG(test, addr, 0, "Could not create userspace mm");
+  KUNIT_ASSERT_LT_MSG(test, addr, (unsigned long)TASK_SIZE, "Could not map user buffer");
+  return (char __user*)addr;
+}
+
+// Directory index
+
+static void vtfs_index_find_test(struct kunit* test) {
+  struct vtfs_node* dir = new_dir(test);
+  struct vtfs_file* a = add_file(test, dir, "a");
+  struct vtfs_file* b = add_file(test, dir, "b");
+
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_dir_find(dir->dir, "a"), a);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_dir_find(dir->dir, "b"), b);
+  KUNIT_EXPECT_NULL(test, vtfs_dir_find(dir->dir, "c"));
+  KUNIT_EXPECT_NULL(test, vtfs_dir_find(dir->dir, "ab"));
+  KUNIT_EXPECT_NULL(test, vtfs_dir_find(dir->dir, ""));
+
+  free_dir(dir);
+}
+
+static void vtfs_index_order_test(struct kunit* test) {
+  static const char* const names[] = {"one", "two", "three", "four"};
+  struct vtfs_node* dir = new_dir(test);
+  struct vtfs_file* entry;
+  int i = 0;
+
+  for (int n = 0; n < ARRAY_SIZE(names); n++) {
+    add_file(test, dir, names[n]);
+  }
+
+  // readdir offsets are list positions, so insertion order must be stable
+  list_for_each_entry(entry, &dir->dir->children, list) {
+    KUNIT_EXPECT_STREQ(test, entry->name, names[i++]);
+  }
+  KUNIT_EXPECT_EQ(test, i, ARRAY_SIZE(names));
+
+  free_dir(dir);
+}
+
+static void vtfs_index_remove_test(struct kunit* test) {
+  struct vtfs_node* dir = new_dir(test);
+  struct vtfs_file* a = add_file(test, dir, "a");
+  struct vtfs_node* node = a->node;
+
+  KUNIT_EXPECT_FALSE(test, vtfs_dir_empty(dir->dir));
+  vtfs_dir_remove(a);
+  KUNIT_EXPECT_TRUE(test, vtfs_dir_empty(dir->dir));
+  KUNIT_EXPECT_NULL(test, vtfs_dir_find(dir->dir, "a"));
+  KUNIT_EXPECT_TRUE(test, list_empty(&a->list));
+
+  KUNIT_EXPECT_TRUE(test, vtfs_file_free(a));
+  vtfs_node_free(node);
+  free_dir(dir);
+}
+
+static void vtfs_index_node_alloc_test(struct kunit* test) {
+  struct vtfs_node* dir = vtfs_node_alloc(NULL, 7, S_IFDIR | 0755);
+  struct vtfs_node* file = vtfs_node_alloc(NULL, 8, S_IFREG | 0644);
+
+  KUNIT_ASSERT_NOT_NULL(test, dir);
+  KUNIT_ASSERT_NOT_NULL(test, file);
+  KUNIT_EXPECT_NOT_NULL(test, dir->dir);
+  KUNIT_EXPECT_TRUE(test, vtfs_dir_empty(dir->dir));
+  KUNIT_EXPECT_NULL(test, file->dir);
+  KUNIT_EXPECT_EQ(test, dir->nlink, 0);
+  KUNIT_EXPECT_EQ(test, file->ino, 8);
+  KUNIT_EXPECT_EQ(test, file->size, 0);
+
+  vtfs_node_free(dir);
+  vtfs_node_free(file);
+}
+
+static void vtfs_index_symlink_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  char* long_target = kunit_kzalloc(test, 1000, GFP_KERNEL);
+  struct vtfs_node* short_link;
+  struct vtfs_node* long_link;
+  struct vtfs_node* file;
+  int i;
+
+  KUNIT_ASSERT_NOT_NULL(test, long_target);
+  memset(long_target, 'a', 999);
+  short_link = vtfs_symlink_alloc(&mem, 9, "../lib/libc.so.6");
+  long_link = vtfs_symlink_alloc(&mem, 10, long_target);
+  KUNIT_ASSERT_NOT_NULL(test, short_link);
+  KUNIT_ASSERT_NOT_NULL(test, long_link);
+
+  KUNIT_EXPECT_TRUE(test, S_ISLNK(short_link->mode));
+  KUNIT_EXPECT_EQ(test, short_link->size, 16);
+  KUNIT_EXPECT_STREQ(test, short_link->data, "../lib/libc.so.6");
+  // Short targets share the node's allocation, long ones get their own
+  KUNIT_EXPECT_TRUE(test, vtfs_node_inline_target(short_link));
+  KUNIT_EXPECT_FALSE(test, vtfs_node_inline_target(long_link));
+  KUNIT_EXPECT_STREQ(test, long_link->data, long_target);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 1000);
+  // File data can be the slab object right after its node
+  file = vtfs_node_alloc(&mem, 11, S_IFREG | 0644);
+  KUNIT_ASSERT_NOT_NULL(test, file);
+  file->data = (char*)(file + 1);
+  KUNIT_EXPECT_FALSE(test, vtfs_node_inline_target(file));
+  file->data = NULL;
+  vtfs_node_free(file);
+
+  vtfs_node_free(short_link);
+  vtfs_node_free(long_link);
+  for (i = 0; i < VTFS_MEM_COUNT; i++) {
+    KUNIT_EXPECT_EQ_MSG(test, vtfs_mem_read(&mem, i), 0, "counter %d", i);
+  }
+}
+
+static struct kunit_case vtfs_index_cases[] = {
+    KUNIT_CASE(vtfs_index_find_test),
+    KUNIT_CASE(vtfs_index_order_test),
+    KUNIT_CASE(vtfs_index_remove_test),
+    KUNIT_CASE(vtfs_index_node_alloc_test),
+    KUNIT_CASE(vtfs_index_symlink_test),
+    {},
+};
+
+static struct kunit_suite vtfs_index_suite = {
+    .name = "vtfs_index",
+    .test_cases = vtfs_index_cases,
+};
+
+// Data path
+
+static void vtfs_data_sparse_write_test(struct kunit* test) {
+  struct vtfs_node* node = vtfs_node_alloc(NULL, 1, S_IFREG | 0644);
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  loff_t pos = 100;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, "hello", 5), 0);
+
+  KUNIT_EXPECT_EQ(test, vtfs_data_write(node, ubuf, 5, &pos), 5);
+  KUNIT_EXPECT_EQ(test, pos, 105);
+  KUNIT_EXPECT_EQ(test, node->size, 105);
+  KUNIT_EXPECT_NULL(test, memchr_inv(node->data, 0, 100));
+  KUNIT_EXPECT_EQ(test, memcmp(node->data + 100, "hello", 5), 0);
+
+  vtfs_node_free(node);
+}
+
+static void vtfs_data_growth_test(struct kunit* test) {
+  struct vtfs_node* node = vtfs_node_alloc(NULL, 1, S_IFREG | 0644);
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  char* expected = kunit_kzalloc(test, 64 * 100, GFP_KERNEL);
+  loff_t pos = 0;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_ASSERT_NOT_NULL(test, expected);
+
+  for (int i = 0; i < 100; i++) {
+    char chunk[64];
+    memset(chunk, 'a' + i % 26, sizeof(chunk));
+    memcpy(expected + i * 64, chunk, sizeof(chunk));
+    KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, chunk, sizeof(chunk)), 0);
+    KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, sizeof(chunk), &pos), sizeof(chunk));
+  }
+  KUNIT_EXPECT_EQ(test, node->size, 64 * 100);
+  KUNIT_EXPECT_EQ(test, memcmp(node->data, expected, 64 * 100), 0);
+
+  // Overwriting inside the file must not grow it
+  pos = 10;
+  KUNIT_EXPECT_EQ(test, vtfs_data_write(node, ubuf, 64, &pos), 64);
+  KUNIT_EXPECT_EQ(test, node->size, 64 * 100);
+
+  vtfs_node_free(node);
+}
+
+static void vtfs_data_read_test(struct kunit* test) {
+  struct vtfs_node* node = vtfs_node_alloc(NULL, 1, S_IFREG | 0644);
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  char out[16];
+  loff_t pos = 0;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_EXPECT_EQ(test, vtfs_data_read(node, ubuf, 16, &pos), 0);
+
+  KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, "0123456789", 10), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 10, &pos), 10);
+
+  pos = 6;
+  KUNIT_EXPECT_EQ(test, vtfs_data_read(node, ubuf, 16, &pos), 4);
+  KUNIT_EXPECT_EQ(test, pos, 10);
+  KUNIT_ASSERT_EQ(test, copy_from_user(out, ubuf, 4), 0);
+  KUNIT_EXPECT_EQ(test, memcmp(out, "6789", 4), 0);
+
+  KUNIT_EXPECT_EQ(test, vtfs_data_read(node, ubuf, 16, &pos), 0);
+  pos = 1000;
+  KUNIT_EXPECT_EQ(test, vtfs_data_read(node, ubuf, 16, &pos), 0);
+  KUNIT_EXPECT_EQ(test, pos, 1000);
+
+  pos = -1;
+  KUNIT_EXPECT_EQ(test, vtfs_data_write(node, ubuf, 1, &pos), -EINVAL);
+  KUNIT_EXPECT_EQ(test, node->size, 10);
+
+  vtfs_node_free(node);
+}
+
+static void vtfs_data_truncate_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_node* node = vtfs_node_alloc(&mem, 1, S_IFREG | 0644);
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  loff_t pos = 0;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, "hello", 5), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 5, &pos), 5);
+
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(node, 2), 0);
+  KUNIT_EXPECT_EQ(test, node->size, 2);
+  KUNIT_EXPECT_EQ(test, memcmp(node->data, "he", 2), 0);
+
+  // Growing zero-fills rather than resurrecting the old bytes
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(node, 8), 0);
+  KUNIT_EXPECT_EQ(test, node->size, 8);
+  KUNIT_EXPECT_NULL(test, memchr_inv(node->data + 2, 0, 6));
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 8);
+
+  // Past what kmalloc can serve the data moves to vmalloc, and back again
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(node, KMALLOC_MAX_SIZE + 1), 0);
+  KUNIT_EXPECT_EQ(test, memcmp(node->data, "he", 2), 0);
+  KUNIT_EXPECT_EQ(test, node->data[KMALLOC_MAX_SIZE], 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(node, 8), 0);
+  KUNIT_EXPECT_EQ(test, memcmp(node->data, "he", 2), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 8);
+
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(node, 0), 0);
+  KUNIT_EXPECT_NULL(test, node->data);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA_SLACK), 0);
+
+  vtfs_node_free(node);
+}
+
+// A demoted file keeps its size but not its bytes, which only the backend
+// has, so nothing may build on them until they are back
+static void vtfs_data_demoted_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_node* node = vtfs_node_alloc(&mem, 1, S_IFREG | 0644);
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  loff_t pos = 0;
+  char* dst;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, "hello", 5), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 5, &pos), 5);
+  vtfs_data_demote(node);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 0);
+
+  KUNIT_EXPECT_EQ(test, vtfs_data_write(node, ubuf, 5, &pos), -EIO);
+  pos = 1;
+  KUNIT_EXPECT_EQ(test, vtfs_data_write(node, ubuf, 2, &pos), -EIO);
+  KUNIT_EXPECT_EQ(test, vtfs_data_truncate(node, 8), -EIO);
+  KUNIT_EXPECT_EQ(test, vtfs_data_truncate(node, 2), -EIO);
+  KUNIT_EXPECT_EQ(test, vtfs_data_reserve(node, 0, 8, &dst), -EIO);
+  KUNIT_EXPECT_NULL(test, node->data);
+  KUNIT_EXPECT_EQ(test, node->size, 5);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 0);
+
+  // Restored, the file grows from its full size again
+  KUNIT_ASSERT_EQ(test, vtfs_data_restore(node), 0);
+  pos = 5;
+  KUNIT_EXPECT_EQ(test, vtfs_data_write(node, ubuf, 5, &pos), 5);
+  KUNIT_EXPECT_EQ(test, node->size, 10);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 10);
+
+  // Truncating to nothing needs none of the old bytes
+  vtfs_data_demote(node);
+  KUNIT_EXPECT_EQ(test, vtfs_data_truncate(node, 0), 0);
+  KUNIT_EXPECT_EQ(test, node->size, 0);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 0);
+
+  vtfs_node_free(node);
+}
+
+static void vtfs_data_csum_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_node* node = vtfs_node_alloc(&mem, 1, S_IFREG | 0644);
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  loff_t pos = VTFS_CSUM_CHUNK;
+  u32 crc;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_EXPECT_EQ(test, vtfs_crc32c("123456789", 9), 0xe3069283);
+
+  KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, "123456789", 9), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 9, &pos), 9);
+  KUNIT_ASSERT_EQ(test, vtfs_data_csum(node, 1, &crc), 0);
+  KUNIT_EXPECT_EQ(test, crc, 0xe3069283);
+  KUNIT_ASSERT_NOT_NULL(test, node->csums);
+  KUNIT_EXPECT_TRUE(test, node->csums->chunk[1] & VTFS_CSUM_VALID);
+  KUNIT_EXPECT_EQ(test, vtfs_data_csum(node, 2, &crc), -EINVAL);
+
+  // Only the chunks a write touches are recomputed
+  KUNIT_ASSERT_EQ(test, vtfs_data_csum(node, 0, &crc), 0);
+  pos = VTFS_CSUM_CHUNK + 1;
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 1, &pos), 1);
+  KUNIT_EXPECT_TRUE(test, node->csums->chunk[0] & VTFS_CSUM_VALID);
+  KUNIT_EXPECT_FALSE(test, node->csums->chunk[1] & VTFS_CSUM_VALID);
+  KUNIT_ASSERT_EQ(test, vtfs_data_csum(node, 1, &crc), 0);
+  KUNIT_EXPECT_EQ(test, crc, vtfs_crc32c("113456789", 9));
+
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(node, VTFS_CSUM_CHUNK + 4), 0);
+  KUNIT_EXPECT_FALSE(test, node->csums->chunk[1] & VTFS_CSUM_VALID);
+
+  vtfs_node_free(node);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_META), 0);
+}
+
+static void vtfs_data_fill_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_node* node = vtfs_node_alloc(&mem, 1, S_IFREG | 0644);
+  char* payload = kunit_kzalloc(test, 4 + VTFS_CSUM_CHUNK + 5 + 8, GFP_KERNEL);
+  u32 len = VTFS_CSUM_CHUNK + 5;
+  u32 crcs[2];
+  const char* data;
+  const char* checked;
+  u32 crc;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_ASSERT_NOT_NULL(test, payload);
+  memcpy(payload, &len, 4);
+  memset(payload + 4, 'a', len);
+  crcs[0] = vtfs_crc32c(payload + 4, VTFS_CSUM_CHUNK);
+  crcs[1] = vtfs_crc32c(payload + 4 + VTFS_CSUM_CHUNK, 5);
+  memcpy(payload + 4 + len, crcs, sizeof(crcs));
+
+  KUNIT_ASSERT_EQ(test, vtfs_csum_check_read(payload, 4 + len + 8, &data, &checked), len);
+  KUNIT_ASSERT_EQ(test, vtfs_data_fill(node, 0, data, len, checked), 0);
+  KUNIT_EXPECT_EQ(test, node->size, len);
+  // Both CRCs came verified, the short one because the file ends there
+  KUNIT_EXPECT_TRUE(test, node->csums->chunk[1] & VTFS_CSUM_VALID);
+  KUNIT_ASSERT_EQ(test, vtfs_data_csum(node, 1, &crc), 0);
+  KUNIT_EXPECT_EQ(test, crc, crcs[1]);
+
+  KUNIT_EXPECT_EQ(test, vtfs_csum_check_read(payload, 4 + len + 4, &data, &checked), -EPROTO);
+  payload[4 + 100] ^= 1;
+  KUNIT_EXPECT_EQ(test, vtfs_csum_check_read(payload, 4 + len + 8, &data, &checked), -EBADMSG);
+  KUNIT_EXPECT_EQ(test, vtfs_data_fill(node, 1, data, len, checked), -EINVAL);
+
+  vtfs_node_free(node);
+}
+
+// The two halves of vtfs_data_fill() for data received in place
+static void vtfs_data_reserve_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_node* node = vtfs_node_alloc(&mem, 1, S_IFREG | 0644);
+  u32 crcs[2];
+  char* dst;
+  u32 crc;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_ASSERT_EQ(test, vtfs_data_reserve(node, 0, 2 * VTFS_CSUM_CHUNK, &dst), 0);
+  KUNIT_EXPECT_PTR_EQ(test, dst, node->data);
+  memset(dst, 'b', 2 * VTFS_CSUM_CHUNK);
+  crcs[0] = vtfs_crc32c(dst, VTFS_CSUM_CHUNK);
+  crcs[1] = crcs[0];
+  vtfs_data_filled(node, 0, 2 * VTFS_CSUM_CHUNK, (const char*)crcs);
+  KUNIT_EXPECT_TRUE(test, node->csums->chunk[1] & VTFS_CSUM_VALID);
+
+  // Receiving over a chunk drops its CRC until the new one is in
+  KUNIT_ASSERT_EQ(test, vtfs_data_reserve(node, VTFS_CSUM_CHUNK, VTFS_CSUM_CHUNK + 5, &dst), 0);
+  KUNIT_EXPECT_PTR_EQ(test, dst, node->data + VTFS_CSUM_CHUNK);
+  KUNIT_EXPECT_EQ(test, node->size, 2 * VTFS_CSUM_CHUNK + 5);
+  KUNIT_EXPECT_TRUE(test, node->csums->chunk[0] & VTFS_CSUM_VALID);
+  KUNIT_EXPECT_FALSE(test, node->csums->chunk[1] & VTFS_CSUM_VALID);
+
+  memset(dst, 'c', VTFS_CSUM_CHUNK + 5);
+  crcs[0] = vtfs_crc32c(dst, VTFS_CSUM_CHUNK);
+  crcs[1] = vtfs_crc32c(dst + VTFS_CSUM_CHUNK, 5);
+  dst[3] ^= 1;
+  KUNIT_EXPECT_EQ(test, vtfs_csum_verify(dst, VTFS_CSUM_CHUNK + 5, (const char*)crcs), -EBADMSG);
+  dst[3] ^= 1;
+  KUNIT_EXPECT_EQ(test, vtfs_csum_verify(dst, VTFS_CSUM_CHUNK + 5, (const char*)crcs), 0);
+  vtfs_data_filled(node, VTFS_CSUM_CHUNK, VTFS_CSUM_CHUNK + 5, (const char*)crcs);
+  KUNIT_EXPECT_TRUE(test, node->csums->chunk[2] & VTFS_CSUM_VALID);
+  KUNIT_ASSERT_EQ(test, vtfs_data_csum(node, 2, &crc), 0);
+  KUNIT_EXPECT_EQ(test, crc, crcs[1]);
+
+  KUNIT_EXPECT_EQ(test, vtfs_data_reserve(node, 1, 1, &dst), -EINVAL);
+  vtfs_node_free(node);
+}
+
+static struct kunit_case vtfs_data_cases[] = {
+    KUNIT_CASE(vtfs_data_sparse_write_test),
+    KUNIT_CASE(vtfs_data_growth_test),
+    KUNIT_CASE(vtfs_data_read_test),
+    KUNIT_CASE(vtfs_data_truncate_test),
+    KUNIT_CASE(vtfs_data_demoted_test),
+    KUNIT_CASE(vtfs_data_csum_test),
+    KUNIT_CASE(vtfs_data_fill_test),
+    KUNIT_CASE(vtfs_data_reserve_test),
+    {},
+};
+
+static struct kunit_suite vtfs_data_suite = {
+    .name = "vtfs_data",
+    .test_cases = vtfs_data_cases,
+};
+
+// Link and unlink refcounting
+
+static void vtfs_link_shares_node_test(struct kunit* test) {
+  struct vtfs_node* dir = new_dir(test);
+  struct vtfs_file* a = add_file(test, dir, "a");
+  struct vtfs_node* node = a->node;
+  struct vtfs_file* b;
+
+  KUNIT_EXPECT_EQ(test, node->nlink, 1);
+  b = vtfs_file_alloc("b", node);
+  KUNIT_ASSERT_NOT_NULL(test, b);
+  vtfs_dir_add(dir->dir, b);
+  KUNIT_EXPECT_EQ(test, node->nlink, 2);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_dir_find(dir->dir, "b")->node, node);
+
+  free_dir(dir);
+}
+
+static void vtfs_unlink_keeps_other_links_test(struct kunit* test) {
+  struct vtfs_node* dir = new_dir(test);
+  struct vtfs_file* a = add_file(test, dir, "a");
+  struct vtfs_node* node = a->node;
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  struct vtfs_file* b;
+  loff_t pos = 0;
+
+  KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, "data", 4), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 4, &pos), 4);
+  b = vtfs_file_alloc("b", node);
+  KUNIT_ASSERT_NOT_NULL(test, b);
+  vtfs_dir_add(dir->dir, b);
+
+  // Dropping the original name must leave the data reachable through the link
+  vtfs_dir_remove(a);
+  KUNIT_EXPECT_FALSE(test, vtfs_file_free(a));
+  KUNIT_EXPECT_EQ(test, node->nlink, 1);
+  KUNIT_EXPECT_EQ(test, node->size, 4);
+  KUNIT_EXPECT_EQ(test, memcmp(node->data, "data", 4), 0);
+
+  vtfs_dir_remove(b);
+  KUNIT_EXPECT_TRUE(test, vtfs_file_free(b));
+  KUNIT_EXPECT_EQ(test, node->nlink, 0);
+
+  vtfs_node_free(node);
+  free_dir(dir);
+}
+
+static struct kunit_case vtfs_link_cases[] = {
+    KUNIT_CASE(vtfs_link_shares_node_test),
+    KUNIT_CASE(vtfs_unlink_keeps_other_links_test),
+    {},
+};
+
+static struct kunit_suite vtfs_link_suite = {
+    .name = "vtfs_link",
+    .test_cases = vtfs_link_cases,
+};
+
+// Memory accounting
+
+static void vtfs_mem_charges_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_node* dir = vtfs_node_alloc(&mem, 100, S_IFDIR | 0777);
+  struct vtfs_node* node = vtfs_node_alloc(&mem, 101, S_IFREG | 0644);
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  struct vtfs_file* file;
+  loff_t pos = 0;
+
+  KUNIT_ASSERT_NOT_NULL(test, dir);
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  file = vtfs_file_alloc("name", node);
+  KUNIT_ASSERT_NOT_NULL(test, file);
+  vtfs_dir_add(dir->dir, file);
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 100, &pos), 100);
+
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_FILES), 1);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DIRS), 1);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_ENTRIES), 1);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_NAMES), 5);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA), 100);
+  KUNIT_EXPECT_EQ(
+      test,
+      vtfs_mem_read(&mem, VTFS_MEM_META),
+      2 * sizeof(struct vtfs_node) + sizeof(struct vtfs_dir) + sizeof(struct vtfs_file)
+  );
+  // kmalloc-128 serves the 100 data bytes
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_DATA_SLACK), 28);
+
+  vtfs_dir_remove(file);
+  KUNIT_EXPECT_TRUE(test, vtfs_file_free(file));
+  vtfs_node_free(node);
+  vtfs_node_free(dir);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_total(&mem, 0), 0);
+}
+
+static void vtfs_mem_tree_free_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_node* root = vtfs_node_alloc(&mem, 100, S_IFDIR | 0777);
+  struct vtfs_node* sub = vtfs_node_alloc(&mem, 101, S_IFDIR | 0777);
+  struct vtfs_node* file = vtfs_node_alloc(&mem, 102, S_IFREG | 0644);
+  int i;
+
+  KUNIT_ASSERT_NOT_NULL(test, root);
+  KUNIT_ASSERT_NOT_NULL(test, sub);
+  KUNIT_ASSERT_NOT_NULL(test, file);
+  root->nlink = 1;
+  vtfs_dir_add(root->dir, vtfs_file_alloc("sub", sub));
+  vtfs_dir_add(sub->dir, vtfs_file_alloc("file", file));
+  // A second link from another directory must not free the node twice
+  vtfs_dir_add(root->dir, vtfs_file_alloc("link", file));
+
+  vtfs_tree_free(root);
+  for (i = 0; i < VTFS_MEM_COUNT; i++) {
+    KUNIT_EXPECT_EQ_MSG(test, vtfs_mem_read(&mem, i), 0, "counter %d", i);
+  }
+}
+
+static void vtfs_mem_report_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  char small[16];
+  char buf[512];
+  int len;
+
+  vtfs_mem_add(&mem, VTFS_MEM_FILES, 2);
+  vtfs_mem_add(&mem, VTFS_MEM_DATA, 10);
+  len = vtfs_mem_report(&mem, 0, buf, sizeof(buf));
+  KUNIT_EXPECT_EQ(test, len, (int)strlen(buf));
+  KUNIT_EXPECT_NOT_NULL(test, strstr(buf, "files            2\n"));
+  KUNIT_EXPECT_NOT_NULL(test, strstr(buf, "data_per_file    5\n"));
+
+  // Truncates instead of overflowing a short buffer
+  len = vtfs_mem_report(&mem, 0, small, sizeof(small));
+  KUNIT_EXPECT_LT(test, len, (int)sizeof(small));
+}
+
+static long node_bytes_sum(struct vtfs_mem* mem) {
+  long sum = 0;
+  int nid;
+
+  for (nid = 0; nid < nr_node_ids; nid++) {
+    sum += atomic_long_read(&mem->node_bytes[nid]);
+  }
+  return sum;
+}
+
+static void vtfs_mem_numa_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  char __user* ubuf = user_buffer(test, PAGE_SIZE);
+  struct vtfs_node* node;
+  loff_t pos = 0;
+
+  KUNIT_ASSERT_EQ(test, vtfs_mem_init(&mem), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_set_policy(&mem, "local"), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_set_policy(&mem, "nearest"), -EINVAL);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_set_policy(&mem, "bind:"), -EINVAL);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_set_policy(&mem, "bind:0"), 0);
+  KUNIT_EXPECT_EQ(test, mem.policy, VTFS_NUMA_BIND);
+  KUNIT_ASSERT_EQ(test, vtfs_mem_set_policy(&mem, "interleave"), 0);
+
+  // Growth past a size class moves the data instead of using krealloc
+  node = vtfs_node_alloc(&mem, 1, S_IFREG | 0644);
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, "hello", 5), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 5, &pos), 5);
+  pos = 1000;
+  KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, 5, &pos), 5);
+  KUNIT_EXPECT_EQ(test, memcmp(node->data, "hello", 5), 0);
+  KUNIT_EXPECT_EQ(
+      test,
+      node_bytes_sum(&mem),
+      (long)(kmalloc_size_roundup(sizeof(struct vtfs_node)) + kmalloc_size_roundup(1005))
+  );
+
+  vtfs_node_free(node);
+  KUNIT_EXPECT_EQ(test, node_bytes_sum(&mem), 0);
+  vtfs_mem_destroy(&mem);
+}
+
+static struct kunit_case vtfs_mem_cases[] = {
+    KUNIT_CASE(vtfs_mem_charges_test),
+    KUNIT_CASE(vtfs_mem_tree_free_test),
+    KUNIT_CASE(vtfs_mem_report_test),
+    KUNIT_CASE(vtfs_mem_numa_test),
+    {},
+};
+
+static struct kunit_suite vtfs_mem_suite = {
+    .name = "vtfs_mem",
+    .test_cases = vtfs_mem_cases,
+};
+
+// Extended attributes
+
+static void vtfs_xattr_inline_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_xattr_table table;
+  struct vtfs_node* node = vtfs_node_alloc(&mem, 101, S_IFREG | 0644);
+  char buf[16];
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  vtfs_xattr_table_init(&table, &mem);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_get(&table, node, "user.a", buf, sizeof(buf)), -ENODATA);
+
+  KUNIT_ASSERT_EQ(test, vtfs_xattr_set(&table, node, "user.a", "one", 3, 0), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_xattr_set(&table, node, "user.b", "", 0, 0), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_get(&table, node, "user.a", NULL, 0), 3);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_get(&table, node, "user.a", buf, 2), -ERANGE);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_get(&table, node, "user.a", buf, sizeof(buf)), 3);
+  KUNIT_EXPECT_MEMEQ(test, buf, "one", 3);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_get(&table, node, "user.b", buf, sizeof(buf)), 0);
+
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_set(&table, node, "user.a", "x", 1, XATTR_CREATE), -EEXIST);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_set(&table, node, "user.c", "x", 1, XATTR_REPLACE), -ENODATA);
+  KUNIT_ASSERT_EQ(test, vtfs_xattr_set(&table, node, "user.a", "three", 5, XATTR_REPLACE), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_get(&table, node, "user.a", buf, sizeof(buf)), 5);
+  KUNIT_EXPECT_MEMEQ(test, buf, "three", 5);
+
+  // Both attributes share one packed area
+  KUNIT_EXPECT_LE(test, vtfs_mem_read(&mem, VTFS_MEM_XATTRS), 64);
+
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_set(&table, node, "user.a", NULL, 0, 0), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_set(&table, node, "user.a", NULL, 0, 0), -ENODATA);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_set(&table, node, "user.b", NULL, 0, 0), 0);
+  KUNIT_EXPECT_NULL(test, node->xattrs);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_XATTRS), 0);
+
+  vtfs_node_free(node);
+  vtfs_xattr_table_destroy(&table);
+}
+
+static void vtfs_xattr_shared_test(struct kunit* test) {
+  struct vtfs_mem mem = {};
+  struct vtfs_xattr_table table;
+  struct vtfs_node* a = vtfs_node_alloc(&mem, 101, S_IFREG | 0644);
+  struct vtfs_node* b = vtfs_node_alloc(&mem, 102, S_IFREG | 0644);
+  char* value = kunit_kzalloc(test, 1000, GFP_KERNEL);
+  char* buf = kunit_kzalloc(test, 1000, GFP_KERNEL);
+  long one_blob;
+
+  KUNIT_ASSERT_NOT_NULL(test, a);
+  KUNIT_ASSERT_NOT_NULL(test, b);
+  KUNIT_ASSERT_NOT_NULL(test, value);
+  KUNIT_ASSERT_NOT_NULL(test, buf);
+  memset(value, 'v', 1000);
+  vtfs_xattr_table_init(&table, &mem);
+
+  KUNIT_ASSERT_EQ(test, vtfs_xattr_set(&table, a, "security.label", value, 1000, 0), 0);
+  one_blob = vtfs_mem_read(&mem, VTFS_MEM_XATTRS);
+  KUNIT_ASSERT_EQ(test, vtfs_xattr_set(&table, b, "security.label", value, 1000, 0), 0);
+  // The second copy only costs b its packed area, not another 1000 bytes
+  KUNIT_EXPECT_LT(test, vtfs_mem_read(&mem, VTFS_MEM_XATTRS), one_blob + 100);
+
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_get(&table, b, "security.label", buf, 1000), 1000);
+  KUNIT_EXPECT_MEMEQ(test, buf, value, 1000);
+
+  // Freeing a keeps the blob alive for b
+  vtfs_node_free(a);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_get(&table, b, "security.label", buf, 1000), 1000);
+  KUNIT_EXPECT_MEMEQ(test, buf, value, 1000);
+  vtfs_node_free(b);
+  KUNIT_EXPECT_EQ(test, vtfs_mem_read(&mem, VTFS_MEM_XATTRS), 0);
+  vtfs_xattr_table_destroy(&table);
+}
+
+static void vtfs_xattr_list_test(struct kunit* test) {
+  struct vtfs_xattr_table table;
+  struct vtfs_node* node = vtfs_node_alloc(NULL, 101, S_IFREG | 0644);
+  char buf[64];
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  vtfs_xattr_table_init(&table, NULL);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_list(&table, node, NULL, buf, sizeof(buf)), 0);
+  vtfs_xattr_set(&table, node, "user.x", "1", 1, 0);
+  vtfs_xattr_set(&table, node, "trusted.y", "2", 1, 0);
+
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_list(&table, node, NULL, NULL, 0), 17);
+  KUNIT_EXPECT_EQ(test, vtfs_xattr_list(&table, node, NULL, buf, 10), -ERANGE);
+  KUNIT_ASSERT_EQ(test, vtfs_xattr_list(&table, node, NULL, buf, sizeof(buf)), 17);
+  KUNIT_EXPECT_MEMEQ(test, buf, "user.x\0trusted.y\0", 17);
+
+  vtfs_node_free(node);
+  vtfs_xattr_table_destroy(&table);
+}
+
+static struct kunit_case vtfs_xattr_cases[] = {
+    KUNIT_CASE(vtfs_xattr_inline_test),
+    KUNIT_CASE(vtfs_xattr_shared_test),
+    KUNIT_CASE(vtfs_xattr_list_test),
+    {},
+};
+
+static struct kunit_suite vtfs_xattr_suite = {
+    .name = "vtfs_xattr",
+    .test_cases = vtfs_xattr_cases,
+};
+
+// Delta encoding
+
+// Encodes new against a signature of old, applies the delta to old and
+// returns its length after checking the result is new
+static ssize_t delta_roundtrip(
+    struct kunit* test, const char* old, size_t old_len, const char* new, size_t new_len
+) {
+  size_t count = vtfs_delta_blocks(old_len);
+  struct vtfs_delta_sig* sigs = kunit_kcalloc(test, count + 1, sizeof(*sigs), GFP_KERNEL);
+  char* out = kunit_kmalloc(test, new_len + 1, GFP_KERNEL);
+  char* delta;
+  ssize_t len;
+
+  KUNIT_ASSERT_NOT_NULL(test, sigs);
+  KUNIT_ASSERT_NOT_NULL(test, out);
+  vtfs_delta_signature(old, old_len, sigs);
+  len = vtfs_delta_encode(sigs, count, old_len, new, new_len, &delta);
+  KUNIT_ASSERT_GE(test, len, 0);
+  KUNIT_EXPECT_EQ(test, vtfs_delta_apply(old, old_len, delta, len, out, new_len), 0);
+  KUNIT_EXPECT_MEMEQ(test, out, new, new_len);
+  kvfree(delta);
+  return len;
+}
+
+static void vtfs_delta_hash_test(struct kunit* test) {
+  char buf[VTFS_DELTA_BLOCK + 16];
+  u32 weak;
+
+  get_random_bytes(buf, sizeof(buf));
+  weak = vtfs_delta_weak(buf, VTFS_DELTA_BLOCK);
+  for (int i = 0; i < 16; i++) {
+    weak = vtfs_delta_roll(weak, buf[i], buf[i + VTFS_DELTA_BLOCK], VTFS_DELTA_BLOCK);
+    KUNIT_EXPECT_EQ(test, weak, vtfs_delta_weak(buf + i + 1, VTFS_DELTA_BLOCK));
+  }
+  KUNIT_EXPECT_EQ(test, vtfs_delta_strong("a", 1), 0xd24ec4f1a98c6e5bULL);
+}
+
+static void vtfs_delta_rewrite_test(struct kunit* test) {
+  const size_t size = 64 * VTFS_DELTA_BLOCK;
+  char* old = kunit_kmalloc(test, size, GFP_KERNEL);
+  char* new = kunit_kmalloc(test, size + 7, GFP_KERNEL);
+
+  KUNIT_ASSERT_NOT_NULL(test, old);
+  KUNIT_ASSERT_NOT_NULL(test, new);
+  get_random_bytes(old, size);
+
+  // Unchanged: a single copy op
+  KUNIT_EXPECT_EQ(test, delta_roundtrip(test, old, size, old, size), 9);
+
+  // One byte rewritten in place costs one block of literals
+  memcpy(new, old, size);
+  new[size / 2] ^= 1;
+  KUNIT_EXPECT_LE(test, delta_roundtrip(test, old, size, new, size), VTFS_DELTA_BLOCK + 32);
+
+  // Bytes inserted shift everything after them; the rolling hash finds the
+  // old blocks at their new offsets
+  memcpy(new, old, 1000);
+  memset(new + 1000, 'x', 7);
+  memcpy(new + 1007, old + 1000, size - 1000);
+  KUNIT_EXPECT_LE(test, delta_roundtrip(test, old, size, new, size + 7), VTFS_DELTA_BLOCK + 32);
+
+  // Short last blocks, growing and shrinking
+  delta_roundtrip(test, old, size - 123, old, size - 100);
+  delta_roundtrip(test, old, size - 123, old, size - 500);
+  delta_roundtrip(test, old, 0, old, 100);
+  KUNIT_EXPECT_EQ(test, delta_roundtrip(test, old, 100, old, 0), 0);
+}
+
+static void vtfs_delta_malformed_test(struct kunit* test) {
+  static const char past_end[] = "C\1\0\0\0\1\0\0\0";
+  static const char short_literal[] = "L\10\0\0\0abc";
+  char old[100] = {};
+  char out[100];
+
+  KUNIT_EXPECT_EQ(test, vtfs_delta_apply(old, 100, past_end, 9, out, 100), -EPROTO);
+  KUNIT_EXPECT_EQ(test, vtfs_delta_apply(old, 100, short_literal, 8, out, 8), -EPROTO);
+  // A valid delta that produces fewer bytes than announced
+  KUNIT_EXPECT_EQ(test, vtfs_delta_apply(old, 100, "L\1\0\0\0a", 6, out, 2), -EPROTO);
+}
+
+// Backend for vtfs_remote_sync() that keeps only the file's size, sized
+// and extended by writes the way tools/mockd.c does. Creates hand out
+// inode 200 for the mount's directory and 201 for the file.
+struct vtfs_sync_backend {
+  size_t size;
+  size_t writes;
+  size_t resizes;
+  size_t creates;
+};
+
+static int64_t vtfs_sync_backend_call(
+    struct vtfs_remote* remote,
+    enum vtfs_rpc_op op,
+    char* response,
+    size_t response_size,
+    const struct vtfs_arg* args,
+    size_t nargs
+) {
+  struct kunit* test = kunit_get_current_test();
+  struct vtfs_sync_backend* backend = test->priv;
+  unsigned long long offset = 0;
+  unsigned long long size;
+  size_t len = 0;
+
+  if (op == VTFS_RPC_CREATE) {
+    KUNIT_EXPECT_STREQ(test, args[2].value, backend->creates ? "file" : "dir");
+    memset(response, 0, response_size);
+    put_unaligned_le64(200 + backend->creates++, response);
+    return 0;
+  }
+  KUNIT_EXPECT_EQ(test, op, VTFS_RPC_WRITE);
+  for (size_t i = 0; i < nargs; i++) {
+    if (strcmp(args[i].key, "inode") == 0) {
+      KUNIT_EXPECT_STREQ(test, args[i].value, "201");
+    } else if (strcmp(args[i].key, "offset") == 0) {
+      KUNIT_EXPECT_EQ(test, kstrtoull(args[i].value, 10, &offset), 0);
+    } else if (strcmp(args[i].key, "content") == 0) {
+      len = args[i].len;
+    } else if (strcmp(args[i].key, "size") == 0) {
+      // Before any data goes up, so the writes land on the new size
+      KUNIT_EXPECT_EQ(test, backend->writes, 0);
+      KUNIT_EXPECT_EQ(test, kstrtoull(args[i].value, 10, &size), 0);
+      backend->size = size;
+      backend->resizes++;
+    }
+  }
+  backend->size = max_t(size_t, backend->size, offset + len);
+  backend->writes++;
+  return 0;
+}
+
+// Files past what one signature covers go up whole. Shrinking one must
+// still cut the backend's copy, which a write alone only ever extends.
+// The first sync creates the file, and every write goes to the inode the
+// backend gave it rather than the local one.
+static void vtfs_delta_sync_shrink_test(struct kunit* test) {
+  size_t size = (4096 + 2) * VTFS_DELTA_BLOCK;
+  struct vtfs_sync_backend backend = {};
+  struct vtfs_remote remote = {};
+  struct vtfs_mem mem = {};
+  struct vtfs_node* node = vtfs_node_alloc(&mem, 1, S_IFREG | 0644);
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+  vtfs_remote_init(&remote);
+  test->priv = &backend;
+  kunit_activate_static_stub(test, vtfs_remote_call, vtfs_sync_backend_call);
+
+  // Nothing to read before the backend has the file
+  KUNIT_EXPECT_EQ(test, vtfs_remote_read(&remote, node, 0, 1), -ESTALE);
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(node, size), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_remote_sync(&remote, node), 0);
+  KUNIT_EXPECT_EQ(test, node->remote_ino, 201);
+  KUNIT_EXPECT_EQ(test, backend.size, size);
+
+  backend.writes = 0;
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(node, size - VTFS_DELTA_BLOCK - 1), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_remote_sync(&remote, node), 0);
+  KUNIT_EXPECT_EQ(test, backend.size, node->size);
+  KUNIT_EXPECT_EQ(test, backend.resizes, 2);
+  KUNIT_EXPECT_EQ(test, backend.creates, 2);
+
+  kunit_deactivate_static_stub(test, vtfs_remote_call);
+  vtfs_node_free(node);
+  vtfs_remote_destroy(&remote);
+}
+
+static struct kunit_case vtfs_delta_cases[] = {
+    KUNIT_CASE(vtfs_delta_hash_test),
+    KUNIT_CASE(vtfs_delta_rewrite_test),
+    KUNIT_CASE(vtfs_delta_malformed_test),
+    KUNIT_CASE(vtfs_delta_sync_shrink_test),
+    {},
+};
+
+static struct kunit_suite vtfs_delta_suite = {
+    .name = "vtfs_delta",
+    .test_cases = vtfs_delta_cases,
+};
+
+// HTTP response parser
+
+#define OK_HEADER "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+
+// Builds "<head>Content-Length: N\r\n\r\n<int64 result><payload>" in a
+// buffer sized exactly to the response, so KASAN flags any overread.
+static char* build_response(
+    struct kunit* test, const char* head, int64_t result, const char* payload, size_t* size
+) {
+  size_t payload_size = strlen(payload);
+  char header[256];
+  int header_size = snprintf(
+      header,
+      sizeof(header),
+      "%sContent-Length: %zu\r\n\r\n",
+      head,
+      sizeof(result) + payload_size
+  );
+  char* raw;
+
+  *size = header_size + sizeof(result) + payload_size;
+  raw = kunit_kmalloc(test, *size, GFP_KERNEL);
+  KUNIT_ASSERT_NOT_NULL(test, raw);
+  memcpy(raw, header, header_size);
+  memcpy(raw + header_size, &result, sizeof(result));
+  memcpy(raw + header_size + sizeof(result), payload, payload_size);
+  return raw;
+}
+
+static char* copy_exact(struct kunit* test, const char* src, size_t size) {
+  char* dst = kunit_kmalloc(test, max_t(size_t, size, 1), GFP_KERNEL);
+  KUNIT_ASSERT_NOT_NULL(test, dst);
+  memcpy(dst, src, size);
+  return dst;
+}
+
+static int64_t parse_literal(
+    struct kunit* test, const char* raw, size_t size, char* out, size_t out_size
+) {
+  return parse_http_response(copy_exact(test, raw, size), size, out, out_size);
+}
+
+static void vtfs_http_parse_ok_test(struct kunit* test) {
+  size_t size;
+  char* raw = build_response(test, OK_HEADER, 42, "payload", &size);
+  char out[16] = {};
+
+  KUNIT_EXPECT_EQ(test, parse_http_response(raw, size, out, sizeof(out)), 42);
+  KUNIT_EXPECT_STREQ(test, out, "payload");
+}
+
+static void vtfs_http_parse_status_test(struct kunit* test) {
+  size_t size;
+  char* raw = build_response(test, "HTTP/1.1 404 Not Found\r\n", 0, "", &size);
+  char out[16];
+
+  KUNIT_EXPECT_EQ(test, parse_http_response(raw, size, out, sizeof(out)), -5);
+}
+
+static void vtfs_http_parse_fragmented_test(struct kunit* test) {
+  size_t size;
+  char* full = build_response(test, OK_HEADER, 7, "0123456789", &size);
+  char out[16];
+
+  // Every truncation point, as a short receive would leave it, must fail cleanly
+  for (size_t cut = 0; cut < size; cut++) {
+    char* raw = copy_exact(test, full, cut);
+    KUNIT_EXPECT_LT_MSG(
+        test, parse_http_response(raw, cut, out, sizeof(out)), 0, "cut at %zu", cut
+    );
+    kunit_kfree(test, raw);
+  }
+  KUNIT_EXPECT_EQ(test, parse_literal(test, full, size, out, sizeof(out)), 7);
+}
+
+static void vtfs_http_parse_oversized_test(struct kunit* test) {
+  static const char no_crlf[] = "HTTP/1.1 200 OK\r\nX-Long: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  static const char too_long[] = OK_HEADER "Content-Length: 4096\r\n\r\n\0\0\0\0\0\0\0\0abc";
+  static const char negative[] = OK_HEADER "Content-Length: -8\r\n\r\n\0\0\0\0\0\0\0\0";
+  size_t size;
+  char* raw = build_response(test, OK_HEADER, 1, "this does not fit", &size);
+  char out[4];
+
+  KUNIT_EXPECT_EQ(test, parse_http_response(raw, size, out, sizeof(out)), -ENOSPC);
+  KUNIT_EXPECT_EQ(test, parse_literal(test, no_crlf, sizeof(no_crlf) - 1, out, 4), -6);
+  KUNIT_EXPECT_EQ(test, parse_literal(test, too_long, sizeof(too_long) - 1, out, 4), -6);
+  KUNIT_EXPECT_EQ(test, parse_literal(test, negative, sizeof(negative) - 1, out, 4), -6);
+}
+
+static void vtfs_http_parse_chunked_test(struct kunit* test) {
+  static const char body[] = "\x05\0\0\0\0\0\0\0hello, world";
+  char raw[256];
+  char out[32] = {};
+  int n;
+
+  // 8-byte result split across chunks, with a chunk extension and a trailer
+  n = snprintf(raw, sizeof(raw), "%sTransfer-Encoding: chunked\r\n\r\n", OK_HEADER);
+  n += snprintf(raw + n, sizeof(raw) - n, "3;ext=1\r\n");
+  memcpy(raw + n, body, 3);
+  n += 3;
+  n += snprintf(raw + n, sizeof(raw) - n, "\r\n11\r\n");
+  memcpy(raw + n, body + 3, 17);
+  n += 17;
+  n += snprintf(raw + n, sizeof(raw) - n, "\r\n0\r\nX-Trailer: 1\r\n\r\n");
+
+  KUNIT_EXPECT_EQ(test, parse_literal(test, raw, n, out, sizeof(out)), 5);
+  KUNIT_EXPECT_STREQ(test, out, "hello, world");
+
+  // Truncated inside the chunk stream
+  for (int cut = n - 20; cut < n - 5; cut++) {
+    KUNIT_EXPECT_LT(test, parse_literal(test, raw, cut, out, sizeof(out)), 0);
+  }
+}
+
+static void vtfs_http_parse_bad_chunk_test(struct kunit* test) {
+  static const char bad_size[] = OK_HEADER "Transfer-Encoding: chunked\r\n\r\nzz\r\n";
+  static const char short_chunk[] =
+      OK_HEADER "Transfer-Encoding: chunked\r\n\r\n40\r\nabc\r\n0\r\n\r\n";
+  char out[16];
+
+  KUNIT_EXPECT_EQ(test, parse_literal(test, bad_size, sizeof(bad_size) - 1, out, 16), -6);
+  KUNIT_EXPECT_EQ(test, parse_literal(test, short_chunk, sizeof(short_chunk) - 1, out, 16), -6);
+}
+
+static int build(char* buf, size_t size, const char* method, size_t arg_size, ...) {
+  va_list args;
+  int length;
+
+  va_start(args, arg_size);
+  length = vtfs_http_build_request(buf, size, "0.0.0.0", "tok", method, arg_size, args);
+  va_end(args);
+  return length;
+}
+
+static void vtfs_http_build_request_test(struct kunit* test) {
+  static const char expected[] =
+      "GET /api/lookup?token=tok&parent=100&name=a HTTP/1.1\r\n"
+      "Host:0.0.0.0\r\nConnection: close\r\n\r\n";
+  char buf[VTFS_HTTP_REQUEST_SIZE];
+
+  KUNIT_EXPECT_EQ(
+      test, build(buf, sizeof(buf), "lookup", 2, "parent", "100", "name", "a"), sizeof(expected) - 1
+  );
+  KUNIT_EXPECT_STREQ(test, buf, expected);
+  KUNIT_EXPECT_EQ(test, build(buf, 32, "lookup", 2, "parent", "100", "name", "a"), -ENOSPC);
+}
+
+static int build_args(char* buf, size_t size, bool keep_alive) {
+  const struct vtfs_arg args[] = {
+      {.key = "inode", .value = "101", .len = 3},
+      {.key = "content", .value = "a\0/", .len = 3},
+  };
+
+  return vtfs_http_build_request_args(buf, size, "0.0.0.0", "tok", "write", args, 2, keep_alive);
+}
+
+static void vtfs_http_build_request_args_test(struct kunit* test) {
+  static const char expected[] =
+      "GET /api/write?token=tok&inode=101&content=a%00%2F HTTP/1.1\r\n"
+      "Host:0.0.0.0\r\nConnection: close\r\n\r\n";
+  char buf[VTFS_HTTP_REQUEST_SIZE];
+
+  KUNIT_EXPECT_EQ(test, build_args(buf, sizeof(buf), false), sizeof(expected) - 1);
+  KUNIT_EXPECT_STREQ(test, buf, expected);
+  KUNIT_EXPECT_EQ(test, build_args(buf, 40, false), -ENOSPC);
+  KUNIT_EXPECT_GT(test, build_args(buf, sizeof(buf), true), 0);
+  KUNIT_EXPECT_NOT_NULL(test, strstr(buf, "\r\nConnection: keep-alive\r\n\r\n"));
+}
+
+// Pipelined responses are split at their own end, whatever follows
+static void vtfs_http_response_length_test(struct kunit* test) {
+  static const char two[] =
+      "HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\n12345678"
+      "HTTP/1.1 200 OK\r\nContent-Length: 9\r\n\r\n123456789";
+  static const char chunked[] =
+      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "3\r\nabc\r\n5;ext=1\r\n12345\r\n0\r\n\r\nHTTP/1.1";
+  static const char until_close[] = "HTTP/1.0 200 OK\r\n\r\n12345678";
+  size_t first = sizeof("HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\n12345678") - 1;
+  bool close;
+
+  KUNIT_EXPECT_EQ(test, vtfs_http_response_length(two, sizeof(two) - 1, &close), first);
+  KUNIT_EXPECT_FALSE(test, close);
+  KUNIT_EXPECT_EQ(test, vtfs_http_response_length(two, first - 1, &close), 0);
+  KUNIT_EXPECT_EQ(
+      test,
+      vtfs_http_response_length(two + first, sizeof(two) - 1 - first, &close),
+      sizeof(two) - 1 - first
+  );
+
+  KUNIT_EXPECT_EQ(
+      test, vtfs_http_response_length(chunked, sizeof(chunked) - 1, &close), sizeof(chunked) - 9
+  );
+  KUNIT_EXPECT_EQ(test, vtfs_http_response_length(chunked, sizeof(chunked) - 12, &close), 0);
+
+  KUNIT_EXPECT_EQ(
+      test, vtfs_http_response_length(until_close, sizeof(until_close) - 1, &close), 0
+  );
+  KUNIT_EXPECT_TRUE(test, close);
+  KUNIT_EXPECT_EQ(test, vtfs_http_response_length("FTP 200\r\n", 9, &close), -6);
+}
+
+static struct kunit_case vtfs_http_cases[] = {
+    KUNIT_CASE(vtfs_http_parse_ok_test),
+    KUNIT_CASE(vtfs_http_parse_status_test),
+    KUNIT_CASE(vtfs_http_parse_fragmented_test),
+    KUNIT_CASE(vtfs_http_parse_oversized_test),
+    KUNIT_CASE(vtfs_http_parse_chunked_test),
+    KUNIT_CASE(vtfs_http_parse_bad_chunk_test),
+    KUNIT_CASE(vtfs_http_build_request_test),
+    KUNIT_CASE(vtfs_http_build_request_args_test),
+    KUNIT_CASE(vtfs_http_response_length_test),
+    {},
+};
+
+static struct kunit_suite vtfs_http_suite = {
+    .name = "vtfs_http",
+    .test_cases = vtfs_http_cases,
+};
+
+static const struct vtfs_arg vtfs_rpc_test_args[] = {
+    {.key = "inode", .value = "101", .len = 3},
+    {.key = "content", .value = "a\0b", .len = 3},
+};
+
+static void vtfs_rpc_request_test(struct kunit* test) {
+  size_t len = vtfs_rpc_request_size("tok", vtfs_rpc_test_args, 2);
+  char* buf = kunit_kzalloc(test, len, GFP_KERNEL);
+  struct vtfs_rpc_header header;
+  struct vtfs_arg arg;
+  size_t key_len;
+  size_t pos = 0;
+  const char* body;
+
+  KUNIT_ASSERT_NOT_NULL(test, buf);
+  KUNIT_EXPECT_EQ(
+      test, vtfs_rpc_build_request(buf, VTFS_RPC_WRITE, 7, "tok", vtfs_rpc_test_args, 2), len
+  );
+  KUNIT_ASSERT_EQ(test, vtfs_rpc_get_header(buf, &header), 0);
+  KUNIT_EXPECT_EQ(test, header.opcode, VTFS_RPC_WRITE);
+  KUNIT_EXPECT_EQ(test, header.nargs, 3);
+  KUNIT_EXPECT_EQ(test, header.id, 7);
+  KUNIT_EXPECT_EQ(test, header.len, len - VTFS_RPC_HEADER_SIZE);
+  KUNIT_EXPECT_STREQ(test, vtfs_rpc_method(header.opcode), "write");
+  KUNIT_EXPECT_EQ(test, vtfs_rpc_opcode("write"), VTFS_RPC_WRITE);
+
+  // The token comes first, then the parameters as given
+  body = buf + VTFS_RPC_HEADER_SIZE;
+  KUNIT_ASSERT_EQ(test, vtfs_rpc_next_arg(body, header.len, &pos, &arg, &key_len), 1);
+  KUNIT_EXPECT_EQ(test, key_len, 5);
+  KUNIT_EXPECT_EQ(test, memcmp(arg.key, "token", 5), 0);
+  KUNIT_EXPECT_EQ(test, arg.len, 3);
+  for (int i = 0; i < 2; i++) {
+    KUNIT_ASSERT_EQ(test, vtfs_rpc_next_arg(body, header.len, &pos, &arg, &key_len), 1);
+    KUNIT_EXPECT_EQ(test, key_len, strlen(vtfs_rpc_test_args[i].key));
+    KUNIT_EXPECT_EQ(test, memcmp(arg.key, vtfs_rpc_test_args[i].key, key_len), 0);
+    KUNIT_EXPECT_EQ(test, arg.len, vtfs_rpc_test_args[i].len);
+    KUNIT_EXPECT_EQ(test, memcmp(arg.value, vtfs_rpc_test_args[i].value, arg.len), 0);
+  }
+  KUNIT_EXPECT_EQ(test, vtfs_rpc_next_arg(body, header.len, &pos, &arg, &key_len), 0);
+}
+
+static void vtfs_rpc_malformed_test(struct kunit* test) {
+  size_t len = vtfs_rpc_request_size("tok", vtfs_rpc_test_args, 2);
+  char* buf = kunit_kzalloc(test, len, GFP_KERNEL);
+  struct vtfs_rpc_header header;
+  struct vtfs_arg arg;
+  size_t key_len;
+  size_t pos = 0;
+  size_t end;
+
+  KUNIT_ASSERT_NOT_NULL(test, buf);
+  vtfs_rpc_build_request(buf, VTFS_RPC_WRITE, 1, "tok", vtfs_rpc_test_args, 2);
+  KUNIT_ASSERT_EQ(test, vtfs_rpc_get_header(buf, &header), 0);
+
+  // A body cut anywhere inside a parameter is refused, never overread
+  end = header.len - 1;
+  while (vtfs_rpc_next_arg(buf + VTFS_RPC_HEADER_SIZE, end, &pos, &arg, &key_len) == 1) {
+  }
+  KUNIT_EXPECT_EQ(
+      test, vtfs_rpc_next_arg(buf + VTFS_RPC_HEADER_SIZE, end, &pos, &arg, &key_len), -EPROTO
+  );
+
+  buf[0] ^= 1;
+  KUNIT_EXPECT_EQ(test, vtfs_rpc_get_header(buf, &header), -EPROTO);
+  buf[0] ^= 1;
+  header.len = VTFS_RPC_FRAME_MAX + 1;
+  vtfs_rpc_put_header(buf, &header);
+  KUNIT_EXPECT_EQ(test, vtfs_rpc_get_header(buf, &header), -EPROTO);
+  KUNIT_EXPECT_NULL(test, vtfs_rpc_method(VTFS_RPC_OP_COUNT));
+  KUNIT_EXPECT_EQ(test, vtfs_rpc_opcode("nosuch"), -EINVAL);
+}
+
+// The gather form sends the same bytes without copying large values
+static void vtfs_rpc_gather_test(struct kunit* test) {
+  char* data = kunit_kmalloc(test, 2 * VTFS_RPC_GATHER_MIN, GFP_KERNEL);
+  struct vtfs_arg args[] = {
+      {.key = "inode", .value = "17", .len = 2},
+      {.key = "content", .value = data, .len = 2 * VTFS_RPC_GATHER_MIN},
+      {.key = "crc32c", .value = "0badf00d", .len = 8},
+  };
+  size_t len = vtfs_rpc_request_size("tok", args, 3);
+  char* frame = kunit_kzalloc(test, len, GFP_KERNEL);
+  char* head = kunit_kzalloc(test, vtfs_rpc_gather_size("tok", args, 3), GFP_KERNEL);
+  struct vtfs_rpc_seg segs[VTFS_RPC_GATHER_SEGS(3)];
+  size_t count;
+  size_t pos = 0;
+
+  KUNIT_ASSERT_NOT_NULL(test, data);
+  KUNIT_ASSERT_NOT_NULL(test, frame);
+  KUNIT_ASSERT_NOT_NULL(test, head);
+  memset(data, 'd', 2 * VTFS_RPC_GATHER_MIN);
+  KUNIT_EXPECT_EQ(test, vtfs_rpc_gather_size("tok", args, 3), len - 2 * VTFS_RPC_GATHER_MIN);
+  vtfs_rpc_build_request(frame, VTFS_RPC_WRITE, 3, "tok", args, 3);
+  count = vtfs_rpc_build_gather(head, VTFS_RPC_WRITE, 3, "tok", args, 3, segs);
+
+  // Before the data, the data itself in place, after it
+  KUNIT_ASSERT_EQ(test, count, 3);
+  KUNIT_EXPECT_PTR_EQ(test, segs[1].base, (const char*)data);
+  for (size_t i = 0; i < count; i++) {
+    KUNIT_ASSERT_LE(test, pos + segs[i].len, len);
+    KUNIT_EXPECT_EQ(test, memcmp(frame + pos, segs[i].base, segs[i].len), 0);
+    pos += segs[i].len;
+  }
+  KUNIT_EXPECT_EQ(test, pos, len);
+}
+
+static struct kunit_case vtfs_rpc_cases[] = {
+    KUNIT_CASE(vtfs_rpc_request_test),
+    KUNIT_CASE(vtfs_rpc_malformed_test),
+    KUNIT_CASE(vtfs_rpc_gather_test),
+    {},
+};
+
+static struct kunit_suite vtfs_rpc_suite = {
+    .name = "vtfs_rpc",
+    .test_cases = vtfs_rpc_cases,
+};
+
+#define FLIGHT_CALLERS 8
+
+struct flight_backend {
+  struct vtfs_flight_table table;
+  struct completion release;  // holds every backend call until the test is ready
+  atomic_t calls;
+};
+
+struct flight_caller {
+  struct flight_backend* backend;
+  struct vtfs_arg arg;
+  char response[16];
+  int64_t result;
+  struct completion done;
+};
+
+static int64_t flight_backend_call(void* ctx, char* response, size_t response_size) {
+  struct flight_backend* backend = ctx;
+
+  atomic_inc(&backend->calls);
+  wait_for_completion(&backend->release);
+  memset(response, 'r', response_size);
+  return 0;
+}
+
+static int flight_caller_main(void* data) {
+  struct flight_caller* caller = data;
+
+  caller->result = vtfs_flight_do(
+      &caller->backend->table,
+      VTFS_RPC_LOOKUP,
+      &caller->arg,
+      1,
+      caller->response,
+      sizeof(caller->response),
+      flight_backend_call,
+      caller->backend
+  );
+  complete(&caller->done);
+  return 0;
+}
+
+// Concurrent identical calls reach the backend once; a different one does not join them
+static void vtfs_flight_coalesce_test(struct kunit* test) {
+  struct flight_backend* backend = kunit_kzalloc(test, sizeof(*backend), GFP_KERNEL);
+  struct flight_caller* callers =
+      kunit_kcalloc(test, FLIGHT_CALLERS + 1, sizeof(*callers), GFP_KERNEL);
+  u64 shared = 0;
+
+  KUNIT_ASSERT_NOT_NULL(test, backend);
+  KUNIT_ASSERT_NOT_NULL(test, callers);
+  vtfs_flight_init(&backend->table);
+  init_completion(&backend->release);
+
+  for (int i = 0; i <= FLIGHT_CALLERS; i++) {
+    callers[i].backend = backend;
+    callers[i].arg.key = "name";
+    callers[i].arg.value = i < FLIGHT_CALLERS ? "same" : "other";
+    callers[i].arg.len = strlen(callers[i].arg.value);
+    init_completion(&callers[i].done);
+    KUNIT_ASSERT_FALSE(
+        test, IS_ERR(kthread_run(flight_caller_main, &callers[i], "vtfs-flight-%d", i))
+    );
+  }
+
+  // Everyone joins before the backend answers
+  for (int waited = 0; waited < 2000; waited++) {
+    spin_lock(&backend->table.lock);
+    shared = backend->table.shared;
+    spin_unlock(&backend->table.lock);
+    if (shared == FLIGHT_CALLERS - 1 && atomic_read(&backend->calls) == 2) {
+      break;
+    }
+    msleep(1);
+  }
+  complete_all(&backend->release);
+  for (int i = 0; i <= FLIGHT_CALLERS; i++) {
+    wait_for_completion(&callers[i].done);
+    KUNIT_EXPECT_EQ(test, callers[i].result, 0);
+    KUNIT_EXPECT_EQ(test, callers[i].response[sizeof(callers[i].response) - 1], 'r');
+  }
+
+  KUNIT_EXPECT_EQ(test, shared, FLIGHT_CALLERS - 1);
+  KUNIT_EXPECT_EQ(test, atomic_read(&backend->calls), 2);
+  KUNIT_EXPECT_EQ(test, backend->table.calls, 2);
+  KUNIT_EXPECT_TRUE(test, hash_empty(backend->table.flights));
+}
+
+static struct kunit_case vtfs_flight_cases[] = {
+    KUNIT_CASE(vtfs_flight_coalesce_test),
+    {},
+};
+
+static struct kunit_suite vtfs_flight_suite = {
+    .name = "vtfs_flight",
+    .test_cases = vtfs_flight_cases,
+};
+
+// Background classes stop at their own limit and leave the rest of the
+// slots to synchronous calls queued behind them
+static void vtfs_iosched_limit_test(struct kunit* test) {
+  struct vtfs_sched_request* writes = kunit_kcalloc(test, 32, sizeof(*writes), GFP_KERNEL);
+  struct vtfs_sched_request lookup;
+  struct vtfs_sched_request* request;
+  struct vtfs_sched sched;
+  int dispatched = 0;
+
+  KUNIT_ASSERT_NOT_NULL(test, writes);
+  vtfs_sched_init(&sched, 32);
+  for (int i = 0; i < 32; i++) {
+    vtfs_sched_enqueue(&sched, &writes[i], VTFS_IO_WRITEBACK, 4);
+  }
+  while (vtfs_sched_dispatch(&sched)) {
+    dispatched++;
+  }
+  KUNIT_EXPECT_EQ(test, dispatched, 8);
+
+  vtfs_sched_enqueue(&sched, &lookup, VTFS_IO_SYNC_META, 1);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_sched_dispatch(&sched), &lookup);
+  KUNIT_EXPECT_NULL(test, vtfs_sched_dispatch(&sched));
+
+  // A finished write lets exactly one more through
+  vtfs_sched_complete(&sched, &writes[0]);
+  request = vtfs_sched_dispatch(&sched);
+  KUNIT_EXPECT_PTR_EQ(test, request, &writes[8]);
+  KUNIT_EXPECT_NULL(test, vtfs_sched_dispatch(&sched));
+
+  // A cancelled request is never handed out
+  vtfs_sched_cancel(&sched, &writes[9]);
+  vtfs_sched_complete(&sched, request);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_sched_dispatch(&sched), &writes[10]);
+  KUNIT_EXPECT_EQ(test, sched.classes[VTFS_IO_WRITEBACK].queued, 21U);
+}
+
+// Backlogged classes share the dispatches in proportion to weight / cost
+static void vtfs_iosched_weight_test(struct kunit* test) {
+  struct vtfs_sched_request* requests = kunit_kcalloc(test, 400, sizeof(*requests), GFP_KERNEL);
+  struct vtfs_sched_request* request;
+  struct vtfs_sched sched;
+  int count[VTFS_IO_CLASS_COUNT] = {};
+
+  KUNIT_ASSERT_NOT_NULL(test, requests);
+  vtfs_sched_init(&sched, 1);
+  for (int i = 0; i < 100; i++) {
+    vtfs_sched_enqueue(&sched, &requests[4 * i], VTFS_IO_SYNC_META, 1);
+    vtfs_sched_enqueue(&sched, &requests[4 * i + 1], VTFS_IO_SYNC_DATA, 1);
+    vtfs_sched_enqueue(&sched, &requests[4 * i + 2], VTFS_IO_READAHEAD, 1);
+    // Twice the weight of readahead at twice the cost
+    vtfs_sched_enqueue(&sched, &requests[4 * i + 3], VTFS_IO_WRITEBACK, 2);
+  }
+  // One slot: every call goes out alone, in the scheduler's order
+  for (int i = 0; i < 112; i++) {
+    request = vtfs_sched_dispatch(&sched);
+    KUNIT_ASSERT_NOT_NULL(test, request);
+    count[request->io_class]++;
+    vtfs_sched_complete(&sched, request);
+  }
+  // Weights 8:4:1:2, costs 1:1:1:2
+  KUNIT_EXPECT_EQ(test, count[VTFS_IO_SYNC_META], 64);
+  KUNIT_EXPECT_EQ(test, count[VTFS_IO_SYNC_DATA], 32);
+  KUNIT_EXPECT_EQ(test, count[VTFS_IO_READAHEAD], 8);
+  KUNIT_EXPECT_EQ(test, count[VTFS_IO_WRITEBACK], 8);
+}
+
+static struct kunit_case vtfs_iosched_cases[] = {
+    KUNIT_CASE(vtfs_iosched_limit_test),
+    KUNIT_CASE(vtfs_iosched_weight_test),
+    {},
+};
+
+static struct kunit_suite vtfs_iosched_suite = {
+    .name = "vtfs_iosched",
+    .test_cases = vtfs_iosched_cases,
+};
+
+static void vtfs_cache_format_test(struct kunit* test) {
+  struct vtfs_cache_header header = {.version = 1ULL << 40 | 7, .size = 5 * VTFS_CSUM_CHUNK + 3};
+  struct vtfs_cache_header back;
+  char* slot = kunit_kzalloc(test, VTFS_CACHE_SLOT, GFP_KERNEL);
+  char* data = kunit_kmalloc(test, VTFS_CSUM_CHUNK, GFP_KERNEL);
+  char buf[VTFS_CACHE_HEADER_SIZE];
+  char path[64];
+  const char* got;
+  u32 crc;
+
+  KUNIT_ASSERT_NOT_NULL(test, slot);
+  KUNIT_ASSERT_NOT_NULL(test, data);
+  // The token is one path component, whatever it contains
+  KUNIT_ASSERT_EQ(test, vtfs_cache_path(path, sizeof(path), "/var/cache", "a/b", 101), 0);
+  KUNIT_EXPECT_STREQ(test, path, "/var/cache/a_b.101");
+  KUNIT_EXPECT_EQ(test, vtfs_cache_path(path, 8, "/var/cache", "a", 101), -ENAMETOOLONG);
+
+  vtfs_cache_put_header(buf, &header);
+  KUNIT_ASSERT_EQ(test, vtfs_cache_get_header(buf, &back), 0);
+  KUNIT_EXPECT_EQ(test, back.version, header.version);
+  KUNIT_EXPECT_EQ(test, back.size, header.size);
+  buf[4] ^= 1;
+  KUNIT_EXPECT_EQ(test, vtfs_cache_get_header(buf, &back), -EINVAL);
+
+  // A hole reads back as a missing chunk, a torn one as corrupt
+  KUNIT_EXPECT_EQ(test, vtfs_cache_get_slot(slot, &got, &crc), -ENOENT);
+  memset(data, 'z', VTFS_CSUM_CHUNK);
+  KUNIT_EXPECT_EQ(
+      test,
+      vtfs_cache_put_slot(slot, data, 100, vtfs_crc32c(data, 100)),
+      VTFS_CACHE_SLOT_HEADER + 100
+  );
+  KUNIT_ASSERT_EQ(test, vtfs_cache_get_slot(slot, &got, &crc), 100);
+  KUNIT_EXPECT_EQ(test, memcmp(got, data, 100), 0);
+  KUNIT_EXPECT_EQ(test, crc, vtfs_crc32c(data, 100));
+  slot[VTFS_CACHE_SLOT_HEADER + 99] ^= 1;
+  KUNIT_EXPECT_EQ(test, vtfs_cache_get_slot(slot, &got, &crc), -EBADMSG);
+  KUNIT_EXPECT_EQ(test, vtfs_cache_slot_offset(0), VTFS_CACHE_SLOT);
+}
+
+static struct kunit_case vtfs_cache_cases[] = {
+    KUNIT_CASE(vtfs_cache_format_test),
+    {},
+};
+
+static struct kunit_suite vtfs_cache_suite = {
+    .name = "vtfs_cache",
+    .test_cases = vtfs_cache_cases,
+};
+
+static void vtfs_heat_counter_test(struct kunit* test) {
+  u32 seed = 1;
+  u32 cell = 0;
+
+  // The first steps up to VTFS_HEAT_INIT are certain, later ones ever rarer
+  for (int i = 0; i < VTFS_HEAT_INIT; i++) {
+    cell = vtfs_heat_touch(cell, 1000, &seed);
+  }
+  KUNIT_EXPECT_EQ(test, vtfs_heat_level(cell, 1000), VTFS_HEAT_INIT);
+  for (int i = 0; i < 10000; i++) {
+    cell = vtfs_heat_touch(cell, 1000, &seed);
+  }
+  KUNIT_EXPECT_GT(test, vtfs_heat_level(cell, 1000), VTFS_HEAT_INIT + 10);
+  KUNIT_EXPECT_LT(test, vtfs_heat_level(cell, 1000), VTFS_HEAT_INIT + 60);
+
+  // Idle time decays it a step per VTFS_HEAT_DECAY ticks, across a wrap too
+  KUNIT_EXPECT_EQ(
+      test,
+      vtfs_heat_level(cell, 1000 + 3 * VTFS_HEAT_DECAY),
+      vtfs_heat_level(cell, 1000) - 3
+  );
+  cell = vtfs_heat_touch(0, (1 << 24) - 1, &seed);
+  KUNIT_EXPECT_EQ(test, vtfs_heat_level(cell, (1 << 24) + VTFS_HEAT_DECAY - 1), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_heat_level(cell, 1 << 24), 1);
+}
+
+static void vtfs_heat_tier_test(struct kunit* test) {
+  struct vtfs_node* cold = vtfs_node_alloc(NULL, 1, S_IFREG | 0644);
+  struct vtfs_node* hot = vtfs_node_alloc(NULL, 2, S_IFREG | 0644);
+  struct vtfs_heat_table table;
+  size_t start;
+  size_t end;
+  char* dst;
+
+  KUNIT_ASSERT_NOT_NULL(test, cold);
+  KUNIT_ASSERT_NOT_NULL(test, hot);
+  vtfs_heat_init(&table, VTFS_CSUM_CHUNK);
+  cold->nlink = 1;
+  hot->nlink = 1;
+  KUNIT_ASSERT_EQ(test, vtfs_data_reserve(cold, 0, 5 * VTFS_CSUM_CHUNK, &dst), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_reserve(hot, 0, VTFS_CSUM_CHUNK, &dst), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_heat_resize(cold, 0), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_heat_resize(hot, 0), 0);
+  vtfs_heat_link(&table, cold);
+  vtfs_heat_link(&table, hot);
+  for (int i = 0; i < 100; i++) {
+    vtfs_heat_access(&table, hot, 0, 1, 0);
+  }
+  // Chunk 4 of the cold file was hot while the file as a whole was not
+  cold->heat->chunk[4] = vtfs_heat_touch(VTFS_HEAT_HOT, 0, &table.seed);
+  KUNIT_EXPECT_EQ(test, table.hits, 100);
+
+  KUNIT_ASSERT_PTR_EQ(test, vtfs_heat_victim(&table, 0), cold);
+  vtfs_heat_demoted(&table, cold->heat);
+  vtfs_data_demote(cold);
+  KUNIT_EXPECT_EQ(test, cold->size, 5 * VTFS_CSUM_CHUNK);
+  KUNIT_EXPECT_EQ(test, cold->heat->missing, 5);
+  // Demoted files are no longer candidates
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_heat_victim(&table, 0), hot);
+
+  // A read of chunk 1 brings back chunk 1 and the hot chunk 4, separately
+  KUNIT_EXPECT_EQ(test, vtfs_heat_access(&table, cold, VTFS_CSUM_CHUNK + 5, 10, 0), 1);
+  KUNIT_EXPECT_EQ(test, table.misses, 1);
+  KUNIT_ASSERT_EQ(test, vtfs_data_restore(cold), 0);
+  vtfs_heat_restored(&table, cold->heat);
+  KUNIT_ASSERT_TRUE(test, vtfs_heat_next_fetch(cold->heat, 0, 1, 2, 0, &start, &end));
+  KUNIT_EXPECT_EQ(test, start, 1);
+  KUNIT_EXPECT_EQ(test, end, 2);
+  vtfs_heat_fetched(&table, cold->heat, start, end);
+  KUNIT_ASSERT_TRUE(test, vtfs_heat_next_fetch(cold->heat, end, 1, 2, 0, &start, &end));
+  KUNIT_EXPECT_EQ(test, start, 4);
+  KUNIT_EXPECT_EQ(test, end, 5);
+  vtfs_heat_fetched(&table, cold->heat, start, end);
+  KUNIT_EXPECT_FALSE(test, vtfs_heat_next_fetch(cold->heat, end, 1, 2, 0, &start, &end));
+  KUNIT_EXPECT_EQ(test, cold->heat->missing, 3);
+  KUNIT_EXPECT_EQ(test, table.promotions, 2);
+
+  // Truncation drops the marks of the chunks it cuts off
+  KUNIT_ASSERT_EQ(test, vtfs_data_truncate(cold, 2 * VTFS_CSUM_CHUNK), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_heat_resize(cold, 0), 0);
+  KUNIT_EXPECT_EQ(test, cold->heat->missing, 1);
+
+  vtfs_heat_unlink(hot);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_heat_victim(&table, 0), cold);
+  vtfs_node_free(cold);
+  vtfs_node_free(hot);
+  KUNIT_EXPECT_TRUE(test, list_empty(&table.nodes));
+}
+
+static void vtfs_heat_hint_test(struct kunit* test) {
+  struct vtfs_node* pinned = vtfs_node_alloc(NULL, 1, S_IFREG | 0644);
+  struct vtfs_node* other = vtfs_node_alloc(NULL, 2, S_IFREG | 0644);
+  struct vtfs_heat_table table;
+  size_t start;
+  size_t end;
+  char* dst;
+
+  KUNIT_ASSERT_NOT_NULL(test, pinned);
+  KUNIT_ASSERT_NOT_NULL(test, other);
+  vtfs_heat_init(&table, VTFS_CSUM_CHUNK);
+  pinned->nlink = 1;
+  other->nlink = 1;
+  KUNIT_ASSERT_EQ(test, vtfs_data_reserve(pinned, 0, VTFS_CSUM_CHUNK, &dst), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_data_reserve(other, 0, 3 * VTFS_CSUM_CHUNK, &dst), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_heat_resize(pinned, 0), 0);
+  KUNIT_ASSERT_EQ(test, vtfs_heat_resize(other, 0), 0);
+  vtfs_heat_link(&table, pinned);
+  vtfs_heat_link(&table, other);
+  for (int i = 0; i < 100; i++) {
+    vtfs_heat_access(&table, other, 0, 3 * VTFS_CSUM_CHUNK, 0);
+  }
+
+  // The colder file is pinned, so the hot one is all there is to demote
+  vtfs_heat_pin(&table, pinned, true);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_heat_victim(&table, 0), other);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_heat_victim(&table, 0), other);
+  // A pinned file stays off the candidates whatever else happens to it
+  vtfs_heat_link(&table, pinned);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_heat_victim(&table, 0), other);
+  vtfs_heat_pin(&table, pinned, false);
+  KUNIT_EXPECT_PTR_EQ(test, vtfs_heat_victim(&table, 0), pinned);
+
+  // Cooled chunks are the first to go and come back with nothing but a
+  // fault of their own
+  vtfs_heat_cool(other->heat, VTFS_CSUM_CHUNK, 2 * VTFS_CSUM_CHUNK);
+  KUNIT_EXPECT_GE(test, vtfs_heat_level(other->heat->chunk[0], 0), VTFS_HEAT_HOT);
+  KUNIT_EXPECT_EQ(test, vtfs_heat_level(other->heat->chunk[1], 0), 0);
+  KUNIT_EXPECT_EQ(test, vtfs_heat_level(other->heat->chunk[2], 0), 0);
+  KUNIT_EXPECT_GT(test, vtfs_heat_level(other->heat->file, 0), 0);
+  vtfs_heat_demoted(&table, other->heat);
+  vtfs_data_demote(other);
+  KUNIT_ASSERT_TRUE(test, vtfs_heat_next_fetch(other->heat, 0, 0, 0, 0, &start, &end));
+  KUNIT_EXPECT_EQ(test, start, 0);
+  KUNIT_EXPECT_EQ(test, end, 1);
+  KUNIT_EXPECT_FALSE(test, vtfs_heat_next_fetch(other->heat, end, 0, 0, 0, &start, &end));
+  // All of the file cools the file as a whole too
+  vtfs_heat_cool(other->heat, 0, 3 * VTFS_CSUM_CHUNK);
+  KUNIT_EXPECT_EQ(test, vtfs_heat_level(other->heat->file, 0), 0);
+
+  vtfs_node_free(pinned);
+  vtfs_node_free(other);
+  KUNIT_EXPECT_TRUE(test, list_empty(&table.nodes));
+}
+
+static void vtfs_heat_readahead_test(struct kunit* test) {
+  struct file* file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+  size_t normal;
+
+  KUNIT_ASSERT_NOT_NULL(test, file);
+  spin_lock_init(&file->f_lock);
+
+  // Without a backing device to copy it from, the window is the tier's own
+  vtfs_tier_open(file);
+  normal = vtfs_tier_readahead(file);
+  KUNIT_EXPECT_GT(test, normal, 0);
+  vtfs_tier_advise(file, POSIX_FADV_SEQUENTIAL);
+  KUNIT_EXPECT_EQ(test, vtfs_tier_readahead(file), 2 * normal);
+  vtfs_tier_advise(file, POSIX_FADV_RANDOM);
+  KUNIT_EXPECT_EQ(test, vtfs_tier_readahead(file), 0);
+  vtfs_tier_advise(file, POSIX_FADV_NORMAL);
+  KUNIT_EXPECT_EQ(test, vtfs_tier_readahead(file), normal);
+  // Other advice does not touch the window
+  vtfs_tier_advise(file, POSIX_FADV_WILLNEED);
+  KUNIT_EXPECT_EQ(test, vtfs_tier_readahead(file), normal);
+}
+
+static struct kunit_case vtfs_heat_cases[] = {
+    KUNIT_CASE(vtfs_heat_counter_test),
+    KUNIT_CASE(vtfs_heat_tier_test),
+    KUNIT_CASE(vtfs_heat_hint_test),
+    KUNIT_CASE(vtfs_heat_readahead_test),
+    {},
+};
+
+static struct kunit_suite vtfs_heat_suite = {
+    .name = "vtfs_heat",
+    .test_cases = vtfs_heat_cases,
+};
+
+// Benchmarks: report ns/op through kunit_info, never fail on timing
+
+#define BENCH_ENTRIES 1024
+#define BENCH_ROUNDS 100000
+
+static void vtfs_bench_lookup(struct kunit* test) {
+  struct vtfs_node* dir = new_dir(test);
+  char name[16];
+  u64 start, elapsed;
+
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    snprintf(name, sizeof(name), "file-%d", i);
+    add_file(test, dir, name);
+  }
+
+  start = ktime_get_ns();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    snprintf(name, sizeof(name), "file-%d", (i * 7919) % BENCH_ENTRIES);
+    KUNIT_ASSERT_NOT_NULL(test, vtfs_dir_find(dir->dir, name));
+  }
+  elapsed = ktime_get_ns() - start;
+  kunit_info(test, "lookup in %d entries: %llu ns/op\n", BENCH_ENTRIES, elapsed / BENCH_ROUNDS);
+
+  free_dir(dir);
+}
+
+static void vtfs_bench_insert(struct kunit* test) {
+  struct vtfs_node* dir = new_dir(test);
+  char name[16];
+  u64 start, elapsed;
+
+  start = ktime_get_ns();
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    snprintf(name, sizeof(name), "file-%d", i);
+    // create() checks for an existing name first
+    KUNIT_ASSERT_NULL(test, vtfs_dir_find(dir->dir, name));
+    add_file(test, dir, name);
+  }
+  elapsed = ktime_get_ns() - start;
+  kunit_info(test, "insert %d entries: %llu ns/op\n", BENCH_ENTRIES, elapsed / BENCH_ENTRIES);
+
+  free_dir(dir);
+}
+
+static void vtfs_bench_iterate(struct kunit* test) {
+  struct vtfs_node* dir = new_dir(test);
+  struct vtfs_file* entry;
+  char name[16];
+  size_t total = 0;
+  u64 start, elapsed;
+
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    snprintf(name, sizeof(name), "file-%d", i);
+    add_file(test, dir, name);
+  }
+
+  start = ktime_get_ns();
+  for (int i = 0; i < 1000; i++) {
+    list_for_each_entry(entry, &dir->dir->children, list) {
+      total += entry->node->ino;
+    }
+  }
+  elapsed = ktime_get_ns() - start;
+  kunit_info(test, "iterate: %llu ns/entry (%zu)\n", elapsed / (1000 * BENCH_ENTRIES), total);
+
+  free_dir(dir);
+}
+
+static void vtfs_bench_write_read(struct kunit* test) {
+  const size_t chunk = 4096;
+  const size_t total = 1 << 20;
+  struct vtfs_node* node = vtfs_node_alloc(NULL, 1, S_IFREG | 0644);
+  char __user* ubuf = user_buffer(test, chunk);
+  u64 start, elapsed;
+  loff_t pos = 0;
+
+  KUNIT_ASSERT_NOT_NULL(test, node);
+
+  start = ktime_get_ns();
+  while (pos < total) {
+    KUNIT_ASSERT_EQ(test, vtfs_data_write(node, ubuf, chunk, &pos), chunk);
+  }
+  elapsed = ktime_get_ns() - start;
+  kunit_info(test, "append 1 MiB in 4 KiB writes: %llu MB/s\n", total * 1000 / max(elapsed, 1ULL));
+
+  pos = 0;
+  start = ktime_get_ns();
+  while (vtfs_data_read(node, ubuf, chunk, &pos) > 0) {
+  }
+  elapsed = ktime_get_ns() - start;
+  kunit_info(test, "read 1 MiB in 4 KiB reads: %llu MB/s\n", total * 1000 / max(elapsed, 1ULL));
+
+  vtfs_node_free(node);
+}
+
+static void vtfs_bench_parse_response(struct kunit* test) {
+  char* payload = kunit_kzalloc(test, 4097, GFP_KERNEL);
+  char* out = kunit_kmalloc(test, 4096, GFP_KERNEL);
+  char* scratch;
+  char* raw;
+  size_t size;
+  u64 start, elapsed;
+
+  KUNIT_ASSERT_NOT_NULL(test, payload);
+  KUNIT_ASSERT_NOT_NULL(test, out);
+  memset(payload, 'y', 4096);
+  raw = build_response(test, OK_HEADER, 0, payload, &size);
+  scratch = kunit_kmalloc(test, size, GFP_KERNEL);
+  KUNIT_ASSERT_NOT_NULL(test, scratch);
+
+  start = ktime_get_ns();
+  for (int i = 0; i < 10000; i++) {
+    memcpy(scratch, raw, size);
+    KUNIT_ASSERT_EQ(test, parse_http_response(scratch, size, out, 4096), 0);
+  }
+  elapsed = ktime_get_ns() - start;
+  kunit_info(test, "parse 4 KiB response: %llu ns/op\n", elapsed / 10000);
+}
+
+static struct kunit_case vtfs_bench_cases[] = {
+    KUNIT_CASE_SLOW(vtfs_bench_lookup),
+    KUNIT_CASE_SLOW(vtfs_bench_insert),
+    KUNIT_CASE_SLOW(vtfs_bench_iterate),
+    KUNIT_CASE_SLOW(vtfs_bench_write_read),
+    KUNIT_CASE_SLOW(vtfs_bench_parse_response),
+    {},
+};
+
+static struct kunit_suite vtfs_bench_suite = {
+    .name = "vtfs_bench",
+    .test_cases = vtfs_bench_cases,
+};
+
+kunit_test_suites(
+    &vtfs_index_suite,
+    &vtfs_data_suite,
+    &vtfs_link_suite,
+    &vtfs_mem_suite,
+    &vtfs_xattr_suite,
+    &vtfs_delta_suite,
+    &vtfs_http_suite,
+    &vtfs_rpc_suite,
+    &vtfs_flight_suite,
+    &vtfs_iosched_suite,
+    &vtfs_cache_suite,
+    &vtfs_heat_suite,
+    &vtfs_bench_suite
+);
@@ -0,0 +1,84 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM vtfs
+
+#if !defined(VTFS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define VTFS_TRACE_H
+
+#include <linux/ktime.h>
+#include <linux/tracepoint.h>
+
+#include "capture.h"
+
+#define vtfs_op_names                \
+  {VTFS_OP_LOOKUP, "lookup"},        \
+      {VTFS_OP_CREATE, "create"},    \
+      {VTFS_OP_MKDIR, "mkdir"},      \
+      {VTFS_OP_UNLINK, "unlink"},    \
+      {VTFS_OP_RMDIR, "rmdir"},      \
+      {VTFS_OP_LINK, "link"},        \
+      {VTFS_OP_ITERATE, "iterate"},  \
+      {VTFS_OP_READ, "read"},        \
+      {VTFS_OP_WRITE, "write"},      \
+      {VTFS_OP_SYMLINK, "symlink"}
+
+// One event per VFS op, emitted when the op returns. start_ns comes from
+// vtfs_trace_start() so the duration is only measured while someone listens.
+TRACE_EVENT(
+    vtfs_op,
+
+    TP_PROTO(
+        u16 op,
+        u64 ino,
+        u64 parent,
+        const char* name,
+        loff_t offset,
+        u64 len,
+        s64 ret,
+        u64 start_ns
+    ),
+
+    TP_ARGS(op, ino, parent, name, offset, len, ret, start_ns),
+
+    TP_STRUCT__entry(
+        __field(u16, op)
+        __field(u64, ino)
+        __field(u64, parent)
+        __string(name, name ? name : "")
+        __field(loff_t, offset)
+        __field(u64, len)
+        __field(s64, ret)
+        __field(u64, dur_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->op = op;
+        __entry->ino = ino;
+        __entry->parent = parent;
+        __assign_str(name, name ? name : "");
+        __entry->offset = offset;
+        __entry->len = len;
+        __entry->ret = ret;
+        __entry->dur_ns = start_ns ? ktime_get_ns() - start_ns : 0;
+    ),
+
+    TP_printk(
+        "%s ino=%llu parent=%llu name=%s offset=%lld len=%llu ret=%lld dur_ns=%llu",
+        __print_symbolic(__entry->op, vtfs_op_names),
+        __entry->ino,
+        __entry->parent,
+        __get_str(name),
+        __entry->offset,
+        __entry->len,
+        __entry->ret,
+        __entry->dur_ns
+    )
+);
+
+#endif  // VTFS_TRACE_H
+
+// Out-of-tree trace header: found through -I$(src)/source in Kbuild
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE vtfs_trace
+#include <trace/define_trace.h>
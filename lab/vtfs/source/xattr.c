@@ -0,0 +1,352 @@
+#include "xattr.h"
+
+#define VTFS_XATTR_NAME_MAX 255
+
+static u32 vtfs_xattr_hash(const void* value, size_t size) {
+  const unsigned char* p = value;
+  u32 hash = 2166136261u;
+  size_t i;
+
+  // FNV-1a: values are short and compared with memcmp on a hit anyway
+  for (i = 0; i < size; i++) {
+    hash = (hash ^ p[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Takes a reference on the blob holding value, creating it if needed
+static struct vtfs_xattr_blob* vtfs_xattr_blob_get(
+    struct vtfs_xattr_table* table, const void* value, size_t size
+) {
+  u32 hash = vtfs_xattr_hash(value, size);
+  struct vtfs_xattr_blob** bucket = &table->buckets[hash % VTFS_XATTR_BUCKETS];
+  struct vtfs_xattr_blob* blob;
+
+  for (blob = *bucket; blob; blob = blob->next) {
+    if (blob->hash == hash && blob->size == size && memcmp(blob->value, value, size) == 0) {
+      blob->refs++;
+      return blob;
+    }
+  }
+
+  blob = vtfs_mem_kmalloc(table->mem, sizeof(struct vtfs_xattr_blob) + size, GFP_KERNEL);
+  if (!blob) {
+    return NULL;
+  }
+  blob->refs = 1;
+  blob->hash = hash;
+  blob->size = size;
+  memcpy(blob->value, value, size);
+  blob->next = *bucket;
+  *bucket = blob;
+  vtfs_mem_charge(table->mem, VTFS_MEM_XATTRS, sizeof(struct vtfs_xattr_blob) + size, 1);
+  return blob;
+}
+
+static void vtfs_xattr_blob_put(struct vtfs_xattr_table* table, struct vtfs_xattr_blob* blob) {
+  struct vtfs_xattr_blob** link = &table->buckets[blob->hash % VTFS_XATTR_BUCKETS];
+
+  if (--blob->refs) {
+    return;
+  }
+  while (*link != blob) {
+    link = &(*link)->next;
+  }
+  *link = blob->next;
+  vtfs_mem_charge(table->mem, VTFS_MEM_XATTRS, sizeof(struct vtfs_xattr_blob) + blob->size, -1);
+  vtfs_mem_kfree(table->mem, blob, sizeof(struct vtfs_xattr_blob) + blob->size);
+}
+
+void vtfs_xattr_table_init(struct vtfs_xattr_table* table, struct vtfs_mem* mem) {
+  memset(table, 0, sizeof(*table));
+  mutex_init(&table->lock);
+  table->mem = mem;
+}
+
+void vtfs_xattr_table_destroy(struct vtfs_xattr_table* table) {
+  int i;
+
+  // Every node was freed before, and with it every reference
+  for (i = 0; i < VTFS_XATTR_BUCKETS; i++) {
+    WARN_ON(table->buckets[i]);
+  }
+  mutex_destroy(&table->lock);
+}
+
+static struct vtfs_xattr_entry vtfs_xattr_entry_at(const struct vtfs_xattrs* xattrs, u32 off) {
+  struct vtfs_xattr_entry entry;
+  memcpy(&entry, xattrs->entries + off, sizeof(entry));
+  return entry;
+}
+
+static u32 vtfs_xattr_entry_len(const struct vtfs_xattr_entry* entry) {
+  return sizeof(*entry) + entry->name_len +
+         (entry->shared ? sizeof(struct vtfs_xattr_blob*) : entry->value_len);
+}
+
+static const char* vtfs_xattr_entry_name(const struct vtfs_xattrs* xattrs, u32 off) {
+  return xattrs->entries + off + sizeof(struct vtfs_xattr_entry);
+}
+
+static struct vtfs_xattr_blob* vtfs_xattr_entry_blob(
+    const struct vtfs_xattrs* xattrs, u32 off, const struct vtfs_xattr_entry* entry
+) {
+  struct vtfs_xattr_blob* blob;
+  memcpy(&blob, vtfs_xattr_entry_name(xattrs, off) + entry->name_len, sizeof(blob));
+  return blob;
+}
+
+// Offset of the record called name, or -1
+static long vtfs_xattr_find(const struct vtfs_xattrs* xattrs, const char* name) {
+  size_t name_len = strlen(name);
+  u32 off = 0;
+
+  while (xattrs && off < xattrs->used) {
+    struct vtfs_xattr_entry entry = vtfs_xattr_entry_at(xattrs, off);
+    if (entry.name_len == name_len &&
+        memcmp(vtfs_xattr_entry_name(xattrs, off), name, name_len) == 0) {
+      return off;
+    }
+    off += vtfs_xattr_entry_len(&entry);
+  }
+  return -1;
+}
+
+ssize_t vtfs_xattr_get(
+    struct vtfs_xattr_table* table,
+    struct vtfs_node* node,
+    const char* name,
+    void* buf,
+    size_t size
+) {
+  struct vtfs_xattrs* xattrs;
+  struct vtfs_xattr_entry entry;
+  const char* value;
+  size_t value_len;
+  ssize_t ret;
+  long off;
+
+  mutex_lock(&table->lock);
+  xattrs = node->xattrs;
+  off = vtfs_xattr_find(xattrs, name);
+  if (off < 0) {
+    ret = -ENODATA;
+    goto out;
+  }
+
+  entry = vtfs_xattr_entry_at(xattrs, off);
+  if (entry.shared) {
+    struct vtfs_xattr_blob* blob = vtfs_xattr_entry_blob(xattrs, off, &entry);
+    value = blob->value;
+    value_len = blob->size;
+  } else {
+    value = vtfs_xattr_entry_name(xattrs, off) + entry.name_len;
+    value_len = entry.value_len;
+  }
+
+  ret = value_len;
+  if (size && value_len > size) {
+    ret = -ERANGE;
+  } else if (size) {
+    memcpy(buf, value, value_len);
+  }
+out:
+  mutex_unlock(&table->lock);
+  return ret;
+}
+
+// Removes the record at off, dropping its blob reference
+static void vtfs_xattr_remove_at(
+    struct vtfs_xattr_table* table, struct vtfs_xattrs* xattrs, u32 off
+) {
+  struct vtfs_xattr_entry entry = vtfs_xattr_entry_at(xattrs, off);
+  u32 len = vtfs_xattr_entry_len(&entry);
+
+  if (entry.shared) {
+    vtfs_xattr_blob_put(table, vtfs_xattr_entry_blob(xattrs, off, &entry));
+  }
+  memmove(xattrs->entries + off, xattrs->entries + off + len, xattrs->used - off - len);
+  xattrs->used -= len;
+}
+
+static void vtfs_xattrs_release(struct vtfs_node* node) {
+  struct vtfs_xattrs* xattrs = node->xattrs;
+
+  vtfs_mem_charge(
+      node->mem, VTFS_MEM_XATTRS, sizeof(struct vtfs_xattrs) + xattrs->size, -1
+  );
+  vtfs_mem_kfree(node->mem, xattrs, sizeof(struct vtfs_xattrs) + xattrs->size);
+  node->xattrs = NULL;
+}
+
+// Makes room for extra more bytes of records, growing to the full size class
+static int vtfs_xattrs_reserve(
+    struct vtfs_xattr_table* table, struct vtfs_node* node, u32 extra
+) {
+  struct vtfs_xattrs* xattrs = node->xattrs;
+  u32 used = xattrs ? xattrs->used : 0;
+  u32 size = xattrs ? xattrs->size : 0;
+  size_t bytes;
+
+  if (used + extra <= size) {
+    return 0;
+  }
+
+  bytes = kmalloc_size_roundup(sizeof(struct vtfs_xattrs) + used + extra);
+  xattrs = vtfs_mem_krealloc(
+      node->mem, xattrs, xattrs ? sizeof(struct vtfs_xattrs) + size : 0, bytes, GFP_KERNEL
+  );
+  if (!xattrs) {
+    return -ENOMEM;
+  }
+  if (!node->xattrs) {
+    xattrs->table = table;
+    xattrs->used = 0;
+  } else {
+    vtfs_mem_charge(node->mem, VTFS_MEM_XATTRS, sizeof(struct vtfs_xattrs) + size, -1);
+  }
+  xattrs->size = bytes - sizeof(struct vtfs_xattrs);
+  vtfs_mem_charge(node->mem, VTFS_MEM_XATTRS, bytes, 1);
+  node->xattrs = xattrs;
+  return 0;
+}
+
+static int vtfs_xattr_set_locked(
+    struct vtfs_xattr_table* table,
+    struct vtfs_node* node,
+    const char* name,
+    const void* value,
+    size_t size,
+    int flags
+) {
+  struct vtfs_xattr_blob* blob = NULL;
+  struct vtfs_xattr_entry entry;
+  struct vtfs_xattrs* xattrs;
+  size_t name_len = strlen(name);
+  long off = vtfs_xattr_find(node->xattrs, name);
+  char* dst;
+  int err;
+
+  if (name_len == 0 || name_len > VTFS_XATTR_NAME_MAX) {
+    return -ERANGE;
+  }
+  if (off >= 0 && (flags & XATTR_CREATE)) {
+    return -EEXIST;
+  }
+  if (off < 0 && (flags & XATTR_REPLACE)) {
+    return -ENODATA;
+  }
+
+  if (!value) {
+    if (off < 0) {
+      return -ENODATA;
+    }
+    vtfs_xattr_remove_at(table, node->xattrs, off);
+    if (node->xattrs->used == 0) {
+      vtfs_xattrs_release(node);
+    }
+    return 0;
+  }
+
+  entry.name_len = name_len;
+  entry.shared = size > VTFS_XATTR_INLINE_MAX;
+  entry.value_len = entry.shared ? 0 : size;
+
+  // Everything that can fail happens before the old value is dropped
+  if (entry.shared) {
+    blob = vtfs_xattr_blob_get(table, value, size);
+    if (!blob) {
+      return -ENOMEM;
+    }
+  }
+  err = vtfs_xattrs_reserve(table, node, vtfs_xattr_entry_len(&entry));
+  if (err) {
+    if (blob) {
+      vtfs_xattr_blob_put(table, blob);
+    }
+    return err;
+  }
+
+  xattrs = node->xattrs;
+  if (off >= 0) {
+    vtfs_xattr_remove_at(table, xattrs, off);
+  }
+  dst = xattrs->entries + xattrs->used;
+  memcpy(dst, &entry, sizeof(entry));
+  memcpy(dst + sizeof(entry), name, name_len);
+  if (blob) {
+    memcpy(dst + sizeof(entry) + name_len, &blob, sizeof(blob));
+  } else {
+    memcpy(dst + sizeof(entry) + name_len, value, size);
+  }
+  xattrs->used += vtfs_xattr_entry_len(&entry);
+  return 0;
+}
+
+int vtfs_xattr_set(
+    struct vtfs_xattr_table* table,
+    struct vtfs_node* node,
+    const char* name,
+    const void* value,
+    size_t size,
+    int flags
+) {
+  int err;
+
+  mutex_lock(&table->lock);
+  err = vtfs_xattr_set_locked(table, node, name, value, size, flags);
+  mutex_unlock(&table->lock);
+  return err;
+}
+
+ssize_t vtfs_xattr_list(
+    struct vtfs_xattr_table* table,
+    struct vtfs_node* node,
+    bool (*visible)(const char* name),
+    char* buf,
+    size_t size
+) {
+  struct vtfs_xattrs* xattrs;
+  char name[VTFS_XATTR_NAME_MAX + 1];
+  ssize_t len = 0;
+  u32 off = 0;
+
+  mutex_lock(&table->lock);
+  xattrs = node->xattrs;
+  while (xattrs && off < xattrs->used) {
+    struct vtfs_xattr_entry entry = vtfs_xattr_entry_at(xattrs, off);
+
+    memcpy(name, vtfs_xattr_entry_name(xattrs, off), entry.name_len);
+    name[entry.name_len] = '\0';
+    off += vtfs_xattr_entry_len(&entry);
+    if (visible && !visible(name)) {
+      continue;
+    }
+    if (size && len + entry.name_len + 1 > size) {
+      len = -ERANGE;
+      break;
+    }
+    if (size) {
+      memcpy(buf + len, name, entry.name_len + 1);
+    }
+    len += entry.name_len + 1;
+  }
+  mutex_unlock(&table->lock);
+  return len;
+}
+
+void vtfs_xattrs_free(struct vtfs_node* node) {
+  struct vtfs_xattrs* xattrs = node->xattrs;
+  struct vtfs_xattr_table* table;
+
+  if (!xattrs) {
+    return;
+  }
+  table = xattrs->table;
+  mutex_lock(&table->lock);
+  while (xattrs->used) {
+    vtfs_xattr_remove_at(table, xattrs, 0);
+  }
+  vtfs_xattrs_release(node);
+  mutex_unlock(&table->lock);
+}
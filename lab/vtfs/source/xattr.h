@@ -0,0 +1,81 @@
+#ifndef VTFS_XATTR_H
+#define VTFS_XATTR_H
+
+#include "index.h"
+#include "mem.h"
+#include "shim.h"
+
+// Extended attributes. A node with no xattrs costs one NULL pointer. The
+// first set allocates a single packed area that holds every attribute of the
+// node: name and value back to back for values up to VTFS_XATTR_INLINE_MAX,
+// name and a blob reference for larger ones. Blobs are refcounted and shared
+// by every attribute of the mount with the same value, so the ACL or security
+// label copied onto each file of a tree is stored once.
+#define VTFS_XATTR_INLINE_MAX 64
+#define VTFS_XATTR_BUCKETS 64
+
+struct vtfs_xattr_blob {
+  struct vtfs_xattr_blob* next;  // hash chain
+  unsigned int refs;
+  u32 hash;
+  size_t size;
+  char value[];
+};
+
+// Per-mount blob table. Its lock also serialises every xattr of the mount,
+// which keeps readers off a packed area while a set reallocates it.
+struct vtfs_xattr_table {
+  struct mutex lock;
+  struct vtfs_mem* mem;
+  struct vtfs_xattr_blob* buckets[VTFS_XATTR_BUCKETS];
+};
+
+struct vtfs_xattrs {
+  struct vtfs_xattr_table* table;
+  u32 used;
+  u32 size;
+  char entries[];  // packed vtfs_xattr_entry records
+};
+
+// Record header, followed by name_len bytes of name (no terminator) and then
+// value_len bytes of value, or a struct vtfs_xattr_blob* if shared. Records
+// are packed without padding and accessed through memcpy.
+struct vtfs_xattr_entry {
+  u8 name_len;
+  u8 shared;
+  u16 value_len;
+};
+
+void vtfs_xattr_table_init(struct vtfs_xattr_table* table, struct vtfs_mem* mem);
+void vtfs_xattr_table_destroy(struct vtfs_xattr_table* table);
+
+// Full names, prefix included. Same conventions as getxattr(2): size 0 asks
+// for the value size, -ERANGE if buf is too small, -ENODATA if missing.
+ssize_t vtfs_xattr_get(
+    struct vtfs_xattr_table* table,
+    struct vtfs_node* node,
+    const char* name,
+    void* buf,
+    size_t size
+);
+// A NULL value removes the attribute. flags are XATTR_CREATE / XATTR_REPLACE.
+int vtfs_xattr_set(
+    struct vtfs_xattr_table* table,
+    struct vtfs_node* node,
+    const char* name,
+    const void* value,
+    size_t size,
+    int flags
+);
+// NUL separated names for which visible() returns true (all if NULL)
+ssize_t vtfs_xattr_list(
+    struct vtfs_xattr_table* table,
+    struct vtfs_node* node,
+    bool (*visible)(const char* name),
+    char* buf,
+    size_t size
+);
+// Drops the packed area and its blob references; called when the node is freed
+void vtfs_xattrs_free(struct vtfs_node* node);
+
+#endif  // VTFS_XATTR_H
@@ -0,0 +1,104 @@
+#include "lat.h"
+
+#include <string.h>
+#include <time.h>
+
+static int lat_bucket(uint64_t ns) {
+  if (ns < LAT_SUB_COUNT) {
+    return (int)ns;
+  }
+  int msb = 63 - __builtin_clzll(ns);
+  int shift = msb - LAT_SUB_BITS;
+  int sub = (int)((ns >> shift) & (LAT_SUB_COUNT - 1));
+  return (shift + 1) * LAT_SUB_COUNT + sub;
+}
+
+// Upper bound of the values that land in bucket b
+static uint64_t lat_bucket_value(int b) {
+  if (b < LAT_SUB_COUNT) {
+    return (uint64_t)b;
+  }
+  int shift = b / LAT_SUB_COUNT - 1;
+  uint64_t sub = (uint64_t)(b % LAT_SUB_COUNT) | LAT_SUB_COUNT;
+  return ((sub + 1) << shift) - 1;
+}
+
+void lat_init(struct lat_hist* h) {
+  memset(h, 0, sizeof(*h));
+}
+
+void lat_record(struct lat_hist* h, uint64_t ns) {
+  h->buckets[lat_bucket(ns)]++;
+  h->count++;
+  h->sum_ns += ns;
+  if (ns > h->max_ns) {
+    h->max_ns = ns;
+  }
+}
+
+void lat_merge(struct lat_hist* dst, const struct lat_hist* src) {
+  for (int i = 0; i < LAT_BUCKETS; i++) {
+    dst->buckets[i] += src->buckets[i];
+  }
+  dst->count += src->count;
+  dst->sum_ns += src->sum_ns;
+  if (src->max_ns > dst->max_ns) {
+    dst->max_ns = src->max_ns;
+  }
+}
+
+uint64_t lat_percentile(const struct lat_hist* h, double p) {
+  if (h->count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p / 100.0 * (double)h->count);
+  if (rank >= h->count) {
+    rank = h->count - 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < LAT_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen > rank) {
+      uint64_t v = lat_bucket_value(i);
+      return v < h->max_ns ? v : h->max_ns;
+    }
+  }
+  return h->max_ns;
+}
+
+void lat_print_header(FILE* out) {
+  fprintf(
+      out,
+      "%-16s %10s %10s %10s %10s %10s %10s %10s\n",
+      "op",
+      "count",
+      "avg(us)",
+      "p50",
+      "p90",
+      "p99",
+      "p99.9",
+      "max"
+  );
+}
+
+void lat_print(FILE* out, const char* label, const struct lat_hist* h) {
+  double avg = h->count ? (double)h->sum_ns / (double)h->count / 1000.0 : 0.0;
+  fprintf(
+      out,
+      "%-16s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+      label,
+      (unsigned long long)h->count,
+      avg,
+      (double)lat_percentile(h, 50) / 1000.0,
+      (double)lat_percentile(h, 90) / 1000.0,
+      (double)lat_percentile(h, 99) / 1000.0,
+      (double)lat_percentile(h, 99.9) / 1000.0,
+      (double)h->max_ns / 1000.0
+  );
+}
+
+uint64_t lat_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,32 @@
+#ifndef VTFS_TOOLS_LAT_H
+#define VTFS_TOOLS_LAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear latency histogram: 16 sub-buckets per power of two, so every
+// recorded value is kept with at most ~6% relative error. Cheap enough to
+// record on every request without allocating.
+#define LAT_SUB_BITS 4
+#define LAT_SUB_COUNT (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS (64 * LAT_SUB_COUNT)
+
+struct lat_hist {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t buckets[LAT_BUCKETS];
+};
+
+void lat_init(struct lat_hist* h);
+void lat_record(struct lat_hist* h, uint64_t ns);
+void lat_merge(struct lat_hist* dst, const struct lat_hist* src);
+uint64_t lat_percentile(const struct lat_hist* h, double p);
+
+// Prints "<label> count avg p50 p90 p99 p99.9 max" in microseconds
+void lat_print(FILE* out, const char* label, const struct lat_hist* h);
+void lat_print_header(FILE* out);
+
+uint64_t lat_now_ns(void);
+
+#endif  // VTFS_TOOLS_LAT_H
@@ -0,0 +1,674 @@
+// Load generator for the vtfs backend.
+//
+// Replays kernel-client shaped traffic: every request is a
+// "GET /api/<method>?token=...&k=v" line exactly like fill_request() in
+// source/http.c builds it, and the response is expected in the kernel wire
+// format (200 status, Content-Length, 8-byte int64_t result, payload).
+//
+// With -r the same operations go out as binary RPC frames (source/rpc_proto.h)
+// instead, all workers sharing one multiplexed connection the way the kernel
+// client's rpc= transport does, so the two paths can be compared in ops/s.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../source/rpc_proto.h"
+#include "lat.h"
+
+#define MAX_OPS 8
+#define MAX_DEPTH 64
+#define RESPONSE_CAP (1 << 20)
+
+enum op_kind { OP_LOOKUP, OP_LIST, OP_READ, OP_CREATE, OP_WRITE, OP_KINDS };
+
+static const char* op_names[OP_KINDS] = {"lookup", "list", "read", "create", "write"};
+
+struct workload {
+  const char* name;
+  int weights[OP_KINDS];
+};
+
+static const struct workload workloads[] = {
+    {"lookup", {85, 10, 5, 0, 0}},
+    {"create", {0, 0, 0, 100, 0}},
+    {"write", {0, 0, 0, 0, 100}},
+    {"mixed", {60, 10, 10, 10, 10}},
+};
+
+struct config {
+  const char* host;
+  int port;
+  const char* token;
+  int concurrency;
+  double duration;
+  long requests;
+  const struct workload* workload;
+  bool keep_alive;
+  int depth;  // requests pipelined per keep-alive connection
+  bool rpc;
+  size_t write_size;
+  int files;
+};
+
+struct worker;
+
+// The connection shared by all workers in RPC mode. Every worker has at
+// most one call in flight, tagged with its id, and a receiver thread hands
+// each response to its worker in whatever order they come back.
+struct rpc_client {
+  int sock;
+  pthread_t receiver;
+  pthread_mutex_t send_lock;
+  pthread_mutex_t lock;  // the workers' rpc_* fields and broken
+  pthread_cond_t done;
+  struct worker* workers;
+  int nworkers;
+  bool broken;
+};
+
+struct worker {
+  pthread_t thread;
+  int id;
+  const struct config* cfg;
+  uint64_t rng;
+  int sock;
+  size_t buffered;  // bytes of the next pipelined response already read
+  long seq;
+  uint64_t sent_bytes;
+  uint64_t recv_bytes;
+  uint64_t errors;
+  struct lat_hist hist[OP_KINDS];
+  // RPC mode
+  struct rpc_client* rpc;
+  char* response;
+  bool rpc_waiting;
+  ssize_t rpc_got;
+};
+
+static volatile bool stop;
+static long requests_left;
+static pthread_mutex_t requests_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t rng_next(uint64_t* s) {
+  uint64_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *s = x;
+}
+
+// Same escaping as encode() in source/http.c
+static char* url_encode(char* dst, const char* src, size_t len) {
+  static const char hex[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)src[i];
+    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+      *dst++ = (char)c;
+    } else {
+      *dst++ = '%';
+      *dst++ = hex[c >> 4];
+      *dst++ = hex[c & 15];
+    }
+  }
+  *dst = '\0';
+  return dst;
+}
+
+static int connect_backend(const struct config* cfg) {
+  int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (sock < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(cfg->port)};
+  inet_pton(AF_INET, cfg->host, &addr.sin_addr);
+  if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+static size_t build_request(struct worker* w, enum op_kind op, char* buf, const char* payload) {
+  const struct config* cfg = w->cfg;
+  char* p = buf;
+  p += sprintf(p, "GET /api/%s?token=%s", op_names[op], cfg->token);
+
+  uint64_t r = rng_next(&w->rng);
+  unsigned long ino = 101 + r % (unsigned long)cfg->files;
+  switch (op) {
+    case OP_LOOKUP:
+      p += sprintf(p, "&parent=100&name=f%lu", ino - 101);
+      break;
+    case OP_LIST:
+      p += sprintf(p, "&inode=100");
+      break;
+    case OP_READ:
+      p += sprintf(p, "&inode=%lu&offset=0&length=%zu", ino, cfg->write_size);
+      break;
+    case OP_CREATE:
+      p += sprintf(p, "&parent=100&name=c%d%%2D%ld&type=file", w->id, w->seq++);
+      break;
+    case OP_WRITE: {
+      size_t offset = (r >> 32) % 16 * cfg->write_size;
+      p += sprintf(p, "&inode=%lu&offset=%zu&content=", ino, offset);
+      p = url_encode(p, payload, cfg->write_size);
+      break;
+    }
+    case OP_KINDS:
+      break;
+  }
+
+  p += sprintf(
+      p,
+      " HTTP/1.1\r\nHost:%s\r\nConnection: %s\r\n\r\n",
+      cfg->host,
+      cfg->keep_alive ? "keep-alive" : "close"
+  );
+  return (size_t)(p - buf);
+}
+
+static int send_all(int sock, const char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(sock, buf, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return -1;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+// Reads one response. In keep-alive mode it stops at Content-Length so the
+// connection can be reused, keeping whatever of the next pipelined response
+// came with it; in close mode it drains to EOF like receive_all().
+static ssize_t read_response(struct worker* w, char* buf, size_t cap) {
+  size_t have = w->buffered;
+  ssize_t body_end = -1;
+
+  w->buffered = 0;
+  for (;;) {
+    buf[have] = '\0';
+    if (body_end < 0) {
+      char* end = strstr(buf, "\r\n\r\n");
+      char* cl = strstr(buf, "Content-Length: ");
+      if (end != NULL && cl != NULL && cl < end) {
+        body_end = (end + 4 - buf) + atol(cl + 16);
+      }
+    }
+    if (w->cfg->keep_alive && body_end >= 0 && (ssize_t)have >= body_end) {
+      break;
+    }
+    if (have + 1 >= cap) {
+      break;
+    }
+    ssize_t n = recv(w->sock, buf + have, cap - have - 1, 0);
+    if (n < 0) {
+      return -1;
+    }
+    if (n == 0) {
+      break;
+    }
+    have += (size_t)n;
+  }
+
+  if (body_end < 0 || (ssize_t)have < body_end) {
+    return -1;
+  }
+  if (strncmp(buf, "HTTP/1.1 200", 12) != 0 && strncmp(buf, "HTTP/1.0 200", 12) != 0) {
+    return -1;
+  }
+  if (w->cfg->keep_alive) {
+    w->buffered = have - (size_t)body_end;
+    memmove(buf, buf + body_end, w->buffered);
+    return body_end;
+  }
+  return (ssize_t)have;
+}
+
+static int recv_all(int sock, void* buf, size_t len) {
+  for (char* p = buf; len > 0;) {
+    ssize_t n = recv(sock, p, len, 0);
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+// Same operations and parameters as build_request(), as an RPC frame
+static size_t build_rpc_request(struct worker* w, enum op_kind op, char* buf, const char* payload) {
+  const struct config* cfg = w->cfg;
+  char ino[24];
+  char name[48];
+  char offset[24];
+  char length[24];
+  struct vtfs_arg args[4];
+  size_t nargs = 0;
+
+#define ARG(k, v, n) (args[nargs++] = (struct vtfs_arg){.key = (k), .value = (v), .len = (n)})
+  uint64_t r = rng_next(&w->rng);
+  unsigned long file = 101 + r % (unsigned long)cfg->files;
+  snprintf(ino, sizeof(ino), "%lu", file);
+  switch (op) {
+    case OP_LOOKUP:
+      snprintf(name, sizeof(name), "f%lu", file - 101);
+      ARG("parent", "100", 3);
+      ARG("name", name, strlen(name));
+      break;
+    case OP_LIST:
+      ARG("inode", "100", 3);
+      break;
+    case OP_READ:
+      snprintf(length, sizeof(length), "%zu", cfg->write_size);
+      ARG("inode", ino, strlen(ino));
+      ARG("offset", "0", 1);
+      ARG("length", length, strlen(length));
+      break;
+    case OP_CREATE:
+      snprintf(name, sizeof(name), "c%d-%ld", w->id, w->seq++);
+      ARG("parent", "100", 3);
+      ARG("name", name, strlen(name));
+      ARG("type", "file", 4);
+      break;
+    case OP_WRITE:
+      snprintf(offset, sizeof(offset), "%zu", (r >> 32) % 16 * cfg->write_size);
+      ARG("inode", ino, strlen(ino));
+      ARG("offset", offset, strlen(offset));
+      ARG("content", payload, cfg->write_size);
+      break;
+    case OP_KINDS:
+      break;
+  }
+#undef ARG
+
+  static const enum vtfs_rpc_op opcodes[OP_KINDS] = {
+      VTFS_RPC_LOOKUP, VTFS_RPC_LIST, VTFS_RPC_READ, VTFS_RPC_CREATE, VTFS_RPC_WRITE
+  };
+  return vtfs_rpc_build_request(buf, opcodes[op], (uint32_t)w->id, cfg->token, args, nargs);
+}
+
+static void rpc_break(struct rpc_client* rpc) {
+  pthread_mutex_lock(&rpc->lock);
+  rpc->broken = true;
+  pthread_cond_broadcast(&rpc->done);
+  pthread_mutex_unlock(&rpc->lock);
+}
+
+static void* rpc_receiver_main(void* arg) {
+  struct rpc_client* rpc = arg;
+  char head[VTFS_RPC_HEADER_SIZE];
+  struct vtfs_rpc_header header;
+
+  while (recv_all(rpc->sock, head, sizeof(head)) == 0 &&
+         vtfs_rpc_get_header(head, &header) == 0 && header.id < (uint32_t)rpc->nworkers &&
+         header.len <= RESPONSE_CAP) {
+    struct worker* w = &rpc->workers[header.id];
+    // Only its own worker waits on this buffer, and it is parked until done
+    if (recv_all(rpc->sock, w->response, header.len) != 0) {
+      break;
+    }
+    pthread_mutex_lock(&rpc->lock);
+    w->rpc_got = w->rpc_waiting ? (ssize_t)(sizeof(head) + header.len) : -1;
+    w->rpc_waiting = false;
+    pthread_cond_broadcast(&rpc->done);
+    pthread_mutex_unlock(&rpc->lock);
+  }
+  rpc_break(rpc);
+  return NULL;
+}
+
+static int rpc_connect(struct rpc_client* rpc, const struct config* cfg) {
+  rpc->sock = connect_backend(cfg);
+  if (rpc->sock < 0) {
+    return -1;
+  }
+  pthread_mutex_init(&rpc->send_lock, NULL);
+  pthread_mutex_init(&rpc->lock, NULL);
+  pthread_cond_init(&rpc->done, NULL);
+  return pthread_create(&rpc->receiver, NULL, rpc_receiver_main, rpc);
+}
+
+// One call on the shared connection; the response length or -1
+static ssize_t rpc_call(struct worker* w, const char* request, size_t len) {
+  struct rpc_client* rpc = w->rpc;
+
+  pthread_mutex_lock(&rpc->lock);
+  w->rpc_waiting = true;
+  w->rpc_got = -1;
+  pthread_mutex_unlock(&rpc->lock);
+
+  pthread_mutex_lock(&rpc->send_lock);
+  int err = send_all(rpc->sock, request, len);
+  pthread_mutex_unlock(&rpc->send_lock);
+  if (err != 0) {
+    shutdown(rpc->sock, SHUT_RDWR);
+  }
+
+  pthread_mutex_lock(&rpc->lock);
+  while (w->rpc_waiting && !rpc->broken) {
+    pthread_cond_wait(&rpc->done, &rpc->lock);
+  }
+  w->rpc_waiting = false;
+  ssize_t got = w->rpc_got;
+  pthread_mutex_unlock(&rpc->lock);
+  return got;
+}
+
+static bool take_request(void) {
+  if (requests_left < 0) {
+    return !stop;
+  }
+  pthread_mutex_lock(&requests_lock);
+  bool ok = requests_left > 0;
+  if (ok) {
+    requests_left--;
+  }
+  pthread_mutex_unlock(&requests_lock);
+  return ok && !stop;
+}
+
+static enum op_kind pick_op(struct worker* w) {
+  const int* weights = w->cfg->workload->weights;
+  int total = 0;
+  for (int i = 0; i < OP_KINDS; i++) {
+    total += weights[i];
+  }
+  int r = (int)(rng_next(&w->rng) % (uint64_t)total);
+  for (int i = 0; i < OP_KINDS; i++) {
+    if (r < weights[i]) {
+      return (enum op_kind)i;
+    }
+    r -= weights[i];
+  }
+  return OP_LOOKUP;
+}
+
+// Runs HTTP requests until there are none left: one per connection, or up
+// to cfg->depth pipelined on a keep-alive connection, whose responses come
+// back in request order
+static void run_http(struct worker* w, char* request, char* response, const char* payload) {
+  const struct config* cfg = w->cfg;
+  struct {
+    enum op_kind op;
+    uint64_t start;
+    size_t len;
+  } window[MAX_DEPTH];
+  int head = 0;
+  int inflight = 0;
+  bool more = true;
+
+  for (;;) {
+    while (more && inflight < cfg->depth && (more = take_request())) {
+      enum op_kind op = pick_op(w);
+      size_t len = build_request(w, op, request, payload);
+      uint64_t start = lat_now_ns();
+
+      if (w->sock < 0) {
+        w->sock = connect_backend(cfg);
+        w->buffered = 0;
+      }
+      if (w->sock < 0 || send_all(w->sock, request, len) != 0) {
+        // Whatever was pipelined before it is lost with the connection
+        if (w->sock >= 0) {
+          close(w->sock);
+        }
+        w->sock = -1;
+        w->errors += 1 + (uint64_t)inflight;
+        inflight = 0;
+        continue;
+      }
+      int slot = (head + inflight++) % MAX_DEPTH;
+      window[slot].op = op;
+      window[slot].start = start;
+      window[slot].len = len;
+    }
+    if (inflight == 0) {
+      break;
+    }
+
+    ssize_t got = read_response(w, response, RESPONSE_CAP);
+    if (got < 0 || !cfg->keep_alive) {
+      close(w->sock);
+      w->sock = -1;
+    }
+    if (got < 0) {
+      w->errors += (uint64_t)inflight;
+      inflight = 0;
+      continue;
+    }
+    lat_record(&w->hist[window[head].op], lat_now_ns() - window[head].start);
+    w->sent_bytes += window[head].len;
+    w->recv_bytes += (uint64_t)got;
+    head = (head + 1) % MAX_DEPTH;
+    inflight--;
+  }
+}
+
+static void* worker_main(void* arg) {
+  struct worker* w = arg;
+  const struct config* cfg = w->cfg;
+  char* request = malloc(cfg->write_size * 3 + 4096);
+  char* response = w->response;
+  char* payload = malloc(cfg->write_size + 1);
+  if (request == NULL || response == NULL || payload == NULL) {
+    fprintf(stderr, "worker %d: out of memory\n", w->id);
+    goto out;
+  }
+  for (size_t i = 0; i < cfg->write_size; i++) {
+    payload[i] = (char)(rng_next(&w->rng) & 0x7f);
+  }
+  w->sock = -1;
+
+  if (!cfg->rpc) {
+    run_http(w, request, response, payload);
+  }
+  while (cfg->rpc && take_request()) {
+    enum op_kind op = pick_op(w);
+    size_t len = build_rpc_request(w, op, request, payload);
+    uint64_t start = lat_now_ns();
+    ssize_t got = rpc_call(w, request, len);
+    if (got < 0) {
+      w->errors++;
+      continue;
+    }
+    lat_record(&w->hist[op], lat_now_ns() - start);
+    w->sent_bytes += len;
+    w->recv_bytes += (uint64_t)got;
+  }
+
+  if (w->sock >= 0) {
+    close(w->sock);
+  }
+out:
+  free(request);
+  free(payload);
+  return NULL;
+}
+
+static void usage(const char* argv0) {
+  fprintf(
+      stderr,
+      "usage: %s [-H host] [-p port] [-t token] [-c concurrency] [-d seconds | -n requests]\n"
+      "          [-w lookup|create|write|mixed] [-k] [-D depth] [-r] [-s write_size] [-f files]\n"
+      "  -k  reuse connections (keep-alive) instead of one connection per request\n"
+      "  -D  pipeline up to depth requests per keep-alive connection (default 1)\n"
+      "  -r  speak binary RPC (mockd -R) over one connection shared by all workers\n",
+      argv0
+  );
+}
+
+int main(int argc, char** argv) {
+  struct config cfg = {
+      .host = "127.0.0.1",
+      .port = 8080,
+      .token = "loadgen",
+      .concurrency = 8,
+      .duration = 10.0,
+      .requests = -1,
+      .workload = &workloads[0],
+      .keep_alive = false,
+      .depth = 1,
+      .write_size = 512,
+      .files = 1000,
+  };
+
+  int opt;
+  while ((opt = getopt(argc, argv, "H:p:t:c:d:n:w:kD:rs:f:")) != -1) {
+    switch (opt) {
+      case 'H':
+        cfg.host = optarg;
+        break;
+      case 'p':
+        cfg.port = atoi(optarg);
+        break;
+      case 't':
+        cfg.token = optarg;
+        break;
+      case 'c':
+        cfg.concurrency = atoi(optarg);
+        break;
+      case 'd':
+        cfg.duration = atof(optarg);
+        break;
+      case 'n':
+        cfg.requests = atol(optarg);
+        break;
+      case 'w':
+        cfg.workload = NULL;
+        for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+          if (strcmp(workloads[i].name, optarg) == 0) {
+            cfg.workload = &workloads[i];
+          }
+        }
+        if (cfg.workload == NULL) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'k':
+        cfg.keep_alive = true;
+        break;
+      case 'D':
+        cfg.depth = atoi(optarg);
+        break;
+      case 'r':
+        cfg.rpc = true;
+        break;
+      case 's':
+        cfg.write_size = (size_t)atol(optarg);
+        break;
+      case 'f':
+        cfg.files = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (cfg.concurrency <= 0 || cfg.files <= 0 || cfg.depth <= 0 || cfg.depth > MAX_DEPTH ||
+      (cfg.depth > 1 && !cfg.keep_alive)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  requests_left = cfg.requests;
+  struct worker* workers = calloc((size_t)cfg.concurrency, sizeof(struct worker));
+  if (workers == NULL) {
+    return 1;
+  }
+
+  struct rpc_client rpc = {.workers = workers, .nworkers = cfg.concurrency};
+  if (cfg.rpc && rpc_connect(&rpc, &cfg) != 0) {
+    perror("loadgen: rpc");
+    return 1;
+  }
+
+  uint64_t start = lat_now_ns();
+  for (int i = 0; i < cfg.concurrency; i++) {
+    workers[i].id = i;
+    workers[i].cfg = &cfg;
+    workers[i].rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(i + 1);
+    workers[i].rpc = &rpc;
+    workers[i].response = malloc(RESPONSE_CAP);
+  }
+  for (int i = 0; i < cfg.concurrency; i++) {
+    pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+  }
+
+  if (cfg.requests < 0) {
+    usleep((useconds_t)(cfg.duration * 1e6));
+    stop = true;
+  }
+
+  struct lat_hist total[OP_KINDS];
+  struct lat_hist all;
+  uint64_t errors = 0;
+  uint64_t sent = 0;
+  uint64_t recvd = 0;
+  lat_init(&all);
+  for (int k = 0; k < OP_KINDS; k++) {
+    lat_init(&total[k]);
+  }
+  for (int i = 0; i < cfg.concurrency; i++) {
+    pthread_join(workers[i].thread, NULL);
+    for (int k = 0; k < OP_KINDS; k++) {
+      lat_merge(&total[k], &workers[i].hist[k]);
+      lat_merge(&all, &workers[i].hist[k]);
+    }
+    errors += workers[i].errors;
+    sent += workers[i].sent_bytes;
+    recvd += workers[i].recv_bytes;
+  }
+  double elapsed = (double)(lat_now_ns() - start) / 1e9;
+  if (cfg.rpc) {
+    shutdown(rpc.sock, SHUT_RDWR);
+    pthread_join(rpc.receiver, NULL);
+    close(rpc.sock);
+  }
+
+  printf(
+      "workload=%s concurrency=%d depth=%d mode=%s elapsed=%.2fs\n",
+      cfg.workload->name,
+      cfg.concurrency,
+      cfg.depth,
+      cfg.rpc ? "rpc" : cfg.keep_alive ? "keep-alive" : "close",
+      elapsed
+  );
+  printf(
+      "requests=%llu errors=%llu throughput=%.1f req/s tx=%.2f MB/s rx=%.2f MB/s\n\n",
+      (unsigned long long)all.count,
+      (unsigned long long)errors,
+      (double)all.count / elapsed,
+      (double)sent / elapsed / 1e6,
+      (double)recvd / elapsed / 1e6
+  );
+  lat_print_header(stdout);
+  for (int k = 0; k < OP_KINDS; k++) {
+    if (total[k].count > 0) {
+      lat_print(stdout, op_names[k], &total[k]);
+    }
+  }
+  lat_print(stdout, "all", &all);
+
+  for (int i = 0; i < cfg.concurrency; i++) {
+    free(workers[i].response);
+  }
+  free(workers);
+  return errors > 0 && all.count == 0 ? 1 : 0;
+}
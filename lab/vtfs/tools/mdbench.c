@@ -0,0 +1,491 @@
+// Metadata benchmark for vtfs in the spirit of mdtest.
+//
+// Runs the namespace ops vtfs implements in phases: mkdir, create, stat,
+// readdir, link, unlink and rmdir. Every thread works on its own tree
+// (default) or all threads share one tree (-S). The tree has -z levels of
+// -b subdirectories each, and files are spread over its leaves. Each phase
+// starts and ends on a barrier, so ops/s is wall-clock throughput across
+// all threads, while latency percentiles are per op.
+//
+//   mdbench -t 1,2,4 -n 1000 vtfs=/mnt/vtfs tmpfs=/mnt/tmpfs ramfs=/mnt/ramfs
+//
+// Targets are existing mount points (or any directory); each gets a
+// scratch directory that is removed by the rmdir phase.
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lat.h"
+
+#define MAX_THREAD_COUNTS 32
+#define PATH_CAP 4096
+
+enum phase { PH_MKDIR, PH_CREATE, PH_STAT, PH_READDIR, PH_LINK, PH_UNLINK, PH_RMDIR, PH_COUNT };
+
+static const char* phase_names[PH_COUNT] = {
+    "mkdir", "create", "stat", "readdir", "link", "unlink", "rmdir"
+};
+
+struct config {
+  int thread_counts[MAX_THREAD_COUNTS];
+  int nthread_counts;
+  long items;
+  int fanout;
+  int depth;
+  bool shared;
+  bool drop_caches;
+  FILE* json;
+};
+
+struct run {
+  const char* root;  // scratch directory of this run
+  int nthreads;
+  int ndirs;    // directories in one tree, excluding its root
+  int nleaves;  // the last level, or the tree root when depth is 0
+  pthread_barrier_t barrier;
+};
+
+struct worker {
+  pthread_t thread;
+  int id;
+  struct run* run;
+  uint64_t errors[PH_COUNT];
+  struct lat_hist hist[PH_COUNT];
+};
+
+static struct config cfg = {.items = 1000, .fanout = 4, .depth = 2};
+
+// Directory d of a tree in breadth-first order: 0 .. fanout-1 are the first
+// level, and so on. The path is built from the chain of parents.
+static int dir_path(char* buf, size_t cap, const char* tree, int d) {
+  int chain[64];
+  int n = 0;
+  while (d >= 0) {
+    chain[n++] = d;
+    d = d / cfg.fanout - 1;
+  }
+  int len = snprintf(buf, cap, "%s", tree);
+  while (n > 0) {
+    len += snprintf(buf + len, cap - (size_t)len, "/d%d", chain[--n]);
+  }
+  return len;
+}
+
+static void leaf_path(char* buf, size_t cap, const char* tree, const struct run* run, long leaf) {
+  if (cfg.depth == 0) {
+    snprintf(buf, cap, "%s", tree);
+  } else {
+    dir_path(buf, cap, tree, run->ndirs - run->nleaves + (int)leaf);
+  }
+}
+
+// First directory index of level (1-based); level depth+1 marks the end
+static int level_start(int level) {
+  int start = 0;
+  int width = 1;
+  for (int l = 1; l < level; l++) {
+    width *= cfg.fanout;
+    start += width;
+  }
+  return start;
+}
+
+// In shared mode all threads fill one tree and split its directories between
+// them; otherwise every thread owns a whole tree
+static void tree_of(const struct worker* w, char* buf, size_t cap) {
+  if (cfg.shared) {
+    snprintf(buf, cap, "%s/shared", w->run->root);
+  } else {
+    snprintf(buf, cap, "%s/t%d", w->run->root, w->id);
+  }
+}
+
+static bool owns(const struct worker* w, long index) {
+  return !cfg.shared || index % w->run->nthreads == w->id;
+}
+
+static void file_path(const struct worker* w, char* buf, size_t cap, long item, char kind) {
+  char tree[PATH_CAP];
+  tree_of(w, tree, sizeof(tree));
+  leaf_path(buf, cap, tree, w->run, item % w->run->nleaves);
+  size_t len = strlen(buf);
+  snprintf(buf + len, cap - len, "/%c.%d.%ld", kind, w->id, item);
+}
+
+static void timed(
+    struct worker* w,
+    enum phase ph,
+    int (*op)(const char*, const char*),
+    const char* a,
+    const char* b
+) {
+  uint64_t start = lat_now_ns();
+  if (op(a, b) != 0) {
+    w->errors[ph]++;
+    return;
+  }
+  lat_record(&w->hist[ph], lat_now_ns() - start);
+}
+
+static int op_mkdir(const char* path, const char* unused) {
+  (void)unused;
+  return mkdir(path, 0755);
+}
+
+static int op_create(const char* path, const char* unused) {
+  (void)unused;
+  int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+  return fd < 0 ? -1 : close(fd);
+}
+
+static int op_stat(const char* path, const char* unused) {
+  (void)unused;
+  struct stat st;
+  return stat(path, &st);
+}
+
+static int op_readdir(const char* path, const char* unused) {
+  (void)unused;
+  DIR* dir = opendir(path);
+  if (dir == NULL) {
+    return -1;
+  }
+  while (readdir(dir) != NULL) {
+  }
+  return closedir(dir);
+}
+
+static int op_link(const char* from, const char* to) {
+  return link(from, to);
+}
+
+static int op_unlink(const char* path, const char* unused) {
+  (void)unused;
+  return unlink(path);
+}
+
+static int op_rmdir(const char* path, const char* unused) {
+  (void)unused;
+  return rmdir(path);
+}
+
+// Creates or removes the directories of one level
+static void tree_level(struct worker* w, enum phase ph, int level) {
+  char tree[PATH_CAP];
+  char path[PATH_CAP];
+  tree_of(w, tree, sizeof(tree));
+  for (int d = level_start(level); d < level_start(level + 1); d++) {
+    if (owns(w, d)) {
+      dir_path(path, sizeof(path), tree, d);
+      timed(w, ph, ph == PH_MKDIR ? op_mkdir : op_rmdir, path, NULL);
+    }
+  }
+}
+
+static void run_phase(struct worker* w, enum phase ph) {
+  char path[PATH_CAP];
+  char other[PATH_CAP];
+  char tree[PATH_CAP];
+
+  switch (ph) {
+    case PH_MKDIR:
+    case PH_RMDIR:
+      // Levels must be complete before the next one starts, across threads
+      for (int i = 1; i <= cfg.depth; i++) {
+        tree_level(w, ph, ph == PH_MKDIR ? i : cfg.depth + 1 - i);
+        pthread_barrier_wait(&w->run->barrier);
+      }
+      return;
+    case PH_READDIR:
+      tree_of(w, tree, sizeof(tree));
+      for (long leaf = 0; leaf < w->run->nleaves; leaf++) {
+        if (owns(w, leaf)) {
+          leaf_path(path, sizeof(path), tree, w->run, leaf);
+          timed(w, ph, op_readdir, path, NULL);
+        }
+      }
+      return;
+    default:
+      break;
+  }
+
+  for (long i = 0; i < cfg.items; i++) {
+    file_path(w, path, sizeof(path), i, 'f');
+    switch (ph) {
+      case PH_CREATE:
+        timed(w, ph, op_create, path, NULL);
+        break;
+      case PH_STAT:
+        timed(w, ph, op_stat, path, NULL);
+        break;
+      case PH_LINK:
+        file_path(w, other, sizeof(other), i, 'l');
+        timed(w, ph, op_link, path, other);
+        break;
+      case PH_UNLINK:
+        file_path(w, other, sizeof(other), i, 'l');
+        timed(w, ph, op_unlink, other, NULL);
+        timed(w, ph, op_unlink, path, NULL);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void* worker_main(void* arg) {
+  struct worker* w = arg;
+  for (int ph = 0; ph < PH_COUNT; ph++) {
+    pthread_barrier_wait(&w->run->barrier);
+    run_phase(w, (enum phase)ph);
+    pthread_barrier_wait(&w->run->barrier);
+  }
+  return NULL;
+}
+
+static void drop_caches(void) {
+  int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+  sync();
+  if (fd < 0 || write(fd, "2", 1) != 1) {
+    fprintf(stderr, "mdbench: cannot drop caches (not root?)\n");
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+// Phase barriers for mkdir and rmdir are counted per level
+static void wait_levels(struct run* run, enum phase ph) {
+  if (ph == PH_MKDIR || ph == PH_RMDIR) {
+    for (int i = 0; i < cfg.depth; i++) {
+      pthread_barrier_wait(&run->barrier);
+    }
+  }
+}
+
+static int run_target(const char* label, const char* dir, int nthreads) {
+  char root[PATH_CAP / 2];
+  char tree[PATH_CAP];
+  snprintf(root, sizeof(root), "%s/mdbench.%d.%d", dir, getpid(), nthreads);
+  if (mkdir(root, 0755) != 0) {
+    fprintf(stderr, "mdbench: %s: %s\n", root, strerror(errno));
+    return -1;
+  }
+
+  struct run run = {.root = root, .nthreads = nthreads};
+  run.ndirs = level_start(cfg.depth + 1);
+  run.nleaves = cfg.depth == 0 ? 1 : run.ndirs - level_start(cfg.depth);
+  // Tree roots are not part of any phase
+  for (int t = 0; t < (cfg.shared ? 1 : nthreads); t++) {
+    snprintf(tree, sizeof(tree), cfg.shared ? "%s/shared" : "%s/t%d", root, t);
+    if (mkdir(tree, 0755) != 0) {
+      fprintf(stderr, "mdbench: %s: %s\n", tree, strerror(errno));
+      return -1;
+    }
+  }
+
+  struct worker* workers = calloc((size_t)nthreads, sizeof(*workers));
+  if (workers == NULL) {
+    return -1;
+  }
+  pthread_barrier_init(&run.barrier, NULL, (unsigned)nthreads + 1);
+  for (int i = 0; i < nthreads; i++) {
+    workers[i].id = i;
+    workers[i].run = &run;
+    for (int ph = 0; ph < PH_COUNT; ph++) {
+      lat_init(&workers[i].hist[ph]);
+    }
+    pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+  }
+
+  double seconds[PH_COUNT];
+  for (int ph = 0; ph < PH_COUNT; ph++) {
+    if (cfg.drop_caches) {
+      drop_caches();
+    }
+    pthread_barrier_wait(&run.barrier);
+    uint64_t start = lat_now_ns();
+    wait_levels(&run, (enum phase)ph);
+    pthread_barrier_wait(&run.barrier);
+    seconds[ph] = (double)(lat_now_ns() - start) / 1e9;
+  }
+
+  struct lat_hist hist[PH_COUNT];
+  uint64_t errors[PH_COUNT] = {0};
+  for (int ph = 0; ph < PH_COUNT; ph++) {
+    lat_init(&hist[ph]);
+  }
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(workers[i].thread, NULL);
+    for (int ph = 0; ph < PH_COUNT; ph++) {
+      lat_merge(&hist[ph], &workers[i].hist[ph]);
+      errors[ph] += workers[i].errors[ph];
+    }
+  }
+  pthread_barrier_destroy(&run.barrier);
+  free(workers);
+
+  for (int t = 0; t < (cfg.shared ? 1 : nthreads); t++) {
+    snprintf(tree, sizeof(tree), cfg.shared ? "%s/shared" : "%s/t%d", root, t);
+    rmdir(tree);
+  }
+  rmdir(root);
+
+  printf(
+      "\n== %s (%s) mode=%s threads=%d items=%ld fanout=%d depth=%d\n",
+      label,
+      dir,
+      cfg.shared ? "shared" : "unique",
+      nthreads,
+      cfg.items,
+      cfg.fanout,
+      cfg.depth
+  );
+  printf("%-16s %10s %10s %12s\n", "phase", "ops", "errors", "ops/s");
+  for (int ph = 0; ph < PH_COUNT; ph++) {
+    printf(
+        "%-16s %10llu %10llu %12.1f\n",
+        phase_names[ph],
+        (unsigned long long)hist[ph].count,
+        (unsigned long long)errors[ph],
+        seconds[ph] > 0 ? (double)hist[ph].count / seconds[ph] : 0.0
+    );
+  }
+  printf("\n");
+  lat_print_header(stdout);
+  for (int ph = 0; ph < PH_COUNT; ph++) {
+    lat_print(stdout, phase_names[ph], &hist[ph]);
+  }
+
+  if (cfg.json != NULL) {
+    for (int ph = 0; ph < PH_COUNT; ph++) {
+      fprintf(
+          cfg.json,
+          "{\"fs\":\"%s\",\"mode\":\"%s\",\"threads\":%d,\"phase\":\"%s\",\"ops\":%llu,"
+          "\"errors\":%llu,\"ops_per_sec\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+          label,
+          cfg.shared ? "shared" : "unique",
+          nthreads,
+          phase_names[ph],
+          (unsigned long long)hist[ph].count,
+          (unsigned long long)errors[ph],
+          seconds[ph] > 0 ? (double)hist[ph].count / seconds[ph] : 0.0,
+          (double)lat_percentile(&hist[ph], 50) / 1000.0,
+          (double)lat_percentile(&hist[ph], 99) / 1000.0,
+          (double)hist[ph].max_ns / 1000.0
+      );
+    }
+  }
+  return 0;
+}
+
+// "1,2,8" or the default sweep 1, 2, 4, ... up to the number of cores
+static int parse_threads(const char* spec) {
+  cfg.nthread_counts = 0;
+  if (spec == NULL) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long t = 1; t < cores && cfg.nthread_counts < MAX_THREAD_COUNTS - 1; t *= 2) {
+      cfg.thread_counts[cfg.nthread_counts++] = (int)t;
+    }
+    cfg.thread_counts[cfg.nthread_counts++] = cores > 0 ? (int)cores : 1;
+    return 0;
+  }
+  char* copy = strdup(spec);
+  char* rest = copy;
+  char* tok;
+  while ((tok = strsep(&rest, ",")) != NULL && cfg.nthread_counts < MAX_THREAD_COUNTS) {
+    int t = atoi(tok);
+    if (t <= 0) {
+      free(copy);
+      return -1;
+    }
+    cfg.thread_counts[cfg.nthread_counts++] = t;
+  }
+  free(copy);
+  return 0;
+}
+
+static void usage(const char* argv0) {
+  fprintf(
+      stderr,
+      "usage: %s [-t threads] [-n items] [-b fanout] [-z depth] [-S] [-D] [-j file]\n"
+      "          [label=]dir...\n"
+      "  -t  comma-separated thread counts (default 1, 2, 4, ... up to the cores)\n"
+      "  -n  files per thread (default 1000)\n"
+      "  -S  all threads share one tree instead of one tree per thread\n"
+      "  -D  drop the dentry and inode caches before every phase (root only)\n"
+      "  -j  append one JSON object per phase to file\n",
+      argv0
+  );
+}
+
+int main(int argc, char** argv) {
+  const char* threads = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:b:z:SDj:")) != -1) {
+    switch (opt) {
+      case 't':
+        threads = optarg;
+        break;
+      case 'n':
+        cfg.items = atol(optarg);
+        break;
+      case 'b':
+        cfg.fanout = atoi(optarg);
+        break;
+      case 'z':
+        cfg.depth = atoi(optarg);
+        break;
+      case 'S':
+        cfg.shared = true;
+        break;
+      case 'D':
+        cfg.drop_caches = true;
+        break;
+      case 'j':
+        cfg.json = fopen(optarg, "a");
+        if (cfg.json == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind == argc || cfg.items <= 0 || cfg.fanout <= 0 || cfg.depth < 0 || cfg.depth > 16 ||
+      parse_threads(threads) != 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int failed = 0;
+  for (int i = optind; i < argc; i++) {
+    char* label = argv[i];
+    char* dir = strchr(label, '=');
+    if (dir != NULL) {
+      *dir++ = '\0';
+    } else {
+      dir = label;
+    }
+    for (int t = 0; t < cfg.nthread_counts; t++) {
+      failed |= run_target(label, dir, cfg.thread_counts[t]) != 0;
+    }
+  }
+  if (cfg.json != NULL) {
+    fclose(cfg.json);
+  }
+  return failed;
+}
@@ -0,0 +1,1390 @@
+// In-memory stand-in for the vtfs backend with network fault injection.
+//
+// Speaks the kernel client's wire format: "GET /api/<method>?token=..&k=v"
+// requests as built by vtfs_http_build_request() in source/proto.c, answered
+// with a 200 status, Content-Length, an 8-byte int64_t result and the
+// payload, which is what parse_http_response() expects. A non-zero result
+// is a positive errno value. Every token gets its own namespace whose root
+// directory is inode 100.
+//
+// Methods and payloads (integers are little-endian):
+//   lookup  parent, name          -> entry
+//   getattr inode                 -> entry
+//   create  parent, name, type    -> entry (type is "file" or "dir")
+//   link    parent, name, inode   -> entry
+//   unlink  parent, name
+//   rmdir   parent, name
+//   list    inode                 -> { u64 ino, u32 mode, u32 name_len, name }*
+//   read    inode, offset, length -> data
+//   write   inode, offset, content [crc32c] [size]
+//   signature inode               -> block signatures, see source/delta.h
+//   patch   inode, size, delta, crc32c
+//   setxattr    inode, xname, value
+//   removexattr inode, xname
+// where entry is { u64 ino, u32 mode, u32 nlink, u64 size, u64 version }.
+// version changes whenever the file's data does and never repeats, not even
+// across restarts, so a client may key cached data on it.
+// Data is checked end to end as described in source/csum.h: a write with
+// crc32c=<8 hex digits per 4 KiB chunk> is refused with EBADMSG if any chunk
+// of content does not match, and a read with crc32c=1 answers
+// { u32 len, data, u32 crc32c per chunk } so the client can check it too.
+// A write with size=<n> first cuts or zero-extends the file to n bytes, as
+// a patch does, so a client rewriting a whole file drops its old tail.
+//
+// With -R and/or -U the same methods are also served over the binary RPC
+// framing of source/rpc_proto.h. Each RPC connection is worked by several
+// threads, so requests on it run concurrently and their responses go out in
+// completion order, not request order.
+//
+// Faults are applied per response, so loopback runs can reproduce slow,
+// lossy or misbehaving backends deterministically for a given seed.
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../source/csum.h"
+#include "../source/delta.h"
+#include "../source/rpc_proto.h"
+
+#define ROOT_INO 100
+#define NAME_HASH_BITS 16
+#define MAX_REQUEST (16 << 20)
+// Largest file. Those past what delta sync covers go up by whole-file writes.
+#define MAX_FILE (1 << 30)
+#define MAX_PARAMS 8
+// Threads per RPC connection, i.e. requests it can have in progress
+#define RPC_WORKERS 8
+
+enum lat_kind { LAT_NONE, LAT_FIXED, LAT_UNIFORM, LAT_EXP, LAT_LOGNORMAL };
+
+struct latency {
+  enum lat_kind kind;
+  double a;
+  double b;
+};
+
+struct config {
+  int port;
+  int rpc_port;  // 0 for no TCP RPC listener
+  const char* rpc_path;  // NULL for no unix socket RPC listener
+  unsigned int seed;
+  struct latency latency;
+  double bandwidth;  // bytes per second per connection, 0 for unlimited
+  double reset_pct;
+  double partial_pct;
+  double slow_pct;
+  double error_pct;
+  int slow_ms;
+  bool quiet;
+};
+
+struct xattr {
+  char* name;
+  char* value;
+  size_t len;
+};
+
+struct node {
+  uint64_t ino;
+  uint32_t mode;
+  uint32_t nlink;
+  char* data;
+  size_t size;
+  uint64_t version;
+  struct xattr* xattrs;
+  size_t nxattrs;
+  // Directories only
+  struct dentry** children;
+  size_t nchildren;
+  size_t cap;
+};
+
+struct dentry {
+  struct dentry* hash_next;
+  uint64_t parent;
+  uint64_t ino;
+  char* name;
+};
+
+struct namespace {
+  struct namespace* next;
+  char* token;
+  struct node** nodes;  // indexed by ino - ROOT_INO, NULL once freed
+  size_t nnodes;
+  struct dentry* names[1 << NAME_HASH_BITS];
+};
+
+struct param {
+  const char* key;
+  char* value;
+  size_t len;
+};
+
+struct request {
+  char method[32];
+  struct param params[MAX_PARAMS];
+  int nparams;
+  bool keep_alive;
+};
+
+struct conn {
+  int sock;
+  uint64_t rng;
+};
+
+static struct config cfg;
+static struct namespace* namespaces;
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+// Next data version. Starts from the wall clock in microseconds, so
+// versions handed out before a restart are not reused after it.
+static uint64_t next_version;
+
+enum stat_kind { ST_REQUESTS, ST_ERRORS, ST_RESETS, ST_PARTIAL, ST_SLOW, ST_HTTP_500, ST_KINDS };
+static const char* stat_names[ST_KINDS] = {"requests", "errors", "resets", "partial", "slow", "500"};
+static uint64_t stats[ST_KINDS];
+
+static uint64_t rng_next(uint64_t* s) {
+  uint64_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *s = x;
+}
+
+static double rng_unit(uint64_t* s) {
+  return (double)(rng_next(s) >> 11) / (double)(1ULL << 53);
+}
+
+static bool roll(struct conn* c, double pct) {
+  return pct > 0 && rng_unit(&c->rng) * 100 < pct;
+}
+
+static void sleep_us(double us) {
+  if (us <= 0) {
+    return;
+  }
+  struct timespec ts = {.tv_sec = (time_t)(us / 1e6), .tv_nsec = (long)fmod(us * 1e3, 1e9)};
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+  }
+}
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double sample_latency_us(struct conn* c) {
+  const struct latency* l = &cfg.latency;
+  switch (l->kind) {
+    case LAT_FIXED:
+      return l->a;
+    case LAT_UNIFORM:
+      return l->a + (l->b - l->a) * rng_unit(&c->rng);
+    case LAT_EXP:
+      return -l->a * log(1 - rng_unit(&c->rng));
+    case LAT_LOGNORMAL: {
+      // Box-Muller; a is the median, b the sigma of the underlying normal
+      double u1 = 1 - rng_unit(&c->rng);
+      double u2 = rng_unit(&c->rng);
+      return l->a * exp(l->b * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2));
+    }
+    case LAT_NONE:
+      break;
+  }
+  return 0;
+}
+
+// "fixed:US", "uniform:LO:HI", "exp:MEAN" or "lognormal:MEDIAN:SIGMA"
+static int parse_latency(const char* spec, struct latency* l) {
+  char kind[16];
+  int n = sscanf(spec, "%15[a-z]:%lf:%lf", kind, &l->a, &l->b);
+  if (n >= 2 && strcmp(kind, "fixed") == 0) {
+    l->kind = LAT_FIXED;
+  } else if (n == 3 && strcmp(kind, "uniform") == 0 && l->b >= l->a) {
+    l->kind = LAT_UNIFORM;
+  } else if (n >= 2 && strcmp(kind, "exp") == 0) {
+    l->kind = LAT_EXP;
+  } else if (n == 3 && strcmp(kind, "lognormal") == 0) {
+    l->kind = LAT_LOGNORMAL;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+static void count(enum stat_kind kind) {
+  __atomic_fetch_add(&stats[kind], 1, __ATOMIC_RELAXED);
+}
+
+// Namespace state; callers hold state_lock
+
+static uint32_t name_hash(uint64_t parent, const char* name) {
+  uint32_t h = 2166136261u ^ (uint32_t)parent;
+  for (; *name; name++) {
+    h = (h ^ (unsigned char)*name) * 16777619u;
+  }
+  return h >> (32 - NAME_HASH_BITS);
+}
+
+static struct node* node_get(struct namespace* ns, uint64_t ino) {
+  if (ino < ROOT_INO || ino - ROOT_INO >= ns->nnodes) {
+    return NULL;
+  }
+  return ns->nodes[ino - ROOT_INO];
+}
+
+static struct node* node_new(struct namespace* ns, uint32_t mode) {
+  struct node** nodes = realloc(ns->nodes, (ns->nnodes + 1) * sizeof(*nodes));
+  struct node* node = calloc(1, sizeof(*node));
+  if (nodes == NULL || node == NULL) {
+    free(node);
+    return NULL;
+  }
+  ns->nodes = nodes;
+  node->ino = ROOT_INO + ns->nnodes;
+  node->mode = mode;
+  node->version = next_version++;
+  ns->nodes[ns->nnodes++] = node;
+  return node;
+}
+
+static void node_put(struct namespace* ns, struct node* node) {
+  if (--node->nlink > 0) {
+    return;
+  }
+  ns->nodes[node->ino - ROOT_INO] = NULL;
+  for (size_t i = 0; i < node->nxattrs; i++) {
+    free(node->xattrs[i].name);
+    free(node->xattrs[i].value);
+  }
+  free(node->xattrs);
+  free(node->data);
+  free(node->children);
+  free(node);
+}
+
+static struct dentry** dentry_slot(struct namespace* ns, uint64_t parent, const char* name) {
+  struct dentry** slot = &ns->names[name_hash(parent, name)];
+  while (*slot != NULL && ((*slot)->parent != parent || strcmp((*slot)->name, name) != 0)) {
+    slot = &(*slot)->hash_next;
+  }
+  return slot;
+}
+
+static int dentry_add(struct namespace* ns, struct node* dir, const char* name, struct node* node) {
+  if (dir->nchildren == dir->cap) {
+    size_t cap = dir->cap ? dir->cap * 2 : 8;
+    struct dentry** children = realloc(dir->children, cap * sizeof(*children));
+    if (children == NULL) {
+      return ENOMEM;
+    }
+    dir->children = children;
+    dir->cap = cap;
+  }
+  struct dentry* d = malloc(sizeof(*d));
+  if (d == NULL || (d->name = strdup(name)) == NULL) {
+    free(d);
+    return ENOMEM;
+  }
+  d->parent = dir->ino;
+  d->ino = node->ino;
+  struct dentry** slot = &ns->names[name_hash(dir->ino, name)];
+  d->hash_next = *slot;
+  *slot = d;
+  dir->children[dir->nchildren++] = d;
+  node->nlink++;
+  return 0;
+}
+
+static void dentry_remove(struct namespace* ns, struct node* dir, struct dentry** slot) {
+  struct dentry* d = *slot;
+  *slot = d->hash_next;
+  for (size_t i = 0; i < dir->nchildren; i++) {
+    if (dir->children[i] == d) {
+      dir->children[i] = dir->children[--dir->nchildren];
+      break;
+    }
+  }
+  node_put(ns, node_get(ns, d->ino));
+  free(d->name);
+  free(d);
+}
+
+static struct namespace* namespace_get(const char* token) {
+  for (struct namespace* ns = namespaces; ns != NULL; ns = ns->next) {
+    if (strcmp(ns->token, token) == 0) {
+      return ns;
+    }
+  }
+  struct namespace* ns = calloc(1, sizeof(*ns));
+  if (ns == NULL || (ns->token = strdup(token)) == NULL) {
+    free(ns);
+    return NULL;
+  }
+  struct node* root = node_new(ns, S_IFDIR | 0777);
+  if (root == NULL) {
+    free(ns->token);
+    free(ns);
+    return NULL;
+  }
+  root->nlink = 1;
+  ns->next = namespaces;
+  namespaces = ns;
+  return ns;
+}
+
+// Request handling
+
+struct buf {
+  char* data;
+  size_t len;
+  size_t cap;
+};
+
+static int buf_put(struct buf* b, const void* src, size_t len) {
+  if (b->len + len > b->cap) {
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + len) {
+      cap *= 2;
+    }
+    char* data = realloc(b->data, cap);
+    if (data == NULL) {
+      return -1;
+    }
+    b->data = data;
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, src, len);
+  b->len += len;
+  return 0;
+}
+
+static int put_entry(struct buf* out, const struct node* node) {
+  uint64_t ino = node->ino;
+  uint64_t size = node->size;
+  if (buf_put(out, &ino, 8) || buf_put(out, &node->mode, 4) || buf_put(out, &node->nlink, 4)) {
+    return -1;
+  }
+  return buf_put(out, &size, 8) || buf_put(out, &node->version, 8) ? -1 : 0;
+}
+
+static struct xattr* xattr_find(struct node* node, const char* name) {
+  for (size_t i = 0; i < node->nxattrs; i++) {
+    if (strcmp(node->xattrs[i].name, name) == 0) {
+      return &node->xattrs[i];
+    }
+  }
+  return NULL;
+}
+
+static struct param* param(struct request* req, const char* key) {
+  for (int i = 0; i < req->nparams; i++) {
+    if (strcmp(req->params[i].key, key) == 0) {
+      return &req->params[i];
+    }
+  }
+  return NULL;
+}
+
+static bool param_u64(struct request* req, const char* key, uint64_t* value) {
+  struct param* p = param(req, key);
+  char* end;
+  if (p == NULL || p->len == 0) {
+    return false;
+  }
+  *value = strtoull(p->value, &end, 10);
+  return *end == '\0';
+}
+
+// Names may not contain '/' or NUL and must fit the kernel's dentry limit
+static const char* param_name(struct request* req) {
+  struct param* p = param(req, "name");
+  if (p == NULL || p->len == 0 || p->len > 255 || strlen(p->value) != p->len ||
+      strchr(p->value, '/') != NULL) {
+    return NULL;
+  }
+  return p->value;
+}
+
+static int64_t do_xattr(struct node* node, struct request* req) {
+  struct param* name = param(req, "xname");
+  struct param* value = param(req, "value");
+  struct xattr* x;
+
+  if (name == NULL || name->len == 0 || name->len > 255 || strlen(name->value) != name->len) {
+    return EINVAL;
+  }
+  x = xattr_find(node, name->value);
+  if (strcmp(req->method, "removexattr") == 0) {
+    if (x == NULL) {
+      return ENODATA;
+    }
+    free(x->name);
+    free(x->value);
+    *x = node->xattrs[--node->nxattrs];
+    return 0;
+  }
+
+  if (value == NULL || value->len > 65536) {
+    return EINVAL;
+  }
+  char* copy = malloc(value->len ? value->len : 1);
+  if (copy == NULL) {
+    return ENOMEM;
+  }
+  memcpy(copy, value->value, value->len);
+  if (x == NULL) {
+    struct xattr* xattrs = realloc(node->xattrs, (node->nxattrs + 1) * sizeof(*xattrs));
+    char* key = strdup(name->value);
+    if (xattrs == NULL || key == NULL) {
+      free(key);
+      free(copy);
+      return ENOMEM;
+    }
+    node->xattrs = xattrs;
+    x = &xattrs[node->nxattrs++];
+    x->name = key;
+  } else {
+    free(x->value);
+  }
+  x->value = copy;
+  x->len = value->len;
+  return 0;
+}
+
+// Checks content against the crc32c parameter of a write, if there is one
+static bool content_matches(struct request* req, const struct param* content) {
+  struct param* crc = param(req, "crc32c");
+  size_t chunks = vtfs_csum_chunks(content->len);
+
+  if (crc == NULL) {
+    return true;
+  }
+  if (crc->len != chunks * 8) {
+    return false;
+  }
+  for (size_t i = 0; i < chunks; i++) {
+    size_t offset = i * VTFS_CSUM_CHUNK;
+    size_t len = content->len - offset < VTFS_CSUM_CHUNK ? content->len - offset : VTFS_CSUM_CHUNK;
+    char hex[9];
+    char* end;
+
+    memcpy(hex, crc->value + i * 8, 8);
+    hex[8] = '\0';
+    if (strtoul(hex, &end, 16) != vtfs_crc32c(content->value + offset, len) || *end != '\0') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Read payload with a CRC per chunk, for clients that asked with crc32c=1
+static bool put_checked(struct buf* out, const char* data, uint32_t len) {
+  if (buf_put(out, &len, 4) || (len && buf_put(out, data, len))) {
+    return false;
+  }
+  for (size_t offset = 0; offset < len; offset += VTFS_CSUM_CHUNK) {
+    size_t chunk = len - offset < VTFS_CSUM_CHUNK ? len - offset : VTFS_CSUM_CHUNK;
+    uint32_t crc = vtfs_crc32c(data + offset, chunk);
+    if (buf_put(out, &crc, 4)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int put_signature(struct buf* out, const struct node* node) {
+  uint64_t size = node->size;
+  uint32_t block = VTFS_DELTA_BLOCK;
+  uint32_t count = vtfs_delta_blocks(node->size);
+
+  if (buf_put(out, &size, 8) || buf_put(out, &block, 4) || buf_put(out, &count, 4)) {
+    return ENOMEM;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    struct vtfs_delta_sig sig;
+    size_t offset = (size_t)i * VTFS_DELTA_BLOCK;
+    size_t len = node->size - offset < VTFS_DELTA_BLOCK ? node->size - offset : VTFS_DELTA_BLOCK;
+
+    vtfs_delta_signature(node->data + offset, len, &sig);
+    if (buf_put(out, &sig.weak, 4) || buf_put(out, &sig.strong, 8)) {
+      return ENOMEM;
+    }
+  }
+  return 0;
+}
+
+// Cuts the file to size bytes or zero-extends it
+static int node_resize(struct node* node, size_t size) {
+  if (size > node->size) {
+    char* data = realloc(node->data, size);
+    if (data == NULL) {
+      return ENOMEM;
+    }
+    memset(data + node->size, 0, size - node->size);
+    node->data = data;
+  }
+  node->size = size;
+  return 0;
+}
+
+// Rebuilds the file from its current contents and a delta, replacing it only
+// if the result has the CRC the client computed over the new contents
+static int do_patch(struct request* req, struct node* node) {
+  struct param* delta = param(req, "delta");
+  struct param* crc = param(req, "crc32c");
+  uint64_t size;
+
+  if (delta == NULL || crc == NULL || !param_u64(req, "size", &size) || size > MAX_FILE) {
+    return EINVAL;
+  }
+  char* data = malloc(size ? size : 1);
+  if (data == NULL) {
+    return ENOMEM;
+  }
+  if (vtfs_delta_apply(node->data, node->size, delta->value, delta->len, data, size) != 0) {
+    free(data);
+    return EPROTO;
+  }
+  if (strtoul(crc->value, NULL, 16) != vtfs_crc32c(data, size)) {
+    free(data);
+    return EBADMSG;
+  }
+  free(node->data);
+  node->data = data;
+  node->size = size;
+  node->version = next_version++;
+  return 0;
+}
+
+static int64_t do_method(struct namespace* ns, struct request* req, struct buf* out) {
+  const char* m = req->method;
+  uint64_t ino;
+  uint64_t offset;
+  uint64_t length;
+
+  if (strcmp(m, "read") == 0 || strcmp(m, "write") == 0 || strcmp(m, "list") == 0 ||
+      strcmp(m, "getattr") == 0 || strcmp(m, "setxattr") == 0 || strcmp(m, "removexattr") == 0 ||
+      strcmp(m, "signature") == 0 || strcmp(m, "patch") == 0) {
+    if (!param_u64(req, "inode", &ino)) {
+      return EINVAL;
+    }
+    struct node* node = node_get(ns, ino);
+    if (node == NULL) {
+      return ENOENT;
+    }
+    if (strcmp(m, "getattr") == 0) {
+      return put_entry(out, node) ? ENOMEM : 0;
+    }
+    if (strcmp(m, "setxattr") == 0 || strcmp(m, "removexattr") == 0) {
+      return do_xattr(node, req);
+    }
+    if (strcmp(m, "list") == 0) {
+      if (!S_ISDIR(node->mode)) {
+        return ENOTDIR;
+      }
+      for (size_t i = 0; i < node->nchildren; i++) {
+        struct dentry* d = node->children[i];
+        uint32_t mode = node_get(ns, d->ino)->mode;
+        uint32_t name_len = (uint32_t)strlen(d->name);
+        if (buf_put(out, &d->ino, 8) || buf_put(out, &mode, 4) || buf_put(out, &name_len, 4) ||
+            buf_put(out, d->name, name_len)) {
+          return ENOMEM;
+        }
+      }
+      return 0;
+    }
+    if (S_ISDIR(node->mode)) {
+      return EISDIR;
+    }
+    if (strcmp(m, "signature") == 0) {
+      return put_signature(out, node);
+    }
+    if (strcmp(m, "patch") == 0) {
+      return do_patch(req, node);
+    }
+    if (!param_u64(req, "offset", &offset)) {
+      return EINVAL;
+    }
+    if (strcmp(m, "read") == 0) {
+      if (!param_u64(req, "length", &length)) {
+        return EINVAL;
+      }
+      if (offset >= node->size) {
+        length = 0;
+        offset = 0;
+      }
+      length = length < node->size - offset ? length : node->size - offset;
+      if (param(req, "crc32c") != NULL) {
+        return put_checked(out, node->data + offset, (uint32_t)length) ? 0 : ENOMEM;
+      }
+      return length && buf_put(out, node->data + offset, length) ? ENOMEM : 0;
+    }
+    struct param* content = param(req, "content");
+    if (content == NULL || offset > MAX_FILE) {
+      return EINVAL;
+    }
+    if (!content_matches(req, content)) {
+      return EBADMSG;
+    }
+    if (param(req, "size") != NULL) {
+      if (!param_u64(req, "size", &length) || length > MAX_FILE) {
+        return EINVAL;
+      }
+      if (node_resize(node, length)) {
+        return ENOMEM;
+      }
+    }
+    if (offset + content->len > node->size && node_resize(node, offset + content->len)) {
+      return ENOMEM;
+    }
+    memcpy(node->data + offset, content->value, content->len);
+    node->version = next_version++;
+    return 0;
+  }
+
+  const char* name = param_name(req);
+  if (name == NULL || !param_u64(req, "parent", &ino)) {
+    return EINVAL;
+  }
+  struct node* dir = node_get(ns, ino);
+  if (dir == NULL) {
+    return ENOENT;
+  }
+  if (!S_ISDIR(dir->mode)) {
+    return ENOTDIR;
+  }
+  struct dentry** slot = dentry_slot(ns, ino, name);
+  struct node* node = *slot ? node_get(ns, (*slot)->ino) : NULL;
+
+  if (strcmp(m, "lookup") == 0) {
+    if (node == NULL) {
+      return ENOENT;
+    }
+    return put_entry(out, node) ? ENOMEM : 0;
+  }
+  if (strcmp(m, "create") == 0 || strcmp(m, "link") == 0) {
+    if (node != NULL) {
+      return EEXIST;
+    }
+    if (strcmp(m, "link") == 0) {
+      if (!param_u64(req, "inode", &ino) || (node = node_get(ns, ino)) == NULL) {
+        return ENOENT;
+      }
+      if (S_ISDIR(node->mode)) {
+        return EPERM;
+      }
+    } else {
+      struct param* type = param(req, "type");
+      bool is_dir = type != NULL && strcmp(type->value, "dir") == 0;
+      if ((node = node_new(ns, (is_dir ? S_IFDIR : S_IFREG) | 0777)) == NULL) {
+        return ENOMEM;
+      }
+    }
+    int err = dentry_add(ns, dir, name, node);
+    if (err != 0) {
+      return err;
+    }
+    return put_entry(out, node) ? ENOMEM : 0;
+  }
+  if (strcmp(m, "unlink") == 0 || strcmp(m, "rmdir") == 0) {
+    if (node == NULL) {
+      return ENOENT;
+    }
+    if (strcmp(m, "rmdir") == 0) {
+      if (!S_ISDIR(node->mode)) {
+        return ENOTDIR;
+      }
+      if (node->nchildren > 0) {
+        return ENOTEMPTY;
+      }
+    } else if (S_ISDIR(node->mode)) {
+      return EISDIR;
+    }
+    dentry_remove(ns, dir, slot);
+    return 0;
+  }
+  return EINVAL;
+}
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Decodes %XX escapes in place; the result may contain NUL bytes
+static size_t url_decode(char* s) {
+  char* out = s;
+  for (char* in = s; *in; in++) {
+    int hi;
+    int lo;
+    if (*in == '%' && (hi = hex_digit(in[1])) >= 0 && (lo = hex_digit(in[2])) >= 0) {
+      *out++ = (char)(hi << 4 | lo);
+      in += 2;
+    } else {
+      *out++ = *in == '+' ? ' ' : *in;
+    }
+  }
+  *out = '\0';
+  return (size_t)(out - s);
+}
+
+// Parses the request head in place; head is NUL-terminated at the blank line
+static int parse_request(char* head, struct request* req) {
+  char* line_end = strstr(head, "\r\n");
+  if (line_end == NULL) {
+    return -1;
+  }
+  *line_end = '\0';
+
+  // Requests without a Connection header follow the HTTP/1.1 default
+  req->keep_alive = strstr(head, " HTTP/1.1") != NULL;
+  for (char* h = line_end + 2; h != NULL && *h; h = strstr(h, "\r\n")) {
+    h += h[0] == '\r' ? 2 : 0;
+    if (strncasecmp(h, "Connection:", 11) == 0) {
+      char* v = h + 11;
+      while (*v == ' ') {
+        v++;
+      }
+      req->keep_alive = strncasecmp(v, "keep-alive", 10) == 0;
+    }
+  }
+
+  if (strncmp(head, "GET /api/", 9) != 0) {
+    return -1;
+  }
+  char* target = head + 9;
+  char* space = strchr(target, ' ');
+  if (space != NULL) {
+    *space = '\0';
+  }
+  char* query = strchr(target, '?');
+  if (query != NULL) {
+    *query++ = '\0';
+  }
+  if (strlen(target) >= sizeof(req->method)) {
+    return -1;
+  }
+  strcpy(req->method, target);
+
+  req->nparams = 0;
+  char* pair;
+  while (query != NULL && (pair = strsep(&query, "&")) != NULL) {
+    char* eq = strchr(pair, '=');
+    if (eq == NULL || req->nparams == MAX_PARAMS) {
+      continue;
+    }
+    *eq = '\0';
+    struct param* p = &req->params[req->nparams++];
+    p->key = pair;
+    p->value = eq + 1;
+    p->len = url_decode(p->value);
+  }
+  return 0;
+}
+
+static int send_all(int sock, const char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(sock, buf, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return -1;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+// Sends len bytes at no more than cfg.bandwidth bytes per second, or one
+// byte every cfg.slow_ms when dripping
+static int send_paced(int sock, const char* buf, size_t len, bool drip) {
+  if (!drip && cfg.bandwidth <= 0) {
+    return send_all(sock, buf, len);
+  }
+  size_t chunk = drip ? 1 : (size_t)(cfg.bandwidth / 100) + 1;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t sent = 0; sent < len;) {
+    size_t n = len - sent < chunk ? len - sent : chunk;
+    if (send_all(sock, buf + sent, n) != 0) {
+      return -1;
+    }
+    sent += n;
+    if (drip) {
+      sleep_us(cfg.slow_ms * 1e3);
+      continue;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed_us = (now.tv_sec - start.tv_sec) * 1e6 + (now.tv_nsec - start.tv_nsec) / 1e3;
+    sleep_us((double)sent / cfg.bandwidth * 1e6 - elapsed_us);
+  }
+  return 0;
+}
+
+// Closes with RST instead of FIN
+static void reset(int sock) {
+  struct linger lg = {.l_onoff = 1, .l_linger = 0};
+  setsockopt(sock, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+}
+
+// Runs req against its token's namespace, appending the int64_t result
+// and the payload to body. False if body could not be allocated.
+static bool run_method(struct request* req, struct buf* body) {
+  int64_t result = EINVAL;
+  size_t slot = body->len;
+
+  // Reserve the result slot, filled in once the method ran
+  buf_put(body, &result, sizeof(result));
+  struct param* token = param(req, "token");
+  pthread_mutex_lock(&state_lock);
+  struct namespace* ns = token != NULL ? namespace_get(token->value) : NULL;
+  result = ns != NULL ? do_method(ns, req, body) : EINVAL;
+  pthread_mutex_unlock(&state_lock);
+  if (result != 0) {
+    count(ST_ERRORS);
+    body->len = slot + sizeof(result);
+  }
+  if (body->data == NULL) {
+    return false;
+  }
+  memcpy(body->data + slot, &result, sizeof(result));
+  return true;
+}
+
+// Returns false once the connection must be closed. The injected latency
+// counts from received_us, so requests pipelined together are served as if
+// concurrently, though answered in order.
+static bool respond(struct conn* c, struct request* req, double received_us) {
+  struct buf body = {0};
+  int status = 200;
+
+  sleep_us(received_us + sample_latency_us(c) - now_us());
+  if (roll(c, cfg.reset_pct)) {
+    count(ST_RESETS);
+    reset(c->sock);
+    return false;
+  }
+
+  if (roll(c, cfg.error_pct)) {
+    count(ST_HTTP_500);
+    status = 500;
+  } else if (!run_method(req, &body)) {
+    status = 500;
+  }
+
+  char head[256];
+  int head_len = snprintf(
+      head,
+      sizeof(head),
+      "HTTP/1.1 %d %s\r\nContent-Type: application/octet-stream\r\nContent-Length: %zu\r\n"
+      "Connection: %s\r\n\r\n",
+      status,
+      status == 200 ? "OK" : "Internal Server Error",
+      status == 200 ? body.len : 0,
+      req->keep_alive ? "keep-alive" : "close"
+  );
+  struct buf out = {0};
+  bool ok = buf_put(&out, head, (size_t)head_len) == 0;
+  if (ok && status == 200) {
+    ok = buf_put(&out, body.data, body.len) == 0;
+  }
+  free(body.data);
+  if (!ok) {
+    free(out.data);
+    return false;
+  }
+
+  if (roll(c, cfg.partial_pct)) {
+    count(ST_PARTIAL);
+    send_paced(c->sock, out.data, 1 + rng_next(&c->rng) % (out.len - 1), false);
+    free(out.data);
+    return false;
+  }
+  bool drip = roll(c, cfg.slow_pct);
+  if (drip) {
+    count(ST_SLOW);
+  }
+  ok = send_paced(c->sock, out.data, out.len, drip) == 0;
+  free(out.data);
+  return ok && req->keep_alive;
+}
+
+static void* conn_main(void* arg) {
+  struct conn* c = arg;
+  struct buf in = {0};
+  size_t scanned = 0;
+  double received_us = 0;
+
+  for (;;) {
+    // Serve every complete request already buffered, which also covers
+    // pipelined requests
+    char* end;
+    while (in.len > 0 && (end = memmem(in.data + scanned, in.len - scanned, "\r\n\r\n", 4))) {
+      *end = '\0';
+      size_t consumed = (size_t)(end + 4 - in.data);
+      struct request req;
+      count(ST_REQUESTS);
+      bool keep = parse_request(in.data, &req) == 0 && respond(c, &req, received_us);
+      if (!keep) {
+        goto out;
+      }
+      memmove(in.data, in.data + consumed, in.len - consumed);
+      in.len -= consumed;
+      scanned = 0;
+    }
+    scanned = in.len > 3 ? in.len - 3 : 0;
+
+    char chunk[16384];
+    ssize_t n = recv(c->sock, chunk, sizeof(chunk), 0);
+    if (n <= 0 || in.len + (size_t)n > MAX_REQUEST || buf_put(&in, chunk, (size_t)n) != 0) {
+      break;
+    }
+    received_us = now_us();
+  }
+out:
+  close(c->sock);
+  free(in.data);
+  free(c);
+  return NULL;
+}
+
+// One RPC connection, shared by its RPC_WORKERS threads. Frames are read
+// and written whole under the locks; methods run in between, concurrently.
+struct rpc_conn {
+  int sock;
+  int workers;  // still running; the last one out closes sock
+  pthread_mutex_t lock;  // workers
+  pthread_mutex_t recv_lock;
+  pthread_mutex_t send_lock;
+};
+
+struct rpc_worker {
+  struct conn c;  // sock and a fault stream of its own
+  struct rpc_conn* rc;
+};
+
+static int recv_all(int sock, void* buf, size_t len) {
+  for (char* p = buf; len > 0;) {
+    ssize_t n = recv(sock, p, len, 0);
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+// Reads the next request frame. Its body is returned in *body, with every
+// key and value copied NUL-terminated into *strings, which req points into.
+static int rpc_read(
+    struct rpc_conn* rc, struct vtfs_rpc_header* header, struct request* req, char** strings
+) {
+  char head[VTFS_RPC_HEADER_SIZE];
+  char* body = NULL;
+
+  pthread_mutex_lock(&rc->recv_lock);
+  int err = recv_all(rc->sock, head, sizeof(head));
+  if (err == 0) {
+    err = vtfs_rpc_get_header(head, header);
+  }
+  if (err == 0) {
+    body = malloc(header->len + 1);
+    err = body == NULL ? -1 : recv_all(rc->sock, body, header->len);
+  }
+  pthread_mutex_unlock(&rc->recv_lock);
+  if (err != 0) {
+    free(body);
+    return -1;
+  }
+
+  // Every parameter loses its 5-byte length prefix and gains two NULs
+  *strings = malloc(header->len + 1);
+  if (*strings == NULL) {
+    free(body);
+    return -1;
+  }
+  const char* method = vtfs_rpc_method(header->opcode);
+  snprintf(req->method, sizeof(req->method), "%s", method != NULL ? method : "");
+  req->nparams = 0;
+  req->keep_alive = true;
+
+  char* p = *strings;
+  size_t pos = 0;
+  struct vtfs_arg arg;
+  size_t key_len;
+  while ((err = vtfs_rpc_next_arg(body, header->len, &pos, &arg, &key_len)) == 1) {
+    if (req->nparams == MAX_PARAMS) {
+      continue;
+    }
+    struct param* param = &req->params[req->nparams++];
+    param->key = p;
+    memcpy(p, arg.key, key_len);
+    p += key_len;
+    *p++ = '\0';
+    param->value = p;
+    param->len = arg.len;
+    memcpy(p, arg.value, arg.len);
+    p += arg.len;
+    *p++ = '\0';
+  }
+  free(body);
+  return err;
+}
+
+// Answers one request; false once the connection must be closed
+static bool rpc_respond(
+    struct rpc_worker* w, const struct vtfs_rpc_header* request, struct request* req
+) {
+  struct rpc_conn* rc = w->rc;
+  struct buf out = {0};
+
+  sleep_us(sample_latency_us(&w->c));
+  if (roll(&w->c, cfg.reset_pct)) {
+    count(ST_RESETS);
+    reset(rc->sock);
+    return false;
+  }
+
+  // The header goes in front once the body length is known
+  char head[VTFS_RPC_HEADER_SIZE] = {0};
+  buf_put(&out, head, sizeof(head));
+  if (roll(&w->c, cfg.error_pct)) {
+    // No status line to fail with: the call fails as a backend I/O error
+    int64_t result = EIO;
+    count(ST_HTTP_500);
+    buf_put(&out, &result, sizeof(result));
+  } else if (!run_method(req, &out)) {
+    free(out.data);
+    return false;
+  }
+  if (out.data == NULL) {
+    return false;
+  }
+  struct vtfs_rpc_header header = {
+      .magic = VTFS_RPC_MAGIC,
+      .opcode = request->opcode,
+      .id = request->id,
+      .len = (uint32_t)(out.len - sizeof(head)),
+  };
+  vtfs_rpc_put_header(out.data, &header);
+
+  bool ok;
+  pthread_mutex_lock(&rc->send_lock);
+  if (roll(&w->c, cfg.partial_pct)) {
+    count(ST_PARTIAL);
+    send_paced(rc->sock, out.data, 1 + rng_next(&w->c.rng) % (out.len - 1), false);
+    ok = false;
+  } else {
+    bool drip = roll(&w->c, cfg.slow_pct);
+    if (drip) {
+      count(ST_SLOW);
+    }
+    ok = send_paced(rc->sock, out.data, out.len, drip) == 0;
+  }
+  pthread_mutex_unlock(&rc->send_lock);
+  free(out.data);
+  return ok;
+}
+
+// Called by each worker on its way out
+static void rpc_conn_put(struct rpc_conn* rc) {
+  // Wakes the other workers out of recv so they wind down too
+  shutdown(rc->sock, SHUT_RDWR);
+  pthread_mutex_lock(&rc->lock);
+  bool last = --rc->workers == 0;
+  pthread_mutex_unlock(&rc->lock);
+  if (last) {
+    close(rc->sock);
+    pthread_mutex_destroy(&rc->lock);
+    pthread_mutex_destroy(&rc->recv_lock);
+    pthread_mutex_destroy(&rc->send_lock);
+    free(rc);
+  }
+}
+
+static void* rpc_worker_main(void* arg) {
+  struct rpc_worker* w = arg;
+  struct rpc_conn* rc = w->rc;
+
+  for (;;) {
+    struct vtfs_rpc_header header;
+    struct request req;
+    char* strings = NULL;
+    if (rpc_read(rc, &header, &req, &strings) != 0) {
+      free(strings);
+      break;
+    }
+    count(ST_REQUESTS);
+    bool keep = rpc_respond(w, &header, &req);
+    free(strings);
+    if (!keep) {
+      break;
+    }
+  }
+
+  rpc_conn_put(rc);
+  free(w);
+  return NULL;
+}
+
+static void rpc_serve(int sock, uint64_t id) {
+  struct rpc_conn* rc = malloc(sizeof(*rc));
+  if (rc == NULL) {
+    close(sock);
+    return;
+  }
+  rc->sock = sock;
+  rc->workers = RPC_WORKERS;
+  pthread_mutex_init(&rc->lock, NULL);
+  pthread_mutex_init(&rc->recv_lock, NULL);
+  pthread_mutex_init(&rc->send_lock, NULL);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (int i = 0; i < RPC_WORKERS; i++) {
+    struct rpc_worker* w = malloc(sizeof(*w));
+    pthread_t thread;
+    if (w != NULL) {
+      w->c.sock = sock;
+      w->c.rng = 0x9E3779B97F4A7C15ULL * (cfg.seed + (id << 8) + i) | 1;
+      w->rc = rc;
+    }
+    if (w == NULL || pthread_create(&thread, &attr, rpc_worker_main, w) != 0) {
+      // Stands in for the worker that never ran
+      free(w);
+      rpc_conn_put(rc);
+    }
+  }
+  pthread_attr_destroy(&attr);
+}
+
+static void* rpc_listen_main(void* arg) {
+  int lsock = (int)(intptr_t)arg;
+  int one = 1;
+
+  for (uint64_t id = 1;; id++) {
+    int sock = accept(lsock, NULL, NULL);
+    if (sock < 0) {
+      continue;
+    }
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    rpc_serve(sock, id);
+  }
+  return NULL;
+}
+
+static int rpc_listen(int family, const char* path) {
+  struct sockaddr_storage ss = {0};
+  socklen_t len;
+  int one = 1;
+
+  int lsock = socket(family, SOCK_STREAM, 0);
+  if (family == AF_UNIX) {
+    struct sockaddr_un* un = (struct sockaddr_un*)&ss;
+    un->sun_family = AF_UNIX;
+    snprintf(un->sun_path, sizeof(un->sun_path), "%s", path);
+    unlink(path);
+    len = sizeof(*un);
+  } else {
+    struct sockaddr_in* in = (struct sockaddr_in*)&ss;
+    in->sin_family = AF_INET;
+    in->sin_port = htons(cfg.rpc_port);
+    in->sin_addr.s_addr = htonl(INADDR_ANY);
+    setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    len = sizeof(*in);
+  }
+  if (lsock < 0 || bind(lsock, (struct sockaddr*)&ss, len) != 0 || listen(lsock, 1024) != 0) {
+    perror("mockd: rpc");
+    return -1;
+  }
+  pthread_t thread;
+  return pthread_create(&thread, NULL, rpc_listen_main, (void*)(intptr_t)lsock) == 0 ? 0 : -1;
+}
+
+static void print_stats(void) {
+  fprintf(stderr, "mockd:");
+  for (int i = 0; i < ST_KINDS; i++) {
+    fprintf(
+        stderr, " %s=%llu", stat_names[i], (unsigned long long)__atomic_load_n(&stats[i], __ATOMIC_RELAXED)
+    );
+  }
+  fprintf(stderr, "\n");
+}
+
+// Signals are taken synchronously here so printing stays out of handlers
+static void* signal_main(void* arg) {
+  sigset_t* set = arg;
+  int sig;
+  while (sigwait(set, &sig) == 0) {
+    print_stats();
+    if (sig != SIGUSR1) {
+      exit(0);
+    }
+  }
+  return NULL;
+}
+
+static void usage(const char* argv0) {
+  fprintf(
+      stderr,
+      "usage: %s [-p port] [-R port] [-U path] [-s seed] [-l latency] [-b bytes/s] [-r pct]\n"
+      "          [-P pct] [-S pct] [-L ms] [-E pct] [-q]\n"
+      "  -R  also serve the binary RPC protocol on this TCP port\n"
+      "  -U  also serve the binary RPC protocol on this unix socket\n"
+      "  -l  fixed:US | uniform:LO:HI | exp:MEAN | lognormal:MEDIAN:SIGMA (microseconds)\n"
+      "  -b  per-connection bandwidth cap\n"
+      "  -r  reset the connection instead of answering\n"
+      "  -P  send a truncated response, then close\n"
+      "  -S  drip the response one byte every -L ms (default 10)\n"
+      "  -E  answer with a bare 500 (EIO over RPC)\n"
+      "Counters are printed on SIGUSR1 and on exit.\n",
+      argv0
+  );
+}
+
+int main(int argc, char** argv) {
+  struct timespec boot;
+
+  clock_gettime(CLOCK_REALTIME, &boot);
+  next_version = (uint64_t)boot.tv_sec * 1000000 + boot.tv_nsec / 1000;
+  cfg.port = 8080;
+  cfg.seed = 1;
+  cfg.slow_ms = 10;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:R:U:s:l:b:r:P:S:L:E:q")) != -1) {
+    switch (opt) {
+      case 'p':
+        cfg.port = atoi(optarg);
+        break;
+      case 'R':
+        cfg.rpc_port = atoi(optarg);
+        break;
+      case 'U':
+        cfg.rpc_path = optarg;
+        break;
+      case 's':
+        cfg.seed = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        if (parse_latency(optarg, &cfg.latency) != 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'b':
+        cfg.bandwidth = atof(optarg);
+        break;
+      case 'r':
+        cfg.reset_pct = atof(optarg);
+        break;
+      case 'P':
+        cfg.partial_pct = atof(optarg);
+        break;
+      case 'S':
+        cfg.slow_pct = atof(optarg);
+        break;
+      case 'L':
+        cfg.slow_ms = atoi(optarg);
+        break;
+      case 'E':
+        cfg.error_pct = atof(optarg);
+        break;
+      case 'q':
+        cfg.quiet = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  int lsock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  int one = 1;
+  setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(cfg.port),
+      .sin_addr.s_addr = htonl(INADDR_ANY),
+  };
+  if (bind(lsock, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(lsock, 1024) != 0) {
+    perror("mockd");
+    return 1;
+  }
+
+  // Blocked before any thread starts so every thread inherits the mask
+  static sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGUSR1);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  pthread_t signal_thread;
+  pthread_create(&signal_thread, NULL, signal_main, &signals);
+  if ((cfg.rpc_port != 0 && rpc_listen(AF_INET, NULL) != 0) ||
+      (cfg.rpc_path != NULL && rpc_listen(AF_UNIX, cfg.rpc_path) != 0)) {
+    return 1;
+  }
+  if (!cfg.quiet) {
+    fprintf(stderr, "mockd listening on port %d\n", cfg.port);
+    if (cfg.rpc_port != 0) {
+      fprintf(stderr, "mockd serving rpc on port %d\n", cfg.rpc_port);
+    }
+    if (cfg.rpc_path != NULL) {
+      fprintf(stderr, "mockd serving rpc on %s\n", cfg.rpc_path);
+    }
+  }
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (uint64_t id = 1;; id++) {
+    int sock = accept(lsock, NULL, NULL);
+    if (sock < 0) {
+      continue;
+    }
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct conn* c = malloc(sizeof(*c));
+    if (c == NULL) {
+      close(sock);
+      continue;
+    }
+    c->sock = sock;
+    // Per-connection streams keep a run reproducible for a given seed
+    c->rng = 0x9E3779B97F4A7C15ULL * (cfg.seed + id) | 1;
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, conn_main, c) != 0) {
+      close(sock);
+      free(c);
+    }
+  }
+}
@@ -0,0 +1,501 @@
+// Replays a vtfs op trace against a mounted file system.
+//
+// Capture on the traced machine with
+//   cat /sys/kernel/debug/vtfs/trace > ops.trace
+// (ops are recorded while the file is open), then replay with
+//   replay [-f | -x speed] [-1] ops.trace /mnt/target
+//
+// Every thread seen in the trace gets its own replay thread; -1 replays
+// everything from one thread in start order, which is the safe choice when
+// threads in the trace depend on each other's files. Inodes are mapped to
+// paths from the lookups, creates and mkdirs in the trace, so the target
+// can be any file system (vtfs, tmpfs, ...) mounted empty or holding the
+// same tree as the traced mount. Ops on inodes the trace never named are
+// skipped and counted.
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../source/capture.h"
+#include "lat.h"
+
+// vtfs_fill_super() gives the root this number
+#define ROOT_INO 100
+#define INO_HASH_BITS 16
+
+static const char* op_names[VTFS_OP_COUNT] = {
+    "lookup", "create", "mkdir", "unlink", "rmdir", "link", "iterate", "read", "write", "symlink"
+};
+
+struct op {
+  struct vtfs_trace_record rec;
+  const char* name;
+};
+
+struct inode_path {
+  struct inode_path* next;
+  uint64_t ino;
+  char* path;
+  int fd;
+};
+
+struct config {
+  bool fast;
+  double speed;
+  bool serial;
+};
+
+struct replayer {
+  pthread_t thread;
+  uint32_t tid;
+  struct op** ops;
+  size_t nops;
+  size_t cap;
+  char* buf;
+  size_t buf_size;
+  uint64_t skipped;
+  uint64_t mismatched;
+  struct lat_hist replayed[VTFS_OP_COUNT];
+  struct lat_hist traced[VTFS_OP_COUNT];
+};
+
+static struct config cfg = {.speed = 1.0};
+static struct inode_path* inodes[1 << INO_HASH_BITS];
+static pthread_mutex_t inodes_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t trace_start_ns;
+static uint64_t replay_start_ns;
+
+static struct inode_path** inode_slot(uint64_t ino) {
+  struct inode_path** slot = &inodes[(ino * 0x9E3779B97F4A7C15ULL) >> (64 - INO_HASH_BITS)];
+  while (*slot != NULL && (*slot)->ino != ino) {
+    slot = &(*slot)->next;
+  }
+  return slot;
+}
+
+// Returns a copy of the path of ino, or NULL if the trace never named it
+static char* path_of(uint64_t ino) {
+  pthread_mutex_lock(&inodes_lock);
+  struct inode_path* ip = *inode_slot(ino);
+  char* path = ip != NULL && ip->path != NULL ? strdup(ip->path) : NULL;
+  pthread_mutex_unlock(&inodes_lock);
+  return path;
+}
+
+static void name_inode(uint64_t ino, const char* path) {
+  pthread_mutex_lock(&inodes_lock);
+  struct inode_path** slot = inode_slot(ino);
+  if (*slot == NULL && (*slot = calloc(1, sizeof(**slot))) != NULL) {
+    (*slot)->ino = ino;
+    (*slot)->fd = -1;
+  }
+  if (*slot != NULL && (*slot)->path == NULL) {
+    (*slot)->path = strdup(path);
+  }
+  pthread_mutex_unlock(&inodes_lock);
+}
+
+// Forgets path for ino; an open fd stays usable like an unlinked open file
+static void unname_inode(uint64_t ino, const char* path) {
+  pthread_mutex_lock(&inodes_lock);
+  struct inode_path* ip = *inode_slot(ino);
+  if (ip != NULL && ip->path != NULL && strcmp(ip->path, path) == 0) {
+    free(ip->path);
+    ip->path = NULL;
+  }
+  pthread_mutex_unlock(&inodes_lock);
+}
+
+static void remember_fd(uint64_t ino, int fd) {
+  pthread_mutex_lock(&inodes_lock);
+  struct inode_path* ip = *inode_slot(ino);
+  if (ip != NULL && ip->fd < 0) {
+    ip->fd = fd;
+    fd = -1;
+  }
+  pthread_mutex_unlock(&inodes_lock);
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+// Returns an fd shared by every op on ino, opened on first use
+static int fd_of(uint64_t ino) {
+  pthread_mutex_lock(&inodes_lock);
+  struct inode_path* ip = *inode_slot(ino);
+  int fd = ip != NULL ? ip->fd : -1;
+  if (ip != NULL && fd < 0 && ip->path != NULL) {
+    fd = ip->fd = open(ip->path, O_RDWR);
+  }
+  pthread_mutex_unlock(&inodes_lock);
+  return fd;
+}
+
+static char* child_path(uint64_t parent, const char* name) {
+  char* dir = path_of(parent);
+  char* path = NULL;
+  if (dir != NULL && asprintf(&path, "%s/%s", dir, name) < 0) {
+    path = NULL;
+  }
+  free(dir);
+  return path;
+}
+
+static bool reserve(struct replayer* r, size_t size) {
+  if (size <= r->buf_size) {
+    return true;
+  }
+  char* buf = realloc(r->buf, size);
+  if (buf == NULL) {
+    return false;
+  }
+  memset(buf + r->buf_size, 'r', size - r->buf_size);
+  r->buf = buf;
+  r->buf_size = size;
+  return true;
+}
+
+static int list_dir(const char* path) {
+  DIR* dir = opendir(path);
+  if (dir == NULL) {
+    return -errno;
+  }
+  while (readdir(dir) != NULL) {
+  }
+  closedir(dir);
+  return 0;
+}
+
+// Issues one op; returns 0 or a byte count on success, -errno on failure,
+// and 1 if the op has to be skipped
+static long issue(struct replayer* r, const struct op* op) {
+  const struct vtfs_trace_record* rec = &op->rec;
+  char* path = NULL;
+  char* target = NULL;
+  long ret = 0;
+  int fd;
+
+  switch (rec->op) {
+    case VTFS_OP_LOOKUP:
+    case VTFS_OP_CREATE:
+    case VTFS_OP_MKDIR:
+    case VTFS_OP_UNLINK:
+    case VTFS_OP_RMDIR:
+    case VTFS_OP_LINK:
+    case VTFS_OP_SYMLINK:
+      if ((path = child_path(rec->parent, op->name)) == NULL) {
+        return 1;
+      }
+      break;
+    default:
+      break;
+  }
+
+  switch (rec->op) {
+    case VTFS_OP_LOOKUP: {
+      struct stat st;
+      ret = lstat(path, &st) == 0 ? 0 : -errno;
+      break;
+    }
+    case VTFS_OP_CREATE:
+      fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+      ret = fd >= 0 ? 0 : -errno;
+      if (fd >= 0 && rec->ino != 0) {
+        name_inode(rec->ino, path);
+        remember_fd(rec->ino, fd);
+      } else if (fd >= 0) {
+        close(fd);
+      }
+      break;
+    case VTFS_OP_MKDIR:
+      ret = mkdir(path, 0755) == 0 ? 0 : -errno;
+      break;
+    case VTFS_OP_UNLINK:
+      ret = unlink(path) == 0 ? 0 : -errno;
+      break;
+    case VTFS_OP_RMDIR:
+      ret = rmdir(path) == 0 ? 0 : -errno;
+      break;
+    case VTFS_OP_LINK:
+      if ((target = path_of(rec->ino)) == NULL) {
+        ret = 1;
+        break;
+      }
+      ret = link(target, path) == 0 ? 0 : -errno;
+      break;
+    case VTFS_OP_SYMLINK:
+      // The trace has the target's length but not its contents
+      if (rec->len >= PATH_MAX) {
+        ret = 1;
+        break;
+      }
+      if ((target = malloc(rec->len + 1)) == NULL) {
+        ret = -ENOMEM;
+        break;
+      }
+      memset(target, 'x', rec->len);
+      target[rec->len] = '\0';
+      ret = symlink(target, path) == 0 ? 0 : -errno;
+      break;
+    case VTFS_OP_ITERATE:
+      // The VFS calls iterate until it emits nothing; one listing per pass
+      if (rec->offset != 0) {
+        return 1;
+      }
+      if ((path = path_of(rec->ino)) == NULL) {
+        return 1;
+      }
+      ret = list_dir(path);
+      break;
+    case VTFS_OP_READ:
+    case VTFS_OP_WRITE:
+      if ((fd = fd_of(rec->ino)) < 0) {
+        return 1;
+      }
+      if (!reserve(r, rec->len)) {
+        return -ENOMEM;
+      }
+      if (rec->op == VTFS_OP_READ) {
+        ret = pread(fd, r->buf, rec->len, rec->offset);
+      } else {
+        ret = pwrite(fd, r->buf, rec->len, rec->offset);
+      }
+      ret = ret >= 0 ? ret : -errno;
+      break;
+  }
+
+  if (ret == 0 && rec->ino != 0) {
+    if (rec->op == VTFS_OP_LOOKUP || rec->op == VTFS_OP_MKDIR || rec->op == VTFS_OP_SYMLINK) {
+      name_inode(rec->ino, path);
+    } else if (rec->op == VTFS_OP_UNLINK || rec->op == VTFS_OP_RMDIR) {
+      unname_inode(rec->ino, path);
+    }
+  }
+  free(path);
+  free(target);
+  return ret;
+}
+
+// A lookup that found nothing succeeds in the kernel but fails lstat()
+static bool traced_ok(const struct vtfs_trace_record* rec) {
+  return rec->ret >= 0 && !(rec->op == VTFS_OP_LOOKUP && rec->ino == 0);
+}
+
+static void wait_until(uint64_t trace_ns) {
+  uint64_t due = replay_start_ns + (uint64_t)((double)(trace_ns - trace_start_ns) / cfg.speed);
+  uint64_t now = lat_now_ns();
+  if (due > now) {
+    usleep((useconds_t)((due - now) / 1000));
+  }
+}
+
+static void* replayer_main(void* arg) {
+  struct replayer* r = arg;
+
+  for (size_t i = 0; i < r->nops; i++) {
+    const struct op* op = r->ops[i];
+    if (!cfg.fast) {
+      wait_until(op->rec.start_ns);
+    }
+    uint64_t start = lat_now_ns();
+    long ret = issue(r, op);
+    uint64_t elapsed = lat_now_ns() - start;
+    if (ret == 1) {
+      r->skipped++;
+      continue;
+    }
+    lat_record(&r->replayed[op->rec.op], elapsed);
+    lat_record(&r->traced[op->rec.op], op->rec.dur_ns);
+    if ((ret >= 0) != traced_ok(&op->rec)) {
+      r->mismatched++;
+    }
+  }
+  return NULL;
+}
+
+static int by_start(const void* a, const void* b) {
+  const struct op* x = *(const struct op* const*)a;
+  const struct op* y = *(const struct op* const*)b;
+  return x->rec.start_ns < y->rec.start_ns ? -1 : x->rec.start_ns > y->rec.start_ns;
+}
+
+static struct op* read_op(FILE* in) {
+  struct op* op = malloc(sizeof(*op));
+  if (op == NULL || fread(&op->rec, sizeof(op->rec), 1, in) != 1) {
+    free(op);
+    return NULL;
+  }
+  size_t padded = (op->rec.name_len + VTFS_TRACE_ALIGN - 1) / VTFS_TRACE_ALIGN * VTFS_TRACE_ALIGN;
+  char* name = calloc(1, padded + 1);
+  if (op->rec.op >= VTFS_OP_COUNT || name == NULL ||
+      (padded > 0 && fread(name, padded, 1, in) != 1)) {
+    free(name);
+    free(op);
+    return NULL;
+  }
+  op->name = name;
+  return op;
+}
+
+static struct replayer* replayer_for(struct replayer** rs, size_t* n, uint32_t tid) {
+  for (size_t i = 0; i < *n; i++) {
+    if ((*rs)[i].tid == tid) {
+      return &(*rs)[i];
+    }
+  }
+  struct replayer* grown = realloc(*rs, (*n + 1) * sizeof(**rs));
+  if (grown == NULL) {
+    return NULL;
+  }
+  *rs = grown;
+  struct replayer* r = &grown[(*n)++];
+  memset(r, 0, sizeof(*r));
+  r->tid = tid;
+  for (int k = 0; k < VTFS_OP_COUNT; k++) {
+    lat_init(&r->replayed[k]);
+    lat_init(&r->traced[k]);
+  }
+  return r;
+}
+
+static void usage(const char* argv0) {
+  fprintf(
+      stderr,
+      "usage: %s [-f | -x speed] [-1] <trace> <mountpoint>\n"
+      "  -f  as fast as possible instead of the traced timing\n"
+      "  -x  scale the traced timing, e.g. -x 2 replays twice as fast\n"
+      "  -1  replay every op from a single thread, in start order\n",
+      argv0
+  );
+}
+
+int main(int argc, char** argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "fx:1")) != -1) {
+    switch (opt) {
+      case 'f':
+        cfg.fast = true;
+        break;
+      case 'x':
+        cfg.speed = atof(optarg);
+        break;
+      case '1':
+        cfg.serial = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 2 || cfg.speed <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  FILE* in = fopen(argv[optind], "rb");
+  if (in == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+  struct op** ops = NULL;
+  size_t nops = 0;
+  struct op* op;
+  while ((op = read_op(in)) != NULL) {
+    struct op** grown = realloc(ops, (nops + 1) * sizeof(*ops));
+    if (grown == NULL) {
+      break;
+    }
+    ops = grown;
+    ops[nops++] = op;
+  }
+  if (!feof(in)) {
+    fprintf(stderr, "%s: truncated or corrupt after %zu records\n", argv[optind], nops);
+  }
+  fclose(in);
+  if (nops == 0) {
+    fprintf(stderr, "%s: no records\n", argv[optind]);
+    return 1;
+  }
+
+  // Records are written as ops complete; replay them in the order they began
+  qsort(ops, nops, sizeof(*ops), by_start);
+  trace_start_ns = ops[0]->rec.start_ns;
+  name_inode(ROOT_INO, argv[optind + 1]);
+
+  struct replayer* rs = NULL;
+  size_t nrs = 0;
+  for (size_t i = 0; i < nops; i++) {
+    struct replayer* r = replayer_for(&rs, &nrs, cfg.serial ? 0 : ops[i]->rec.tid);
+    if (r == NULL) {
+      return 1;
+    }
+    if (r->nops == r->cap) {
+      size_t cap = r->cap ? r->cap * 2 : 64;
+      struct op** grown = realloc(r->ops, cap * sizeof(*grown));
+      if (grown == NULL) {
+        return 1;
+      }
+      r->ops = grown;
+      r->cap = cap;
+    }
+    r->ops[r->nops++] = ops[i];
+  }
+
+  replay_start_ns = lat_now_ns();
+  for (size_t i = 0; i < nrs; i++) {
+    pthread_create(&rs[i].thread, NULL, replayer_main, &rs[i]);
+  }
+
+  struct lat_hist replayed[VTFS_OP_COUNT];
+  struct lat_hist traced[VTFS_OP_COUNT];
+  uint64_t skipped = 0;
+  uint64_t mismatched = 0;
+  for (int k = 0; k < VTFS_OP_COUNT; k++) {
+    lat_init(&replayed[k]);
+    lat_init(&traced[k]);
+  }
+  for (size_t i = 0; i < nrs; i++) {
+    pthread_join(rs[i].thread, NULL);
+    for (int k = 0; k < VTFS_OP_COUNT; k++) {
+      lat_merge(&replayed[k], &rs[i].replayed[k]);
+      lat_merge(&traced[k], &rs[i].traced[k]);
+    }
+    skipped += rs[i].skipped;
+    mismatched += rs[i].mismatched;
+  }
+  double elapsed = (double)(lat_now_ns() - replay_start_ns) / 1e9;
+  double span = (double)(ops[nops - 1]->rec.start_ns - trace_start_ns) / 1e9;
+
+  printf(
+      "records=%zu threads=%zu skipped=%llu mismatched=%llu traced_span=%.2fs elapsed=%.2fs\n\n",
+      nops,
+      nrs,
+      (unsigned long long)skipped,
+      (unsigned long long)mismatched,
+      span,
+      elapsed
+  );
+  lat_print_header(stdout);
+  for (int k = 0; k < VTFS_OP_COUNT; k++) {
+    if (replayed[k].count == 0) {
+      continue;
+    }
+    char label[32];
+    lat_print(stdout, op_names[k], &replayed[k]);
+    snprintf(label, sizeof(label), "%s(trace)", op_names[k]);
+    lat_print(stdout, label, &traced[k]);
+  }
+  return 0;
+}
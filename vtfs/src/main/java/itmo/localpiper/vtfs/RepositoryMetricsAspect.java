@@ -0,0 +1,54 @@
+package itmo.localpiper.vtfs;
+
+import java.util.concurrent.TimeUnit;
+
+import org.aspectj.lang.ProceedingJoinPoint;
+import org.aspectj.lang.annotation.Around;
+import org.aspectj.lang.annotation.Aspect;
+import org.springframework.beans.factory.annotation.Autowired;
+import org.springframework.stereotype.Component;
+
+import io.micrometer.core.instrument.MeterRegistry;
+import io.micrometer.core.instrument.Timer;
+
+/**
+ * Times every FileMetadataRepository call and adds it to the DB time of the
+ * request being served, which RequestMetricsFilter reports per endpoint.
+ */
+@Aspect
+@Component
+public class RepositoryMetricsAspect {
+
+    private static final ThreadLocal<long[]> requestDbNanos = new ThreadLocal<>();
+
+    @Autowired
+    private MeterRegistry registry;
+
+    @Around("execution(* itmo.localpiper.vtfs.FileMetadataRepository.*(..))")
+    public Object timeRepositoryCall(ProceedingJoinPoint call) throws Throwable {
+        long start = System.nanoTime();
+        try {
+            return call.proceed();
+        } finally {
+            long elapsed = System.nanoTime() - start;
+            Timer.builder("vtfs.db.calls")
+                    .tag("method", call.getSignature().getName())
+                    .register(registry)
+                    .record(elapsed, TimeUnit.NANOSECONDS);
+            long[] total = requestDbNanos.get();
+            if (total != null) {
+                total[0] += elapsed;
+            }
+        }
+    }
+
+    static void beginRequest() {
+        requestDbNanos.set(new long[1]);
+    }
+
+    static long endRequest() {
+        long[] total = requestDbNanos.get();
+        requestDbNanos.remove();
+        return total == null ? 0 : total[0];
+    }
+}
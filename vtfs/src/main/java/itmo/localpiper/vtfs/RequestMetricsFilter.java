@@ -0,0 +1,66 @@
+package itmo.localpiper.vtfs;
+
+import java.io.IOException;
+import java.util.concurrent.TimeUnit;
+
+import org.springframework.beans.factory.annotation.Autowired;
+import org.springframework.stereotype.Component;
+import org.springframework.web.filter.OncePerRequestFilter;
+import org.springframework.web.servlet.HandlerMapping;
+
+import io.micrometer.core.instrument.MeterRegistry;
+import io.micrometer.core.instrument.Timer;
+import jakarta.servlet.FilterChain;
+import jakarta.servlet.ServletException;
+import jakarta.servlet.http.HttpServletRequest;
+import jakarta.servlet.http.HttpServletResponse;
+
+/**
+ * Records per-endpoint, per-token request latency and the DB time spent
+ * serving each request. Spring's own http.server.requests timer carries the
+ * same endpoint breakdown without the token.
+ */
+@Component
+public class RequestMetricsFilter extends OncePerRequestFilter {
+
+    @Autowired
+    private MeterRegistry registry;
+
+    @Autowired
+    private TokenTags tokenTags;
+
+    @Override
+    protected void doFilterInternal(HttpServletRequest request, HttpServletResponse response,
+            FilterChain chain) throws ServletException, IOException {
+        long start = System.nanoTime();
+        RepositoryMetricsAspect.beginRequest();
+        try {
+            chain.doFilter(request, response);
+        } finally {
+            long elapsed = System.nanoTime() - start;
+            long dbNanos = RepositoryMetricsAspect.endRequest();
+
+            Object pattern = request.getAttribute(HandlerMapping.BEST_MATCHING_PATTERN_ATTRIBUTE);
+            String uri = pattern == null ? "UNKNOWN" : pattern.toString();
+            String token = tokenTags.tagFor(request);
+
+            Timer.builder("vtfs.requests")
+                    .tag("uri", uri)
+                    .tag("status", Integer.toString(response.getStatus()))
+                    .tag("token", token)
+                    .publishPercentileHistogram()
+                    .register(registry)
+                    .record(elapsed, TimeUnit.NANOSECONDS);
+            Timer.builder("vtfs.db.time")
+                    .tag("uri", uri)
+                    .tag("token", token)
+                    .register(registry)
+                    .record(dbNanos, TimeUnit.NANOSECONDS);
+        }
+    }
+
+    @Override
+    protected boolean shouldNotFilter(HttpServletRequest request) {
+        return !request.getRequestURI().startsWith("/api/");
+    }
+}
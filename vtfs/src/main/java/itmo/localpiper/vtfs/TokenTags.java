@@ -0,0 +1,56 @@
+package itmo.localpiper.vtfs;
+
+import java.nio.charset.StandardCharsets;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.HexFormat;
+import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
+
+import org.springframework.beans.factory.annotation.Value;
+import org.springframework.stereotype.Component;
+
+import jakarta.servlet.http.HttpServletRequest;
+
+/**
+ * Turns the request token into a metric tag value.
+ * Tokens are secrets, so only a short digest is exposed, and the number of
+ * distinct values is capped to keep tag cardinality bounded.
+ */
+@Component
+public class TokenTags {
+
+    public static final String NONE = "none";
+    public static final String OTHER = "other";
+
+    private final Set<String> seen = ConcurrentHashMap.newKeySet();
+
+    @Value("${vtfs.metrics.max-tokens:64}")
+    private int maxTokens;
+
+    public String tagFor(HttpServletRequest request) {
+        String token = request.getParameter("token");
+        if (token == null || token.isEmpty()) {
+            return NONE;
+        }
+        String tag = digest(token);
+        if (seen.contains(tag)) {
+            return tag;
+        }
+        if (seen.size() >= maxTokens) {
+            return OTHER;
+        }
+        seen.add(tag);
+        return tag;
+    }
+
+    private static String digest(String token) {
+        try {
+            byte[] hash = MessageDigest.getInstance("SHA-256")
+                    .digest(token.getBytes(StandardCharsets.UTF_8));
+            return HexFormat.of().formatHex(hash, 0, 6);
+        } catch (NoSuchAlgorithmException e) {
+            throw new IllegalStateException(e);
+        }
+    }
+}